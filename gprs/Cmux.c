@@ -0,0 +1,495 @@
+/* **************************************************************************																					
+ *                                OpenPicus                 www.openpicus.com
+ *                                                            italian concept
+ * 
+ *            openSource wireless Platform for sensors and Internet of Things	
+ * **************************************************************************
+ *  FileName:        Cmux.c
+ *  Dependencies:    Microchip configs files
+ *  Module:          FlyPort GPRS
+ *  Compiler:        Microchip C30 v3.12 or higher
+ *
+ *  Software License Agreement
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License (version 2) as published by 
+ *  the Free Software Foundation AND MODIFIED BY OpenPicus team.
+ *  
+ *  ***NOTE*** The exception to the GPL is included to allow you to distribute
+ *  a combined work that includes OpenPicus code without being obliged to 
+ *  provide the source code for proprietary components outside of the OpenPicus
+ *  code. 
+ *  OpenPicus software is distributed in the hope that it will be useful, but 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details. 
+ * 
+ * 
+ * Warranty
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * THE SOFTWARE AND DOCUMENTATION ARE PROVIDED "AS IS" WITHOUT
+ * WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION, ANY WARRANTY OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * WE ARE LIABLE FOR ANY INCIDENTAL, SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES, LOST PROFITS OR LOST DATA, COST OF
+ * PROCUREMENT OF SUBSTITUTE GOODS, TECHNOLOGY OR SERVICES, ANY CLAIMS
+ * BY THIRD PARTIES (INCLUDING BUT NOT LIMITED TO ANY DEFENSE
+ * THEREOF), ANY CLAIMS FOR INDEMNITY OR CONTRIBUTION, OR OTHER
+ * SIMILAR COSTS, WHETHER ASSERTED ON THE BASIS OF CONTRACT, TORT
+ * (INCLUDING NEGLIGENCE), BREACH OF WARRANTY, OR OTHERWISE.
+ *
+ **************************************************************************/
+/// @cond debug
+
+// GSM 07.10 multiplexer on the Hilo UART, basic option with UIH frames.
+// The AT commands of the GSM Task go on CMUX_AT, the socket in transparent mode on
+// CMUX_DATA, so that neither waits for the other. GSMRxInt passes every char to CmuxRx,
+// the chars of CMUX_AT go on to GSMBuffer, the ones of CMUX_DATA to dataBuffer.
+
+#include "HWlib.h"
+#include "Hilo.h"
+
+#if GSM_CMUX
+
+// The modem is stopped with 2 * CMUX_N1 chars free, and restarted below half
+#if CMUX_DATA_SIZE <= 4 * CMUX_N1
+#error "CMUX_DATA_SIZE must be larger than 4 * CMUX_N1"
+#endif
+
+#define CMUX_FLAG		0xF9
+#define CMUX_EA			0x01
+#define CMUX_CR			0x02
+#define CMUX_PF			0x10
+
+// Frame types
+#define CMUX_SABM		0x2F
+#define CMUX_UA			0x63
+#define CMUX_DM			0x0F
+#define CMUX_UIH		0xEF
+
+// Modem status command (MSC) on DLCI 0, and its V.24 signals:
+// ready to communicate, ready to receive, data valid, and the flow control bit
+#define CMUX_MSC		0xE1
+#define CMUX_V24_ON		0x8D
+#define CMUX_V24_FC		0x02
+
+#define CMUX_CHANNELS	3
+
+// Frame receive state
+enum { RX_HUNT, RX_ADDR, RX_CTRL, RX_LEN, RX_LEN2, RX_INFO, RX_FCS, RX_END };
+
+static BOOL cmuxOn = FALSE;
+static BYTE rxState;
+static BYTE rxDlci;
+static BYTE rxCtrl;
+static BYTE rxFcs;
+static int rxLen;
+static int rxCount;
+// Information field of the last frame of DLCI 0
+static BYTE ctrlMsg[8];
+static int ctrlLen;
+
+// Set by CmuxRx: last UA or DM of each DLCI, V.24 signals of the modem and the MSC to answer
+static volatile BYTE cmuxAck[CMUX_CHANNELS];
+static volatile BYTE modemV24[CMUX_CHANNELS];
+static volatile BYTE mscAnswer;
+
+// dataBuffer is a ring like GSMBuffer, written by CmuxRx and read by the socket task.
+// The modem is stopped with the MSC flow control bit when it is almost full.
+static char dataBuffer[CMUX_DATA_SIZE];
+static volatile int data_w;
+static volatile int data_r;
+static volatile BOOL dataStop;
+static BOOL dataStopped;
+// CMUX_DATA is in transparent mode, see TCPStreamStart
+static BOOL dataOpen = FALSE;
+
+// Frames of different tasks are not mixed on the UART
+static xSemaphoreHandle cmuxTxLock = NULL;
+
+// CRC of 07.10 (x^8 + x^2 + x + 1, reflected), over the address, control and length fields
+static BYTE CmuxFcs(BYTE fcs, BYTE c)
+{
+	int i;
+	
+	fcs ^= c;
+	for (i = 0; i < 8; i++)
+		fcs = (fcs & 1) ? (fcs >> 1) ^ 0xE0 : (fcs >> 1);
+	return fcs;
+}
+
+// Sends a frame, with cmuxTxLock taken
+static void CmuxFrame(BYTE dlci, BYTE ctrl, const char* info, int len)
+{
+	char frame[CMUX_N1 + 6];
+	BYTE fcs;
+	int n = 0;
+	
+	frame[n++] = CMUX_FLAG;
+	frame[n++] = (dlci << 2) | CMUX_CR | CMUX_EA;
+	frame[n++] = ctrl;
+	frame[n++] = (len << 1) | CMUX_EA;
+	fcs = CmuxFcs(CmuxFcs(CmuxFcs(0xFF, frame[1]), frame[2]), frame[3]);
+	if (len > 0)
+		memcpy(frame + n, info, len);
+	n += len;
+	frame[n++] = 0xFF - fcs;
+	frame[n++] = CMUX_FLAG;
+	GSMWriteRaw(frame, n);
+}
+
+// Sends the V.24 signals of a channel (MSC), with cmuxTxLock taken
+static void CmuxMsc(BYTE type, BYTE dlci, BYTE v24)
+{
+	char msg[4];
+	
+	msg[0] = type;
+	msg[1] = (2 << 1) | CMUX_EA;
+	msg[2] = (dlci << 2) | CMUX_CR | CMUX_EA;
+	msg[3] = v24;
+	CmuxFrame(0, CMUX_UIH, msg, 4);
+}
+
+// Stops or restarts the modem on CMUX_DATA when dataStop changed, with cmuxTxLock taken.
+// Every frame sent checks it first, so a long write does not delay it.
+static void CmuxFlowLocked()
+{
+	if (dataStop != dataStopped)
+	{
+		dataStopped = dataStop;
+		CmuxMsc(CMUX_MSC | CMUX_CR, CMUX_DATA, CMUX_V24_ON | (dataStopped ? CMUX_V24_FC : 0));
+	}
+}
+
+static void CmuxDataFlow()
+{
+	xSemaphoreTake(cmuxTxLock, portMAX_DELAY);
+	CmuxFlowLocked();
+	xSemaphoreGive(cmuxTxLock);
+}
+
+static void CmuxDataPut(char c)
+{
+	int next = (data_w == CMUX_DATA_SIZE - 1) ? 0 : data_w + 1;
+	
+	// Buffer full: the char is dropped
+	if (next == data_r)
+		return;
+	dataBuffer[data_w] = c;
+	data_w = next;
+	// Room left for the frames the modem sends before it gets the MSC
+	if (CmuxDataSize() > CMUX_DATA_SIZE - 2 * CMUX_N1)
+		dataStop = TRUE;
+}
+
+// A frame was received whole, with a valid FCS
+static void CmuxFrameEnd()
+{
+	BYTE ctrl = rxCtrl & ~CMUX_PF;
+	BYTE dlci;
+	
+	if (rxDlci >= CMUX_CHANNELS)
+		return;
+	if (ctrl == CMUX_UA || ctrl == CMUX_DM)
+		cmuxAck[rxDlci] = ctrl;
+	// MSC command of the modem: answered by CmuxPoll
+	else if (ctrl == CMUX_UIH && rxDlci == 0 && ctrlLen >= 4 && ctrlMsg[0] == (CMUX_MSC | CMUX_CR))
+	{
+		dlci = ctrlMsg[2] >> 2;
+		if (dlci < CMUX_CHANNELS)
+		{
+			modemV24[dlci] = ctrlMsg[3];
+			mscAnswer |= 1 << dlci;
+		}
+	}
+}
+
+// Closes the multiplexer, the modem is then reset by HiloStdModeOn
+void CmuxReset()
+{
+	int i;
+	
+	if (cmuxTxLock == NULL)
+		cmuxTxLock = xSemaphoreCreateMutex();
+	cmuxOn = FALSE;
+	rxState = RX_HUNT;
+	for (i = 0; i < CMUX_CHANNELS; i++)
+	{
+		cmuxAck[i] = 0;
+		modemV24[i] = 0;
+	}
+	mscAnswer = 0;
+	data_r = data_w;
+	dataOpen = FALSE;
+	dataStop = FALSE;
+	dataStopped = FALSE;
+}
+
+// Starts the multiplexer (AT+CMUX) and opens its channels. Returns -1 if the modem did not accept them.
+int CmuxStart()
+{
+	char cmd[24];
+	BYTE dlci;
+	int i, cnt, speed;
+	long int baud;
+	
+	// Port speed of 07.10: 5 is 115200, one more each time the speed of HiloStdModeOn doubles
+	for (speed = 5, baud = 115200; baud < HiloBaud() && speed < 8; baud *= 2)
+		speed++;
+	sprintf(cmd, "AT+CMUX=0,0,%d,%d\r", speed, CMUX_N1);
+	GSMWrite(cmd);
+	if (findStr("OK\r\n", 300))
+		return -1;
+	vTaskDelay(20);
+	GSMFlush();
+	cmuxOn = TRUE;
+	
+	for (dlci = 0; dlci < CMUX_CHANNELS; dlci++)
+	{
+		for (i = 0; i < 3 && cmuxAck[dlci] != CMUX_UA; i++)
+		{
+			cmuxAck[dlci] = 0;
+			xSemaphoreTake(cmuxTxLock, portMAX_DELAY);
+			CmuxFrame(dlci, CMUX_SABM | CMUX_PF, NULL, 0);
+			xSemaphoreGive(cmuxTxLock);
+			for (cnt = 0; cnt < 50 && cmuxAck[dlci] == 0; cnt++)
+				vTaskDelay(10);
+		}
+		if (cmuxAck[dlci] != CMUX_UA)
+		{
+			cmuxOn = FALSE;
+			return -1;
+		}
+		// DTR and RTS on
+		if (dlci > 0)
+		{
+			xSemaphoreTake(cmuxTxLock, portMAX_DELAY);
+			CmuxMsc(CMUX_MSC | CMUX_CR, dlci, CMUX_V24_ON);
+			xSemaphoreGive(cmuxTxLock);
+		}
+	}
+	return 0;
+}
+
+BOOL CmuxOn()
+{
+	return cmuxOn;
+}
+
+// Called by GSMRxInt for each char. Returns TRUE if the char is data of CMUX_AT, for GSMBuffer.
+// The FCS of UIH frames does not cover the data, so the data is passed on before it.
+BOOL CmuxRx(char ch)
+{
+	BYTE c = (BYTE)ch;
+	
+	switch (rxState)
+	{
+		case RX_HUNT:
+			if (c == CMUX_FLAG)
+				rxState = RX_ADDR;
+			break;
+			
+		case RX_ADDR:
+			// Flags can be repeated between frames
+			if (c == CMUX_FLAG)
+				break;
+			if ((c & CMUX_EA) == 0)
+			{
+				rxState = RX_HUNT;
+				break;
+			}
+			rxDlci = c >> 2;
+			rxFcs = CmuxFcs(0xFF, c);
+			rxState = RX_CTRL;
+			break;
+			
+		case RX_CTRL:
+			rxCtrl = c;
+			rxFcs = CmuxFcs(rxFcs, c);
+			rxState = RX_LEN;
+			break;
+			
+		case RX_LEN:
+		case RX_LEN2:
+			rxFcs = CmuxFcs(rxFcs, c);
+			if (rxState == RX_LEN)
+				rxLen = c >> 1;
+			else
+				rxLen |= (int)c << 7;
+			if (rxState == RX_LEN && (c & CMUX_EA) == 0)
+			{
+				rxState = RX_LEN2;
+				break;
+			}
+			rxCount = 0;
+			ctrlLen = 0;
+			if (rxLen > CMUX_N1)
+				rxState = RX_HUNT;
+			else
+				rxState = (rxLen > 0) ? RX_INFO : RX_FCS;
+			break;
+			
+		case RX_INFO:
+			if (++rxCount == rxLen)
+				rxState = RX_FCS;
+			if ((rxCtrl & ~CMUX_PF) != CMUX_UIH)
+				break;
+			if (rxDlci == CMUX_AT)
+				return TRUE;
+			if (rxDlci == CMUX_DATA)
+				CmuxDataPut(ch);
+			else if (rxDlci == 0 && ctrlLen < sizeof(ctrlMsg))
+				ctrlMsg[ctrlLen++] = c;
+			break;
+			
+		case RX_FCS:
+			if (CmuxFcs(rxFcs, c) == 0xCF)
+				CmuxFrameEnd();
+			rxState = RX_END;
+			break;
+			
+		case RX_END:
+			rxState = (c == CMUX_FLAG) ? RX_ADDR : RX_HUNT;
+			break;
+	}
+	return FALSE;
+}
+
+// Sends len chars on a channel, in frames of CMUX_N1 chars at most.
+// The frames wait while the modem stopped the channel.
+void CmuxWrite(int dlci, const char* data, int len)
+{
+	int n;
+	
+	while (len > 0)
+	{
+		while (cmuxOn && (modemV24[dlci] & CMUX_V24_FC))
+			vTaskDelay(5);
+		n = (len > CMUX_N1) ? CMUX_N1 : len;
+		xSemaphoreTake(cmuxTxLock, portMAX_DELAY);
+		CmuxFlowLocked();
+		CmuxFrame(dlci, CMUX_UIH, data, n);
+		xSemaphoreGive(cmuxTxLock);
+		data += n;
+		len -= n;
+	}
+}
+
+// GSM Task side: answers the MSC of the modem, and stops CMUX_DATA when dataBuffer is almost full
+void CmuxPoll()
+{
+	BYTE dlci;
+	
+	if (!cmuxOn)
+		return;
+	for (dlci = 1; dlci < CMUX_CHANNELS; dlci++)
+	{
+		if (mscAnswer & (1 << dlci))
+		{
+			mscAnswer &= ~(1 << dlci);
+			xSemaphoreTake(cmuxTxLock, portMAX_DELAY);
+			CmuxMsc(CMUX_MSC, dlci, modemV24[dlci]);
+			xSemaphoreGive(cmuxTxLock);
+		}
+	}
+	if (dataStop && !dataStopped)
+		CmuxDataFlow();
+}
+
+int CmuxDataSize()
+{
+	int size = data_w - data_r;
+	
+	if (size < 0)
+		size += CMUX_DATA_SIZE;
+	return size;
+}
+
+// Copies num chars of dataBuffer, from start, without removing them. FALSE if they are not all there.
+BOOL CmuxDataPeek(int start, int num, char* dest)
+{
+	int ind;
+	
+	if (start + num > CmuxDataSize())
+		return FALSE;
+	ind = data_r + start;
+	while (num-- > 0)
+	{
+		if (ind >= CMUX_DATA_SIZE)
+			ind -= CMUX_DATA_SIZE;
+		*dest++ = dataBuffer[ind++];
+	}
+	return TRUE;
+}
+
+// Removes count chars from dataBuffer, and restarts the modem once half of it is free
+void CmuxDataConsume(int count)
+{
+	int size = CmuxDataSize();
+	int ind;
+	
+	if (count > size)
+		count = size;
+	ind = data_r + count;
+	if (ind >= CMUX_DATA_SIZE)
+		ind -= CMUX_DATA_SIZE;
+	data_r = ind;
+	if (dataStop && size - count < CMUX_DATA_SIZE / 2)
+	{
+		dataStop = FALSE;
+		CmuxDataFlow();
+	}
+}
+
+int CmuxDataRead(char* dest, int count)
+{
+	int size = CmuxDataSize();
+	
+	if (count > size)
+		count = size;
+	CmuxDataPeek(0, count, dest);
+	CmuxDataConsume(count);
+	return count;
+}
+
+// Returns the position of str in dataBuffer, -1 if it is not there
+int CmuxDataFind(const char* str)
+{
+	int len = strlen(str);
+	int size = CmuxDataSize();
+	int i, j, ind;
+	
+	for (i = 0; i + len <= size; i++)
+	{
+		ind = data_r + i;
+		for (j = 0; j < len; j++, ind++)
+		{
+			if (ind >= CMUX_DATA_SIZE)
+				ind -= CMUX_DATA_SIZE;
+			if (dataBuffer[ind] != str[j])
+				break;
+		}
+		if (j == len)
+			return i;
+	}
+	return -1;
+}
+
+void CmuxDataFlush()
+{
+	CmuxDataConsume(CmuxDataSize());
+}
+
+void CmuxDataOpen(BOOL open)
+{
+	dataOpen = open;
+}
+
+BOOL CmuxDataIsOpen()
+{
+	return cmuxOn && dataOpen;
+}
+
+#endif
+/// @endcond
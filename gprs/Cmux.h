@@ -0,0 +1,77 @@
+/* **************************************************************************																					
+ *                                OpenPicus                 www.openpicus.com
+ *                                                            italian concept
+ * 
+ *            openSource wireless Platform for sensors and Internet of Things	
+ * **************************************************************************
+ *  FileName:        Cmux.h
+ *  Dependencies:    Microchip configs files
+ *  Module:          FlyPort GPRS
+ *  Compiler:        Microchip C30 v3.12 or higher
+ *
+ *  Software License Agreement
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License (version 2) as published by 
+ *  the Free Software Foundation AND MODIFIED BY OpenPicus team.
+ *  
+ *  ***NOTE*** The exception to the GPL is included to allow you to distribute
+ *  a combined work that includes OpenPicus code without being obliged to 
+ *  provide the source code for proprietary components outside of the OpenPicus
+ *  code. 
+ *  OpenPicus software is distributed in the hope that it will be useful, but 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details. 
+ * 
+ * 
+ * Warranty
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * THE SOFTWARE AND DOCUMENTATION ARE PROVIDED "AS IS" WITHOUT
+ * WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION, ANY WARRANTY OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * WE ARE LIABLE FOR ANY INCIDENTAL, SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES, LOST PROFITS OR LOST DATA, COST OF
+ * PROCUREMENT OF SUBSTITUTE GOODS, TECHNOLOGY OR SERVICES, ANY CLAIMS
+ * BY THIRD PARTIES (INCLUDING BUT NOT LIMITED TO ANY DEFENSE
+ * THEREOF), ANY CLAIMS FOR INDEMNITY OR CONTRIBUTION, OR OTHER
+ * SIMILAR COSTS, WHETHER ASSERTED ON THE BASIS OF CONTRACT, TORT
+ * (INCLUDING NEGLIGENCE), BREACH OF WARRANTY, OR OTHERWISE.
+ *
+ **************************************************************************/
+
+#ifndef __CMUX_H
+#define __CMUX_H
+
+#include "GenericTypeDefs.h"
+
+// DLCIs of the multiplexer, DLCI 0 is its control channel
+#define CMUX_AT			1	// AT commands and unsolicited messages, into GSMBuffer for the GSM Task
+#define CMUX_DATA		2	// socket in transparent mode, see TCPStreamStart
+
+// Largest information field of a frame, set with AT+CMUX
+#define CMUX_N1			127
+
+// Size of the receive buffer of the CMUX_DATA channel
+#ifndef CMUX_DATA_SIZE
+#define CMUX_DATA_SIZE	1024
+#endif
+
+void CmuxReset();
+int  CmuxStart();
+BOOL CmuxOn();
+BOOL CmuxRx(char c);
+void CmuxWrite(int dlci, const char* data, int len);
+void CmuxPoll();
+
+int  CmuxDataSize();
+int  CmuxDataRead(char* dest, int count);
+BOOL CmuxDataPeek(int start, int num, char* dest);
+int  CmuxDataFind(const char* str);
+void CmuxDataConsume(int count);
+void CmuxDataFlush();
+void CmuxDataOpen(BOOL open);
+BOOL CmuxDataIsOpen();
+
+#endif
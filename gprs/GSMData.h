@@ -97,4 +97,24 @@ typedef struct
 	int		ErrorCode; // CMS or CME or GPRS error number
 }OpStat;
 
+// Number of GSM command contexts, one for each task using the Flyport libs
+#ifndef GSM_MAX_CMD
+#define GSM_MAX_CMD		3
+#endif
+
+// GSM command context: each task queues its requests to the GSM task with its own context.
+// The parameters are copied to the libs variables by Load when the command starts, so
+// the pointers passed to a lib function must stay valid until its command is completed.
+typedef struct GSMCmd
+{
+	int		Function; // FP_CMD number
+	int		ExecStat; // as OpStat, OP_EXECUTION from submission to completion
+	int		ErrorCode;
+	void	(*Load)(struct GSMCmd*); // Sets the libs variables from Arg and Val
+	void*	Arg[6];
+	long	Val[2];
+	xTaskHandle			Owner;
+	xSemaphoreHandle	Done; // Given when the command is completed
+}GSMCmd;
+
 #endif
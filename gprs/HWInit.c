@@ -117,7 +117,7 @@ void HWInit(int conf)
         // PPS configuration
         // HiLo UART (UART4)
         RPOR9bits.RP19R = 30;                   // Assign RP19 to U4TX (output)
-        RPOR13bits.RP27R = 31;                  // Assign RP27 to U4RTS (output)
+        RPOR13bits.RP27R = 0;                   // RP27 is RG9, the RTS driven by GSMRxInt (HILO_RTS_IO)
 
         RPINR27bits.U4RXR = 21;                 // Assign RP21 to U4RX (input)
         RPINR27bits.U4CTSR = 26;                // Assign RP26 to U4CTS (input)
@@ -76,11 +76,27 @@ extern int *URXREGs[];
 extern int UTXIPos[];
 extern int URXIPos[];
 
+// Modem UART data registers. The host build in gprs/bench maps them on a pty, from its HWmap.h
+#ifndef GSM_UART_RX_READY
+#define GSM_UART_RX_READY(port)		((*USTAs[port] & 1) != 0)
+#define GSM_UART_RX_CHAR(port)		(*URXREGs[port])
+#define GSM_UART_TX_FULL(port)		((*USTAs[port] & 512) > 0)
+#define GSM_UART_TX_CHAR(port, c)	(*UTXREGs[port] = (c))
+#define GSM_UART_OVERRUN(port)		((*USTAs[port] & 2) != 0)
+#define GSM_UART_OVERRUN_CLEAR(port)	(*USTAs[port] &= ~2)
+#endif
+
+// GSMBuffer is a ring written by GSMRxInt (bufind_w) and read by the GSM Task (bufind_r).
+// One slot is always left free, so the indexes alone tell a full buffer from an empty one.
 static int bufind_w;
 static int bufind_r;
-static int last_op;
 static char GSMBuffer[GSM_BUFFER_SIZE];
-static char GSMbuffover;
+// GSMBuffer was full: GSMRxInt left the chars in the UART, and masked itself until GSMConsume makes room
+static volatile BOOL rxHeld;
+// GSMBuffer nearly full: GSMRxInt raised RTS, GSMRxResume lowers it once the GSM Task made room
+static volatile BOOL rxStopped;
+// Chars lost by the UART, that received one with its Rx FIFO full (OERR)
+unsigned int gsmRxOverruns;
 static char UnsolBuffer[150];
 
 // FrontEnd variables
@@ -91,6 +107,7 @@ extern int xErr;
 */
 
 extern const long int baudComp[];
+extern const long int baudHigh[];
 
 //	RTOS variables
 extern xTaskHandle hGSMTask;
@@ -108,12 +125,18 @@ SMSData			mainSMS;
 static BYTE		IncomingSMS_MemType;
 static int		IncomingSMS_Index;
 OpStat			mainOpStatus;
+static GSMCmd	gsmCmd[GSM_MAX_CMD];
+static GSMCmd*	activeCmd;		// command run by the GSM Task
+static xSemaphoreHandle xSemGSMWake = NULL;	// modem data or command arrived
+static xSemaphoreHandle xSemGSMTx = NULL;	// a char left the Hilo UART, while the modem held CTS off
+static long int hiloBaud = 115200;
 extern int 	mainGSMStateMachine;
 extern FTP_SOCKET* xFTPSocket;
 
 int gsmDebugOn=1;
 
 int EventType=0;
+static GSMCmd* GSMCmdOf();
 int HiloComTest();
 int CheckEcho(int countData, const DWORD tick, char* reply, const char* msg, const BYTE maxtimeout);
 
@@ -153,17 +176,194 @@ BYTE LastConnStatus()
  */
 int LastExecStat()
 {
-	return mainOpStatus.ExecStat;
+	GSMCmd* cmd = GSMCmdOf();
+	
+	if (cmd == NULL)
+		return OP_SYNTAX_ERR;
+	return cmd->ExecStat;
 }	
 
 /**
- * Returns last GSM Task error code
+ * Waits for the last GSM Task operation of the calling task to end. The task sleeps until
+ * the GSM Task reports the operation done, instead of polling LastExecStat().
+ * \param timeout - maximum wait in ms, OP_WAIT_FOREVER to wait until the operation ends.
+ * \return - Operation status, as LastExecStat(). OP_EXECUTION if the timeout expired.
+ */
+int LastExecWait(DWORD timeout)
+{
+	GSMCmd* cmd = GSMCmdOf();
+	portTickType start = xTaskGetTickCount();
+	portTickType elapsed;
+	DWORD ticks = timeout / portTICK_RATE_MS;
+
+	if (cmd == NULL)
+		return OP_SYNTAX_ERR;
+	while (cmd->ExecStat == OP_EXECUTION)
+	{
+		// Done may still hold the end of a command nobody waited for,
+		// so ExecStat is checked again after each wake up
+		if (timeout == OP_WAIT_FOREVER || ticks >= portMAX_DELAY)
+			xSemaphoreTake(cmd->Done, portMAX_DELAY);
+		else
+		{
+			elapsed = xTaskGetTickCount() - start;
+			if (elapsed >= ticks)
+				break;
+			xSemaphoreTake(cmd->Done, (portTickType)ticks - elapsed);
+		}
+	}
+	return cmd->ExecStat;
+}
+
+/**
+ * Returns last GSM Task error code of the calling task
  * \return - error code value.
  */
 int LastErrorCode()
 {
-	return mainOpStatus.ErrorCode;
+	GSMCmd* cmd = GSMCmdOf();
+	
+	if (cmd == NULL)
+		return 0;
+	return cmd->ErrorCode;
+}
+
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	GSM command queue. Each task gets its own GSMCmd on its first request,
+//	the GSM Task runs the queued commands one at a time.
+//****************************************************************************
+void GSMCmdInit()
+{
+	int i;
+	
+	for (i = 0; i < GSM_MAX_CMD; i++)
+	{
+		gsmCmd[i].ExecStat = OP_SUCCESS;
+		gsmCmd[i].Owner = NULL;
+		vSemaphoreCreateBinary(gsmCmd[i].Done);
+		xSemaphoreTake(gsmCmd[i].Done, 0);
+	}
+	vSemaphoreCreateBinary(xSemGSMWake);
+	vSemaphoreCreateBinary(xSemGSMTx);
+	xSemaphoreTake(xSemGSMTx, 0);
+}
+
+// Returns the context of the calling task, NULL if all of them are used by other tasks
+static GSMCmd* GSMCmdOf()
+{
+	xTaskHandle self = xTaskGetCurrentTaskHandle();
+	GSMCmd* cmd = NULL;
+	int i;
+	
+	vTaskSuspendAll();
+	for (i = 0; i < GSM_MAX_CMD; i++)
+	{
+		if (gsmCmd[i].Owner == self)
+		{
+			cmd = &gsmCmd[i];
+			break;
+		}
+		if (gsmCmd[i].Owner == NULL && cmd == NULL)
+			cmd = &gsmCmd[i];
+	}
+	if (cmd != NULL)
+		cmd->Owner = self;
+	xTaskResumeAll();
+	return cmd;
+}
+
+// Returns the context of the calling task for a new command, once its previous
+// command is completed. NULL if there are no contexts left.
+GSMCmd* GSMCmdNew(int function, void (*load)(GSMCmd*))
+{
+	GSMCmd* cmd = GSMCmdOf();
+	
+	if (cmd == NULL)
+	{
+		_dbgwrite("GSMCmdNew: no GSM command context left\r\n");
+		return NULL;
+	}
+	while (cmd->ExecStat == OP_EXECUTION)
+		xSemaphoreTake(cmd->Done, portMAX_DELAY);
+	cmd->Function = function;
+	cmd->ErrorCode = 0;
+	cmd->Load = load;
+	return cmd;
+}
+
+// Queues the command to the GSM Task
+void GSMCmdSubmit(GSMCmd* cmd)
+{
+	cmd->ExecStat = OP_EXECUTION;
+	xQueueSendToBack(xQueue, &cmd, portMAX_DELAY);
+	xSemaphoreGive(xSemGSMWake);
+}
+
+// GSM Task side: starts the next queued command when mainOpStatus is free. execStat is
+// OP_LL in LowLevel mode, where only LLWrite, STDModeEnable and TCPStreamStop are accepted.
+void GSMCmdDispatch(int execStat)
+{
+	GSMCmd* cmd;
+	
+	if (activeCmd != NULL || mainOpStatus.ExecStat == OP_EXECUTION)
+		return;
+	if (xQueueReceive(xQueue, &cmd, 0) != pdTRUE)
+		return;
+	
+	if (execStat == OP_LL && cmd->Function != 17 && cmd->Function != 19 && cmd->Function != 37)
+	{
+		cmd->ExecStat = OP_LL;
+		xSemaphoreGive(cmd->Done);
+		return;
+	}
+	
+	while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);
+	mainOpStatus.Function = cmd->Function;
+	mainOpStatus.ExecStat = execStat;
+	mainOpStatus.ErrorCode = 0;
+	if (cmd->Load != NULL)
+		cmd->Load(cmd);
+	activeCmd = cmd;
+#if GSM_TRACE
+	GSMTraceCmd(cmd->Function);
+#endif
+	xSemaphoreGive(xSemFrontEnd);
+}
+
+// GSM Task side: reports the result of the running command to its task, once
+// mainOpStatus.ExecStat left OP_EXECUTION
+void GSMCmdComplete()
+{
+	if (activeCmd == NULL || mainOpStatus.ExecStat == OP_EXECUTION)
+		return;
+	activeCmd->ErrorCode = mainOpStatus.ErrorCode;
+	activeCmd->ExecStat = mainOpStatus.ExecStat;
+#if GSM_TRACE
+	GSMTraceCmdEnd(activeCmd->Function, activeCmd->ExecStat, activeCmd->ErrorCode);
+#endif
+	xSemaphoreGive(activeCmd->Done);
+	activeCmd = NULL;
+	// Failed commands leave their Function, that would keep GSMIdleWait awake
+	mainOpStatus.Function = 0;
+}
+
+// GSM Task side: sleeps when there is nothing to do, until the modem sends
+// something or a command is queued
+void GSMIdleWait()
+{
+	if (mainGSMStateMachine != SM_GSM_IDLE && mainGSMStateMachine != SM_GSM_LL_MODE
+		&& mainGSMStateMachine != SM_GSM_HIBERNATE)
+		return;
+	if (activeCmd != NULL || mainOpStatus.Function != 0 || uxQueueMessagesWaiting(xQueue) != 0)
+		return;
+	// GSMUnsol parses complete lines only
+	if (mainGSMStateMachine == SM_GSM_IDLE && GSMFind(0, GSM_BUFFER_SIZE, '\n') >= 0)
+		return;
+	xSemaphoreTake(xSemGSMWake, GSM_IDLE_TIMEOUT / portTICK_RATE_MS);
 }
+/// @endcond
 
 void callbackDbg(BYTE smInt)
 {
@@ -200,31 +400,42 @@ void HiloPok()
     while(HILO_CTS_IO == 1);
 }
 
-// Initializes Flyport UART4 to be used with Hilo Modem with sperified "long int baud" baudrate. It enables also HW flow signals CTS/RTS
+// Rounded divisor of the Hilo UART for baud, with the clock (x16, or x4 with BRGH) that makes it closest.
+// Returns the error of the speed made, in tenths of percent.
+static int HiloBaudDiv(long int baud, long int* brg, BOOL* brgh)
+{
+	long int clk = GetInstructionClock();
+	long int div16, div4, err16, err4;
+	
+	div16 = (clk + baud*8) / (baud*16);
+	div4 = (clk + baud*2) / (baud*4);
+	err16 = (div16 > 0) ? (labs(clk/16/div16 - baud)*1000) / baud : 1000;
+	err4 = (labs(clk/4/div4 - baud)*1000) / baud;
+	*brgh = (err4 < err16);
+	*brg = (*brgh ? div4 : div16) - 1;
+	return (*brgh ? err4 : err16);
+}
+
+// Initializes Flyport UART4 to be used with Hilo Modem with sperified "long int baud" baudrate. It enables also HW flow signals CTS/RTS:
+// the UART sends only while the modem asserts CTS. RTS is driven by GSMRxInt (RG9 is a port pin, see HWInit.c):
+// the U4RTS of the UART only goes off with its Rx FIFO full, too late for the char the modem has in flight.
 void HiloUARTInit(long int baud)
 {
     // Initialize HILO UART...
     int port = HILO_UART-1;
-	long int brg , baudcalc , clk , err;
-	clk = GetInstructionClock();
-	brg = (clk/(baud*16ul))-1;
-	baudcalc = (clk/16ul/(brg+1));
-	err = (abs(baudcalc-baud)*100ul)/baud;
+	long int brg;
+	BOOL brgh;
+	
+	HiloBaudDiv(baud, &brg, &brgh);
+	hiloBaud = baud;
 
+	// UEN = 10 (UxCTS and UxRTS used, U4RTS is not mapped to a pin), RTSMD = 0 (flow control mode)
 	int UMODEval = 0;
-	UMODEval = (*UMODEs[port] & 0x3CFF);
-	
-	if (err<2)
-	{
-		*UMODEs[port] = (0xFFF7 & UMODEval);
-		*UBRGs[port] = brg;
-	}
-	else
-	{
-		brg = (clk/(baud*4ul))-1;
-		*UMODEs[port] = (0x8 | UMODEval);
-		*UBRGs[port] = brg;
-	}
+	UMODEval = (*UMODEs[port] & 0x34F7) | 0x0200;
+	if (brgh)
+		UMODEval |= 0x8;
+	*UMODEs[port] = UMODEval;
+	*UBRGs[port] = brg;
 	
 	// UART ON:
 	*UMODEs[port] = *UMODEs[port] | 0x8000;
@@ -232,9 +443,22 @@ void HiloUARTInit(long int baud)
 
 	*UIFSs[port] = *UIFSs[port] & (~URXIPos[port]);
 	*UIFSs[port] = *UIFSs[port] & (~UTXIPos[port]);
+	*UIECs[port] = *UIECs[port] & (~UTXIPos[port]);
+	rxHeld = FALSE;
+	rxStopped = FALSE;
+	HILO_RTS_IO = 0;
+	// GSMRxInt and GSMTxInt wake up the GSM Task, so they must not preempt the kernel
+	IPC22bits.U4RXIP = configKERNEL_INTERRUPT_PRIORITY;
+	IPC22bits.U4TXIP = configKERNEL_INTERRUPT_PRIORITY;
 	*UIECs[port] = *UIECs[port] | URXIPos[port];
 }
 
+// Speed of the Hilo UART
+long int HiloBaud()
+{
+	return hiloBaud;
+}
+
 // Initializes Hilo using Reset, UART setup, Pok and waits until the procedure is finished
 void HiloInit(long int baud)
 {
@@ -254,52 +478,69 @@ void HiloInit(long int baud)
 
 int findStr(char* str, int vTaskTimeout)
 {
-	char buff;
 	int cnt=0;
-	int cnt2=0;
 	int len = strlen(str);
-	// Waiting for the first char...
-	while (GSMBufferSize() == 0)
-	{
-		cnt++;
-		vTaskDelay(1);
-		if (cnt == vTaskTimeout)
-			return -1;
-	}
+	int avail, pos;
 	
-	//	Searching for OK answer
-	while (GSMBufferSize() > 0)
+	while (1)
 	{
-		GSMRead(&buff, 1);
-			
-		if (buff == str[cnt2])
-			cnt2++;
-		else
-			cnt2 = 0;
-		if (cnt2 == len)
+		//	Searching for the answer inside the chars already received
+		avail = GSMBufferSize();
+		pos = GSMSearch(0, avail, str);
+		if (pos >= 0)
 		{
+			GSMConsume(pos + len);
 			return 0;
-		}	
-		while (GSMBufferSize() == 0)
+		}
+		
+		// Only the last len-1 chars can still be the start of the answer
+		if (avail >= len)
+		{
+			GSMConsume(avail - len + 1);
+			avail = len - 1;
+		}
+		
+		// Waiting for more chars...
+		while (GSMBufferSize() <= avail)
 		{
-			vTaskDelay(1);
 			cnt++;
+			vTaskDelay(1);
 			if (cnt == vTaskTimeout)
-				break;
-		}				
-	}		
-	return -1;
+				return -1;
+		}
+	}
+}
+
+// Speeds tried by HiloComTest: 115200, then those above it that HiloStdModeOn may have set, then the slower ones.
+// Returns 0 after the last one.
+static long int HiloScanBaud(int i)
+{
+	int high = 0;
+	
+	if (i == 0)
+		return baudComp[7];
+	while (baudHigh[high] != 0)
+		high++;
+	if (i <= high)
+		return baudHigh[i-1];
+	i -= high;
+	return (i <= 7) ? baudComp[7-i] : 0;
 }
 
 int HiloComTest()
 {
 	int cnt, i;
+	long int baud, brg;
+	BOOL brgh;
 	char tofind[]="OK\r", buff;
 	#if defined(STACK_USE_UART)
 	char gab[55];
 	#endif
-	for (i=7; i>=0; i--)
+	for (i=0; (baud = HiloScanBaud(i)) != 0; i++)
 	{
+		// Out of reach of the UART, never set
+		if (HiloBaudDiv(baud, &brg, &brgh) > GSM_BAUD_TOL)
+			continue;
 		cnt = 0;
 		HILO_RTS_IO = 0;
 		
@@ -314,10 +555,10 @@ int HiloComTest()
 			}
 		}
 		
-		//	Hilo UART initialization, without hardware flow control
-		HiloUARTInit(baudComp[i]);
+		//	Hilo UART initialization
+		HiloUARTInit(baud);
 		#if defined(STACK_USE_UART)
-		sprintf(gab, "Testing %ld baud...\n", baudComp[i]);
+		sprintf(gab, "Testing %ld baud...\n", baud);
 		_dbgwrite(gab);
 		#endif
 		while (GSMBufferSize() > 0)
@@ -356,7 +597,7 @@ int HiloComTest()
 				cnt = 0;
 			if (cnt == 3)
 			{
-				if(i != 7)
+				if(baud != 115200)
 				{
 					GSMWrite("AT+IPR=115200\r");
 					vTaskDelay(50);
@@ -391,9 +632,10 @@ int HiloTestBaud(long int baud)
 	if(length > 0)
 	{
 		DelayMs(20);
-		if(length > 20)
-			length = 20;
+		if(length > 19)
+			length = 19;
 		GSMRead(baudRate, length);
+		baudRate[length] = '\0';
 		
 		if(strstr(baudRate, "OK")!=NULL)
 		{
@@ -423,13 +665,86 @@ int HiloTestBaud(long int baud)
 }
 
 extern const long int baudComp[];
-// Configures GSM modem to enter in "StandardMode", setting up desired parameters
+
+// Whether the module answers at the speed of the UART
+static BOOL HiloBaudCheck()
+{
+	int i;
+	
+	for (i = 0; i < 3; i++)
+	{
+		GSMFlush();
+		GSMWrite("AT\r");
+		if (!findStr("OK\r", 300))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+// Raises the speed of the Hilo UART from 115200 up to maxBaud. The rates of baudHigh that the UART makes
+// within GSM_BAUD_TOL are asked to the module from the highest (HiloTestBaud), and the UART follows once
+// it answered OK. A rate where the module is not heard from then is given up for good, back to 115200.
+// The echo is left off. Returns the speed in use.
+static long int HiloBaudUp(long int maxBaud)
+{
+	static BYTE failed;
+	long int brg;
+	BOOL brgh;
+	int i;
+	
+	for (i = 0; baudHigh[i] != 0; i++)
+	{
+		if (baudHigh[i] > maxBaud || (failed & (1 << i)) || HiloBaudDiv(baudHigh[i], &brg, &brgh) > GSM_BAUD_TOL)
+			continue;
+		if (HiloTestBaud(baudHigh[i]) != 1)
+			continue;
+		HiloUARTInit(baudHigh[i]);
+		if (HiloBaudCheck())
+			return baudHigh[i];
+		
+		failed |= 1 << i;
+		_dbgwrite("Hilo UART speed not sustained, back to 115200\r\n");
+		GSMWrite("AT+IPR=115200\r");
+		vTaskDelay(50);
+		HiloUARTInit(115200);
+		vTaskDelay(20);
+		GSMFlush();
+		break;
+	}
+	return hiloBaud;
+}
+
+// Configures GSM modem to enter in "StandardMode", setting up desired parameters.
+// The Hilo UART runs at up to baud, see HiloBaudUp.
 int HiloStdModeOn(long int baud)
 {
+#if GSM_CMUX
+	// The reset of HiloInit ends the multiplexer
+	CmuxReset();
+#endif
 	// Hw init:
 	HiloInit(baud);
 	vTaskDelay(20);
 	GSMFlush();
+	if (baud > 115200)
+	{
+		#if defined(STACK_USE_UART)
+		char gab[40];
+		sprintf(gab, "Hilo UART at %ld baud\r\n", HiloBaudUp(baud));
+		_dbgwrite(gab);
+		#else
+		HiloBaudUp(baud);
+		#endif
+	}
+#if GSM_CMUX
+	// The settings below are made on the AT channel
+	if(CmuxStart())
+	{
+		_dbgwrite("AT+CMUX ERROR\r\n");
+		return OP_SYNTAX_ERR;
+	}
+	_dbgwrite("AT+CMUX OK\r\n");
+#endif
 	// Set parameters
 	_dbgwrite("setup parameters...\r\n");
 	
@@ -648,62 +963,136 @@ void GSMRxInt()
 	int port = HILO_UART - 1;
 	gprs_data++;
 	
-	while ((*USTAs[port] & 1)!=0)
+	int next, size;
+	char rx;
+#if GSM_TRACE
+	DWORD tick = TickGet();
+#endif
+	
+	while (GSM_UART_RX_READY(port))
 	{
-		if (bufind_w == bufind_r)
+		// GSMBuffer nearly full: RTS off, the modem stops after the chars it has in flight
+		size = GSMBufferSize();
+		if (size >= GSM_BUFFER_SIZE - 1 - GSM_RX_HEADROOM)
 		{
-			if (last_op == 1)
-			{
-				GSMbuffover = 1;
-				bufind_w = 0;
-				bufind_r = 0;
-				last_op = 0;
-			}
+			HILO_RTS_IO = 1;
+			rxStopped = TRUE;
 		}
-
-		GSMBuffer[bufind_w] = *URXREGs[port];
+		// GSMBuffer full all the same: the chars wait in the UART
+		if (size == GSM_BUFFER_SIZE - 1)
+		{
+			rxHeld = TRUE;
+			*UIECs[port] = *UIECs[port] & (~URXIPos[port]);
+			break;
+		}
+		rx = GSM_UART_RX_CHAR(port);
 		
-		rxChar[rxIdx] = GSMBuffer[bufind_w];
+		rxChar[rxIdx] = rx;
 		if (rxIdx == 49)
 			rxIdx = 0;
 		else
 			rxIdx++;
 		
+#if GSM_CMUX
+		// Only the chars of the AT channel are for GSMBuffer
+		if (CmuxOn() && !CmuxRx(rx))
+			continue;
+#endif
+#if GSM_TRACE
+		GSMTraceRx(rx, tick);
+#endif
+		
 		if (bufind_w == GSM_BUFFER_SIZE - 1)
+			next = 0;
+		else
+			next = bufind_w + 1;
+		
+		GSMBuffer[bufind_w] = rx;
+		bufind_w = next;
+	}
+	// Held: the flag stays, GSMRxResume unmasks the interrupt
+	if (!rxHeld)
+	{
+		// A char came with the FIFO full, and the UART stopped receiving. The FIFO is empty now,
+		// so clearing OERR loses nothing more: the AT parser and the CMUX frame checks skip the damage.
+		if (GSM_UART_OVERRUN(port))
 		{
-			bufind_w = 0;
+			GSM_UART_OVERRUN_CLEAR(port);
+			gsmRxOverruns++;
 		}
-		else
-			bufind_w++;
+		*UIFSs[port] = *UIFSs[port] & (~URXIPos[port]);
 	}
-	last_op = 1;
-	*UIFSs[port] = *UIFSs[port] & (~URXIPos[port]);
+	
+	// Wake up the GSM Task
+	if (xSemGSMWake != NULL)
+	{
+		portBASE_TYPE woken = pdFALSE;
+		xSemaphoreGiveFromISR(xSemGSMWake, &woken);
+		if (woken != pdFALSE)
+			taskYIELD();
+	}
+}
+
+// UART4 Tx Interrupt, unmasked by GSMTxWait while the modem holds CTS off
+void GSMTxInt()
+{
+	int port = HILO_UART - 1;
+	portBASE_TYPE woken = pdFALSE;
+	
+	*UIECs[port] = *UIECs[port] & (~UTXIPos[port]);
+	*UIFSs[port] = *UIFSs[port] & (~UTXIPos[port]);
+	xSemaphoreGiveFromISR(xSemGSMTx, &woken);
+	if (woken != pdFALSE)
+		taskYIELD();
+}
+
+// Waits for room in the Tx FIFO of the Hilo UART. The FIFO empties in a few char times while the modem
+// asserts CTS; while it holds CTS off, the task sleeps until the Tx interrupt, for up to 500 ms.
+// Returns FALSE on timeout.
+static BOOL GSMTxWait(int port)
+{
+	while (GSM_UART_TX_FULL(port))
+	{
+		if (HILO_CTS_IO == 0)
+			continue;
+		*UIFSs[port] = *UIFSs[port] & (~UTXIPos[port]);
+		*UIECs[port] = *UIECs[port] | UTXIPos[port];
+		if (xSemaphoreTake(xSemGSMTx, 500 / portTICK_RATE_MS) != pdTRUE)
+		{
+			*UIECs[port] = *UIECs[port] & (~UTXIPos[port]);
+			return FALSE;
+		}
+	}
+	return TRUE;
 }
 
 // Writes to GSM Modem the cahrs contained on data2wr until a '\0' is reached
 void GSMWrite(char* data2wr)
 {
 	RS232Write(3, data2wr);
+#if GSM_TRACE
+	GSMTraceTx(data2wr, strlen(data2wr));
+#endif
 
-	int port = HILO_UART-1;
-	int pdsel;
-	int cnt = 0;	
-	while(HILO_CTS_IO == 1)
+#if GSM_CMUX
+	if (CmuxOn())
 	{
-		vTaskDelay(10);
-		cnt++;
-		if(cnt == 50)
-			return;
+		CmuxWrite(CMUX_AT, data2wr, strlen(data2wr));
+		return;
 	}
-	HILO_RTS_IO = 1;
+#endif
+
+	int port = HILO_UART-1;
+	int pdsel;
 	// transmits till NUL character is encountered 
 	pdsel = (*UMODEs[port] & 6) >>1;
     if (pdsel == 3)                             // checks if TX is 8bits or 9bits
     {
         while(*data2wr != '\0') 
         {
-            while((*USTAs[port] & 512)>0);	// waits if the buffer is full 
-            *UTXREGs[port] = *data2wr++;         // sends char to TX reg
+            if(!GSMTxWait(port))				// waits if the buffer is full 
+            	return;
+            GSM_UART_TX_CHAR(port, *data2wr++);  // sends char to TX reg
             gprs_data++;
         }
     }
@@ -711,861 +1100,676 @@ void GSMWrite(char* data2wr)
     {
         while(*data2wr != '\0')
         {
-            while((*USTAs[port] & 512)>0);      // sends char to TX reg
-            *UTXREGs[port] = *data2wr++ & 0xFF;  // sends char to TX reg
+            if(!GSMTxWait(port))				// waits if the buffer is full 
+            	return;
+            GSM_UART_TX_CHAR(port, *data2wr++ & 0xFF);  // sends char to TX reg
             gprs_data++;
         }
     }
-    HILO_RTS_IO = 0;
 }
 
 void GSMWriteCh(char chr)
 {
 	gprs_data++;
 	RS232WriteCh(3, chr);
+#if GSM_TRACE
+	GSMTraceTx(&chr, 1);
+#endif
+
+#if GSM_CMUX
+	if (CmuxOn())
+	{
+		CmuxWrite(CMUX_AT, &chr, 1);
+		return;
+	}
+#endif
 
 	int port = HILO_UART-1;
 	int pdsel;
 	pdsel = (*UMODEs[port] & 6) >>1;
-	int cnt = 0;
-	while(HILO_CTS_IO == 1)
-	{
-		vTaskDelay(10);
-		cnt++;
-		if(cnt == 50)
-			return;
-	}
-	HILO_RTS_IO = 1;
+	if(!GSMTxWait(port))			/* waits if the buffer is full */
+		return;
     if(pdsel == 3)        /* checks if TX is 8bits or 9bits */
-    {
-        while((*USTAs[port] & 512)>0);	/* waits if the buffer is full */
-        *UTXREGs[port] = chr;    		/* transfer data to TX reg */
-    }
+        GSM_UART_TX_CHAR(port, chr);    /* transfer data to TX reg */
     else
-    {
-        while((*USTAs[port] & 512)>0); /* waits if the buffer is full */
-        *UTXREGs[port] = chr & 0xFF;   /* transfer data to TX reg */
-    }
-    HILO_RTS_IO = 0;
+        GSM_UART_TX_CHAR(port, chr & 0xFF);   /* transfer data to TX reg */
 }
 
-
-void GSMFlush()
+// Writes len chars to GSM Modem, NUL chars included
+void GSMWriteN(const char* data, int len)
 {
-	bufind_w = 0;
-	bufind_r = 0;
-	last_op = 0;
-	GSMBuffer[0] = '\0';
+	int i;
+	
+	for (i = 0; i < len; i++)
+		RS232WriteCh(3, data[i]);
+#if GSM_TRACE
+	GSMTraceTx(data, len);
+#endif
+#if GSM_CMUX
+	if (CmuxOn())
+	{
+		CmuxWrite(CMUX_AT, data, len);
+		return;
+	}
+#endif
+	GSMWriteRaw(data, len);
 }
 
-
-int GSMBufferSize()
+// Writes len chars on the Hilo UART as they are, below the multiplexer
+void GSMWriteRaw(const char* data, int len)
 {
-	BYTE loc_last_op = last_op;
-	int conf_buff;
-	int bsize=0;
-
-	conf_buff = bufind_r - bufind_w;
-	if (conf_buff > 0)
-		bsize = GSM_BUFFER_SIZE - bufind_r + bufind_w;
-	else if (conf_buff < 0)
-		bsize = bufind_w - bufind_r;
-	else if (conf_buff == 0)
-		if (loc_last_op == 1)
-			bsize = GSM_BUFFER_SIZE;
-
-	return bsize;
+	int port = HILO_UART-1;
+	
+	while(len-- > 0)
+	{
+		if(!GSMTxWait(port))			// waits if the buffer is full
+			return;
+		GSM_UART_TX_CHAR(port, *data++ & 0xFF);
+		gprs_data++;
+	}
 }
 
-// Reads a max of count chars and puts them inside towrite char array, from GSMBuffer. This functions clears GSM buffer array
-int GSMRead(char *towrite , int count)
+
+// Lets the modem send again once GSMBuffer has room, and unmasks GSMRxInt for the chars it left in the UART
+static void GSMRxResume()
 {
-	int rd,limit;
-	limit = GSMBufferSize();
-	if (count > limit)
-		count=limit;
-	int irx = 0;
-	rd = 0;
-	while (irx < count)
+	// Twice the headroom, not to toggle RTS at each char
+	if (rxStopped && GSMBufferSize() < GSM_BUFFER_SIZE - 1 - 2 * GSM_RX_HEADROOM)
 	{
-        *(towrite+irx) = GSMBuffer[bufind_r];
-
-		if (gsmDebugOn)
-			RS232WriteCh(3, GSMBuffer[bufind_r]);
-
-		if (bufind_r == (GSM_BUFFER_SIZE-1))
-			bufind_r = 0;
-		else
-			bufind_r++;		
-
-		irx++;
+		rxStopped = FALSE;
+		HILO_RTS_IO = 0;
 	}
-	
-	if ( GSMbuffover != 0 )
+	if (rxHeld)
 	{
-		rd = -count;
-		GSMbuffover = 0;
+		rxHeld = FALSE;
+		*UIECs[HILO_UART-1] = *UIECs[HILO_UART-1] | URXIPos[HILO_UART-1];
 	}
-	else
-		rd = count;
+}
 
-	last_op = 2;
-	return rd;
+void GSMFlush()
+{
+	bufind_r = bufind_w;
+	GSMRxResume();
 }
 
-// Reads a max of count chars inside towrite char array, from GSMBuffer. This functions DOES NOT clear GSM buffer array
-int GSMpRead(char *towrite, int count)
+
+int GSMBufferSize()
 {
-	int rd,limit;
-	int bufind_r_temp = bufind_r;
+	int bsize = bufind_w - bufind_r;
 	
-	limit = GSMBufferSize();
-	if (count > limit)
-		count=limit;
-	int irx = 0;
-	rd = 0;
-	while (irx < count)
-	{
-        *(towrite+irx) = GSMBuffer[bufind_r_temp];
-
-		if (bufind_r_temp == (GSM_BUFFER_SIZE-1))
-			bufind_r_temp = 0;
-		else
-			bufind_r_temp++;		
+	if (bsize < 0)
+		bsize += GSM_BUFFER_SIZE;
+	return bsize;
+}
 
-		irx++;
-	}
+// Points span to the chars of GSMBuffer starting from offset relative position, and returns
+// how many of them are contiguous in memory (0 if there is no data at offset).
+// The chars after a wrap are given by a second call with offset increased by the length returned.
+int GSMPeekSpan(int offset, char** span)
+{
+	int avail = GSMBufferSize();
+	int ind;
 	
-	if ( GSMbuffover != 0 )
-	{
-		rd = -count;
-		GSMbuffover = 0;
-	}
-	else
-		rd = count;
-	return rd;
+	if ((offset < 0) || (offset >= avail))
+		return 0;
+	ind = bufind_r + offset;
+	if (ind >= GSM_BUFFER_SIZE)
+		ind -= GSM_BUFFER_SIZE;
+	*span = &GSMBuffer[ind];
+	avail -= offset;
+	if (avail > GSM_BUFFER_SIZE - ind)
+		avail = GSM_BUFFER_SIZE - ind;
+	return avail;
 }
 
-// Reads a max of num chars inside towrite char array, from GSMBuffer, starting from start relative position. 
-// This functions DOES NOT clear GSM buffer array 
-BOOL GSMpSeek(int start, int num, char* towrite)
+// Clears a max of count chars from GSMBuffer
+void GSMConsume(int count)
 {
-	int limit = GSMBufferSize();
-	// Check if we have a sufficient number of BYTEs on GSMBuffer
-	if((start + num) > limit)
-		return FALSE;
-	else
+	int avail = GSMBufferSize();
+	int ind = bufind_r;
+	int i;
+	
+	if (count > avail)
+		count = avail;
+	if (count <= 0)
+		return;
+	if (gsmDebugOn)
 	{
-		limit = num;
-		int bufind_r_temp = bufind_r + start;
-		
-		if(bufind_r_temp >= GSM_BUFFER_SIZE)
-			bufind_r_temp = bufind_r_temp - GSM_BUFFER_SIZE;
-			
-		int irx = 0;
-		
-		while(irx < limit)
+		for (i = 0; i < count; i++)
 		{
-			*(towrite+irx) = GSMBuffer[bufind_r_temp];
-
-			if (bufind_r_temp == (GSM_BUFFER_SIZE-1))
-				bufind_r_temp = 0;
+			RS232WriteCh(3, GSMBuffer[ind]);
+			if (ind == (GSM_BUFFER_SIZE-1))
+				ind = 0;
 			else
-				bufind_r_temp++;		
-	
-			irx++;
+				ind++;
 		}
-		return TRUE;	
 	}
+	ind = bufind_r + count;
+	if (ind >= GSM_BUFFER_SIZE)
+		ind -= GSM_BUFFER_SIZE;
+	bufind_r = ind;
+	GSMRxResume();
 }
 
-
-int GSMReadN(int maxlen, char term, int occurr, char* destbuff)
+// Returns the relative position of the first c char of GSMBuffer between start and end, -1 if not found.
+// This functions DOES NOT clear GSM buffer array
+int GSMFind(int start, int end, char c)
 {
-	int count = 0;
-	int i, occ_count = 0;
-	for(i = 0; i < maxlen; i++)
+	char* span;
+	char* hit;
+	int len;
+	
+	while (start < end)
 	{
-		GSMRead(destbuff+count, 1);
-		if( *(destbuff+count) == term)
-			occ_count++;
-		count++;
-		if(occ_count == occurr)
-		{
-			return count;
-		}
+		len = GSMPeekSpan(start, &span);
+		if (len == 0)
+			return -1;
+		if (len > end - start)
+			len = end - start;
+		hit = memchr(span, c, len);
+		if (hit != NULL)
+			return start + (hit - span);
+		start += len;
 	}
-	// Error (less occ_count than expected)
 	return -1;
 }
 
-// Unsolicited Messages Parsing
-void GSMUnsol(int errorType)
+static BOOL GSMMatch(int offset, const char* str, int len)
+{
+	char* span;
+	int n;
+	
+	while (len > 0)
+	{
+		n = GSMPeekSpan(offset, &span);
+		if (n == 0)
+			return FALSE;
+		if (n > len)
+			n = len;
+		if (memcmp(span, str, n) != 0)
+			return FALSE;
+		offset += n;
+		str += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+// Returns the relative position of str inside GSMBuffer, if it is found whole between start and end, -1 otherwise.
+// This functions DOES NOT clear GSM buffer array
+int GSMSearch(int start, int end, const char* str)
 {
-	// Parse unsollecited message on GSMBuffer
-	if (GSMBufferSize() > 3)
+	int len = strlen(str);
+	int avail = GSMBufferSize();
+	
+	if (end > avail)
+		end = avail;
+	while (start + len <= end)
 	{
-		vTaskDelay(1);
-		char unsolStr[5];
-		GSMRead(unsolStr, 4);
-		unsolStr[4] = '\0';
+		start = GSMFind(start, end - len + 1, str[0]);
+		if (start < 0)
+			return -1;
+		if (GSMMatch(start, str, len))
+			return start;
+		start++;
+	}
+	return -1;
+}
+
+// Copies count chars of GSMBuffer, starting from offset relative position. They must be available.
+static void GSMCopy(int offset, char* towrite, int count)
+{
+	char* span;
+	int n;
+	
+	while (count > 0)
+	{
+		n = GSMPeekSpan(offset, &span);
+		if (n == 0)
+			return;
+		if (n > count)
+			n = count;
+		memcpy(towrite, span, n);
+		towrite += n;
+		offset += n;
+		count -= n;
+	}
+}
+
+// Reads a max of count chars and puts them inside towrite char array, from GSMBuffer. This functions clears GSM buffer array
+int GSMRead(char *towrite , int count)
+{
+	int limit = GSMBufferSize();
+	if (count > limit)
+		count=limit;
+	
+	GSMCopy(0, towrite, count);
+	GSMConsume(count);
+	return count;
+}
+
+// Reads a max of count chars inside towrite char array, from GSMBuffer. This functions DOES NOT clear GSM buffer array
+int GSMpRead(char *towrite, int count)
+{
+	int limit = GSMBufferSize();
+	if (count > limit)
+		count=limit;
+	
+	GSMCopy(0, towrite, count);
+	return count;
+}
+
+// Reads a max of num chars inside towrite char array, from GSMBuffer, starting from start relative position. 
+// This functions DOES NOT clear GSM buffer array 
+BOOL GSMpSeek(int start, int num, char* towrite)
+{
+	// Check if we have a sufficient number of BYTEs on GSMBuffer
+	if((start + num) > GSMBufferSize())
+		return FALSE;
+	GSMCopy(start, towrite, num);
+	return TRUE;
+}
+
+
+// Reads from GSMBuffer until the occurr occurrence of term char, within maxlen chars.
+// Returns the number of chars read, -1 if less occurrences are found (the chars scanned are cleared anyway)
+int GSMReadN(int maxlen, char term, int occurr, char* destbuff)
+{
+	int limit = GSMBufferSize();
+	int pos = -1;
+	
+	if (limit > maxlen)
+		limit = maxlen;
+	while (occurr-- > 0)
+	{
+		pos = GSMFind(pos + 1, limit, term);
+		if (pos < 0)
+			break;
+	}
+	if (pos < 0)
+	{
+		// Error (less occ_count than expected)
+		GSMRead(destbuff, limit);
+		return -1;
+	}
+	GSMRead(destbuff, pos + 1);
+	return pos + 1;
+}
+
+// Unsolicited result codes handlers. The line to parse, <CR><LF> included, is in UnsolBuffer.
+// They return FALSE if the line is malformed.
+static BOOL UnsolRing()
+{
+	// The caller ID follows in the +CLIP line
+	return TRUE;
+}
+
+static BOOL UnsolClip()
+{
+	//+CLIP: "<number>",<type>
+	// get phone number
+	if(getfield('"', '"', 20, 1, UnsolBuffer, mainCall.CallerID, 500) != 1)
+	{
+		_dbgwrite("ERROR getfield RING\r\n");
+		return FALSE;
+	}
+	// Set GSM Event:
+	EventType = ON_RING;
+	
+	// Set mainCall status
+	mainCall.Status = CALL_IN_PROG;
+	return TRUE;
+}
+
+static BOOL UnsolNoCarrier()
+{
+	EventType = ON_NO_CARRIER;
+	mainCall.Status = CALL_READY;
+	return TRUE;
+}
+
+static BOOL UnsolBusy()
+{
+	EventType = ON_BUSY;
+	mainCall.Status = CALL_BUSY;
+	return TRUE;
+}
+
+static BOOL UnsolError()
+{
+	//+CMS ERROR:<n> or +CME ERROR:<n>
+	char temp[10];
+	// get error number
+	if(getfield(':', '\r', 8, 1, UnsolBuffer, temp, 500) != 1)
+		return FALSE;
+	
+	// Set error code
+	errorCode = atoi(temp);
+	mainOpStatus.ErrorCode = errorCode;
+	// Set GSM Event:
+	EventType = ON_ERROR;
+	return TRUE;
+}
+
+static BOOL UnsolCmti()
+{
+	//+CMTI:<memory>,<index>
+	// <memory> can be "SM" or "ME"
+	// <index> is the int number of new SMS location in memory 
+	char temp[10];
+	// get Memory Type
+	if(getfield('"', '"', 4, 1, UnsolBuffer, temp, 500) != 1)
+		return FALSE;
+	
+	// Set mainSMS.MemType
+	if(strstr(temp, "SM")!=NULL)
+		IncomingSMS_MemType = SM_MEM;
+	else if(strstr(temp, "ME")!=NULL)
+		IncomingSMS_MemType = ME_MEM;
 		
-		while(GSMBufferSize() > 0)
+	// Get also index if Memory type is correct (SM or ME)
+	getfield(',','\r', 5, 1, UnsolBuffer, temp, 500);
+	int indexSMS = atoi(temp);
+	
+	if(indexSMS > 0)
+	{
+		IncomingSMS_Index = indexSMS;
+	}
+	// Set GSM Event:
+	EventType = ON_SMS_REC;
+	return TRUE;
+}
+
+static BOOL UnsolCds()
+{
+	//+CDS: <fo>,<mr>,[<ra>],[<tora>],<scts>,<dt>, <st>(text mode enabled)
+	char temp[25];
+	
+	// get <mr>
+	if(getfield(',', ',', 4, 1, UnsolBuffer, temp, 500) != 1)
+		return FALSE;
+	mainSMS.MessageReference = atoi(temp);
+	
+	// get <ra> (destination)
+	if(getfield('\"', '\"', 20, 1, UnsolBuffer, temp, 500) != 1)
+		return FALSE;
+	strncpy(mainSMS.Destination, temp, sizeof(mainSMS.Destination) - 1);
+	mainSMS.Destination[sizeof(mainSMS.Destination) - 1] = '\0';
+	
+	// get <dt>
+	if(getfield('\"', '\"', 22, 5, UnsolBuffer, temp, 500) != 1)
+		return FALSE;
+	strncpy(mainSMS.DateTime, temp, sizeof(mainSMS.DateTime) - 1);
+	mainSMS.DateTime[sizeof(mainSMS.DateTime) - 1] = '\0';
+	
+	// Convert DateTime string to struct time:
+	int countFirstSlash = strlen(mainSMS.DateTime);
+	int dmp;
+	char tmpval[25];
+	// Get index of first slash:
+	for(dmp = 0; dmp < countFirstSlash; dmp++)
+	{
+		if(mainSMS.DateTime[dmp] == '/')
+			countFirstSlash = dmp;
+	}
+	// copy first fieldof DateTime inside tmpval char[]
+	strncpy(tmpval, mainSMS.DateTime, countFirstSlash);
+	tmpval[countFirstSlash] = '\0';
+	
+	// Convert YEAR:
+	mainSMS.time.tm_year = atoi(tmpval)+100;
+	
+	// Get second field (month)
+	getfield('/', '/', 5, 1, mainSMS.DateTime, tmpval, 500);
+	// Convert MONTH:
+	mainSMS.time.tm_mon = atoi(tmpval);
+	
+	// Get third field (day)
+	getfield('/', ',', 5, 2, mainSMS.DateTime, tmpval, 500);
+	// Convert DAY
+	mainSMS.time.tm_mday = atoi(tmpval);
+	
+	// Get hour
+	getfield(',', ':', 5, 1, mainSMS.DateTime, tmpval, 500);
+	// convert HOUR
+	mainSMS.time.tm_hour = atoi(tmpval);
+	
+	// Get minutes
+	getfield(':', ':', 5, 1, mainSMS.DateTime, tmpval, 500);
+	// convert MINUTES
+	mainSMS.time.tm_min = atoi(tmpval);
+	
+	// Get seconds & GMT
+	countFirstSlash = strlen(mainSMS.DateTime);
+	int quithere = 0;
+	// Get index of last ':' char to retrieve seconds:
+	for(dmp = 0; dmp < countFirstSlash; dmp++)
+	{
+		// stop at second ':'
+		if((mainSMS.DateTime[dmp] == ':')&&(quithere != 0))
 		{
-			// Scan for "RING" message
-			if(strstr(unsolStr, "RING")!=NULL)
-			{
-				// Wait for message complete...
-				int counterEx = 120;
-				while((counterEx>0)&&(GSMBufferSize() < 10))
-				{
-					counterEx--;
-					vTaskDelay(2);
-				}	
-				//RING
-				int res = GSMReadN(150, '\n', 3, UnsolBuffer);
-				
-				if(res == -1)
-				{
-					//ERROR:
-					_dbgwrite("ERROR GSMReadN RING:\r\n");
-					
-					// Execute Error Handler
-					ErrorHandler(errorType);
-				}
-				else
-				{
-					UnsolBuffer[res] = '\0';
-					
-					// get phone number
-					res = getfield('"', '"', 20, 1, UnsolBuffer, mainCall.CallerID, 500);
-					
-					if(res != 1)
-					{
-						_dbgwrite("ERROR getfield RING\r\n");
-						
-						// Execute Error Handler
-						ErrorHandler(errorType);						
-						break;
-					}
-					else
-					{				
-						// Set GSM Event:
-						EventType = ON_RING;
-						
-						// Set mainCall status
-						mainCall.Status = CALL_IN_PROG;
-					}
-				}
-				
-				break;
-			}
-			// Scan for "NO CARRIER" message
-			else if(strstr(unsolStr, "NO C")!=NULL)
-			{
-				vTaskDelay(2);
-				// NO CARRIER
-				int res = GSMReadN(15, '\n', 1, UnsolBuffer);
-				if(res == -1)
-				{
-					//ERROR:
-					_dbgwrite("ERROR GSMReadN NO CARRIER\r\n");
-										
-					// Execute Error Handler
-					ErrorHandler(errorType);
-				}
-				else
-				{
-					UnsolBuffer[res] = '\0';
-					EventType = ON_NO_CARRIER;
-					mainCall.Status = CALL_READY;
-				}	
-				break;
-			}
-			// Scan for "BUSY" message
-			else if(strstr(unsolStr, "BUSY")!=NULL)
-			{
-				vTaskDelay(2);
-				// BUSY
-				int res = GSMReadN(15, '\n', 1, UnsolBuffer);
-				if(res == -1)
-				{
-					// ERROR:
-					_dbgwrite("ERROR GSMReadN BUSY\r\n");
-										
-					// Execute Error Handler
-					ErrorHandler(errorType);
-				}
-				else
-				{
-					UnsolBuffer[res] = '\0';
-					EventType = ON_BUSY;
-					mainCall.Status = CALL_BUSY;
-				}
-				break;
-			}
-			// Scan for "+CMS ERROR" message
-			else if(strstr(unsolStr, "+CMS")!=NULL)
-			{
-				vTaskDelay(2);
-				//+CMS ERROR:<n>
-				// Search the first LineFeed and put the string inside UnsolBuffer
-				int res = GSMReadN(20, '\n', 1, UnsolBuffer);
-				
-				// Check result
-				if(res == -1)
-				{
-					_dbgwrite("ERROR GSMReadN +CMS\r\n");
-										
-					// Execute Error Handler
-					ErrorHandler(errorType);
-				}
-				else
-				{
-					UnsolBuffer[res] = '\0';
-					char temp[10];
-					// get error number
-					res = getfield(':', '\r', 8, 1, UnsolBuffer, temp, 500);
-					
-					if(res != 1)
-					{
-						// Execute Error Handler
-						ErrorHandler(errorType);
-						
-						break;
-					}
-					else
-					{				
-						// Set error code
-						errorCode = atoi(temp);
-						mainOpStatus.ErrorCode = errorCode;
-						// Set GSM Event:
-						EventType = ON_ERROR;	
-					}
-				}	
-				break;
-			}
-			// Scan for "+CME ERROR" message
-			else if(strstr(unsolStr, "+CME")!=NULL)
-			{
-				vTaskDelay(2);
-				//+CME ERROR:<n>
-				// Search the first LineFeed and put the string inside UnsolBuffer
-				int res = GSMReadN(20, '\n', 1, UnsolBuffer);
-				UnsolBuffer[res] = '\0';
-				
-				// Check result
-				if(res == -1)
-				{
-					//ERROR:
-					_dbgwrite("ERROR GSMReadN +CME\r\n");
-					
-					// Execute Error Handler
-					ErrorHandler(errorType);
-				}
-				else
-				{
-					UnsolBuffer[res] = '\0';
-					char temp[10];
-					// get error number
-					res = getfield(':', '\r', 8, 1, UnsolBuffer, temp, 500);
-					
-					if(res != 1)
-					{
-						// Execute Error Handler
-						ErrorHandler(errorType);
-						
-						break;
-					}
-					else
-					{				
-						// Set error code
-						errorCode = atoi(temp);
-						mainOpStatus.ErrorCode = errorCode;
-						// Set GSM Event:
-						EventType = ON_ERROR;	
-					}
-				}	
-				break;
-			}
-			// Scan for "+CMTI:..." message
-			else if(strstr(unsolStr, "+CMT")!=NULL)
-			{
-				vTaskDelay(2);
-				//+CMTI:<memory>,<index>
-				// <memory> can be "SM" or "ME"
-				// <index> is the int number of new SMS location in memory 
-				
-				// Search the first LineFeed and put the string inside UnsolBuffer
-				int res = GSMReadN(20, '\n', 1, UnsolBuffer);
-				
-				// Check result
-				if(res == -1)
-				{
-					//ERROR:
-					_dbgwrite("ERROR GSMReadN +CMTI\r\n");
-										
-					// Execute Error Handler
-					ErrorHandler(errorType);
-				}
-				else
-				{
-					UnsolBuffer[res] = '\0';
-					char temp[10];
-					// get Memory Type
-					res = getfield('"', '"', 4, 1, UnsolBuffer, temp, 500);
-					
-					if(res != 1)
-					{
-						// Execute Error Handler
-						ErrorHandler(errorType);
-					
-						break;
-					}
-					else
-					{				
-						// Set mainSMS.MemType
-						if(strstr(temp, "SM")!=NULL)
-							IncomingSMS_MemType = SM_MEM;
-						else if(strstr(temp, "ME")!=NULL)
-							IncomingSMS_MemType = ME_MEM;
-							
-						// Get also index if Memory type is correct (SM or ME)
-						res = getfield(',','\r', 5, 1, UnsolBuffer, temp, 500);
-						int indexSMS = atoi(temp);
-						
-						if(indexSMS > 0)
-						{
-							IncomingSMS_Index = indexSMS;
-						}
-						// Set GSM Event:
-						EventType = ON_SMS_REC;	
-					}
-				}
-				break;
-			} 
-			// Scan for ":..." message
-			else if(strstr(unsolStr, "+CDS")!=NULL)
+			// store index of second ':'
+			countFirstSlash = dmp;
+		}
+		// get first ':'
+		if(mainSMS.DateTime[dmp] == ':')
+		{	
+			quithere++;
+		}	
+	}
+	// copy 5 chars (2 chars for seconds, up to 5 chars for GMT)
+	strncpy(tmpval, &mainSMS.DateTime[countFirstSlash+1], 5);
+	
+	// copy seconds
+	char secs[3];
+	secs[0] = tmpval[0];
+	secs[1] = tmpval[1];
+	secs[2] = '\0';
+	
+	// Convert SECONDS
+	mainSMS.time.tm_sec = atoi(secs);
+	
+	// get <st>
+	if(getfield(',', '\r', 4, 8, UnsolBuffer, temp, 500) != 1)
+		return FALSE;
+	mainSMS.ReportValue = atoi(temp);
+	
+	// Set GSM Event:
+	EventType = ON_SMS_SENT;
+	return TRUE;
+}
+
+static BOOL UnsolCreg()
+{
+	//+CREG
+	// replies: +CREG:<stat>
+	// <stat>
+	// - 0: deregistration
+	// - 1: registration
+	// - 2: searching for new operator
+	// - 3: registration failed
+	// - 4: unknown
+	// - 5: registered, roaming
+	char temp[5];
+	if(getfield(':', '\r', 4, 1, UnsolBuffer, temp, 500) != 1)
+		return FALSE;
+	
+	// Set GSM Event:
+	EventType = ON_REG;
+	// Set mainGSM Connection Status
+	switch(atoi(temp))
+	{
+		case 0:
+			mainGSM.ConnStatus = NO_REG;
+			break;
+		case 1:
+			mainGSM.ConnStatus = REG_SUCCESS;
+			break;
+		case 2:
+			mainGSM.ConnStatus = SEARCHING;
+			break;
+		case 3:
+			mainGSM.ConnStatus = REG_DENIED;
+			break;
+		case 5:
+			mainGSM.ConnStatus = ROAMING;
+			break;
+		default:
+			mainGSM.ConnStatus = UNKOWN;
+			break;
+	}
+	return TRUE;
+}
+
+static BOOL UnsolKtcpNotif()
+{
+	//+KTCP_NOTIF
+	// response: +KTCP_NOTIF:<session_id>,<tcp_notif>
+	// <tcp_notif>
+	// 0- Network error 
+	// 1- No more sockets available; max. number already reached 
+	// 2- Memory problem  
+	// 3- DNS error 
+	// 4-TCP disconnection by the server or remote client
+	// 5-TCP connection error 
+	// 6- Generic error 
+	// 7- Fail to accept client requests 
+	// 8- Data sending is OK but KTCPSND was waiting more or less characters 
+	// 9- Bad session ID 
+	// 10- Session is already running 
+	// 11- All sessions are used 
+	char temp[5];
+	if(getfield(',', '\r', 4, 1, UnsolBuffer, temp, 500) != 1)
+		return FALSE;
+	xSocket->notif = atoi(temp);
+	return TRUE;
+}
+
+static BOOL UnsolKtcpData()
+{
+	//+KTCP_DATA
+	// response: +KTCP_DATA:<session_id>,<rxLen>
+	char temp[7];
+	if(getfield(',', '\r', 6, 1, UnsolBuffer, temp, 500) != 1)
+		return FALSE;
+	xSocket->rxLen = atoi(temp);
+	return TRUE;
+}
+
+static BOOL UnsolKftpError()
+{
+	// response: +KFTP_ERROR:<session_id>,<ftp_error>
+	char temp[5];
+	if(getfield(',', '\r', 4, 1, UnsolBuffer, temp, 500) != 1)
+		return FALSE;
+	xFTPSocket->ftpError = atoi(temp);
+	return TRUE;
+}
+
+// Unsolicited result codes, recognized by the start of the line
+static const struct
+{
+	const char* prefix;
+	BOOL (*parse)();
+} unsolCodes[] =
+{
+	{ "RING", UnsolRing },
+	{ "+CLIP:", UnsolClip },
+	{ "NO CARRIER", UnsolNoCarrier },
+	{ "BUSY", UnsolBusy },
+	{ "+CMS ERROR", UnsolError },
+	{ "+CME ERROR", UnsolError },
+	{ "+CMTI:", UnsolCmti },
+	{ "+CDS:", UnsolCds },
+	{ "+CREG:", UnsolCreg },
+	{ "+KTCP_NOTIF:", UnsolKtcpNotif },
+	{ "+KTCP_DATA:", UnsolKtcpData },
+	{ "+KFTP_ERROR", UnsolKftpError },
+};
+
+#define UNSOL_CODES (sizeof(unsolCodes) / sizeof(unsolCodes[0]))
+
+// Returns TRUE if the len chars of GSMBuffer at start can be the beginning of an unsolicited code
+static BOOL UnsolPrefix(int start, int len)
+{
+	int i, n;
+	for (i = 0; i < UNSOL_CODES; i++)
+	{
+		n = strlen(unsolCodes[i].prefix);
+		if (n > len)
+			n = len;
+		if (GSMMatch(start, unsolCodes[i].prefix, n))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+// Unsolicited Messages Parsing
+// GSMBuffer is parsed one complete line at a time, each line is matched once against unsolCodes.
+// While a command is pending (errorType CMD_UNEXPECTED) only the first line is parsed,
+// since it is the one the command did not expect.
+void GSMUnsol(int errorType)
+{
+	int avail, start, end, len, i;
+	char c;
+	
+	while (mainGSMStateMachine != SM_GSM_HW_FAULT)
+	{
+		// Skip the <CR><LF> before the line
+		avail = GSMBufferSize();
+		start = 0;
+		while ((GSMpSeek(start, 1, &c) == TRUE) && ((c == '\r') || (c == '\n')))
+			start++;
+		
+		end = GSMFind(start, avail, '\n');
+		if (end < 0)
+		{
+			// Line not complete yet: in idle state a partial line is kept only if it can be
+			// the beginning of an unsolicited code
+			if (errorType == NO_ERR)
 			{
-				vTaskDelay(50);
-				char temp[25];
-				//+CDS: <fo>,<mr>,[<ra>],[<tora>],<scts>,<dt>, <st>(text mode enabled)
-				
-				// Search the first LineFeed and put the string inside UnsolBuffer
-				int res = GSMReadN(145, '\n', 1, UnsolBuffer);
-				
-				// Check result
-				if(res == -1)
-				{
-					//ERROR:
-					_dbgwrite("ERROR GSMReadN +CDS\r\n");
-					
-					// Execute Error Handler
-					ErrorHandler(errorType);
-				}
+				len = avail - start;
+				if ((len >= sizeof(UnsolBuffer)) || !UnsolPrefix(start, len))
+					GSMConsume(avail);
 				else
-				{
-					UnsolBuffer[res] = '\0';
-					// get <mr>
-					res = getfield(',', ',', 4, 1, UnsolBuffer, temp, 500);
-					if(res != 1)
-					{
-						// Execute Error Handler
-						ErrorHandler(errorType);
-						break;
-					}
-					else
-					{
-						mainSMS.MessageReference = atoi(temp);
-					}
-					
-					// get <ra> (destination)
-					res = getfield('\"', '\"', 20, 1, UnsolBuffer, temp, 500);
-					
-					if(res != 1)
-					{
-						// Execute Error Handler
-						ErrorHandler(errorType);
-						break;
-					}
-					else
-					{
-						sprintf(mainSMS.Destination, temp);
-					}
-					
-					// get <dt>
-					res = getfield('\"', '\"', 22, 5, UnsolBuffer, temp, 500);
-					if(res != 1)
-					{
-						// Execute Error Handler
-						ErrorHandler(errorType);
-						break;
-					}
-					else
-					{
-						sprintf(mainSMS.DateTime, temp);
-						
-						// Convert DateTime string to struct time:
-						int countFirstSlash = strlen(mainSMS.DateTime);
-						int dmp;
-						char tmpval[25];
-						// Get index of first slash:
-						for(dmp = 0; dmp < countFirstSlash; dmp++)
-						{
-							if(mainSMS.DateTime[dmp] == '/')
-								countFirstSlash = dmp;
-						}
-						// copy first fieldof DateTime inside tmpval char[]
-						strncpy(tmpval, mainSMS.DateTime, countFirstSlash);
-						
-						// Convert YEAR:
-						mainSMS.time.tm_year = atoi(tmpval)+100;
-						
-						// Get second field (month)
-						getfield('/', '/', 5, 1, mainSMS.DateTime, tmpval, 500);
-						// Convert MONTH:
-						mainSMS.time.tm_mon = atoi(tmpval);
-						
-						// Get third field (day)
-						getfield('/', ',', 5, 2, mainSMS.DateTime, tmpval, 500);
-						// Convert DAY
-						mainSMS.time.tm_mday = atoi(tmpval);
-						
-						// Get hour
-						getfield(',', ':', 5, 1, mainSMS.DateTime, tmpval, 500);
-						// convert HOUR
-						mainSMS.time.tm_hour = atoi(tmpval);
-						
-						// Get minutes
-						getfield(':', ':', 5, 1, mainSMS.DateTime, tmpval, 500);
-						// convert MINUTES
-						mainSMS.time.tm_min = atoi(tmpval);
-						
-						// Get seconds & GMT
-						countFirstSlash = strlen(mainSMS.DateTime);
-						int quithere = 0;
-						// Get index of last ':' char to retrieve seconds:
-						for(dmp = 0; dmp < countFirstSlash; dmp++)
-						{
-							// stop at second ':'
-							if((mainSMS.DateTime[dmp] == ':')&&(quithere != 0))
-							{
-								// store index of second ':'
-								countFirstSlash = dmp;
-							}
-							// get first ':'
-							if(mainSMS.DateTime[dmp] == ':')
-							{	
-								quithere++;
-							}	
-							
-						}
-						// copy 5 chars (2 chars for seconds, up to 5 chars for GMT)
-						strncpy(tmpval, &mainSMS.DateTime[countFirstSlash+1], 5);
-						
-						// copy seconds
-						char secs[3];
-						secs[0] = tmpval[0];
-						secs[1] = tmpval[1];
-						secs[2] = '\0';
-						
-						// copy gmt
-						char gmt[4];
-						gmt[0] = tmpval[2];
-						gmt[1] = tmpval[3];
-						gmt[2] = tmpval[4];
-						gmt[3] = '\0';
-						
-						// Convert SECONDS
-						mainSMS.time.tm_sec = atoi(secs);
-						/*
-						// Add GMT to hours
-						int gmtVal = atoi(gmt);
-						gmtVal = gmtVal + mainSMS.time.tm_hour;
-						if(gmtVal < 0)
-						{
-							mainSMS.time.tm_hour = gmtVal + 24;
-							mainSMS.time.tm_mday--; 
-						}
-						else if(gmtVal > 24)
-						{
-							mainSMS.time.tm_hour = gmtVal - 24;
-							mainSMS.time.tm_mday++;
-						}
-						*/
-					}
-					
-					// get <st>
-					res = getfield(',', '\r', 4, 8, UnsolBuffer, temp, 500);
-					if(res != 1)
-					{
-						// Execute Error Handler
-						ErrorHandler(errorType);
-						break;
-					}
-					else
-					{
-						mainSMS.ReportValue = atoi(temp);
-					}
-				}			
-				
-				// Set GSM Event:
-				EventType = ON_SMS_SENT;
-				
-				break;
+					GSMConsume(start);
 			}
-			// Scan for "+CREG:..." message
-			else if(strstr(unsolStr, "+CRE")!=NULL)
+			else
 			{
-				vTaskDelay(20);
-				//+CREG
-				// replies: +CREG:<stat>
-				// <stat>
-				// - 0: deregistration
-				// - 1: registration
-				// - 2: searching for new operator
-				// - 3: registration failed
-				// - 4: unknown
-				// - 5: registered, roaming
-				
-				// Search the first LineFeed and put the string inside UnsolBuffer
-				int res = GSMReadN(15, '\n', 1, UnsolBuffer);
-				
-				// Set GSM.ConnStatus = +CREG value
-				if(res == -1)
-				{
-					//ERROR:
-					_dbgwrite("ERROR GSMReadN +CREG\r\n");
-					
-					// Execute Error Handler
-					ErrorHandler(errorType);
-				}
-				else
-				{
-					UnsolBuffer[res] = '\0';
-					char temp[5];
-					// get phone number
-					res = getfield(':', '\r', 4, 1, UnsolBuffer, temp, 500);
-					
-					if(res != 1)
-					{
-						// Execute Error Handler
-						ErrorHandler(errorType);
-					
-						break;
-					}
-					else
-					{				
-						int regStatus = atoi(temp);
-						switch(regStatus)
-						{
-							case 0:
-								// Set GSM Event:
-								EventType = ON_REG;							
-								// Set mainGSM Connection Status
-								mainGSM.ConnStatus = NO_REG;
-								break;
-							case 1:
-								// Set GSM Event:
-								EventType = ON_REG;							
-								// Set mainGSM Connection Status
-								mainGSM.ConnStatus = REG_SUCCESS;
-								break;
-							case 2:
-								// Set GSM Event:
-								EventType = ON_REG;							
-								// Set mainGSM Connection Status
-								mainGSM.ConnStatus = SEARCHING;
-								break;
-							case 3:
-								// Set GSM Event:
-								EventType = ON_REG;							
-								// Set mainGSM Connection Status
-								mainGSM.ConnStatus = REG_DENIED;
-								break;
-							case 4:
-								// Set GSM Event:
-								EventType = ON_REG;							
-								// Set mainGSM Connection Status
-								mainGSM.ConnStatus = UNKOWN;
-								break;
-							case 5:
-								// Set GSM Event:
-								EventType = ON_REG;							
-								// Set mainGSM Connection Status
-								mainGSM.ConnStatus = ROAMING;
-								break;
-							default:
-								// Set GSM Event:
-								EventType = ON_REG;							
-								// Set mainGSM Connection Status
-								mainGSM.ConnStatus = UNKOWN;
-								break;
-						}
-					}
-				}
-				
-				break;
+				// The <CR><LF> left by a reply are not a message
+				GSMConsume(start);
 			}
-			// Scan for "+KTCP_NOTIF:..." message or +KTCP_DATA
-			else if(strstr(unsolStr, "+KTC")!=NULL)
+			break;
+		}
+		
+		len = end + 1 - start;
+		GSMConsume(start);
+		if (len >= sizeof(UnsolBuffer))
+		{
+			// Too long for any unsolicited code
+			GSMConsume(len);
+		}
+		else
+		{
+			GSMRead(UnsolBuffer, len);
+			UnsolBuffer[len] = '\0';
+			
+			for (i = 0; i < UNSOL_CODES; i++)
 			{
-				vTaskDelay(20);
-				
-				// Search the first LineFeed and put the string inside UnsolBuffer
-				int res = GSMReadN(20, '\n', 1, UnsolBuffer);
-				
-				if(strstr(UnsolBuffer, "P_NOTIF:") != NULL)
-				{			
-					//+KTCP_NOTIF
-					// response: +KTCP_NOTIF:<session_id>,<tcp_notif>
-					// <tcp_notif>
-					// 0- Network error 
-					// 1- No more sockets available; max. number already reached 
-					// 2- Memory problem  
-					// 3- DNS error 
-					// 4-TCP disconnection by the server or remote client
-					// 5-TCP connection error 
-					// 6- Generic error 
-					// 7- Fail to accept client requests 
-					// 8- Data sending is OK but KTCPSND was waiting more or less characters 
-					// 9- Bad session ID 
-					// 10- Session is already running 
-					// 11- All sessions are used 
-
-					
-					// Set xSocket.notif = tcp_notif
-					if(res == -1)
-					{
-						//ERROR:
-						_dbgwrite("ERROR GSMReadN +KTCP_NOTIF\r\n");
-						
-						// Execute Error Handler
-						ErrorHandler(errorType);
-					}
-					else
-					{
-						UnsolBuffer[res] = '\0';
-						char temp[5];
-						// get phone number
-						res = getfield(',', '\r', 4, 1, UnsolBuffer, temp, 500);
-						
-						if(res != 1)
-						{
-							// Execute Error Handler
-							ErrorHandler(errorType);
-						
-							break;
-						}
-						else
-						{				
-							xSocket->notif = atoi(temp);
-						}
-					}
-				}
-				else if(strstr(UnsolBuffer, "P_DATA:") != NULL)// Ignore +KTCP_DATA
+				if (strncmp(UnsolBuffer, unsolCodes[i].prefix, strlen(unsolCodes[i].prefix)) == 0)
 				{
-					//+KTCP_DATA
-					// response: +KTCP_DATA:<session_id>,<rxLen>
-					// <rxLen>
-					
-					// Set xSocket.notif = tcp_notif
-					if(res == -1)
-					{
-						//ERROR:
-						_dbgwrite("ERROR GSMReadN +KTCP_DATA\r\n");
-
-						// Execute Error Handler
-						ErrorHandler(errorType);
-					}
-					else
-					{
-						UnsolBuffer[res] = '\0';
-						char temp[7];
-						// get phone number
-						res = getfield(',', '\r', 6, 1, UnsolBuffer, temp, 500);
-						
-						if(res != 1)
-						{
-							// Execute Error Handler
-							ErrorHandler(errorType);
-						
-							break;
-						}
-						else
-						{				
-							xSocket->rxLen = atoi(temp);
-						}
-					}
-				}
-				break;
-			}			
-			// Scan for "+KFTP_ERROR:<session_id>,<ftpError>..." message or 
-			// +KFTP_SND_DONE:<session_id> or +KFTP_SND_ERROR:<session_id>,<ftp_error> or
-			// +KFTP_RCV_DONE:<session_id> or +KFTP_RCV_ERROR:<session_id>,<ftp_error> 
-			else if(strstr(unsolStr, "+KFT")!=NULL)
-			{
-				vTaskDelay(20);
-
-				// Search the first LineFeed and put the string inside UnsolBuffer
-				int res = GSMReadN(20, '\n', 1, UnsolBuffer);
-
-				if(strstr(UnsolBuffer, "P_ERROR :") != NULL)
-				{			
-					// response: +KFTP_ERROR:<session_id>,<ftp_error>
-					// <ftp_error>
-					
-					// xFTPSocket
-					// Set xFTPSocket.ftpError = ftp_error
-					if(res == -1)
-					{
-						//ERROR:
-						_dbgwrite("ERROR GSMReadN +KFTP_ERROR\r\n");
-				
+					if (!unsolCodes[i].parse())
 						// Execute Error Handler
 						ErrorHandler(errorType);
-					}
-					else
-					{
-						UnsolBuffer[res] = '\0';
-						char temp[5];
-						// get phone number
-						res = getfield(',', '\r', 4, 1, UnsolBuffer, temp, 500);
-						
-						if(res != 1)
-						{
-							// Execute Error Handler
-							ErrorHandler(errorType);
-						
-							break;
-						}
-						else
-						{				
-							xFTPSocket->ftpError = atoi(temp);
-						}
-					}
-				}
-			}	
-			// Message not understood, shift one char over and tries again
-			else
-			{	
-				if(errorType == NO_ERR)
-				{
-					int i;
-					for(i = 1; i < 4; i++)
-						unsolStr[i-1] = unsolStr[i];
-					GSMRead(&unsolStr[3], 1);
-				}
-				else if(errorType == CMD_UNEXPECTED)
-				{
-					int i;
-					for(i = 1; i < 4; i++)
-						unsolStr[i-1] = unsolStr[i];
-					GSMRead(&unsolStr[3], 1);
+					break;
 				}
 			}
-		}	
-	}	
+		}
+		
+		if (errorType != NO_ERR)
+			break;
+	}
+	
 	// If the UnsolParsing generated a GSM Event, launch the event handler
 	if (EventType != NO_EVENT)
 	{
@@ -1751,18 +1955,20 @@ int echoFind(const char* echoStr)
 	// 200-4 max echo to find... to be defined!
 	char echoBuff[200];
 	int lenStr = strlen(echoStr);
+	char c;
 	
-	GSMpRead(echoBuff, lenStr);
-	echoBuff[lenStr] = '\0';
-		
-	if(strstr(echoBuff, echoStr)!=NULL)
+	// <CR><LF> left by the end of the previous reply are not part of the echo
+	while ((GSMpSeek(0, 1, &c) == TRUE) && ((c == '\r') || (c == '\n')))
+		GSMConsume(1);
+	
+	// The echo is searched in place, inside the first lenStr chars of GSMBuffer
+	if(GSMSearch(0, lenStr, echoStr) >= 0)
 	{
 		// Flush GSMBuffer of the same size of string read...
-		GSMRead(echoBuff, lenStr);
-		echoBuff[lenStr] = '\0';
+		GSMConsume(lenStr);
 		return 0;
 	}
-	else if(strstr(echoBuff, "ERROR") != NULL)
+	else if(GSMSearch(0, lenStr, "ERROR") >= 0)
 	{
 		// Reply present! Read until the lineNumber occurrence of '\n' char are found...
 		int cc = GSMReadN(200, '\n', 2, echoBuff);
@@ -1773,7 +1979,7 @@ int echoFind(const char* echoStr)
 		mainGSMStateMachine = SM_GSM_IDLE;
 		return 1;
 	}
-	else if(strstr(echoBuff, "+CMS ") != NULL)
+	else if(GSMSearch(0, lenStr, "+CMS ") >= 0)
 	{
 		// Reply present! Read until the lineNumber occurrence of '\n' char are found...
 		int cc = GSMReadN(200, '\n', 2, echoBuff);
@@ -1798,7 +2004,7 @@ int echoFind(const char* echoStr)
 		}	
 		return 2;
 	}
-	else if(strstr(echoBuff, "+CME ") != NULL)
+	else if(GSMSearch(0, lenStr, "+CME ") >= 0)
 	{
 		// Reply present! Read until the lineNumber occurrence of '\n' char are found...
 		int cc = GSMReadN(200, '\n', 2, echoBuff);
@@ -1841,11 +2047,10 @@ int getAnswer(const char* answer2src, int lineNumber, char* replyBuffer)
 {
 	// Answer is in format:
 	// <CR><LF><response><CR><LF>
-	int lenStr = strlen(answer2src);
-	GSMpRead(replyBuffer, lenStr+2);
-	replyBuffer[lenStr+2] = '\0';
+	// The answer is searched in place, inside the first lenStr+2 chars of GSMBuffer
+	int lenStr = strlen(answer2src) + 2;
 
-	if(strstr(replyBuffer, answer2src) != NULL)
+	if(GSMSearch(0, lenStr, answer2src) >= 0)
 	{
 		// Reply present! Read until the lineNumber occurrence of '\n' char are found...
 		int cc = GSMReadN(200, '\n', lineNumber, replyBuffer);
@@ -1853,7 +2058,7 @@ int getAnswer(const char* answer2src, int lineNumber, char* replyBuffer)
 
 		return 0;
 	}
-	else if(strstr(replyBuffer, "+CMS") != NULL)
+	else if(GSMSearch(0, lenStr, "+CMS") >= 0)
 	{
 		// Reply present! Read until the lineNumber occurrence of '\n' char are found...
 		int cc = GSMReadN(200, '\n', 2, replyBuffer);
@@ -1878,7 +2083,7 @@ int getAnswer(const char* answer2src, int lineNumber, char* replyBuffer)
 		}	
 		return 2;
 	}
-	else if(strstr(replyBuffer, "+CME") != NULL)
+	else if(GSMSearch(0, lenStr, "+CME") >= 0)
 	{
 		// Reply present! Read until the lineNumber occurrence of '\n' char are found...
 		int cc = GSMReadN(200, '\n', 2, replyBuffer);
@@ -1903,7 +2108,7 @@ int getAnswer(const char* answer2src, int lineNumber, char* replyBuffer)
 		}	
 		return 3;	
 	}
-	else if(strstr(replyBuffer, "NO C") != NULL)
+	else if(GSMSearch(0, lenStr, "NO C") >= 0)
 	{
 		// Reply present! Read until the lineNumber occurrence of '\n' char are found...
 		int cc = GSMReadN(200, '\n', 2, replyBuffer);
@@ -1915,7 +2120,7 @@ int getAnswer(const char* answer2src, int lineNumber, char* replyBuffer)
 		return 4;
 	}
 	
-	else if(strstr(replyBuffer, "+KSM")!=NULL)
+	else if(GSMSearch(0, lenStr, "+KSM") >= 0)
 	{
 		// Reply present! Read until the lineNumber occurrence of '\n' char are found...
 		int cc = GSMReadN(200, '\n', 2, replyBuffer);
@@ -1941,7 +2146,7 @@ int getAnswer(const char* answer2src, int lineNumber, char* replyBuffer)
 		return 3;	
 	}
 	
-	else if(strstr(replyBuffer, "+KFT")!=NULL)
+	else if(GSMSearch(0, lenStr, "+KFT") >= 0)
 	{
 		// Reply present! Read until the lineNumber occurrence of '\n' char are found...
 		int cc = GSMReadN(200, '\n', 2, replyBuffer);
@@ -1968,7 +2173,7 @@ int getAnswer(const char* answer2src, int lineNumber, char* replyBuffer)
 		return 3;
 	}
 	
-	else if(strstr(replyBuffer, "ERRO") != NULL)
+	else if(GSMSearch(0, lenStr, "ERRO") >= 0)
 	{
 		// Reply present! Read until the lineNumber occurrence of '\n' char are found...
 		int cc = GSMReadN(200, '\n', 2, replyBuffer);
@@ -1988,6 +2193,36 @@ int getAnswer(const char* answer2src, int lineNumber, char* replyBuffer)
 }
 
 
+// Returns TRUE if GSMBuffer starts with the answer, as getAnswer searches it,
+// but less than lineNumber '\n' chars of it were received
+static BOOL AnswerPartial(const char* answer2src, int lineNumber)
+{
+	int limit = GSMBufferSize();
+	int pos = -1;
+	
+	if(GSMSearch(0, strlen(answer2src) + 2, answer2src) < 0)
+		return FALSE;
+	if(limit > 200)
+		limit = 200;
+	while(lineNumber-- > 0)
+	{
+		pos = GSMFind(pos + 1, limit, '\n');
+		if(pos < 0)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+// Waits for more chars of a reply. The multiplexer is served meanwhile, so that
+// a long command does not delay the flow control of CMUX_DATA.
+static void ReplyWait()
+{
+#if GSM_CMUX
+	CmuxPoll();
+#endif
+	vTaskDelay(10);
+}
+
 /**
  * CheckCmd - 	Check if GSM received echo message (written inside msg). 
  				This functions searches the '\r' char inside GSMBuffer using GSMpSeek, and after uses getAnswer
@@ -2005,20 +2240,22 @@ int CheckCmd(int countData, int chars2read, const DWORD tick, char* reply, const
 	// Check timeout	
 	while((TickGetDiv64K() - tick) < maxtimeout)
 	{
-		// Seek GSMBuffer to search '\r' character...
-		if(GSMpSeek(countData, 1, reply) == TRUE)
-		{			
-			if(reply[0] == '\r')
-			{
+		// Search the '\r' character inside the chars of GSMBuffer not yet scanned...
+		int end = GSMBufferSize();
+		if(GSMFind(countData, end, '\r') >= 0)
+		{
+			// The answer is read once all its lines arrived, or its last chars
+			// would be left before the next reply
+			if(!AnswerPartial(msg, chars2read))
 				return getAnswer(msg, chars2read, reply);
-			}	
-			else
-				countData++;
+			ReplyWait();
 		}
 		else
 		{
 			// do not increase buffer, but wait a while to increase buffer
-			vTaskDelay(10);
+			if(end > countData)
+				countData = end;
+			ReplyWait();
 		}
 	}
 	
@@ -2042,21 +2279,19 @@ int CheckEcho(int countData, const DWORD tick, char* reply, const char* msg, con
 	// Check timeout	
 	while((TickGetDiv64K() - tick) < maxtimeout)
 	{
-		// Seek GSMBuffer to search '\r' character...
-		if(GSMpSeek(countData, 1, reply) == TRUE)
+		// Search the '\r' character inside the chars of GSMBuffer not yet scanned...
+		int end = GSMBufferSize();
+		if(GSMFind(countData, end, '\r') >= 0)
 		{
-			if(reply[0] == '\r')
-			{
-				return echoFind(msg);
-			}	
-			else
-				countData++;
+			return echoFind(msg);
 		}
 		else
 		{
 			// do not increase buffer, but wait a while to increase buffer
-			vTaskDelay(10);
-		}	
+			if(end > countData)
+				countData = end;
+			ReplyWait();
+		}
 	}
 	
 	// Timeout
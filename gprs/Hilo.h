@@ -73,6 +73,45 @@
 #define GSM_BUFFER_SIZE   1512
 #endif
 
+// Room left in GSMBuffer when GSMRxInt raises RTS, for the chars the modem sends before it stops
+#ifndef GSM_RX_HEADROOM
+#define GSM_RX_HEADROOM	32
+#endif
+
+// Longest sleep of the GSM Task with nothing to do, in ms. It is woken up before
+// by the modem UART or by a new command.
+#ifndef GSM_IDLE_TIMEOUT
+#define GSM_IDLE_TIMEOUT	100
+#endif
+
+// 1 runs the Hilo UART as a GSM 07.10 multiplexer (see Cmux.c): the AT commands and the
+// socket in transparent mode get their own channels, and do not wait for each other
+#ifndef GSM_CMUX
+#define GSM_CMUX	0
+#endif
+
+#include "Cmux.h"
+
+// 1 records the AT channel and the commands of the GSM Task with their time (see Trace.c),
+// for the command latencies
+#ifndef GSM_TRACE
+#define GSM_TRACE	0
+#endif
+
+#include "Trace.h"
+
+// Highest speed of the Hilo UART, negotiated by HiloStdModeOn with AT+IPR among baudHigh (Main.c).
+// 115200 keeps the speed the module starts with.
+#ifndef GSM_BAUD
+#define GSM_BAUD	921600
+#endif
+
+// Largest error of a speed made by the UART, in tenths of percent. At 16 MIPS, 230400 is 2.1% off
+// and 460800 is 3.5% off.
+#ifndef GSM_BAUD_TOL
+#define GSM_BAUD_TOL	25
+#endif
+
 // Size of the stack for GSM
 #define STACK_SIZE_GSM	(configMINIMAL_STACK_SIZE * 5)	
 
@@ -91,9 +130,11 @@ void ErrorHandler(int errorType);
 
 // GSM UART/modem related functions
 void GSMRxInt();
+void GSMTxInt();
 void HiloReset();
 void HiloPok();
 void HiloUARTInit(long int baud);
+long int HiloBaud();
 void HiloInit(long int baud);
 int  HiloTestBaud(long int baud);
 void GSMFlush();
@@ -102,8 +143,15 @@ int  GSMRead(char*, int);
 int  GSMpRead(char*, int);
 int  GSMReadN(int maxlen, char term, int occurr, char* destbuff);
 BOOL GSMpSeek(int start, int num, char* destBuff);
+int  GSMPeekSpan(int offset, char** span);
+void GSMConsume(int count);
+int  GSMFind(int start, int end, char c);
+int  GSMSearch(int start, int end, const char* str);
 void GSMWrite(char* data2wr);
 void GSMWriteCh(char chr);
+void GSMWriteN(const char* data, int len);
+void GSMWriteRaw(const char* data, int len);
+int  findStr(char* str, int vTaskTimeout);
 
 // Parsing helper functions
 int echoFind(const char* echoStr);
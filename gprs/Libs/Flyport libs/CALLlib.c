@@ -190,40 +190,16 @@ int cCALLHangUp()
  */
 void CALLHangUp()
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-		
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			
-			// Set mainOpStatus parameters
-			mainOpStatus.Function = 10;
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			// Nothing to set...
-						
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);					//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(10, NULL);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -299,6 +275,17 @@ int cCALLVoiceStart()
 }
 /// @endcond
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	CALLVoiceStart params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pCALLVoiceStart(GSMCmd* cmd)
+{
+	strcpy(mainCall.CallerID, cmd->Arg[0]);
+}
+/// @endcond
+
 /**
  * Starts a voice call to provided call id.
  * \param the char[] with call id
@@ -306,38 +293,19 @@ int cCALLVoiceStart()
  */
 void CALLVoiceStart(char* phoneNumber)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-		
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			// Set mainOpStatus parameters
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 11;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			strcpy(mainCall.CallerID, phoneNumber);
-						
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(11, pCALLVoiceStart);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = phoneNumber;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 /*! @} */
 
@@ -87,6 +87,22 @@ DATAlib contains the functions to setup APN parameters
 
 */
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	APNConfig params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pAPNConfig(GSMCmd* cmd)
+{
+	xApn = cmd->Arg[0];
+	xLogin = cmd->Arg[1];
+	xPassw = cmd->Arg[2];
+	xIp = cmd->Arg[3];
+	xDns1 = cmd->Arg[4];
+	xDns2 = cmd->Arg[5];
+}
+/// @endcond
+
 /**
  * Configures APN params for data connections. Please, contact your SIM mobile operator to retrive more info.
  * \param apn - APN host name
@@ -99,42 +115,24 @@ DATAlib contains the functions to setup APN parameters
  */
 void APNConfig(char* apn, char* login, char* passw, char* ip, char* dns1, char* dns2)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 26;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xApn = apn;
-			xLogin = login;
-			xPassw = passw;
-			xIp = ip;
-			xDns1 = dns1;
-			xDns2 = dns2;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(26, pAPNConfig);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = apn;
+	cmd->Arg[1] = login;
+	cmd->Arg[2] = passw;
+	cmd->Arg[3] = ip;
+	cmd->Arg[4] = dns1;
+	cmd->Arg[5] = dns2;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 
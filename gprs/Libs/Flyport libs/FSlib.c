@@ -88,6 +88,19 @@ FSlib contains the functions to manage Hilo internal flash files
 
 */
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	FSWrite params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pFSWrite(GSMCmd* cmd)
+{
+	xFSFilename = cmd->Arg[0];
+	xFSBuffer = cmd->Arg[1];
+	xFSDatasize = cmd->Val[0];
+}
+/// @endcond
+
 /**
  * Writes data on a file. If files exists, this function overrides all data.
  * \param filename - char[] with name of file to write
@@ -97,39 +110,21 @@ FSlib contains the functions to manage Hilo internal flash files
  */
 void FSWrite(char* filename, BYTE* dataBuffer, unsigned int dataSize)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 30;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xFSFilename = filename;
-			xFSBuffer = dataBuffer;
-			xFSDatasize = dataSize;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(30, pFSWrite);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = filename;
+	cmd->Arg[1] = dataBuffer;
+	cmd->Val[0] = dataSize;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -184,11 +179,7 @@ int cFSWrite()
 			else
 			{
 				int dummyLen = strlen(xFSFilename) + strlen(sizeStr) + 4;
-				while(dummyLen > 0)
-				{
-					GSMRead(cmdReply, 1);
-					dummyLen--;
-				}
+				GSMConsume(dummyLen);
 				cmdReply[0] = '\0';
 			}
 			
@@ -246,6 +237,19 @@ int cFSWrite()
 }
 /// @endcond
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	FSRead params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pFSRead(GSMCmd* cmd)
+{
+	xFSFilename = cmd->Arg[0];
+	xFSBuffer = cmd->Arg[1];
+	xFSDatasize = cmd->Val[0];
+}
+/// @endcond
+
 /**
  * Reads data from a file. 
  * \param filename - char[] with name of file to read
@@ -255,39 +259,21 @@ int cFSWrite()
  */
 void FSRead(char* filename, BYTE* dataBuffer, unsigned int dataSize)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 31;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xFSFilename = filename;
-			xFSBuffer = dataBuffer;
-			xFSDatasize = dataSize;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(31, pFSRead);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = filename;
+	cmd->Arg[1] = dataBuffer;
+	cmd->Val[0] = dataSize;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -342,11 +328,7 @@ int cFSRead()
 			else
 			{
 				int dummyLen = strlen(xFSFilename) + strlen(sizeStr) + 2;
-				while(dummyLen > 0)
-				{
-					GSMRead(cmdReply, 1);
-					dummyLen--;
-				}
+				GSMConsume(dummyLen);
 				cmdReply[0] = '\0';
 			}
 			
@@ -366,16 +348,9 @@ int cFSRead()
 			else
 			{
 				// Read data from file
-				int rxCount = 0;
+				int rxCount = GSMRead((char*)xFSBuffer, xFSDatasize);
 				
-				while(rxCount < xFSDatasize)
-				{
-					char tmp[2];
-					GSMRead(tmp, 1);
-					*(xFSBuffer+rxCount) = tmp[0];
-					rxCount++;
-				}
-				*(xFSBuffer+xFSDatasize) = '\0';
+				*(xFSBuffer+rxCount) = '\0';
 				// Set tcpReadBufferCount as the effective number of BYTEs read
 				xFSDatasize = rxCount;
 			}
@@ -411,6 +386,17 @@ int cFSRead()
 }
 /// @endcond
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	FSDelete params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pFSDelete(GSMCmd* cmd)
+{
+	xFSFilename = cmd->Arg[0];
+}
+/// @endcond
+
 /**
  * Deletes file from flash memory. 
  * \param filename - char[] with name of file to delete
@@ -418,37 +404,19 @@ int cFSRead()
  */
 void FSDelete(char* filename)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 32;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xFSFilename = filename;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(32, pFSDelete);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = filename;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -500,11 +468,7 @@ int cFSDelete()
 			else
 			{
 				int dummyLen = strlen(xFSFilename) + 4;
-				while(dummyLen > 0)
-				{
-					GSMRead(cmdReply, 1);
-					dummyLen--;
-				}
+				GSMConsume(dummyLen);
 				cmdReply[0] = '\0';
 			}
 			
@@ -539,6 +503,18 @@ int cFSDelete()
 /// @endcond
 
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	FSSize params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pFSSize(GSMCmd* cmd)
+{
+	xFSFilename = cmd->Arg[0];
+	xFSSize = cmd->Arg[1];
+}
+/// @endcond
+
 /**
  * Provide file size (in bytes). 
  * \param filename - char[] with name of file
@@ -547,38 +523,20 @@ int cFSDelete()
  */
 void FSSize(char* filename, int* dataSize)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 33;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xFSFilename = filename;
-			xFSSize = dataSize;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(33, pFSSize);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = filename;
+	cmd->Arg[1] = dataSize;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -630,11 +588,7 @@ int cFSSize()
 			else
 			{
 				int dummyLen = strlen(xFSFilename) + 4;
-				while(dummyLen > 0)
-				{
-					GSMRead(cmdReply, 1);
-					dummyLen--;
-				}
+				GSMConsume(dummyLen);
 				cmdReply[0] = '\0';
 			}
 			
@@ -701,6 +655,19 @@ int cFSSize()
 /// @endcond
 
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	FSAppend params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pFSAppend(GSMCmd* cmd)
+{
+	xFSFilename = cmd->Arg[0];
+	xFSBuffer = cmd->Arg[1];
+	xFSDatasize = cmd->Val[0];
+}
+/// @endcond
+
 /**
  * Appends data on a file.
  * \param filename - char[] with name of file to write
@@ -710,39 +677,21 @@ int cFSSize()
  */
 void FSAppend(char* filename, BYTE* dataBuffer, unsigned int dataSize)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 34;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xFSFilename = filename;
-			xFSBuffer = dataBuffer;
-			xFSDatasize = dataSize;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(34, pFSAppend);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = filename;
+	cmd->Arg[1] = dataBuffer;
+	cmd->Val[0] = dataSize;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -797,11 +746,7 @@ int cFSAppend()
 			else
 			{
 				int dummyLen = strlen(xFSFilename) + strlen(sizeStr) + 4;
-				while(dummyLen > 0)
-				{
-					GSMRead(cmdReply, 1);
-					dummyLen--;
-				}
+				GSMConsume(dummyLen);
 				cmdReply[0] = '\0';
 			}
 			
@@ -96,6 +96,22 @@ static BOOL xFTPAppeMode = FALSE;
 Provides FTP Client functions
 */
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	FTPConfig params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pFTPConfig(GSMCmd* cmd)
+{
+	xFTPSocket = cmd->Arg[0];
+	xFTPSocket->ftpError = 0;
+	xFTPServName = cmd->Arg[1];
+	xFTPLogin = cmd->Arg[2];
+	xFTPPassw = cmd->Arg[3];
+	xFTPPort = cmd->Val[0];
+}
+/// @endcond
+
 /**
  * Configures FTP Server parameters
  * \param FTP_SOCKET to be used for connection
@@ -107,42 +123,23 @@ Provides FTP Client functions
  */
 void FTPConfig(FTP_SOCKET* ftpSocket, char* serverName, char* login, char* password, WORD portNumber)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 12;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xFTPSocket = ftpSocket;
-			xFTPSocket->ftpError = 0;
-			xFTPServName = serverName;
-			xFTPLogin = login;
-			xFTPPassw = password;
-			xFTPPort = portNumber;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(12, pFTPConfig);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = ftpSocket;
+	cmd->Arg[1] = serverName;
+	cmd->Arg[2] = login;
+	cmd->Arg[3] = password;
+	cmd->Val[0] = portNumber;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -252,6 +249,21 @@ int cFTPConfig()
 /// @endcond
 
 // In FTP Receive path, we will use always the "ftp" directory
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	FTPReceive params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pFTPReceive(GSMCmd* cmd)
+{
+	xFTPSocket = cmd->Arg[0];
+	xFTPFlashLoc = cmd->Val[0];
+	xFTPServPath = cmd->Arg[1];
+	xFTPServFilename = cmd->Arg[2];
+	xFTPServFileSize = cmd->Val[1];
+}
+/// @endcond
+
 /**
  * Download a file from FTP Server
  * \param FTP_SOCKET to be used for connection
@@ -262,41 +274,23 @@ int cFTPConfig()
  */
 void FTPReceive(FTP_SOCKET* ftpSocket, unsigned long flashLoc, char* serverPath, char* serverFilename, long fileSize)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 13;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xFTPSocket = ftpSocket;
-			xFTPFlashLoc = flashLoc;
-			xFTPServPath = serverPath;
-			xFTPServFilename = serverFilename;
-			xFTPServFileSize = fileSize;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(13, pFTPReceive);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = ftpSocket;
+	cmd->Arg[1] = serverPath;
+	cmd->Arg[2] = serverFilename;
+	cmd->Val[0] = flashLoc;
+	cmd->Val[1] = fileSize;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -376,13 +370,19 @@ int cFTPReceive()
 				
 				while(1)
 				{
-					char tmp[1];
-					if (rxCount > 0 && GSMRead(tmp, 1) == 1) {
-						SPIFlashWrite((BYTE)tmp[0]);
-						rxCount--;
-						if (nCount++ == 1024) {
+					char* span;
+					int len = (rxCount > 0) ? GSMPeekSpan(0, &span) : 0;
+					if (len > 0) {
+						// Write the contiguous chars of GSMBuffer straight to flash
+						if (len > rxCount)
+							len = rxCount;
+						SPIFlashWriteArray((BYTE*)span, len);
+						GSMConsume(len);
+						rxCount -= len;
+						nCount += len;
+						if (nCount >= 1024) {
 							IOPut(p18, toggle);
-							nCount = 0;
+							nCount -= 1024;
 							gsmDebugPrint("#");
 						}
 						if (rxCount == 0)
@@ -453,6 +453,21 @@ int cFTPReceive()
 }
 /// @endcond
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	FTPSend params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pFTPSend(GSMCmd* cmd)
+{
+	xFTPSocket = cmd->Arg[0];
+	xFTPFlashFilename = cmd->Arg[1];
+	xFTPServPath = cmd->Arg[2];
+	xFTPServFilename = cmd->Arg[3];
+	xFTPAppeMode = cmd->Val[0];
+}
+/// @endcond
+
 /**
  * Uploads a file to FTP Server
  * \param FTP_SOCKET to be used for connection
@@ -464,41 +479,23 @@ int cFTPReceive()
  */
 void FTPSend(FTP_SOCKET* ftpSocket, char* flashFilename, char* serverPath, char* serverFilename, BOOL appendMode)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 14;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xFTPSocket = ftpSocket;
-			xFTPFlashFilename = flashFilename;
-			xFTPServPath = serverPath;
-			xFTPServFilename = serverFilename;
-			xFTPAppeMode = appendMode;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(14, pFTPSend);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = ftpSocket;
+	cmd->Arg[1] = flashFilename;
+	cmd->Arg[2] = serverPath;
+	cmd->Arg[3] = serverFilename;
+	cmd->Val[0] = appendMode;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -566,11 +563,7 @@ int cFTPSend()
 			else
 			{
 				int dummyLen = strlen(xFTPFlashFilename) + strlen(xFTPServPath) + strlen(xFTPServFilename) + 14;
-				while(dummyLen > 0)
-				{
-					GSMRead(cmdReply, 1);
-					dummyLen--;
-				}
+				GSMConsume(dummyLen);
 				cmdReply[0] = '\0';
 			}
 			
@@ -677,6 +670,19 @@ int cFTPSend()
 }
 /// @endcond
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	FTPDelete params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pFTPDelete(GSMCmd* cmd)
+{
+	xFTPSocket = cmd->Arg[0];
+	xFTPServPath = cmd->Arg[1];
+	xFTPServFilename = cmd->Arg[2];
+}
+/// @endcond
+
 /**
  * Deletes a file from FTP Server
  * \param FTP_SOCKET to be used for connection
@@ -686,39 +692,21 @@ int cFTPSend()
  */
 void FTPDelete(FTP_SOCKET* ftpSocket, char* serverPath, char* serverFilename)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 15;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xFTPSocket = ftpSocket;
-			xFTPServPath = serverPath;
-			xFTPServFilename = serverFilename;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(15, pFTPDelete);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = ftpSocket;
+	cmd->Arg[1] = serverPath;
+	cmd->Arg[2] = serverFilename;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -777,11 +765,7 @@ int cFTPDelete()
 			else
 			{
 				int dummyLen = strlen(xFTPServPath) + strlen(xFTPServFilename) + 9;
-				while(dummyLen > 0)
-				{
-					GSMRead(cmdReply, 1);
-					dummyLen--;
-				}
+				GSMConsume(dummyLen);
 				cmdReply[0] = '\0';
 			}
 			
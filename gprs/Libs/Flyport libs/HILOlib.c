@@ -100,36 +100,18 @@ char* GSMGetIMEI()
  */
 void GSMHibernate()
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	if(mainGSMStateMachine == SM_GSM_HIBERNATE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 28;
-			mainOpStatus.ErrorCode = 0;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(28, NULL);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 
@@ -238,36 +220,18 @@ int cGSMHibernate()
  */
 void GSMSleep()
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
+	cmd = GSMCmdNew(28, NULL);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 28; //29;
-			mainOpStatus.ErrorCode = 0;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-			taskYIELD();
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
-	while (mainOpStatus.ExecStat == OP_EXECUTION);		// wait for callback Execution...	
+	LastExecWait(OP_WAIT_FOREVER);		// wait for callback Execution...	
 
 	if(mainGSMStateMachine == SM_GSM_HIBERNATE)
 	{
@@ -286,36 +250,18 @@ void GSMSleep()
  */
 void GSMOn()
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	if(mainGSMStateMachine != SM_GSM_HIBERNATE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 29;
-			mainOpStatus.ErrorCode = 0;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(29, NULL);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -335,34 +281,16 @@ int cGSMOn()
  */
 void GSMSignal()
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 35;
-			mainOpStatus.ErrorCode = 0;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(35, NULL);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
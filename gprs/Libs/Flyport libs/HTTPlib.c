@@ -123,6 +123,32 @@ void HTTPStatus(TCP_SOCKET* sock)
 	TCPStatus(sock);
 }
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	HTTPRequest params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pHTTPRequest(GSMCmd* cmd)
+{
+	xHTTPCode = 0;
+	xSocket = cmd->Arg[0];
+	
+	httpReqUrl = cmd->Arg[1];
+	httpReqType = cmd->Val[0];
+	httpWriteBuffer = cmd->Arg[2];
+	maxHTTPattempt = 10;
+	
+	if(cmd->Arg[3] != HTTP_NO_PARAM)
+	{
+		httpParams = cmd->Arg[3];
+	}
+	else
+	{
+		httpParams[0] = '\0';
+	}
+}
+/// @endcond
+
 /**
  * Sends a HTTP Request to host
  * \param TCP_SOCKET to use. <I>Please, remember to use the "&" operator</I>
@@ -138,52 +164,23 @@ void HTTPStatus(TCP_SOCKET* sock)
  */
 void HTTPRequest(TCP_SOCKET* sock, BYTE type, char* reqUrl, char* data2snd, char* param)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 27;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xHTTPCode = 0;
-			xSocket = sock;
-			
-			httpReqUrl = reqUrl;
-			httpReqType = type;
-			httpWriteBuffer = data2snd;
-			maxHTTPattempt = 10;
-			
-			if(param != HTTP_NO_PARAM)
-			{
-				httpParams = param;
-			}
-			else
-			{
-				httpParams[0] = '\0';
-			}
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(27, pHTTPRequest);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = sock;
+	cmd->Arg[1] = reqUrl;
+	cmd->Arg[2] = data2snd;
+	cmd->Arg[3] = param;
+	cmd->Val[0] = type;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -40,6 +40,13 @@ void __attribute__((interrupt, no_auto_psv)) _U4RXInterrupt(void)
 #endif
 }
 
+void __attribute__((interrupt, no_auto_psv)) _U4TXInterrupt(void)
+{
+#if defined (FLYPORTGPRS)
+    GSMTxInt();
+#endif
+}
+
 
 void __attribute__((interrupt, auto_psv)) _DefaultInterrupt(void)
 {
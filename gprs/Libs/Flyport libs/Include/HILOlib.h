@@ -41,6 +41,9 @@
 #define		OP_FTP_ERR		7
 #define		OP_HIB_ERR		8
 
+// LastExecWait timeout that never expires
+#define		OP_WAIT_FOREVER	0xFFFFFFFFUL
+
 
 // Call Values Defines
 #define		CALL_READY		0
@@ -62,8 +65,17 @@
 
 extern BYTE LastConnStatus();
 extern int	LastExecStat();
+extern int	LastExecWait(DWORD timeout);
 extern int  LastErrorCode();
 
+struct GSMCmd;		// GSMData.h
+void GSMCmdInit();
+struct GSMCmd* GSMCmdNew(int function, void (*load)(struct GSMCmd*));
+void GSMCmdSubmit(struct GSMCmd* cmd);
+void GSMCmdDispatch(int execStat);
+void GSMCmdComplete();
+void GSMIdleWait();
+
 char* GSMGetIMEI();
 
 int cGSMHibernate(void);
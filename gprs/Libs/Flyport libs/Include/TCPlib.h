@@ -70,6 +70,18 @@ extern xSemaphoreHandle xSemFrontEnd;
 extern xSemaphoreHandle xSemHW;
 extern portBASE_TYPE xStatus;
 
+// TCP_STREAM_GUARD : Silence kept before and after the "+++" escape of TCPStreamStop, in milliseconds
+#ifndef TCP_STREAM_GUARD
+#define TCP_STREAM_GUARD	1100
+#endif
+
+// Scatter/gather segment, used by TCPWriteV
+typedef struct
+{
+	char*	buf;
+	int		len;
+} TCP_IOVEC;
+
 /*****************************************************************************
 	TCP function declarations	
 *****************************************************************************/
@@ -84,12 +96,29 @@ void TCPStatus(TCP_SOCKET* sock);
 int  cTCPStatus();
 
 void TCPWrite(TCP_SOCKET* sock, char* , int);
+void TCPWriteV(TCP_SOCKET* sock, TCP_IOVEC*, int);
 int  cTCPWrite();
 
 void TCPRxFlush(TCP_SOCKET* sock);
 int  cTCPRxFlush();
 
 void TCPRead(TCP_SOCKET* , char*, int);
+int  TCPReadCount();
 int  cTCPRead();
 
+void TCPStreamStart(TCP_SOCKET* sock);
+int  cTCPStreamStart();
+
+void TCPStreamDial(char* apn);
+int  cTCPStreamDial();
+
+void TCPStreamStop(TCP_SOCKET* sock);
+int  cTCPStreamStop();
+
+int  TCPStreamSize();
+int  TCPStreamRead(char* dest, int count);
+BOOL TCPStreamPeek(int start, int num, char* dest);
+int  TCPStreamWrite(char* data, int count);
+void TCPStreamFlush();
+
 #endif
@@ -66,7 +66,6 @@ extern OpStat	mainOpStatus;
 extern GSMModule mainGSM;
 
 extern int HiloStdModeOn(long int baud);
-extern const long int baudComp[8];
 
 static char* writeBuffer;
 static int writeBufferCount;
@@ -105,43 +104,23 @@ int cLLModeEnable()
  */
 void LLModeEnable()
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-		
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_LL)
-		{		
-			// Set mainOpStatus parameters
-			mainOpStatus.ExecStat = OP_LL;
-			if(mainGSMStateMachine != SM_GSM_LL_MODE)
-				mainGSMStateMachine = SM_GSM_LL_MODE;
-			mainOpStatus.Function = 18;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-						
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(18, NULL);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
 int cSTDModeEnable()
 {	
 	// Enter STD Mode:
-	int res = HiloStdModeOn(baudComp[7]); // 115200 baud...
+	int res = HiloStdModeOn(GSM_BAUD); // 115200 baud, then up to GSM_BAUD
+	
+	if(mainGSMStateMachine == SM_GSM_LL_MODE)
+		mainGSMStateMachine = SM_GSM_IDLE;
 	
 	mainOpStatus.ExecStat = OP_SUCCESS;
 	mainOpStatus.Function = 0;
@@ -160,39 +139,13 @@ int cSTDModeEnable()
  */
 void STDModeEnable()
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-		
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			if(mainGSMStateMachine == SM_GSM_LL_MODE)
-				mainGSMStateMachine = SM_GSM_IDLE;
-			
-			mainOpStatus.ExecStat = OP_EXECUTION;
-
-			// Set mainOpStatus parameters
-			// mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 19;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-						
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(19, NULL);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /**
@@ -245,14 +198,24 @@ int  LLRead(char *buffer , int count)
 /// @cond debug
 int cLLWrite()
 {
-	int c;
-	for (c = 0; c < writeBufferCount; c++)
-		GSMWriteCh(writeBuffer[c]);
+	GSMWriteN(writeBuffer, writeBufferCount);
 	
 	mainOpStatus.Function = 0;
 	mainOpStatus.ErrorCode = 0;
 		
-	return c;
+	return writeBufferCount;
+}
+/// @endcond
+
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	LLWrite params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pLLWrite(GSMCmd* cmd)
+{
+	writeBuffer = cmd->Arg[0];
+	writeBufferCount = cmd->Val[0];
 }
 /// @endcond
 
@@ -266,38 +229,20 @@ int cLLWrite()
  */
 void LLWrite(char *buffer, int count)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainOpStatus.ExecStat != OP_LL)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-		
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat == OP_LL)
-		{		
-			// Set mainOpStatus parameters
-			mainOpStatus.Function = 17;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			writeBuffer = buffer;
-			writeBufferCount = count;
-						
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(17, pLLWrite);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = buffer;
+	cmd->Val[0] = count;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /**
@@ -384,6 +384,21 @@ int cSMSSend()
 }
 /// @endcond 
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	SMSSend params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pSMSSend(GSMCmd* cmd)
+{
+	strcpy(mainSMS.Text, cmd->Arg[1]);
+	strcpy(mainSMS.Destination, cmd->Arg[0]);
+	
+	// Needed to set +CSMP parameters
+	ackSMSrequested = cmd->Val[0];
+}
+/// @endcond
+
 /**
  * Sends a SMS to provided phone number
  * \param char[] with phone number
@@ -397,41 +412,21 @@ int cSMSSend()
  */
 void SMSSend(char* phoneNumber, char* text, BOOL ack)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 1;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			strcpy(mainSMS.Text, text);
-			strcpy(mainSMS.Destination, phoneNumber);
-			
-			// Needed to set +CSMP parameters
-			ackSMSrequested = ack;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(1, pSMSSend);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = phoneNumber;
+	cmd->Arg[1] = text;
+	cmd->Val[0] = ack;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -811,6 +806,19 @@ int cSMSRead()
 }
 /// @endcond 
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	SMSRead params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pSMSRead(GSMCmd* cmd)
+{
+	smInternal = 0;
+	mainSMS.MemType = cmd->Val[1];
+	mainSMS.Index = cmd->Val[0];
+}
+/// @endcond
+
 /**
  * Fills SMS struct with SMS content
  * \param index of SMS to read
@@ -823,41 +831,20 @@ int cSMSRead()
  */
 void SMSRead(int indexMsg, BYTE memType)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			// Set mainOpStatus parameters
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 2;
-			mainOpStatus.ErrorCode = 0;	
-			smInternal = 0;
-			
-			// Set Params	
-			mainSMS.MemType = memType;
-			mainSMS.Index = indexMsg;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(2, pSMSRead);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Val[0] = indexMsg;
+	cmd->Val[1] = memType;
 	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -1010,6 +997,19 @@ int cSMSDelete()
 }
 /// @endcond 
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	SMSDelete params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pSMSDelete(GSMCmd* cmd)
+{
+	smInternal = 0;
+	mainSMS.MemType = cmd->Val[1];
+	mainSMS.Index = cmd->Val[0];
+}
+/// @endcond
+
 /**
  * Deletes SMS of provided memory and index
  * \param index of SMS to read
@@ -1022,40 +1022,20 @@ int cSMSDelete()
  */
 void SMSDelete(int indexMsg, BYTE memType)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-		
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			// Set mainOpStatus parameters
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 3;
-			mainOpStatus.ErrorCode = 0;
-			smInternal = 0;
-			
-			// Set Params	
-			mainSMS.MemType = memType;
-			mainSMS.Index = indexMsg;
-						
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(3, pSMSDelete);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Val[0] = indexMsg;
+	cmd->Val[1] = memType;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /*! @} */
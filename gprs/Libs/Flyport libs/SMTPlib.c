@@ -105,6 +105,21 @@ int LastSMTPSessionId()
 	return smtpLastSessionId;
 }
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	SMTPParamsSet params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pSMTPParamsSet(GSMCmd* cmd)
+{
+	smtpdomain = cmd->Arg[0];
+	smtpport = cmd->Val[0];
+	smtpsender = cmd->Arg[1];
+	smtplogin = cmd->Arg[2];
+	smtppassw = cmd->Arg[3];
+}
+/// @endcond
+
 /**
  * Sets SMTP parameter to use
  * \param char[] SMTP Domain name
@@ -116,41 +131,23 @@ int LastSMTPSessionId()
  */
 void SMTPParamsSet(char* smtpDomain, int smtpPort, char* senderEmail, char* smtpLogin, char* smtpPassw)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
-			
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 6;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			smtpdomain = smtpDomain;
-			smtpport = smtpPort;
-			smtpsender = senderEmail;
-			smtplogin = smtpLogin;
-			smtppassw = smtpPassw;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	
+	cmd = GSMCmdNew(6, pSMTPParamsSet);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = smtpDomain;
+	cmd->Arg[1] = senderEmail;
+	cmd->Arg[2] = smtpLogin;
+	cmd->Arg[3] = smtpPassw;
+	cmd->Val[0] = smtpPort;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 
@@ -432,6 +429,20 @@ int  cSMTPParamsSet()
 /// @endcond
 
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	SMTPEmailTo params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pSMTPEmailTo(GSMCmd* cmd)
+{
+	smtpTo1 = cmd->Arg[0];
+	smtpTo2 = cmd->Arg[1];
+	smtpCc1 = cmd->Arg[2];
+	smtpCc2 = cmd->Arg[3];
+}
+/// @endcond
+
 /**
  * Sets email destination
  * \param char[] email of first destination
@@ -443,40 +454,22 @@ int  cSMTPParamsSet()
  */
 void SMTPEmailTo(char* toDest1, char* toDest2, char* ccDest1, char* ccDest2)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
-			
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 7;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			smtpTo1 = toDest1;
-			smtpTo2 = toDest2;
-			smtpCc1 = ccDest1;
-			smtpCc2 = ccDest2;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	
+	cmd = GSMCmdNew(7, pSMTPEmailTo);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = toDest1;
+	cmd->Arg[1] = toDest2;
+	cmd->Arg[2] = ccDest1;
+	cmd->Arg[3] = ccDest2;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -535,11 +528,7 @@ int  cSMTPEmailTo()
 				int flushNum = 	strlen(smtpTo2) + 
 								strlen(smtpCc1) + 
 								strlen(smtpCc2) + 10;
-				while(flushNum > 0)
-				{
-					GSMRead(cmdReply, 1);
-					flushNum--;	
-				}	
+				GSMConsume(flushNum);
 				cmdReply[0] = '\0';
 			}
 			
@@ -574,6 +563,19 @@ int  cSMTPEmailTo()
 /// @endcond
 
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	SMTPEmailSend params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pSMTPEmailSend(GSMCmd* cmd)
+{
+	smtpsubject = cmd->Arg[0];
+	smtpmsg = cmd->Arg[1];
+	smtpLastSessionId = 0;
+}
+/// @endcond
+
 /**
  * Sends email to destinations
  * \param char[] subject of email 
@@ -582,39 +584,20 @@ int  cSMTPEmailTo()
  */
 void SMTPEmailSend(char* subject, char* text)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
-			
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 8;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			smtpsubject = subject;
-			smtpmsg = text;
-			smtpLastSessionId = 0;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	
+	cmd = GSMCmdNew(8, pSMTPEmailSend);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = subject;
+	cmd->Arg[1] = text;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -666,11 +649,7 @@ int  cSMTPEmailSend()
 			else
 			{
 				int flushNum = strlen(smtpsubject) + 2;
-				while(flushNum > 0)
-				{
-					GSMRead(cmdReply, 1);
-					flushNum--;	
-				}	
+				GSMConsume(flushNum);
 				cmdReply[0] = '\0';
 			}
 			
@@ -807,35 +786,16 @@ int  cSMTPEmailSend()
  */
 void SMTPParamsClear()
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
-			
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 5;
-			mainOpStatus.ErrorCode = 0;
-			
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	
+	cmd = GSMCmdNew(5, NULL);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -77,7 +77,9 @@ static DWORD tick;
 extern char msg2send[200];
 extern char cmdReply[200];
 
-static char* tcpWriteBuffer;
+static TCP_IOVEC tcpWriteSingle;
+static TCP_IOVEC* tcpWriteIov;
+static int tcpWriteIovCount;
 static int tcpWriteBufferCount;
 static char* tcpReadBuffer;
 static int tcpReadBufferCount;
@@ -90,6 +92,25 @@ Provides TCP Client functions
 */
 
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	TCPClientOpen params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pTCPClientOpen(GSMCmd* cmd)
+{
+	char* tcpaddr = cmd->Arg[1];
+	int termChar = strlen(tcpaddr);
+	
+	xTCPPort = atoi(cmd->Arg[2]);
+	if(termChar > 100) // xIPAddress array size is 100
+		termChar = 100;
+	strncpy((char*)xIPAddress, tcpaddr, termChar);
+	xIPAddress[termChar] = '\0';
+	xSocket = cmd->Arg[0];
+}
+/// @endcond
+
 /**
  * Creates a TCP client on specified IP address and port
  * \param tcpaddr - IP address of the remote server. Example: "192.168.1.100" (the char array must be NULL terminated).
@@ -100,7 +121,7 @@ Provides TCP Client functions
  */
 void TCPClientOpen(TCP_SOCKET* sock, char* tcpaddr, char* tcpport)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
@@ -108,40 +129,17 @@ void TCPClientOpen(TCP_SOCKET* sock, char* tcpaddr, char* tcpport)
 	// Check if sock->number is INVALID SOCKET
 	if(sock->number != INVALID_SOCKET)
 		return;
-			
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 20;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xTCPPort = atoi(tcpport);
-			int termChar = strlen(tcpaddr);
-			if(termChar > 100) // xIPAddress array size is 100
-				termChar = 100;
-			strncpy((char*)xIPAddress, tcpaddr, termChar);
-			xIPAddress[termChar] = '\0';
-			xSocket = sock;
-			//xSocket->number = INVALID_SOCKET;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	
+	cmd = GSMCmdNew(20, pTCPClientOpen);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = sock;
+	cmd->Arg[1] = tcpaddr;
+	cmd->Arg[2] = tcpport;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -298,6 +296,17 @@ int cTCPClientOpen()
 }
 /// @endcond
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	TCPClientClose params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pTCPClientClose(GSMCmd* cmd)
+{
+	xSocket = cmd->Arg[0];
+}
+/// @endcond
+
 /**
  * Closes the client socket specified by the handle.
  * \param Sockclose - The handle of the socket to close (the handle returned by the command TCPClientOpen).
@@ -305,7 +314,7 @@ int cTCPClientOpen()
  */
 void TCPClientClose (TCP_SOCKET* sock)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
@@ -313,32 +322,14 @@ void TCPClientClose (TCP_SOCKET* sock)
 	if(sock->number == INVALID_SOCKET)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 21;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xSocket = sock;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(21, pTCPClientClose);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = sock;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -465,6 +456,23 @@ int cTCPClientClose()
 }
 /// @endcond
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	TCPRead params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pTCPRead(GSMCmd* cmd)
+{
+	xSocket = cmd->Arg[0];
+	tcpReadBuffer = cmd->Arg[1];
+	
+	// Set max of socket buffer size
+	tcpReadBufferCount = cmd->Val[0];
+	if(tcpReadBufferCount > 1460)
+		tcpReadBufferCount = 1460;
+}
+/// @endcond
+
 /**
  * Reads the specified number of characters from a TCP socket and puts them into the specified char array. <B>NOTE:</B> This function flushes the buffer after reading!
  * \param socktoread - The handle of the socket to read (the handle returned by the command TCPClientOpen or TCPServerOpen).
@@ -475,43 +483,30 @@ int cTCPClientClose()
  */
 void TCPRead(TCP_SOCKET* sock , char* readch , int rlen)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
+	cmd = GSMCmdNew(24, pTCPRead);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = sock;
+	cmd->Arg[1] = readch;
+	cmd->Val[0] = rlen;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
+}
 
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 24;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xSocket = sock;
-			tcpReadBuffer = readch;
-			
-			// Set max of socket buffer size
-			if(rlen > 1460)
-				rlen = 1460;
-			tcpReadBufferCount = rlen;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+/**
+ * Returns the number of characters the last TCPRead put in its char array, once it was successfully executed. It can be less than requested when the socket holds less data.
+ * \return The number of characters read.
+ */
+int TCPReadCount()
+{
+	return tcpReadBufferCount;
 }
 
 /// @cond debug
@@ -647,6 +642,7 @@ int cTCPRead()
 			if(xSocket->rxLen == 0)
 			{
 				// Break operation
+				tcpReadBufferCount = 0;
 				break;
 			}
 			// Send first AT command
@@ -701,12 +697,11 @@ int cTCPRead()
 				int retCount = 0;			
 				while(rxCount < tcpReadBufferCount)
 				{
-					char tmp[1];
-					retCount = GSMRead(tmp, 1);
-					if (retCount == 1) {
-						*(tcpReadBuffer+rxCount) = tmp[0];
+					retCount = GSMRead(tcpReadBuffer+rxCount, tcpReadBufferCount-rxCount);
+					if (retCount < 0)
+						retCount = -retCount;
+					if (retCount > 0)
 						rxCount += retCount;
-					}
 					else if ((TickGetDiv64K() - tick) < maxtimeout)
 						vTaskDelay(1);
 					else {
@@ -755,6 +750,22 @@ int cTCPRead()
 }
 /// @endcond
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	TCPWrite params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pTCPWrite(GSMCmd* cmd)
+{
+	xSocket = cmd->Arg[0];
+	tcpWriteSingle.buf = cmd->Arg[1];
+	tcpWriteSingle.len = cmd->Val[0];
+	tcpWriteIov = &tcpWriteSingle;
+	tcpWriteIovCount = 1;
+	tcpWriteBufferCount = cmd->Val[0];
+}
+/// @endcond
+
 /**
  * Writes an array of characters on the specified socket.
  * \param socktowrite - The socket to which data is to be written (it's the handle returned by the command TCPClientOpen or TCPServerOpen).
@@ -764,39 +775,65 @@ int cTCPRead()
  */
 void TCPWrite(TCP_SOCKET* sock , char* writech , int wlen)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
+	cmd = GSMCmdNew(23, pTCPWrite);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = sock;
+	cmd->Arg[1] = writech;
+	cmd->Val[0] = wlen;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
+}
 
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 23;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xSocket = sock;
-			tcpWriteBuffer = writech;
-			tcpWriteBufferCount = wlen;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	TCPWriteV params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pTCPWriteV(GSMCmd* cmd)
+{
+	int i;
+	
+	xSocket = cmd->Arg[0];
+	tcpWriteIov = cmd->Arg[1];
+	tcpWriteIovCount = cmd->Val[0];
+	tcpWriteBufferCount = 0;
+	for (i = 0; i < tcpWriteIovCount; i++)
+		tcpWriteBufferCount += tcpWriteIov[i].len;
+}
+/// @endcond
+
+/**
+ * Writes a list of buffers on the specified socket with a single AT+KTCPSND command.
+ * \param socktowrite - The socket to which data is to be written (it's the handle returned by the command TCPClientOpen or TCPServerOpen).
+ * \param iov - Array of segments to be written, in order. The array and the segments must stay valid until the operation is completed.
+ * \param iovcnt - The number of segments in iov.
+ * \return None.
+ */
+void TCPWriteV(TCP_SOCKET* sock , TCP_IOVEC* iov , int iovcnt)
+{
+	GSMCmd* cmd;
+	
+	if(mainGSM.HWReady != TRUE)
+		return;
+	
+	cmd = GSMCmdNew(23, pTCPWriteV);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = sock;
+	cmd->Arg[1] = iov;
+	cmd->Val[0] = iovcnt;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -870,13 +907,12 @@ int cTCPWrite()
 			}
 			else
 			{
-				int counterLen = 0;
+				int seg;
 				
-				while(counterLen < tcpWriteBufferCount) 
+				for(seg = 0; seg < tcpWriteIovCount; seg++)
 				{
-					GSMWriteCh(tcpWriteBuffer[counterLen]);
-					counterLen++;
-				}		
+					GSMWriteN(tcpWriteIov[seg].buf, tcpWriteIov[seg].len);
+				}
 				
 				// and write --EOF--Pattern-- (without \r)
 				GSMWrite("--EOF--Pattern--");
@@ -913,6 +949,17 @@ int cTCPWrite()
 }
 /// @endcond
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	TCPStatus params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pTCPStatus(GSMCmd* cmd)
+{
+	xSocket = cmd->Arg[0];
+}
+/// @endcond
+
 /**
  * Updates the status of a TCP socket.
  * \param sockconn - The handle of the socket to control.
@@ -920,37 +967,19 @@ int cTCPWrite()
  */
 void TCPStatus(TCP_SOCKET* sock)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 22;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xSocket = sock;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(22, pTCPStatus);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = sock;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -1090,6 +1119,17 @@ int cTCPStatus()
 }
 /// @endcond
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	TCPRxFlush params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pTCPRxFlush(GSMCmd* cmd)
+{
+	xSocket = cmd->Arg[0];
+}
+/// @endcond
+
 /**
  * Empty specified TCP socket RX Buffer.
  * \param sockflush - The handle of the socket to empty (the handle returned by the command TCPClientOpen or TCPServerOpen).
@@ -1097,37 +1137,19 @@ int cTCPStatus()
  */
 void TCPRxFlush(TCP_SOCKET* sock)
 {
-	BOOL opok = FALSE;
+	GSMCmd* cmd;
 	
 	if(mainGSM.HWReady != TRUE)
 		return;
 	
-	//	Function cycles until it is not executed
-	while (!opok)
-	{
-		while (xSemaphoreTake(xSemFrontEnd,0) != pdTRUE);		//	xSemFrontEnd TAKE
-
-		// Check mainOpStatus.ExecStat
-		if (mainOpStatus.ExecStat != OP_EXECUTION)
-		{		
-			mainOpStatus.ExecStat = OP_EXECUTION;
-			mainOpStatus.Function = 25;
-			mainOpStatus.ErrorCode = 0;
-			
-			// Set Params	
-			xSocket = sock;
-			
-			xQueueSendToBack(xQueue,&mainOpStatus.Function,0);	//	Send COMMAND request to the stack
-			
-			xSemaphoreGive(xSemFrontEnd);						//	xSemFrontEnd GIVE, the stack can answer to the command
-			opok = TRUE;
-		}
-		else
-		{
-			xSemaphoreGive(xSemFrontEnd);
-			taskYIELD();
-		}
-	}
+	cmd = GSMCmdNew(25, pTCPRxFlush);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = sock;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
 }
 
 /// @cond debug
@@ -1310,15 +1332,9 @@ int cTCPRxFlush()
 				else
 				{
 					// Read data from TCP Socket
-					int rxCount = 0;
+					int rxCount = tcpReadBufferCount;
 					
-					while(rxCount < tcpReadBufferCount)
-					{
-						char tmp[1];
-						GSMRead(tmp, 1);
-						//*(tcpReadBuffer+rxCount) = tmp[0];
-						rxCount++;
-					}
+					GSMConsume(rxCount);
 					
 					// Set tcpReadBufferCount as the effective number of BYTEs read
 					tcpReadBufferCount = rxCount;
@@ -1367,6 +1383,667 @@ int cTCPRxFlush()
 }
 /// @endcond
 
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	Channel of the socket in transparent mode. With GSM_CMUX it is CMUX_DATA, 
+//	and the GSM Task keeps running commands on CMUX_AT. Otherwise it is the
+//	Hilo UART itself, left by the GSM Task in LL mode.
+//****************************************************************************
+#if GSM_CMUX
+#define StreamFind(str)		CmuxDataFind(str)
+#define StreamConsume(num)	CmuxDataConsume(num)
+#define StreamSend(str)		CmuxWrite(CMUX_DATA, str, strlen(str))
+#else
+#define StreamFind(str)		GSMSearch(0, GSMBufferSize(), str)
+#define StreamConsume(num)	GSMConsume(num)
+#define StreamSend(str)		GSMWrite(str)
+#endif
+
+static DWORD streamTick;
+
+//****************************************************************************
+//	Only internal use:
+//	TCPStreamStart params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pTCPStreamStart(GSMCmd* cmd)
+{
+	xSocket = cmd->Arg[0];
+}
+/// @endcond
+
+/**
+ * Switches the connected socket to transparent mode (AT+KTCPSTART): the TCP data is then read and 
+ * written with TCPStreamRead and TCPStreamWrite, without AT+KTCPRCV and AT+KTCPSND.
+ * With GSM_CMUX the socket has its own channel of the multiplexer and the other commands keep working.
+ * Otherwise the socket takes the Hilo UART, like LL mode: until TCPStreamStop, unsolicited messages 
+ * are not handled and only LL functions are accepted.
+ * Once the module answered CONNECT, TCPStreamSize is no longer -1.
+ * \param sock - TCP_SOCKET of a connected socket.
+ * \return None.
+ */
+void TCPStreamStart(TCP_SOCKET* sock)
+{
+	GSMCmd* cmd;
+	
+	if(mainGSM.HWReady != TRUE)
+		return;
+	
+	if(sock->number == INVALID_SOCKET)
+		return;
+	
+	cmd = GSMCmdNew(36, pTCPStreamStart);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = sock;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
+}
+
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	cTCPStreamStart callback function
+//****************************************************************************
+#if GSM_CMUX
+int cTCPStreamStart()
+{
+	int pos;
+	
+	switch(smInternal)
+	{
+		case 0:
+			// ----------	TCP Transparent Mode, on the data channel	----------
+			CmuxDataFlush();
+			sprintf(msg2send, "AT+KTCPSTART=%d\r",xSocket->number);
+			
+			StreamSend(msg2send);
+			// Start timeout count
+			tick = TickGetDiv64K(); // 1 tick every seconds
+			maxtimeout = 30;
+			smInternal++;
+			
+		case 1:
+			// Get reply (CONNECT\r\n), after the echo
+			pos = StreamFind("CONNECT\r\n");
+			if(pos >= 0)
+			{
+				StreamConsume(pos + 9);
+				break;
+			}
+			if(StreamFind("ERROR") >= 0)
+			{
+				CmuxDataFlush();
+				CheckErr(1, &smInternal, &tick);
+				return mainOpStatus.ErrorCode;
+			}
+			if((TickGetDiv64K() - tick) > maxtimeout)
+			{
+				CheckErr(-2, &smInternal, &tick);
+				return mainOpStatus.ErrorCode;
+			}
+			vTaskDelay(1);
+			return -1;
+			
+		default:
+			break;
+	
+	}
+	
+	smInternal = 0;
+	CmuxDataOpen(TRUE);
+	// Cmd = 0 only if the last command successfully executed
+	mainOpStatus.ExecStat = OP_SUCCESS;
+	mainOpStatus.Function = 0;
+	mainOpStatus.ErrorCode = 0;
+	mainGSMStateMachine = SM_GSM_IDLE;
+	return -1;
+}
+#else
+int cTCPStreamStart()
+{
+	int resCheck = 0;
+	int countData;
+	int chars2read;
+	
+	switch(smInternal)
+	{
+		case 0:
+			// Check if Buffer is free
+			if(GSMBufferSize() > 0)
+			{
+				// Parse Unsol Message
+				mainGSMStateMachine = SM_GSM_CMD_PENDING;
+				return -1;
+			}
+			else
+				smInternal++;
+				
+		case 1:	
+			// Send first AT command
+			// ----------	TCP Transparent Mode	----------
+			sprintf(msg2send, "AT+KTCPSTART=%d\r",xSocket->number);
+			
+			GSMWrite(msg2send);
+			// Start timeout count
+			tick = TickGetDiv64K(); // 1 tick every seconds
+			maxtimeout = 30;
+			smInternal++;
+			
+		case 2:
+			vTaskDelay(1);
+			// Check ECHO 
+			countData = 0;
+			
+			resCheck = CheckEcho(countData, tick, cmdReply, msg2send, maxtimeout);
+						
+			CheckErr(resCheck, &smInternal, &tick);
+			
+			if(resCheck)
+			{
+				return mainOpStatus.ErrorCode;
+			}
+			
+		case 3:
+			// Get reply (\r\nCONNECT\r\n)
+			vTaskDelay(1);
+			sprintf(msg2send, "\r\nCONNECT");
+			chars2read = 2;
+			countData = 2; // GSM buffer should be: <CR><LF>CONNECT<CR><LF>
+			resCheck = CheckCmd(countData, chars2read, tick, cmdReply, msg2send, maxtimeout);
+			
+			CheckErr(resCheck, &smInternal, &tick);
+			
+			if(resCheck)
+			{
+				return mainOpStatus.ErrorCode;
+			}
+			
+		default:
+			break;
+	
+	}
+	
+	smInternal = 0;
+	// From now on the GSM Task leaves the UART to TCPStreamRead and TCPStreamWrite, as in LL mode
+	mainGSM.HWReady = FALSE;
+	mainOpStatus.ExecStat = OP_LL;
+	mainOpStatus.Function = 0;
+	mainOpStatus.ErrorCode = 0;
+	mainGSMStateMachine = SM_GSM_LL_MODE;
+	return -1;
+}
+#endif
+/// @endcond
+
+/**
+ * Returns the number of chars received in transparent mode, and not read yet.
+ * \return Number of chars, -1 if no socket is in transparent mode.
+ */
+int TCPStreamSize()
+{
+#if GSM_CMUX
+	if(!CmuxDataIsOpen())
+		return -1;
+	return CmuxDataSize();
+#else
+	if(mainGSMStateMachine != SM_GSM_LL_MODE)
+		return -1;
+	return LLBufferSize();
+#endif
+}
+
+/**
+ * Reads the chars received in transparent mode.
+ * \param dest - buffer to fill.
+ * \param count - max number of chars to read.
+ * \return Number of chars read, -1 if no socket is in transparent mode.
+ */
+int TCPStreamRead(char* dest, int count)
+{
+	if(TCPStreamSize() < 0)
+		return -1;
+#if GSM_CMUX
+	return CmuxDataRead(dest, count);
+#else
+	return LLRead(dest, count);
+#endif
+}
+
+/**
+ * Copies chars received in transparent mode, without removing them.
+ * \param start - position of the first char.
+ * \param num - number of chars.
+ * \param dest - buffer to fill.
+ * \return FALSE if the chars were not all received yet.
+ */
+BOOL TCPStreamPeek(int start, int num, char* dest)
+{
+	if(TCPStreamSize() < 0)
+		return FALSE;
+#if GSM_CMUX
+	return CmuxDataPeek(start, num, dest);
+#else
+	return GSMpSeek(start, num, dest);
+#endif
+}
+
+/**
+ * Sends chars on the socket in transparent mode, and waits until they are written to the Hilo UART.
+ * \param data - chars to send.
+ * \param count - number of chars.
+ * \return Number of chars sent, -1 if no socket is in transparent mode or the module failed.
+ */
+int TCPStreamWrite(char* data, int count)
+{
+	if(TCPStreamSize() < 0)
+		return -1;
+#if GSM_CMUX
+	CmuxWrite(CMUX_DATA, data, count);
+#else
+	LLWrite(data, count);
+	if(LastExecWait(OP_WAIT_FOREVER) != OP_LL)
+		return -1;
+#endif
+	return count;
+}
+
+/**
+ * Discards the chars received in transparent mode and not read yet.
+ * \return None.
+ */
+void TCPStreamFlush()
+{
+#if GSM_CMUX
+	if(CmuxDataIsOpen())
+		CmuxDataFlush();
+#else
+	LLFlush();
+#endif
+}
+
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	TCPStreamDial params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pTCPStreamDial(GSMCmd* cmd)
+{
+	char* apn = cmd->Arg[0];
+	int termChar = strlen(apn);
+	
+	if(termChar > 99) // xIPAddress array size is 100
+		termChar = 99;
+	memcpy(xIPAddress, apn, termChar);
+	xIPAddress[termChar] = '\0';
+}
+/// @endcond
+
+/**
+ * Opens a packet data call (ATD*99***1#) instead of a socket: the channel of TCPStreamStart then carries 
+ * the PPP frames of an IP stack running on the Flyport (see ppp/PPP.h), read and written with TCPStreamRead 
+ * and TCPStreamWrite. Any number of connections then share the call, without AT commands for their data.
+ * The call ends when PPP terminates the link (the module answers NO CARRIER), after which TCPStreamStop(NULL)
+ * gives the channel back, or with TCPStreamStop alone.
+ * Once the module answered CONNECT, TCPStreamSize is no longer -1.
+ * \param apn - Access Point Name of the call (the char array must be NULL terminated).
+ * \return None.
+ */
+void TCPStreamDial(char* apn)
+{
+	GSMCmd* cmd;
+	
+	if(mainGSM.HWReady != TRUE)
+		return;
+	
+	if(TCPStreamSize() >= 0)
+		return;
+	
+	cmd = GSMCmdNew(38, pTCPStreamDial);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = apn;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
+}
+
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	cTCPStreamDial callback function
+//****************************************************************************
+#if GSM_CMUX
+int cTCPStreamDial()
+{
+	int pos;
+	
+	switch(smInternal)
+	{
+		case 0:
+			// ----------	PDP Context, on the data channel	----------
+			CmuxDataFlush();
+			sprintf(msg2send, "AT+CGDCONT=1,\"IP\",\"%s\"\r", xIPAddress);
+			
+			StreamSend(msg2send);
+			// Start timeout count
+			tick = TickGetDiv64K(); // 1 tick every seconds
+			maxtimeout = 5;
+			smInternal++;
+			
+		case 1:
+			// Get reply (\r\nOK\r\n), after the echo
+			pos = StreamFind("\r\nOK\r\n");
+			if(pos < 0)
+			{
+				if(StreamFind("ERROR") >= 0)
+				{
+					CmuxDataFlush();
+					CheckErr(1, &smInternal, &tick);
+					return mainOpStatus.ErrorCode;
+				}
+				if((TickGetDiv64K() - tick) > maxtimeout)
+				{
+					CheckErr(-2, &smInternal, &tick);
+					return mainOpStatus.ErrorCode;
+				}
+				vTaskDelay(1);
+				return -1;
+			}
+			StreamConsume(pos + 6);
+			
+			// ----------	Packet Data Call	----------
+			StreamSend("ATD*99***1#\r");
+			tick = TickGetDiv64K();
+			maxtimeout = 30;
+			smInternal++;
+			
+		case 2:
+			// Get reply (CONNECT\r\n), after the echo
+			pos = StreamFind("CONNECT\r\n");
+			if(pos >= 0)
+			{
+				StreamConsume(pos + 9);
+				break;
+			}
+			if(StreamFind("ERROR") >= 0 || StreamFind("NO CARRIER") >= 0)
+			{
+				CmuxDataFlush();
+				CheckErr(1, &smInternal, &tick);
+				return mainOpStatus.ErrorCode;
+			}
+			if((TickGetDiv64K() - tick) > maxtimeout)
+			{
+				CheckErr(-2, &smInternal, &tick);
+				return mainOpStatus.ErrorCode;
+			}
+			vTaskDelay(1);
+			return -1;
+			
+		default:
+			break;
+	
+	}
+	
+	smInternal = 0;
+	CmuxDataOpen(TRUE);
+	// Cmd = 0 only if the last command successfully executed
+	mainOpStatus.ExecStat = OP_SUCCESS;
+	mainOpStatus.Function = 0;
+	mainOpStatus.ErrorCode = 0;
+	mainGSMStateMachine = SM_GSM_IDLE;
+	return -1;
+}
+#else
+int cTCPStreamDial()
+{
+	int resCheck = 0;
+	int countData;
+	int chars2read;
+	
+	switch(smInternal)
+	{
+		case 0:
+			// Check if Buffer is free
+			if(GSMBufferSize() > 0)
+			{
+				// Parse Unsol Message
+				mainGSMStateMachine = SM_GSM_CMD_PENDING;
+				return -1;
+			}
+			else
+				smInternal++;
+				
+		case 1:	
+			// Send first AT command
+			// ----------	PDP Context	----------
+			sprintf(msg2send, "AT+CGDCONT=1,\"IP\",\"%s\"\r", xIPAddress);
+			
+			GSMWrite(msg2send);
+			// Start timeout count
+			tick = TickGetDiv64K(); // 1 tick every seconds
+			maxtimeout = 5;
+			smInternal++;
+			
+		case 2:
+			vTaskDelay(1);
+			// Check ECHO 
+			countData = 0;
+			
+			resCheck = CheckEcho(countData, tick, cmdReply, msg2send, maxtimeout);
+						
+			CheckErr(resCheck, &smInternal, &tick);
+			
+			if(resCheck)
+			{
+				return mainOpStatus.ErrorCode;
+			}
+			
+		case 3:
+			// Get reply (\r\nOK\r\n)
+			vTaskDelay(1);
+			sprintf(msg2send, "\r\nOK");
+			chars2read = 2;
+			countData = 2; // GSM buffer should be: <CR><LF>OK<CR><LF>
+			resCheck = CheckCmd(countData, chars2read, tick, cmdReply, msg2send, maxtimeout);
+			
+			CheckErr(resCheck, &smInternal, &tick);
+			
+			if(resCheck)
+			{
+				return mainOpStatus.ErrorCode;
+			}
+			
+		case 4:	
+			// Send AT command
+			// ----------	Packet Data Call	----------
+			sprintf(msg2send, "ATD*99***1#\r");
+			
+			GSMWrite(msg2send);
+			// Start timeout count
+			tick = TickGetDiv64K(); // 1 tick every seconds
+			maxtimeout = 30;
+			smInternal++;
+			
+		case 5:
+			vTaskDelay(1);
+			// Check ECHO 
+			countData = 0;
+			
+			resCheck = CheckEcho(countData, tick, cmdReply, msg2send, maxtimeout);
+						
+			CheckErr(resCheck, &smInternal, &tick);
+			
+			if(resCheck)
+			{
+				return mainOpStatus.ErrorCode;
+			}
+			
+		case 6:
+			// Get reply (\r\nCONNECT\r\n)
+			vTaskDelay(1);
+			sprintf(msg2send, "\r\nCONNECT");
+			chars2read = 2;
+			countData = 2; // GSM buffer should be: <CR><LF>CONNECT<CR><LF>
+			resCheck = CheckCmd(countData, chars2read, tick, cmdReply, msg2send, maxtimeout);
+			
+			CheckErr(resCheck, &smInternal, &tick);
+			
+			if(resCheck)
+			{
+				return mainOpStatus.ErrorCode;
+			}
+			
+		default:
+			break;
+	
+	}
+	
+	smInternal = 0;
+	// From now on the GSM Task leaves the UART to TCPStreamRead and TCPStreamWrite, as in LL mode
+	mainGSM.HWReady = FALSE;
+	mainOpStatus.ExecStat = OP_LL;
+	mainOpStatus.Function = 0;
+	mainOpStatus.ErrorCode = 0;
+	mainGSMStateMachine = SM_GSM_LL_MODE;
+	return -1;
+}
+#endif
+/// @endcond
+
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	TCPStreamStop params, set by the GSM Task when the command starts
+//****************************************************************************
+static void pTCPStreamStop(GSMCmd* cmd)
+{
+	xSocket = cmd->Arg[0];
+}
+/// @endcond
+
+/**
+ * Leaves the transparent mode of TCPStreamStart, with the "+++" escape sequence, and goes back to 
+ * command mode. The socket stays connected, the data received and not read yet is discarded.
+ * If the server closed the connection, the module already left transparent mode with NO CARRIER.
+ * After TCPStreamDial, the module likewise answers NO CARRIER once PPP terminated the link.
+ * \param sock - TCP_SOCKET of the socket in transparent mode, NULL after TCPStreamDial.
+ * \return None.
+ */
+void TCPStreamStop(TCP_SOCKET* sock)
+{
+	GSMCmd* cmd;
+	
+	if(TCPStreamSize() < 0)
+		return;
+	
+	cmd = GSMCmdNew(37, pTCPStreamStop);		//	Waits for the previous command of this task
+	if (cmd == NULL)
+		return;
+	
+	// Set Params	
+	cmd->Arg[0] = sock;
+	
+	GSMCmdSubmit(cmd);								//	Send COMMAND request to the stack
+}
+
+/// @cond debug
+//****************************************************************************
+//	Only internal use:
+//	cTCPStreamStop callback function
+//****************************************************************************
+int cTCPStreamStop()
+{
+	int pos;
+	
+	switch(smInternal)
+	{
+		case 0:
+			// In LL mode the command runs on until the module answered, see SM_GSM_LL_MODE
+			mainOpStatus.ExecStat = OP_EXECUTION;
+			// The module may have left transparent mode by itself
+			pos = StreamFind("\r\nNO CARRIER\r\n");
+			if(pos >= 0)
+			{
+				StreamConsume(pos + 14);
+				break;
+			}
+			// The guard times are counted without blocking the GSM Task
+			streamTick = xTaskGetTickCount();
+			smInternal++;
+			
+		case 1:
+			// ----------	Escape Sequence	----------
+			if((xTaskGetTickCount() - streamTick) < TCP_STREAM_GUARD / portTICK_RATE_MS)
+			{
+				vTaskDelay(1);
+				return -1;
+			}
+			StreamSend("+++");
+			streamTick = xTaskGetTickCount();
+			smInternal++;
+			
+		case 2:
+			if((xTaskGetTickCount() - streamTick) < TCP_STREAM_GUARD / portTICK_RATE_MS)
+			{
+				vTaskDelay(1);
+				return -1;
+			}
+			// Start timeout count
+			tick = TickGetDiv64K(); // 1 tick every seconds
+			maxtimeout = 5;
+			smInternal++;
+			
+		case 3:
+			// Get reply (\r\nOK\r\n), after the last data received
+			pos = StreamFind("\r\nOK\r\n");
+			if(pos >= 0)
+			{
+				StreamConsume(pos + 6);
+				break;
+			}
+			pos = StreamFind("\r\nNO CARRIER\r\n");
+			if(pos >= 0)
+			{
+				StreamConsume(pos + 14);
+				break;
+			}
+			if((TickGetDiv64K() - tick) > maxtimeout)
+			{
+				CheckErr(-2, &smInternal, &tick);
+				return mainOpStatus.ErrorCode;
+			}
+			// Still in transparent mode: the data is dropped, so that it cannot fill the buffer
+			pos = TCPStreamSize() - 14;
+			if(pos > 0)
+				StreamConsume(pos);
+			vTaskDelay(1);
+			return -1;
+			
+		default:
+			break;
+	
+	}
+	
+	smInternal = 0;
+#if GSM_CMUX
+	CmuxDataOpen(FALSE);
+	CmuxDataFlush();
+#else
+	mainGSM.HWReady = TRUE;
+#endif
+	// Cmd = 0 only if the last command successfully executed
+	mainOpStatus.ExecStat = OP_SUCCESS;
+	mainOpStatus.Function = 0;
+	mainOpStatus.ErrorCode = 0;
+	mainGSMStateMachine = SM_GSM_IDLE;
+	return -1;
+}
+/// @endcond
+
 /*! @} */
 
 /*! @} */
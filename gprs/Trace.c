@@ -0,0 +1,247 @@
+/* **************************************************************************																					
+ *                                OpenPicus                 www.openpicus.com
+ *                                                            italian concept
+ * 
+ *            openSource wireless Platform for sensors and Internet of Things	
+ * **************************************************************************
+ *  FileName:        Trace.c
+ *  Dependencies:    Microchip configs files
+ *  Module:          FlyPort GPRS
+ *  Compiler:        Microchip C30 v3.12 or higher
+ *
+ *  Software License Agreement
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License (version 2) as published by 
+ *  the Free Software Foundation AND MODIFIED BY OpenPicus team.
+ *  
+ *  ***NOTE*** The exception to the GPL is included to allow you to distribute
+ *  a combined work that includes OpenPicus code without being obliged to 
+ *  provide the source code for proprietary components outside of the OpenPicus
+ *  code. 
+ *  OpenPicus software is distributed in the hope that it will be useful, but 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details. 
+ * 
+ * 
+ * Warranty
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * THE SOFTWARE AND DOCUMENTATION ARE PROVIDED "AS IS" WITHOUT
+ * WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION, ANY WARRANTY OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * WE ARE LIABLE FOR ANY INCIDENTAL, SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES, LOST PROFITS OR LOST DATA, COST OF
+ * PROCUREMENT OF SUBSTITUTE GOODS, TECHNOLOGY OR SERVICES, ANY CLAIMS
+ * BY THIRD PARTIES (INCLUDING BUT NOT LIMITED TO ANY DEFENSE
+ * THEREOF), ANY CLAIMS FOR INDEMNITY OR CONTRIBUTION, OR OTHER
+ * SIMILAR COSTS, WHETHER ASSERTED ON THE BASIS OF CONTRACT, TORT
+ * (INCLUDING NEGLIGENCE), BREACH OF WARRANTY, OR OTHERWISE.
+ *
+ **************************************************************************/
+/// @cond debug
+
+// Trace of the AT channel for the command latencies: the chars to and from the modem and the
+// commands of the GSM Task, with their time, in a ring of GSM_TRACE_SIZE bytes. GSMRxInt adds the
+// chars it puts in GSMBuffer, GSMWrite, GSMWriteCh and GSMWriteN the ones they write, and
+// GSMCmdDispatch and GSMCmdComplete the commands. The times are TickGet ones: it only toggles
+// the interrupt of its own timer, so GSMRxInt can call it.
+// GSMTraceSave writes the ring to the SPI flash, bench/tracedec.c decodes it.
+
+#include "HWlib.h"
+#include "Hilo.h"
+#include "SPIFlash.h"
+
+#if GSM_TRACE
+
+#if GSM_TRACE_SIZE < 256 || GSM_TRACE_SIZE > 65535
+#error "GSM_TRACE_SIZE must be between 256 and 65535"
+#endif
+
+static BYTE traceBuf[GSM_TRACE_SIZE];
+static WORD traceHead = 0;			// where the next record goes
+static WORD traceTail = 0;			// oldest record
+static WORD traceLast = 0;			// newest record
+static DWORD traceTick = 0;			// time of the newest record
+static BOOL traceStarted = FALSE;	// a TRACE_TIME record has been written
+static BOOL traceJoin = FALSE;		// the newest record is TRACE_RX, GSMTraceRx can add to it
+static BOOL traceOff = FALSE;		// while GSMTraceSave runs
+
+// The ring is shared with GSMRxInt: the tasks add records in critical sections, that
+// mask the interrupts at configKERNEL_INTERRUPT_PRIORITY
+
+static WORD TraceUsed()
+{
+	int used = traceHead - traceTail;
+	
+	if (used < 0)
+		used += GSM_TRACE_SIZE;
+	return used;
+}
+
+static void TracePut(BYTE b)
+{
+	traceBuf[traceHead] = b;
+	if (++traceHead == GSM_TRACE_SIZE)
+		traceHead = 0;
+}
+
+// Drops the oldest records until len bytes fit
+static void TraceRoom(int len)
+{
+	WORD tail;
+	
+	while (GSM_TRACE_SIZE - 1 - TraceUsed() < len)
+	{
+		tail = traceTail + 3 + (traceBuf[traceTail] & TRACE_MAX_LEN);
+		if (tail >= GSM_TRACE_SIZE)
+			tail -= GSM_TRACE_SIZE;
+		traceTail = tail;
+	}
+}
+
+// Starts a record, its len bytes of payload follow with TracePut
+static void TraceStart(BYTE type, BYTE len, DWORD tick)
+{
+	DWORD ticks = tick - traceTick;
+	
+	if (!traceStarted || ticks > 0xFFFF)
+	{
+		TraceRoom(7);
+		TracePut((TRACE_TIME << 6) | 4);
+		TracePut(0);
+		TracePut(0);
+		TracePut(tick);
+		TracePut(tick >> 8);
+		TracePut(tick >> 16);
+		TracePut(tick >> 24);
+		traceStarted = TRUE;
+		ticks = 0;
+	}
+	TraceRoom(3 + len);
+	traceLast = traceHead;
+	TracePut((type << 6) | len);
+	TracePut(ticks);
+	TracePut(ticks >> 8);
+	traceTick = tick;
+	traceJoin = (type == TRACE_RX);
+}
+
+// GSMRxInt only: a char from the modem, received at tick
+void GSMTraceRx(char c, DWORD tick)
+{
+	if (traceOff)
+		return;
+	if (traceJoin && (traceBuf[traceLast] < TRACE_MAX_LEN) && (tick - traceTick < GSM_TRACE_JOIN))
+	{
+		TraceRoom(1);
+		traceBuf[traceLast]++;
+	}
+	else
+		TraceStart(TRACE_RX, 1, tick);
+	TracePut(c);
+}
+
+// Chars written to the modem
+void GSMTraceTx(const char* data, int len)
+{
+	DWORD tick = TickGet();
+	int n;
+	int i;
+	
+	// A critical section for each record, GSMWriteN can write a whole TCP segment
+	while (len > 0)
+	{
+		n = (len < TRACE_MAX_LEN) ? len : TRACE_MAX_LEN;
+		len -= n;
+		taskENTER_CRITICAL();
+		if (!traceOff)
+		{
+			TraceStart(TRACE_TX, n, tick);
+			for (i = 0; i < n; i++)
+				TracePut(data[i]);
+		}
+		taskEXIT_CRITICAL();
+		data += n;
+	}
+}
+
+// GSM Task: function starts
+void GSMTraceCmd(int function)
+{
+	DWORD tick = TickGet();
+	
+	taskENTER_CRITICAL();
+	if (!traceOff)
+	{
+		TraceStart(TRACE_CMD, 1, tick);
+		TracePut(function);
+	}
+	taskEXIT_CRITICAL();
+}
+
+// GSM Task: function ended with execStat and errorCode
+void GSMTraceCmdEnd(int function, int execStat, int errorCode)
+{
+	DWORD tick = TickGet();
+	
+	taskENTER_CRITICAL();
+	if (!traceOff)
+	{
+		TraceStart(TRACE_CMD, 4, tick);
+		TracePut(function);
+		TracePut(execStat);
+		TracePut(errorCode);
+		TracePut(errorCode >> 8);
+	}
+	taskEXIT_CRITICAL();
+}
+
+void GSMTraceClear()
+{
+	taskENTER_CRITICAL();
+	traceHead = 0;
+	traceTail = 0;
+	traceStarted = FALSE;
+	traceJoin = FALSE;
+	taskEXIT_CRITICAL();
+}
+
+// Writes the trace at addr of the SPI flash, see TRACE_MAGIC, and returns its length.
+// Nothing is recorded meanwhile. The trace stays, GSMTraceClear starts a new one.
+int GSMTraceSave(DWORD addr)
+{
+	BYTE head[TRACE_HEAD_LEN];
+	DWORD rate = TICK_SECOND;
+	WORD len;
+	WORD n;
+	
+	// Once traceOff is set, GSMRxInt leaves the ring alone
+	taskENTER_CRITICAL();
+	traceOff = TRUE;
+	taskEXIT_CRITICAL();
+	
+	len = TraceUsed();
+	memcpy(head, TRACE_MAGIC, 4);
+	head[4] = rate;
+	head[5] = rate >> 8;
+	head[6] = rate >> 16;
+	head[7] = rate >> 24;
+	head[8] = len;
+	head[9] = len >> 8;
+	SPIFlashBeginWrite(addr);
+	SPIFlashWriteArray(head, TRACE_HEAD_LEN);
+	n = GSM_TRACE_SIZE - traceTail;
+	if (n > len)
+		n = len;
+	SPIFlashWriteArray(&traceBuf[traceTail], n);
+	if (len > n)
+		SPIFlashWriteArray(traceBuf, len - n);
+	
+	traceOff = FALSE;
+	return TRACE_HEAD_LEN + len;
+}
+
+#endif
+/// @endcond
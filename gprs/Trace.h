@@ -0,0 +1,82 @@
+/* **************************************************************************																					
+ *                                OpenPicus                 www.openpicus.com
+ *                                                            italian concept
+ * 
+ *            openSource wireless Platform for sensors and Internet of Things	
+ * **************************************************************************
+ *  FileName:        Trace.h
+ *  Dependencies:    Microchip configs files
+ *  Module:          FlyPort GPRS
+ *  Compiler:        Microchip C30 v3.12 or higher
+ *
+ *  Software License Agreement
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *  This is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License (version 2) as published by 
+ *  the Free Software Foundation AND MODIFIED BY OpenPicus team.
+ *  
+ *  ***NOTE*** The exception to the GPL is included to allow you to distribute
+ *  a combined work that includes OpenPicus code without being obliged to 
+ *  provide the source code for proprietary components outside of the OpenPicus
+ *  code. 
+ *  OpenPicus software is distributed in the hope that it will be useful, but 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details. 
+ * 
+ * 
+ * Warranty
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * THE SOFTWARE AND DOCUMENTATION ARE PROVIDED "AS IS" WITHOUT
+ * WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION, ANY WARRANTY OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * WE ARE LIABLE FOR ANY INCIDENTAL, SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES, LOST PROFITS OR LOST DATA, COST OF
+ * PROCUREMENT OF SUBSTITUTE GOODS, TECHNOLOGY OR SERVICES, ANY CLAIMS
+ * BY THIRD PARTIES (INCLUDING BUT NOT LIMITED TO ANY DEFENSE
+ * THEREOF), ANY CLAIMS FOR INDEMNITY OR CONTRIBUTION, OR OTHER
+ * SIMILAR COSTS, WHETHER ASSERTED ON THE BASIS OF CONTRACT, TORT
+ * (INCLUDING NEGLIGENCE), BREACH OF WARRANTY, OR OTHERWISE.
+ *
+ **************************************************************************/
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include "GenericTypeDefs.h"
+
+// Trace of the AT channel (see Trace.c). A record is a header byte, with the type in the two
+// high bits and the payload length in the others, the ticks since the previous record
+// (2 bytes, little endian), then the payload.
+#define TRACE_RX		0	// chars from the modem
+#define TRACE_TX		1	// chars to the modem
+#define TRACE_CMD		2	// 1 byte: a command starts, its Function. 4 bytes: it ends, Function,
+							// ExecStat and ErrorCode (2 bytes)
+#define TRACE_TIME		3	// 4 bytes: TickGet, when the ticks do not fit in 2 bytes
+#define TRACE_MAX_LEN	63
+
+// Image written by GSMTraceSave: TRACE_MAGIC, TICK_SECOND (4 bytes), length of the records
+// (2 bytes), then the records from the oldest. Little endian.
+#define TRACE_MAGIC		"GTR1"
+#define TRACE_HEAD_LEN	10
+
+// Size of the trace in RAM, the oldest records are dropped when it is full
+#ifndef GSM_TRACE_SIZE
+#define GSM_TRACE_SIZE	2048
+#endif
+
+// Chars from the modem go in the same record for this many ticks (1 ms), a bit less than
+// TRACE_MAX_LEN chars at 921600 baud
+#ifndef GSM_TRACE_JOIN
+#define GSM_TRACE_JOIN	(TICK_SECOND / 1000)
+#endif
+
+void GSMTraceRx(char c, DWORD tick);
+void GSMTraceTx(const char* data, int len);
+void GSMTraceCmd(int function);
+void GSMTraceCmdEnd(int function, int execStat, int errorCode);
+void GSMTraceClear();
+int  GSMTraceSave(DWORD addr);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef __COMPILER_H
+#define __COMPILER_H
+
+// Host stand-in for the Microchip compiler header: no configuration bits on the host
+
+#define _CONFIG1(x)
+#define _CONFIG2(x)
+#define _CONFIG3(x)
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+// Host stand-in for FreeRTOS V6, see rtos.c. Ticks are 16 bits and 1 ms, like on the Flyport.
+
+#include <stddef.h>
+
+#define portBASE_TYPE	short
+typedef unsigned short portTickType;
+#define portMAX_DELAY	((portTickType) 0xffff)
+#define portTICK_RATE_MS	((portTickType) 1)
+
+#define pdTRUE	1
+#define pdFALSE	0
+#define pdPASS	1
+#define pdFAIL	0
+
+#define tskIDLE_PRIORITY	0
+#define configMINIMAL_STACK_SIZE	115
+#define configKERNEL_INTERRUPT_PRIORITY	0x01
+
+typedef void* xTaskHandle;
+typedef struct rtosQueue* xQueueHandle;
+typedef xQueueHandle xSemaphoreHandle;
+
+// Tasks
+portBASE_TYPE xTaskCreate(void (*code)(void*), const signed char* name, unsigned short stack,
+						  void* param, unsigned portBASE_TYPE prio, xTaskHandle* handle);
+void vTaskStartScheduler(void);
+void vTaskDelay(portTickType ticks);
+void vTaskSuspend(xTaskHandle task);
+void vTaskResume(xTaskHandle task);
+void vTaskSuspendAll(void);
+signed portBASE_TYPE xTaskResumeAll(void);
+xTaskHandle xTaskGetCurrentTaskHandle(void);
+portTickType xTaskGetTickCount(void);
+void vPortYield(void);
+#define taskYIELD()	vPortYield()
+// Critical sections mask the interrupts up to configKERNEL_INTERRUPT_PRIORITY: the UART one of hw.c
+void vPortEnterCritical(void);
+void vPortExitCritical(void);
+#define taskENTER_CRITICAL()	vPortEnterCritical()
+#define taskEXIT_CRITICAL()		vPortExitCritical()
+
+// Queues and semaphores
+xQueueHandle xQueueCreate(unsigned portBASE_TYPE length, unsigned portBASE_TYPE itemSize);
+signed portBASE_TYPE xQueueSendToBack(xQueueHandle q, const void* item, portTickType ticks);
+signed portBASE_TYPE xQueueReceive(xQueueHandle q, void* item, portTickType ticks);
+signed portBASE_TYPE xQueueSendFromISR(xQueueHandle q, const void* item, signed portBASE_TYPE* woken);
+unsigned portBASE_TYPE uxQueueMessagesWaiting(xQueueHandle q);
+
+xSemaphoreHandle xSemaphoreCreateMutex(void);
+#define vSemaphoreCreateBinary(s)	do { (s) = xQueueCreate(1, 0); if ((s) != NULL) xSemaphoreGive(s); } while (0)
+#define xSemaphoreTake(s, ticks)	xQueueReceive((s), NULL, (ticks))
+#define xSemaphoreGive(s)			xQueueSendToBack((s), NULL, 0)
+#define xSemaphoreGiveFromISR(s, woken)	xQueueSendFromISR((s), NULL, (woken))
+
+// Host only: CPU time used by a task thread, in seconds
+double rtosTaskCpu(xTaskHandle task);
+
+#endif
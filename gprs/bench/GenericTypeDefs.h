@@ -0,0 +1,24 @@
+#ifndef __GENERIC_TYPE_DEFS_H_
+#define __GENERIC_TYPE_DEFS_H_
+
+// Host stand-in for the Microchip types, with the sizes they have on the PIC24
+
+#include <stdint.h>
+
+typedef enum _BOOL { FALSE = 0, TRUE } BOOL;
+
+typedef unsigned char BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint64_t QWORD;
+typedef signed char CHAR;
+typedef int16_t SHORT;
+typedef int32_t LONG;
+typedef unsigned char UINT8;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef signed char INT8;
+typedef int16_t INT16;
+typedef int32_t INT32;
+
+#endif
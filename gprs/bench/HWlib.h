@@ -0,0 +1,33 @@
+#ifndef __SOFTLIB_H
+#define __SOFTLIB_H
+
+// Host stand-in for the Flyport hardware library, just what the GSM stack uses
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "GenericTypeDefs.h"
+#include "Compiler.h"
+#include "HWmap.h"
+#include "p24FJ256GA106.h"
+#include "FreeRTOS.h"
+
+#define UART_DBG_DEF_BAUD 	19200
+#define STACK_USE_UART
+
+#define off			(0)
+#define on			(1)
+#define toggle		(2)
+
+void HWInit(int);
+void IOPut(int io, int putval);
+void UARTInit(int port, long int baud);
+void UARTOn(int port);
+void UARTWrite(int port, char *buffer);
+void UARTWriteCh(int port, char chr);
+void _dbgwrite(char* dbgstr);
+void DelayMs(WORD ms);
+
+#endif
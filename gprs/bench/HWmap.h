@@ -0,0 +1,41 @@
+#ifndef __MAP_H
+#define __MAP_H
+
+// Host stand-in for the Flyport GPRS hardware map. The HiLo UART is a pty, see hw.c.
+
+#define GetSystemClock()		(32000000ul)      // Hz
+#define GetInstructionClock()	(GetSystemClock()/2)
+#define GetPeripheralClock()	GetInstructionClock()
+
+#define FLYPORTGPRS
+#define HWDEFAULT	(1)
+
+#define HILO_UART		4
+
+// Modem control lines: the modem is always ready, hw.c honours RTS
+extern int hiloLines[8];
+#define HILO_CTS_TRIS	hiloLines[0]
+#define HILO_CTS_IO		hiloLines[1]
+#define HILO_RTS_IO		hiloLines[2]
+#define HILO_POK_IO		hiloLines[3]
+#define HILO_RESET_IO	hiloLines[4]
+#define HILO_DSR_IO		hiloLines[5]
+#define HILO_DCD_IO		hiloLines[6]
+#define HILO_DTR_IO		hiloLines[7]
+
+// Modem UART data registers used by Hilo.c
+int hwUartRxReady(void);
+char hwUartRxChar(void);
+void hwUartTxChar(char c);
+int hwUartOverrun(void);
+void hwUartOverrunClear(void);
+#define GSM_UART_RX_READY(port)		hwUartRxReady()
+#define GSM_UART_RX_CHAR(port)		hwUartRxChar()
+#define GSM_UART_TX_FULL(port)		0
+#define GSM_UART_TX_CHAR(port, c)	hwUartTxChar(c)
+#define GSM_UART_OVERRUN(port)		hwUartOverrun()
+#define GSM_UART_OVERRUN_CLEAR(port)	hwUartOverrunClear()
+
+#define p18		(18)
+
+#endif
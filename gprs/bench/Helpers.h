@@ -0,0 +1,24 @@
+#ifndef HELPERS_H
+#define HELPERS_H
+
+// Host stand-in for the socket types of the Flyport GPRS framework
+
+#include "GenericTypeDefs.h"
+
+#define INVALID_SOCKET	(-1)
+
+typedef struct
+{
+	int number;
+	int status;
+	int notif;
+	int rxLen;
+} TCP_SOCKET;
+
+typedef struct
+{
+	int number;
+	int ftpError;
+} FTP_SOCKET;
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef RS232HELPER_H
+#define RS232HELPER_H
+
+// Host stand-in for the debug serial port, printed with -v, see hw.c
+
+void RS232Write(int port, char* data);
+void RS232WriteCh(int port, char chr);
+
+#endif
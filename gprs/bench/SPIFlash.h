@@ -0,0 +1,15 @@
+#ifndef SPIFLASH_H
+#define SPIFLASH_H
+
+// Host stand-in for the SPI flash, kept in memory, see hw.c
+
+#include "GenericTypeDefs.h"
+
+#define SPI_FLASH_SIZE	0x200000ul
+
+void SPIFlashBeginWrite(DWORD addr);
+void SPIFlashWrite(BYTE data);
+void SPIFlashWriteArray(BYTE* data, WORD len);
+void SPIFlashReadArray(DWORD addr, BYTE* data, WORD len);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __TICK_H
+#define __TICK_H
+
+// Host stand-in for the Tick module, on the monotonic clock. A tick is 1/62500 s like on the Flyport.
+
+#include "GenericTypeDefs.h"
+
+#define TICK_SECOND		62500ul
+
+void TickInit(void);
+DWORD TickGet(void);
+DWORD TickGetDiv256(void);
+DWORD TickGetDiv64K(void);
+
+#endif
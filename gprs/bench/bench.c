@@ -0,0 +1,429 @@
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "taskFlyport.h"
+#include "hw.h"
+#include "sim.h"
+#include "SPIFlash.h"
+
+// Host benchmark of the GSM stack against the HiLo simulator: round trip of each
+// command, TCP echo in command and in transparent mode, FTP download throughput, and
+// driver CPU per char on the UART. Built with CMUX=1, the transparent mode runs on its own
+// channel of the multiplexer, and a GSMSignal goes on the AT channel during each echo.
+// The GSM Task is the one of Main.c, run by the FreeRTOS stand-in of rtos.c.
+
+#define BENCH_TCP_MAX	1460
+#define BENCH_FLASH_LOC	0x10000ul
+#define BENCH_TRACE_LOC	0x100000ul
+
+int gprs_main(void);
+extern xTaskHandle hGSMTask;
+
+struct cmdStat
+{
+	const char* name;
+	unsigned n;
+	unsigned fails;
+	double min, max, sum;
+};
+
+enum { ST_CSQ, ST_APN, ST_OPEN, ST_STATUS, ST_WRITE, ST_READ, ST_ECHO, ST_CLOSE,
+	   ST_STREAM_START, ST_STREAM_WRITE, ST_STREAM_CSQ, ST_STREAM_ECHO, ST_STREAM_STOP,
+	   ST_FTPCFG, ST_FTPRCV, ST_SMS, ST_COUNT };
+
+static struct cmdStat stats[ST_COUNT] =
+{
+	{ "GSMSignal" }, { "APNConfig" }, { "TCPClientOpen" }, { "TCPStatus" },
+	{ "TCPWrite" }, { "TCPRead" }, { "echo" }, { "TCPClientClose" },
+	{ "TCPStreamStart" }, { "TCPStreamWrite" }, { "stream GSMSignal" }, { "stream echo" },
+	{ "TCPStreamStop" },
+	{ "FTPConfig" }, { "FTPReceive" }, { "SMSSend" },
+};
+
+// A phase of the run, for the CPU used per char
+struct phase
+{
+	double wall;
+	double cpu;
+	struct hwUartStat uart;
+};
+
+static int count = 20, size = 512;
+static long ftpSize = 32768;
+static long baud = -1;
+static int failures;
+static const char* tracePath;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(char *prog)
+{
+	printf("usage: %s [options]\n"
+		"  -n count    TCP echo round trips (20)\n"
+		"  -s size     TCP write size, up to %d (512)\n"
+		"  -F bytes    FTP file size, 0 to skip the download (32768)\n"
+		"  -b baud     modem UART speed at startup, 0 for no pacing (115200). HiloStdModeOn\n"
+		"              raises it up to GSM_BAUD, limited with the ipr directive of sim.c\n"
+		"  -l ms       modem reply latency (5)\n"
+		"  -r ms       TCP echo round trip (50)\n"
+		"  -R chars    chars the modem still sends once RTS goes off (2)\n"
+		"  -S script   simulator script, see sim.c\n"
+		"  -t seconds  run time limit (300)\n"
+		"  -T file     saves the AT channel trace for tracedec, built with TRACE=1\n"
+		"  -v          debug output, twice for the modem traffic\n", prog, BENCH_TCP_MAX);
+}
+
+static void record(int st, double t, int ok)
+{
+	struct cmdStat* s = &stats[st];
+
+	if (!ok)
+	{
+		s->fails++;
+		failures++;
+		return;
+	}
+	if (s->n == 0 || t < s->min)
+		s->min = t;
+	if (t > s->max)
+		s->max = t;
+	s->sum += t;
+	s->n++;
+}
+
+// Waits for the command just submitted, that ends with expect, and records its round trip
+static int done(int st, double t0)
+{
+	int res = LastExecWait(OP_WAIT_FOREVER);
+
+	record(st, now() - t0, res == OP_SUCCESS);
+	if (res != OP_SUCCESS)
+		printf("%s failed: %d, error %d\n", stats[st].name, res, LastErrorCode());
+	return res == OP_SUCCESS;
+}
+
+static void phaseStart(struct phase* p)
+{
+	p->wall = now();
+	p->cpu = rtosTaskCpu(hGSMTask);
+	hwUartStats(&p->uart);
+}
+
+static void phaseEnd(struct phase* p, const char* name)
+{
+	struct hwUartStat u;
+	unsigned long chars;
+	double cpu;
+
+	hwUartStats(&u);
+	p->wall = now() - p->wall;
+	cpu = rtosTaskCpu(hGSMTask) - p->cpu + u.isrCpu - p->uart.isrCpu;
+	chars = u.rxChars - p->uart.rxChars + u.txChars - p->uart.txChars;
+	printf("%-8s %8.3f s %8lu chars %6.1f%% of the link %8.3f s cpu %8.3f us/char %6lu int %5lu holds %5lu stops %6.3f s held %4lu lost\n",
+		name, p->wall, chars, baud > 0 ? 100.0 * chars * 10 / HiloBaud() / p->wall : 0, cpu,
+		chars > 0 ? cpu * 1e6 / chars : 0, u.interrupts - p->uart.interrupts,
+		u.holds - p->uart.holds, u.stops - p->uart.stops, u.held - p->uart.held,
+		u.overruns - p->uart.overruns);
+}
+
+static void tcpBench(void)
+{
+	static char wbuf[BENCH_TCP_MAX], rbuf[BENCH_TCP_MAX + 1];
+	TCP_SOCKET sock;
+	double t0, te;
+	int i, j, got;
+
+	memset(&sock, 0, sizeof(sock));
+	sock.number = INVALID_SOCKET;
+	t0 = now();
+	TCPClientOpen(&sock, "127.0.0.1", "7");
+	if (!done(ST_OPEN, t0))
+		return;
+	t0 = now();
+	TCPStatus(&sock);
+	if (!done(ST_STATUS, t0))
+		return;
+
+	for (i = 0; i < count; i++)
+	{
+		for (j = 0; j < size; j++)
+			wbuf[j] = (char)(i * 7 + j);
+		te = t0 = now();
+		TCPWrite(&sock, wbuf, size);
+		if (!done(ST_WRITE, t0))
+			break;
+		// The echo is read as soon as the modem has some of it
+		for (got = 0; got < size; )
+		{
+			if (now() - te > 10)
+			{
+				record(ST_ECHO, 0, 0);
+				printf("echo %d: %d of %d chars back\n", i, got, size);
+				break;
+			}
+			t0 = now();
+			TCPRead(&sock, rbuf + got, size - got);
+			if (!done(ST_READ, t0))
+				break;
+			if (TCPReadCount() == 0)
+				vTaskDelay(5);
+			got += TCPReadCount();
+		}
+		if (got < size)
+			break;
+		record(ST_ECHO, now() - te, memcmp(wbuf, rbuf, size) == 0);
+		if (memcmp(wbuf, rbuf, size) != 0)
+			printf("echo %d: chars differ\n", i);
+	}
+
+	t0 = now();
+	TCPClientClose(&sock);
+	done(ST_CLOSE, t0);
+}
+
+// Same echo as tcpBench, with the socket in transparent mode
+static void streamBench(void)
+{
+	static char wbuf[BENCH_TCP_MAX], rbuf[BENCH_TCP_MAX];
+	TCP_SOCKET sock;
+	double t0, te;
+	int i, j, got;
+
+	memset(&sock, 0, sizeof(sock));
+	sock.number = INVALID_SOCKET;
+	t0 = now();
+	TCPClientOpen(&sock, "127.0.0.1", "7");
+	if (!done(ST_OPEN, t0))
+		return;
+	t0 = now();
+	TCPStreamStart(&sock);
+	LastExecWait(OP_WAIT_FOREVER);
+	record(ST_STREAM_START, now() - t0, TCPStreamSize() >= 0);
+	if (TCPStreamSize() < 0)
+	{
+		printf("TCPStreamStart failed: error %d\n", LastErrorCode());
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		for (j = 0; j < size; j++)
+			wbuf[j] = (char)(i * 11 + j);
+		te = t0 = now();
+		j = TCPStreamWrite(wbuf, size);
+		record(ST_STREAM_WRITE, now() - t0, j == size);
+		if (j != size)
+			break;
+#if GSM_CMUX
+		// The AT channel is free while the echo is on its way
+		t0 = now();
+		GSMSignal();
+		done(ST_STREAM_CSQ, t0);
+#endif
+		for (got = 0; got < size; )
+		{
+			if (now() - te > 10)
+			{
+				record(ST_STREAM_ECHO, 0, 0);
+				printf("stream echo %d: %d of %d chars back\n", i, got, size);
+				break;
+			}
+			if (TCPStreamSize() == 0)
+				vTaskDelay(1);
+			else
+				got += TCPStreamRead(rbuf + got, size - got);
+		}
+		if (got < size)
+			break;
+		record(ST_STREAM_ECHO, now() - te, memcmp(wbuf, rbuf, size) == 0);
+		if (memcmp(wbuf, rbuf, size) != 0)
+			printf("stream echo %d: chars differ\n", i);
+	}
+
+	t0 = now();
+	TCPStreamStop(&sock);
+	if (!done(ST_STREAM_STOP, t0))
+		return;
+	t0 = now();
+	TCPClientClose(&sock);
+	done(ST_CLOSE, t0);
+}
+
+static void ftpBench(void)
+{
+	FTP_SOCKET ftp;
+	double t0;
+	long i;
+
+	memset(&ftp, 0, sizeof(ftp));
+	ftp.number = INVALID_SOCKET;
+	t0 = now();
+	FTPConfig(&ftp, "127.0.0.1", "bench", "bench", 21);
+	if (!done(ST_FTPCFG, t0))
+		return;
+	t0 = now();
+	FTPReceive(&ftp, BENCH_FLASH_LOC, "/", "bench.bin", ftpSize);
+	if (!done(ST_FTPRCV, t0))
+		return;
+	for (i = 0; i < ftpSize; i++)
+	{
+		if (hwFlash(BENCH_FLASH_LOC)[i] != simFtpByte(i))
+		{
+			printf("FTP file differs at %ld\n", i);
+			record(ST_FTPRCV, 0, 0);
+			break;
+		}
+	}
+}
+
+static void report(void)
+{
+	struct cmdStat* s;
+	int i;
+
+	printf("\n%-16s %6s %6s %10s %10s %10s\n", "command", "ok", "failed", "min ms", "mean ms", "max ms");
+	for (i = 0; i < ST_COUNT; i++)
+	{
+		s = &stats[i];
+		if (s->n + s->fails == 0)
+			continue;
+		printf("%-16s %6u %6u %10.2f %10.2f %10.2f\n", s->name, s->n, s->fails,
+			s->min * 1e3, s->n ? s->sum / s->n * 1e3 : NAN, s->max * 1e3);
+	}
+}
+
+// Writes the trace to the SPI flash with GSMTraceSave, then from there to tracePath
+static void traceSave(void)
+{
+#if GSM_TRACE
+	static BYTE image[TRACE_HEAD_LEN + GSM_TRACE_SIZE];
+	FILE* f;
+	int len;
+
+	len = GSMTraceSave(BENCH_TRACE_LOC);
+	SPIFlashReadArray(BENCH_TRACE_LOC, image, len);
+	f = fopen(tracePath, "wb");
+	if (f == NULL || fwrite(image, 1, len, f) != (size_t)len || fclose(f) != 0) {
+		perror(tracePath);
+		failures++;
+		return;
+	}
+	printf("trace    %8d bytes in %s\n", len, tracePath);
+#endif
+}
+
+void FlyportTask()
+{
+	struct phase p;
+	double t0;
+
+	// Registered once +CREG: 1 comes
+	t0 = now();
+	while (LastConnStatus() != REG_SUCCESS && LastConnStatus() != ROAMING)
+	{
+		if (now() - t0 > 10)
+		{
+			printf("not registered\n");
+			exit(EXIT_FAILURE);
+		}
+		vTaskDelay(20);
+	}
+	printf("startup  %8.3f s, modem UART at %ld baud\n\n", now() - t0, HiloBaud());
+
+	phaseStart(&p);
+	t0 = now();
+	GSMSignal();
+	done(ST_CSQ, t0);
+	t0 = now();
+	APNConfig("bench.apn", "", "", DYNAMIC_IP, DYNAMIC_IP, DYNAMIC_IP);
+	done(ST_APN, t0);
+	t0 = now();
+	SMSSend("+390000000000", "Flyport GPRS bench", FALSE);
+	done(ST_SMS, t0);
+	phaseEnd(&p, "at");
+
+	phaseStart(&p);
+	tcpBench();
+	phaseEnd(&p, "tcp");
+
+	phaseStart(&p);
+	streamBench();
+	phaseEnd(&p, "stream");
+
+	if (ftpSize > 0)
+	{
+		phaseStart(&p);
+		ftpBench();
+		phaseEnd(&p, "ftp");
+	}
+
+	report();
+	if (tracePath != NULL)
+		traceSave();
+	fflush(stdout);
+	exit(failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void timeout(int sig)
+{
+	(void)sig;
+	fprintf(stderr, "time limit reached, last chars on the modem UART:");
+	hwTraceDump();
+	_exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	char path[64], arg[80];
+	unsigned limit = 300;
+	int opt;
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	while ((opt = getopt(argc, argv, "n:s:F:b:l:r:R:S:t:T:vh")) != -1) {
+		switch (opt) {
+		case 'n': count = atoi(optarg); break;
+		case 's': size = atoi(optarg); break;
+		case 'F': ftpSize = atol(optarg); break;
+		case 'b': baud = atol(optarg); break;
+		case 'l': snprintf(arg, sizeof(arg), "latency %s", optarg); simSet(arg); break;
+		case 'r': snprintf(arg, sizeof(arg), "rtt %s", optarg); simSet(arg); break;
+		case 'R': hwUartLag(atoi(optarg)); break;
+		case 'S': if (simLoad(optarg) != 0) return 1; break;
+		case 't': limit = atoi(optarg); break;
+		case 'T': tracePath = optarg; break;
+		case 'v': hwVerbose++; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (size <= 0 || size > BENCH_TCP_MAX || count < 0 || ftpSize < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (tracePath != NULL && !GSM_TRACE) {
+		fprintf(stderr, "-T needs a build with TRACE=1\n");
+		return 1;
+	}
+	if (baud >= 0) {
+		snprintf(arg, sizeof(arg), "baud %ld", baud);
+		simSet(arg);
+	}
+	baud = simBaud();
+	hwUartPace(baud > 0);
+	snprintf(arg, sizeof(arg), "ftpsize %ld", ftpSize);
+	simSet(arg);
+
+	if (simStart(path, sizeof(path)) < 0 || hwUartOpen(path) != 0)
+		return 1;
+	// A stuck command ends the run
+	signal(SIGALRM, timeout);
+	alarm(limit);
+	return gprs_main();
+}
@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+// The HiLo simulator alone, on a pty, for terminals or other hosts of the GSM stack
+
+int main(int argc, char **argv)
+{
+	char path[64];
+	int fd;
+
+	if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+		printf("usage: %s [script]\n", argv[0]);
+		return 1;
+	}
+	if (argc == 2 && simLoad(argv[1]) != 0)
+		return 1;
+	fd = simOpen(path, sizeof(path));
+	if (fd < 0)
+		return 1;
+	printf("%s\n", path);
+	fflush(stdout);
+	simRun(fd);
+	return 0;
+}
@@ -0,0 +1,429 @@
+// Host stand-in for the Flyport hardware used by the GSM stack.
+// The HiLo UART is a pty: a thread reads it and calls GSMRxInt, like the UART4 Rx interrupt.
+// Once GSMRxInt raises RTS (HILO_RTS_IO), the modem sends the chars it has in flight, then the pty
+// is not read: the simulator stops sending. A char sent while GSMRxInt leaves chars in the FIFO
+// is lost, and sets OERR until GSMRxInt clears it.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "HWlib.h"
+#include "Tick.h"
+#include "SPIFlash.h"
+#include "RS232Helper.h"
+#include "p24FJ256GA106.h"
+#include "hw.h"
+
+// The PIC24 UART Rx and Tx FIFOs are 4 chars deep
+#define HW_UART_FIFO	4
+// Chars the modem sends once RTS goes off
+#define HW_RTS_LAG		2
+
+void GSMRxInt();
+
+int hwVerbose;
+
+int hiloLines[8];
+unsigned int gprs_data;
+struct hwIPC22 IPC22bits;
+struct hwRCON RCONbits;
+
+// UART registers, only kept for HiloUARTInit and the pdsel checks
+static int uartRegs[4][6];
+int *UMODEs[] = { &uartRegs[0][0], &uartRegs[1][0], &uartRegs[2][0], &uartRegs[3][0] };
+int *USTAs[] = { &uartRegs[0][1], &uartRegs[1][1], &uartRegs[2][1], &uartRegs[3][1] };
+int *UBRGs[] = { &uartRegs[0][2], &uartRegs[1][2], &uartRegs[2][2], &uartRegs[3][2] };
+int *UIFSs[] = { &uartRegs[0][3], &uartRegs[1][3], &uartRegs[2][3], &uartRegs[3][3] };
+int *UIECs[] = { &uartRegs[0][4], &uartRegs[1][4], &uartRegs[2][4], &uartRegs[3][4] };
+int *UTXREGs[] = { &uartRegs[0][5], &uartRegs[1][5], &uartRegs[2][5], &uartRegs[3][5] };
+int *URXREGs[] = { &uartRegs[0][5], &uartRegs[1][5], &uartRegs[2][5], &uartRegs[3][5] };
+int UTXIPos[] = { 0x1000, 0x8000, 0x0400, 0x0400 };
+int URXIPos[] = { 0x0800, 0x4000, 0x0200, 0x0200 };
+
+static int uartFd = -1;
+static char rxFifo[HW_UART_FIFO];
+static int rxLen, rxPos;
+static pthread_t isrThread;
+static double isrCpu;
+static unsigned long isrCount;
+static unsigned long rxCount;
+static unsigned long txCount;
+static unsigned long holdCount;
+static unsigned long stopCount;
+static unsigned long overrunCount;
+static double heldTime;
+// RTS: chars the modem may still send once it goes off, and sent since
+static int rtsLag = HW_RTS_LAG;
+static int rtsSent;
+static int oerr;
+// Tx pacing: time the last char written leaves the UART
+static int txPace;
+static double txClock;
+
+// Last chars on the UART, '<' from the modem and '>' to it
+#define HW_TRACE	1024
+static char trace[HW_TRACE][2];
+static unsigned traceInd;
+
+static BYTE flash[SPI_FLASH_SIZE];
+static DWORD flashAddr;
+
+static void hwTraceCh(char dir, char c)
+{
+	unsigned i = __sync_fetch_and_add(&traceInd, 1) % HW_TRACE;
+
+	trace[i][0] = dir;
+	trace[i][1] = c;
+}
+
+static double threadCpu(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double hwNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The modem may send: RTS on, or chars still in flight since it went off
+static int uartRtsOn(void)
+{
+	if (!HILO_RTS_IO)
+		rtsSent = 0;
+	return !HILO_RTS_IO || rtsSent < rtsLag;
+}
+
+// RTS off and no char in flight: waits for GSMRxResume to lower it
+static void uartStopped(void)
+{
+	struct timespec ts = { 0, 50000 };
+	double start;
+
+	if (uartRtsOn())
+		return;
+	start = hwNow();
+	stopCount++;
+	while (!uartRtsOn())
+		nanosleep(&ts, NULL);
+	heldTime += hwNow() - start;
+}
+
+// Rx interrupt masked by GSMRxInt, and FIFO not empty: waits for GSMRxResume.
+// The chars the modem sends meanwhile find the FIFO full.
+static void uartHeld(void)
+{
+	struct timespec ts = { 0, 50000 };
+	struct pollfd pfd = { uartFd, POLLIN, 0 };
+	char c;
+
+	holdCount++;
+	while (!(*UIECs[HILO_UART - 1] & URXIPos[HILO_UART - 1]))
+	{
+		if (uartRtsOn() && poll(&pfd, 1, 0) > 0 && read(uartFd, &c, 1) == 1)
+		{
+			rtsSent += HILO_RTS_IO ? 1 : 0;
+			rxCount++;
+			overrunCount++;
+			oerr = 1;
+			continue;
+		}
+		nanosleep(&ts, NULL);
+	}
+}
+
+// UART4 Rx interrupt: one call of GSMRxInt for each FIFO load.
+// Only the time spent in GSMRxInt is counted, not the pty reads.
+static void* uartIsr(void* arg)
+{
+	double start;
+	ssize_t n;
+	int room;
+
+	(void)arg;
+	for (;;)
+	{
+		uartStopped();
+		room = HILO_RTS_IO ? rtsLag - rtsSent : HW_UART_FIFO;
+		n = read(uartFd, rxFifo, room < HW_UART_FIFO ? room : HW_UART_FIFO);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			fprintf(stderr, "hw: modem UART closed\n");
+			exit(EXIT_FAILURE);
+		}
+		if (HILO_RTS_IO)
+			rtsSent += n;
+		rxLen = n;
+		rxCount += n;
+		for (rxPos = 0; rxPos < n; rxPos++)
+			hwTraceCh('<', rxFifo[rxPos]);
+		rxPos = 0;
+		for (;;)
+		{
+			start = threadCpu();
+			vPortEnterCritical();
+			GSMRxInt();
+			vPortExitCritical();
+			isrCpu += threadCpu() - start;
+			isrCount++;
+			if (rxPos == rxLen)
+				break;
+			uartHeld();
+		}
+	}
+	return NULL;
+}
+
+int hwUartOpen(const char* path)
+{
+	struct termios tio;
+
+	uartFd = open(path, O_RDWR | O_NOCTTY);
+	if (uartFd < 0)
+	{
+		perror(path);
+		return -1;
+	}
+	if (tcgetattr(uartFd, &tio) == 0)
+	{
+		cfmakeraw(&tio);
+		tcsetattr(uartFd, TCSANOW, &tio);
+	}
+	if (pthread_create(&isrThread, NULL, uartIsr, NULL) != 0)
+	{
+		perror("hw: pthread_create");
+		return -1;
+	}
+	return 0;
+}
+
+int hwUartRxReady(void)
+{
+	return rxPos < rxLen;
+}
+
+char hwUartRxChar(void)
+{
+	return rxFifo[rxPos++];
+}
+
+int hwUartOverrun(void)
+{
+	return oerr;
+}
+
+void hwUartOverrunClear(void)
+{
+	oerr = 0;
+}
+
+void hwUartLag(int chars)
+{
+	rtsLag = chars;
+}
+
+void hwUartPace(int pace)
+{
+	txPace = pace;
+}
+
+// Char time at the speed of the UART registers, as set by HiloUARTInit
+static double uartByteTime(void)
+{
+	int port = HILO_UART - 1;
+	double clk = GetInstructionClock() / ((*UMODEs[port] & 8) ? 4.0 : 16.0);
+
+	return 10.0 * (*UBRGs[port] + 1) / clk;
+}
+
+void hwUartTxChar(char c)
+{
+	struct timespec ts;
+	double t, wait, txByteTime;
+
+	// Waits while the Tx FIFO is full
+	if (txPace)
+	{
+		txByteTime = uartByteTime();
+		t = hwNow();
+		if (txClock < t)
+			txClock = t;
+		wait = txClock - t - (HW_UART_FIFO - 1) * txByteTime;
+		if (wait > 0)
+		{
+			ts.tv_sec = (time_t)wait;
+			ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+			while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+				;
+		}
+		txClock += txByteTime;
+	}
+	hwTraceCh('>', c);
+	while (write(uartFd, &c, 1) < 0 && errno == EINTR)
+		;
+	txCount++;
+}
+
+void hwUartStats(struct hwUartStat* stat)
+{
+	stat->isrCpu = isrCpu;
+	stat->interrupts = isrCount;
+	stat->rxChars = rxCount;
+	stat->txChars = txCount;
+	stat->holds = holdCount;
+	stat->stops = stopCount;
+	stat->overruns = overrunCount;
+	stat->held = heldTime;
+}
+
+void hwTraceDump(void)
+{
+	unsigned i, end = traceInd;
+	char dir = 0;
+
+	for (i = end > HW_TRACE ? end - HW_TRACE : 0; i < end; i++)
+	{
+		char* t = trace[i % HW_TRACE];
+
+		if (t[0] != dir)
+			fprintf(stderr, "\n%c ", dir = t[0]);
+		if (t[1] >= ' ' && t[1] < 127)
+			fputc(t[1], stderr);
+		else
+			fprintf(stderr, "\\x%02x", (unsigned char)t[1]);
+	}
+	fputc('\n', stderr);
+}
+
+const BYTE* hwFlash(DWORD addr)
+{
+	return flash + addr;
+}
+
+void HWInit(int conf)
+{
+	(void)conf;
+}
+
+void IOPut(int io, int putval)
+{
+	(void)io;
+	(void)putval;
+}
+
+void UARTInit(int port, long int baud)
+{
+	(void)port;
+	(void)baud;
+}
+
+void UARTOn(int port)
+{
+	(void)port;
+}
+
+void UARTWrite(int port, char *buffer)
+{
+	(void)port;
+	if (hwVerbose)
+		fputs(buffer, stderr);
+}
+
+void UARTWriteCh(int port, char chr)
+{
+	(void)port;
+	if (hwVerbose)
+		fputc(chr, stderr);
+}
+
+void _dbgwrite(char* dbgstr)
+{
+	if (hwVerbose)
+		fputs(dbgstr, stderr);
+}
+
+// Port 3 echoes the modem traffic, printed with -v -v
+void RS232Write(int port, char* data)
+{
+	if (hwVerbose > 1 && port == 3)
+		fputs(data, stderr);
+}
+
+void RS232WriteCh(int port, char chr)
+{
+	if (hwVerbose > 1 && port == 3)
+		fputc(chr, stderr);
+}
+
+void DelayMs(WORD ms)
+{
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+
+	while (nanosleep(&ts, &ts) != 0)
+		;
+}
+
+void TickInit(void)
+{
+}
+
+// Ticks since the monotonic clock origin
+static unsigned long long ticks(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * TICK_SECOND + (unsigned long long)ts.tv_nsec * TICK_SECOND / 1000000000ull;
+}
+
+DWORD TickGet(void)
+{
+	return (DWORD)ticks();
+}
+
+DWORD TickGetDiv256(void)
+{
+	return (DWORD)(ticks() >> 8);
+}
+
+DWORD TickGetDiv64K(void)
+{
+	return (DWORD)(ticks() >> 16);
+}
+
+void SPIFlashBeginWrite(DWORD addr)
+{
+	flashAddr = addr;
+}
+
+void SPIFlashWrite(BYTE data)
+{
+	if (flashAddr < SPI_FLASH_SIZE)
+		flash[flashAddr++] = data;
+}
+
+void SPIFlashWriteArray(BYTE* data, WORD len)
+{
+	while (len-- > 0)
+		SPIFlashWrite(*data++);
+}
+
+void SPIFlashReadArray(DWORD addr, BYTE* data, WORD len)
+{
+	while (len-- > 0)
+		*data++ = addr < SPI_FLASH_SIZE ? flash[addr++] : 0xff;
+}
@@ -0,0 +1,34 @@
+#ifndef HW_H
+#define HW_H
+
+// Host hardware of the bench, see hw.c
+
+#include "GenericTypeDefs.h"
+
+extern int hwVerbose;
+
+// Opens the modem UART on the pty at path and starts its Rx interrupt
+int hwUartOpen(const char* path);
+// Chars to the modem leave at the speed set by HiloUARTInit, as from the 4 chars Tx FIFO, or unpaced
+void hwUartPace(int pace);
+// Chars the modem still sends once RTS goes off (2)
+void hwUartLag(int chars);
+struct hwUartStat
+{
+	double isrCpu;				// seconds spent in GSMRxInt
+	unsigned long interrupts;	// calls of GSMRxInt
+	unsigned long rxChars;		// chars from the modem
+	unsigned long txChars;		// chars to the modem
+	unsigned long holds;		// times GSMRxInt left chars in the FIFO, GSMBuffer being full
+	unsigned long stops;		// times the modem stopped, RTS being off
+	unsigned long overruns;		// chars lost, sent with the FIFO full (OERR)
+	double held;				// seconds the modem was held by RTS
+};
+
+void hwUartStats(struct hwUartStat* stat);
+// Prints the last chars on the UART
+void hwTraceDump(void);
+// SPI flash contents
+const BYTE* hwFlash(DWORD addr);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __P24FJ256GA106_H
+#define __P24FJ256GA106_H
+
+// Host stand-in for the PIC24 registers used by the GSM stack
+
+struct hwIPC22 { unsigned U4RXIP; unsigned U4TXIP; };
+extern struct hwIPC22 IPC22bits;
+
+struct hwRCON { unsigned VREGS; };
+extern struct hwRCON RCONbits;
+
+// PIC instructions, like PWRSAV, are skipped on the host
+#define asm(instr)	((void)0)
+
+#endif
@@ -0,0 +1,359 @@
+// Host stand-in for FreeRTOS: each task is a thread, queues are guarded by a mutex.
+// The GSM stack runs on a preemptive kernel, so it already copes with tasks
+// interleaving at any point. Only the calls used by the stack are provided.
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "FreeRTOS.h"
+
+#define RTOS_MAX_TASKS	8
+
+struct rtosTask
+{
+	pthread_t thread;
+	void (*code)(void*);
+	void* param;
+	int started;
+	int suspended;
+};
+
+struct rtosQueue
+{
+	unsigned length;
+	unsigned itemSize;
+	unsigned count;
+	unsigned head;
+	char* items;
+	pthread_cond_t changed;
+};
+
+static struct rtosTask tasks[RTOS_MAX_TASKS];
+static int taskCount;
+static int schedulerRunning;
+static __thread struct rtosTask* current;
+
+// Kernel lock, for the queues and the task states
+static pthread_mutex_t kernel = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t resumed = PTHREAD_COND_INITIALIZER;
+// Taken by vTaskSuspendAll, the stack uses it for short critical sections
+static pthread_mutex_t suspendAll;
+// Taken by taskENTER_CRITICAL, and by hw.c around the UART interrupt, whose priority is
+// configKERNEL_INTERRUPT_PRIORITY
+static pthread_mutex_t critical;
+static pthread_once_t locksOnce = PTHREAD_ONCE_INIT;
+static struct timespec startTime;
+
+static void nowPlus(struct timespec* ts, portTickType ticks)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	ts->tv_sec += ticks / 1000;
+	ts->tv_nsec += (long)(ticks % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+// Waits on cond with the kernel lock held. FALSE when ticks expired.
+static int kernelWait(pthread_cond_t* cond, const struct timespec* deadline)
+{
+	if (deadline == NULL)
+		return pthread_cond_wait(cond, &kernel) == 0;
+	return pthread_cond_timedwait(cond, &kernel, deadline) == 0;
+}
+
+// A suspended task stops at its next kernel call
+static void checkSuspended(void)
+{
+	if (current == NULL)
+		return;
+	pthread_mutex_lock(&kernel);
+	while (current->suspended)
+		pthread_cond_wait(&resumed, &kernel);
+	pthread_mutex_unlock(&kernel);
+}
+
+static void* taskEntry(void* arg)
+{
+	current = arg;
+	current->code(current->param);
+	fprintf(stderr, "rtos: a task returned\n");
+	exit(EXIT_FAILURE);
+	return NULL;
+}
+
+static void startTask(struct rtosTask* t)
+{
+	pthread_attr_t attr;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&t->thread, &attr, taskEntry, t) != 0)
+	{
+		perror("rtos: pthread_create");
+		exit(EXIT_FAILURE);
+	}
+	pthread_attr_destroy(&attr);
+	t->started = 1;
+}
+
+portBASE_TYPE xTaskCreate(void (*code)(void*), const signed char* name, unsigned short stack,
+						  void* param, unsigned portBASE_TYPE prio, xTaskHandle* handle)
+{
+	struct rtosTask* t;
+
+	(void)name;
+	(void)stack;
+	(void)prio;
+	pthread_mutex_lock(&kernel);
+	if (taskCount == RTOS_MAX_TASKS)
+	{
+		pthread_mutex_unlock(&kernel);
+		return pdFAIL;
+	}
+	t = &tasks[taskCount++];
+	t->code = code;
+	t->param = param;
+	if (handle != NULL)
+		*handle = t;
+	if (schedulerRunning)
+		startTask(t);
+	pthread_mutex_unlock(&kernel);
+	return pdPASS;
+}
+
+void vTaskStartScheduler(void)
+{
+	int i;
+
+	pthread_mutex_lock(&kernel);
+	schedulerRunning = 1;
+	for (i = 0; i < taskCount; i++)
+		if (!tasks[i].started)
+			startTask(&tasks[i]);
+	pthread_mutex_unlock(&kernel);
+	// The tasks end the program
+	for (;;)
+		pause();
+}
+
+void vTaskDelay(portTickType ticks)
+{
+	struct timespec ts;
+
+	checkSuspended();
+	if (ticks == 0)
+	{
+		sched_yield();
+		return;
+	}
+	nowPlus(&ts, ticks);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+		;
+}
+
+void vTaskSuspend(xTaskHandle task)
+{
+	struct rtosTask* t = task != NULL ? task : current;
+
+	pthread_mutex_lock(&kernel);
+	t->suspended = 1;
+	pthread_mutex_unlock(&kernel);
+	if (t == current)
+		checkSuspended();
+}
+
+void vTaskResume(xTaskHandle task)
+{
+	struct rtosTask* t = task;
+
+	pthread_mutex_lock(&kernel);
+	t->suspended = 0;
+	pthread_cond_broadcast(&resumed);
+	pthread_mutex_unlock(&kernel);
+}
+
+static void locksInit(void)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&suspendAll, &attr);
+	pthread_mutex_init(&critical, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+void vTaskSuspendAll(void)
+{
+	pthread_once(&locksOnce, locksInit);
+	pthread_mutex_lock(&suspendAll);
+}
+
+signed portBASE_TYPE xTaskResumeAll(void)
+{
+	pthread_mutex_unlock(&suspendAll);
+	return pdFALSE;
+}
+
+void vPortEnterCritical(void)
+{
+	pthread_once(&locksOnce, locksInit);
+	pthread_mutex_lock(&critical);
+}
+
+void vPortExitCritical(void)
+{
+	pthread_mutex_unlock(&critical);
+}
+
+xTaskHandle xTaskGetCurrentTaskHandle(void)
+{
+	return current;
+}
+
+portTickType xTaskGetTickCount(void)
+{
+	struct timespec ts;
+
+	if (startTime.tv_sec == 0 && startTime.tv_nsec == 0)
+		clock_gettime(CLOCK_MONOTONIC, &startTime);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (portTickType)((ts.tv_sec - startTime.tv_sec) * 1000 + (ts.tv_nsec - startTime.tv_nsec) / 1000000);
+}
+
+void vPortYield(void)
+{
+	checkSuspended();
+	sched_yield();
+}
+
+xQueueHandle xQueueCreate(unsigned portBASE_TYPE length, unsigned portBASE_TYPE itemSize)
+{
+	struct rtosQueue* q = calloc(1, sizeof(*q));
+	pthread_condattr_t attr;
+
+	if (q == NULL)
+		return NULL;
+	q->length = length;
+	q->itemSize = itemSize;
+	if (itemSize > 0)
+		q->items = calloc(length, itemSize);
+	// The deadlines of nowPlus are on the monotonic clock
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&q->changed, &attr);
+	pthread_condattr_destroy(&attr);
+	return q;
+}
+
+xSemaphoreHandle xSemaphoreCreateMutex(void)
+{
+	xQueueHandle q = xQueueCreate(1, 0);
+
+	if (q != NULL)
+		xQueueSendToBack(q, NULL, 0);
+	return q;
+}
+
+// Queue operations with the kernel lock held
+static int queuePut(xQueueHandle q, const void* item)
+{
+	if (q->count == q->length)
+		return 0;
+	if (q->itemSize > 0)
+		memcpy(q->items + ((q->head + q->count) % q->length) * q->itemSize, item, q->itemSize);
+	q->count++;
+	pthread_cond_broadcast(&q->changed);
+	return 1;
+}
+
+static int queueGet(xQueueHandle q, void* item)
+{
+	if (q->count == 0)
+		return 0;
+	if (q->itemSize > 0)
+		memcpy(item, q->items + q->head * q->itemSize, q->itemSize);
+	q->head = (q->head + 1) % q->length;
+	q->count--;
+	pthread_cond_broadcast(&q->changed);
+	return 1;
+}
+
+signed portBASE_TYPE xQueueSendToBack(xQueueHandle q, const void* item, portTickType ticks)
+{
+	struct timespec ts;
+	int done;
+
+	checkSuspended();
+	if (ticks != portMAX_DELAY)
+		nowPlus(&ts, ticks);
+	pthread_mutex_lock(&kernel);
+	while (!(done = queuePut(q, item)) && ticks != 0)
+		if (!kernelWait(&q->changed, ticks == portMAX_DELAY ? NULL : &ts))
+			ticks = 0;
+	pthread_mutex_unlock(&kernel);
+	return done ? pdPASS : pdFAIL;
+}
+
+signed portBASE_TYPE xQueueReceive(xQueueHandle q, void* item, portTickType ticks)
+{
+	struct timespec ts;
+	int done;
+
+	checkSuspended();
+	if (ticks != portMAX_DELAY)
+		nowPlus(&ts, ticks);
+	pthread_mutex_lock(&kernel);
+	while (!(done = queueGet(q, item)) && ticks != 0)
+		if (!kernelWait(&q->changed, ticks == portMAX_DELAY ? NULL : &ts))
+			ticks = 0;
+	pthread_mutex_unlock(&kernel);
+	// Polling with no timeout lets the holder run
+	if (!done && ticks == 0)
+		sched_yield();
+	return done ? pdPASS : pdFAIL;
+}
+
+signed portBASE_TYPE xQueueSendFromISR(xQueueHandle q, const void* item, signed portBASE_TYPE* woken)
+{
+	int done;
+
+	pthread_mutex_lock(&kernel);
+	done = queuePut(q, item);
+	pthread_mutex_unlock(&kernel);
+	if (done && woken != NULL)
+		*woken = pdTRUE;
+	return done ? pdPASS : pdFAIL;
+}
+
+unsigned portBASE_TYPE uxQueueMessagesWaiting(xQueueHandle q)
+{
+	unsigned count;
+
+	pthread_mutex_lock(&kernel);
+	count = q->count;
+	pthread_mutex_unlock(&kernel);
+	return count;
+}
+
+double rtosTaskCpu(xTaskHandle task)
+{
+	struct rtosTask* t = task;
+	clockid_t clk;
+	struct timespec ts;
+
+	if (t == NULL || !t->started || pthread_getcpuclockid(t->thread, &clk) != 0)
+		return 0;
+	if (clock_gettime(clk, &ts) != 0)
+		return 0;
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,991 @@
+// Scriptable HiLo modem simulator.
+//
+// It answers the AT commands used by the Flyport libs with the replies of a HiLo
+// in standard mode, echo included. Chars are paced at the UART baud rate in both
+// directions. TCP sessions are served by an echo server, FTP downloads get a
+// generated file (see simFtpByte). AT+KTCPSTART switches to transparent mode,
+// left with "+++" between two SIM_GUARD silences. AT+CMUX starts a 07.10
+// multiplexer (basic option, UIH frames): DLCI 1 and 2 then work as two modems
+// sharing the echo server, the unsolicited codes go on DLCI 1. AT+IPR changes the
+// speed once its OK is sent. The host stops the modem by not reading the pty (RTS).
+//
+// Script directives, one per line, # starts a comment:
+//	baud <bps>						UART speed, 0 for no pacing (115200)
+//	ipr <bps>						highest speed taken by AT+IPR (921600)
+//	latency <ms>					delay of every reply (5)
+//	latency <prefix> <ms>			delay of the replies to the commands starting with prefix
+//	rtt <ms>						echo server round trip, before +KTCP_DATA (50)
+//	ftpsize <bytes>					size of the files served by AT+KFTPRCV (32768)
+//	error <prefix> <count> <reply>	next count commands starting with prefix get reply
+//	urc <ms> <text>					unsolicited code sent ms after the start
+//	urc-after <prefix> <ms> <text>	unsolicited code sent ms after each reply to prefix
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+#define SIM_RULES		32
+#define SIM_LINE		256
+#define SIM_EOF			"--EOF--Pattern--"
+#define SIM_EOF_LEN		16
+#define SIM_IMEI		"351234567890123"
+#define SIM_GUARD		1.0
+
+// 07.10 multiplexer
+#define MUX_FLAG		0xF9
+#define MUX_PF			0x10
+#define MUX_SABM		0x2F
+#define MUX_UA			0x63
+#define MUX_UIH			0xEF
+#define MUX_MSC			0xE1
+#define MUX_V24_FC		0x02
+#define MUX_N1			127
+#define MUX_CHANNELS	3
+
+enum { RULE_LATENCY, RULE_ERROR, RULE_URC, RULE_URC_AFTER };
+
+struct simRule
+{
+	int type;
+	char prefix[64];
+	long ms;
+	long count;
+	char text[128];
+};
+
+// Growing byte buffer, consumed from head
+struct simBuf
+{
+	char* data;
+	size_t head;
+	size_t len;
+	size_t size;
+};
+
+// Chars scheduled for the UART, or TCP data reaching the echo server
+struct simEvent
+{
+	double due;
+	int dlci;
+	int muxStart;
+	long ipr;
+	long tcpData;
+	struct simBuf out;
+	struct simEvent* next;
+};
+
+enum { MODE_CMD, MODE_TCPSND, MODE_SMS, MODE_STREAM };
+
+static struct simRule rules[SIM_RULES];
+static int ruleCount;
+static long baud = 115200;
+static long iprMax = 921600;
+// Speed of AT+IPR, once the UART sent its OK
+static long iprNext;
+static long latency = 5;
+static long rtt = 50;
+static long ftpSize = 32768;
+
+static double startTime;
+static double byteTime;
+static int uart;
+
+// UART out: chars leave at outClock, one byteTime each
+static struct simBuf outq;
+static double outClock;
+// UART in: chars and the time they are fully received
+static struct simBuf inq;
+static double* inDue;
+static size_t inDueSize;
+static double inClock;
+
+static struct simEvent* events;
+
+// State of a modem: the UART, or a DLCI of the multiplexer
+struct simChan
+{
+	int mode;
+	int echo;
+	char line[SIM_LINE];
+	int lineLen;
+	long sndExpected;
+	struct simBuf snd;
+	// Transparent mode: last char received, "+" of the escape sequence held back,
+	// and the echo of the last chars
+	double streamLast;
+	int streamPlus;
+	struct simEvent* streamEv;
+	// Multiplexer: chars waiting for their frame, and channel stopped by the host
+	struct simBuf held;
+	int stopped;
+};
+
+static struct simChan chans[MUX_CHANNELS];
+// Channel of the char being handled, 0 without multiplexer
+static int cur;
+static struct simChan* ch = &chans[0];
+// Echo of the chars being handled
+static struct simBuf echoBuf;
+static int cmgsRef;
+
+static int muxOn;
+// Frame being received, from the address to the closing flag. The basic option has
+// no transparency, frames are found by their length field.
+static unsigned char frame[MUX_N1 + 8];
+static int frameLen;
+static int muxHunt;
+
+// Echo server: chars in flight, then available to AT+KTCPRCV
+static struct simBuf tcpData;
+static long tcpInFlight;
+static long tcpAvail;
+
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bufAdd(struct simBuf* b, const char* data, size_t len)
+{
+	if (b->head > 0 && b->head == b->len)
+		b->head = b->len = 0;
+	if (b->len + len > b->size)
+	{
+		if (b->head > 0)
+		{
+			memmove(b->data, b->data + b->head, b->len - b->head);
+			b->len -= b->head;
+			b->head = 0;
+		}
+		while (b->len + len > b->size)
+			b->size = b->size ? b->size * 2 : 256;
+		b->data = realloc(b->data, b->size);
+		if (b->data == NULL)
+		{
+			perror("sim");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+}
+
+static void bufAddStr(struct simBuf* b, const char* str)
+{
+	bufAdd(b, str, strlen(str));
+}
+
+static size_t bufSize(const struct simBuf* b)
+{
+	return b->len - b->head;
+}
+
+static void schedule(struct simEvent* ev)
+{
+	struct simEvent** p = &events;
+
+	// Same due time: kept in order
+	while (*p != NULL && (*p)->due <= ev->due)
+		p = &(*p)->next;
+	ev->next = *p;
+	*p = ev;
+}
+
+static struct simEvent* newEvent(double due)
+{
+	struct simEvent* ev = calloc(1, sizeof(*ev));
+
+	if (ev == NULL)
+	{
+		perror("sim");
+		exit(EXIT_FAILURE);
+	}
+	ev->due = due;
+	ev->dlci = cur;
+	return ev;
+}
+
+static void sendAt(double due, const char* text)
+{
+	struct simEvent* ev = newEvent(due);
+
+	bufAddStr(&ev->out, text);
+	schedule(ev);
+}
+
+static void sendUrc(double due, const char* text)
+{
+	struct simEvent* ev = newEvent(due);
+
+	bufAddStr(&ev->out, "\r\n");
+	bufAddStr(&ev->out, text);
+	bufAddStr(&ev->out, "\r\n");
+	schedule(ev);
+}
+
+static void uartOut(const char* data, size_t len)
+{
+	double t = now();
+
+	if (bufSize(&outq) == 0 && outClock < t)
+		outClock = t;
+	bufAdd(&outq, data, len);
+}
+
+static unsigned char muxFcs(unsigned char fcs, unsigned char c)
+{
+	int i;
+
+	fcs ^= c;
+	for (i = 0; i < 8; i++)
+		fcs = (fcs & 1) ? (fcs >> 1) ^ 0xE0 : (fcs >> 1);
+	return fcs;
+}
+
+static void muxFrame(int dlci, int cr, unsigned char ctrl, const char* info, size_t len)
+{
+	unsigned char head[4], tail[2];
+
+	head[0] = MUX_FLAG;
+	head[1] = (dlci << 2) | (cr ? 2 : 0) | 1;
+	head[2] = ctrl;
+	head[3] = (len << 1) | 1;
+	tail[0] = 0xFF - muxFcs(muxFcs(muxFcs(0xFF, head[1]), head[2]), head[3]);
+	tail[1] = MUX_FLAG;
+	uartOut((char*)head, 4);
+	uartOut(info, len);
+	uartOut((char*)tail, 2);
+}
+
+// Output of a channel. With the multiplexer the chars wait for muxPump. Channel 0 is the AT channel.
+static void chanOut(int dlci, const char* data, size_t len)
+{
+	if (!muxOn)
+	{
+		uartOut(data, len);
+		return;
+	}
+	bufAdd(&chans[dlci == 0 ? 1 : dlci].held, data, len);
+}
+
+// Frames of the channels go on the UART one at a time, once the previous one left,
+// so that a channel stops within a frame when the host stops it
+static void muxPump(void)
+{
+	static int last;
+	struct simChan* c;
+	size_t n;
+	int i;
+
+	if (!muxOn || bufSize(&outq) > 0)
+		return;
+	for (i = 1; i <= MUX_CHANNELS; i++)
+	{
+		c = &chans[(last + i) % MUX_CHANNELS];
+		if (c->stopped || bufSize(&c->held) == 0)
+			continue;
+		last = c - chans;
+		n = bufSize(&c->held);
+		if (n > MUX_N1)
+			n = MUX_N1;
+		muxFrame(last, 0, MUX_UIH, c->held.data + c->held.head, n);
+		c->held.head += n;
+		return;
+	}
+}
+
+static void echoFlush(void)
+{
+	chanOut(cur, echoBuf.data + echoBuf.head, bufSize(&echoBuf));
+	echoBuf.head = echoBuf.len = 0;
+}
+
+unsigned char simFtpByte(long offset)
+{
+	return (unsigned char)(offset * 31 + (offset >> 8) + 7);
+}
+
+static int startsWith(const char* str, const char* prefix)
+{
+	return strncmp(str, prefix, strlen(prefix)) == 0;
+}
+
+int simSet(const char* text)
+{
+	char word[32];
+	struct simRule r;
+	int n = 0;
+
+	memset(&r, 0, sizeof(r));
+	while (*text == ' ' || *text == '\t')
+		text++;
+	if (*text == '\0' || *text == '#' || *text == '\r' || *text == '\n')
+		return 0;
+	if (sscanf(text, "%31s %n", word, &n) != 1)
+		return -1;
+	text += n;
+
+	if (strcmp(word, "baud") == 0)
+		return sscanf(text, "%ld", &baud) == 1 && baud >= 0 ? 0 : -1;
+	if (strcmp(word, "ipr") == 0)
+		return sscanf(text, "%ld", &iprMax) == 1 && iprMax > 0 ? 0 : -1;
+	if (strcmp(word, "rtt") == 0)
+		return sscanf(text, "%ld", &rtt) == 1 && rtt >= 0 ? 0 : -1;
+	if (strcmp(word, "ftpsize") == 0)
+		return sscanf(text, "%ld", &ftpSize) == 1 && ftpSize >= 0 ? 0 : -1;
+	if (strcmp(word, "latency") == 0)
+	{
+		if (sscanf(text, "%ld", &r.ms) == 1)
+			return (latency = r.ms) >= 0 ? 0 : -1;
+		r.type = RULE_LATENCY;
+		if (sscanf(text, "%63s %ld", r.prefix, &r.ms) != 2)
+			return -1;
+	}
+	else if (strcmp(word, "error") == 0)
+	{
+		r.type = RULE_ERROR;
+		if (sscanf(text, "%63s %ld %127[^\r\n]", r.prefix, &r.count, r.text) != 3)
+			return -1;
+	}
+	else if (strcmp(word, "urc") == 0)
+	{
+		r.type = RULE_URC;
+		if (sscanf(text, "%ld %127[^\r\n]", &r.ms, r.text) != 2)
+			return -1;
+	}
+	else if (strcmp(word, "urc-after") == 0)
+	{
+		r.type = RULE_URC_AFTER;
+		if (sscanf(text, "%63s %ld %127[^\r\n]", r.prefix, &r.ms, r.text) != 3)
+			return -1;
+	}
+	else
+		return -1;
+
+	if (ruleCount == SIM_RULES)
+		return -1;
+	rules[ruleCount++] = r;
+	return 0;
+}
+
+int simLoad(const char* path)
+{
+	char buf[SIM_LINE];
+	int lineNo = 0;
+	FILE* f = fopen(path, "r");
+
+	if (f == NULL)
+	{
+		perror(path);
+		return -1;
+	}
+	while (fgets(buf, sizeof(buf), f) != NULL)
+	{
+		lineNo++;
+		if (simSet(buf) != 0)
+		{
+			fprintf(stderr, "%s:%d: bad directive\n", path, lineNo);
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+long simBaud(void)
+{
+	return baud;
+}
+
+// Reply delay of a command, in seconds
+static double replyDelay(const char* cmd)
+{
+	int i;
+
+	for (i = 0; i < ruleCount; i++)
+		if (rules[i].type == RULE_LATENCY && startsWith(cmd, rules[i].prefix))
+			return rules[i].ms / 1000.0;
+	return latency / 1000.0;
+}
+
+// Speeds of AT+IPR
+static int iprValid(long bps)
+{
+	static const long rates[] = { 1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600 };
+	size_t i;
+
+	for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+		if (rates[i] == bps)
+			return bps <= iprMax;
+	return 0;
+}
+
+static void tcpReceived(double t, long len)
+{
+	struct simEvent* ev = newEvent(t + rtt / 1000.0);
+
+	tcpInFlight += len;
+	ev->tcpData = len;
+	schedule(ev);
+}
+
+// Handles a complete command line, replies at t
+static void command(const char* cmd, double t)
+{
+	char reply[128];
+	struct simEvent* ev;
+	long a, b;
+	int i;
+
+	if (cmd[0] == '\0')
+		return;
+
+	for (i = 0; i < ruleCount; i++)
+	{
+		if (rules[i].type == RULE_ERROR && rules[i].count > 0 && startsWith(cmd, rules[i].prefix))
+		{
+			rules[i].count--;
+			sendUrc(t, rules[i].text);
+			return;
+		}
+	}
+	for (i = 0; i < ruleCount; i++)
+		if (rules[i].type == RULE_URC_AFTER && startsWith(cmd, rules[i].prefix))
+			sendUrc(t + rules[i].ms / 1000.0, rules[i].text);
+
+	if (startsWith(cmd, "ATE0") || startsWith(cmd, "ATE1"))
+	{
+		ch->echo = cmd[3] == '1';
+		sendAt(t, "\r\nOK\r\n");
+	}
+	else if (startsWith(cmd, "AT+KGSN"))
+		sendAt(t, "\r\n+KGSN: " SIM_IMEI "\r\n\r\nOK\r\n");
+	else if (startsWith(cmd, "AT+CSQ"))
+		sendAt(t, "\r\n+CSQ: 18,0\r\n\r\nOK\r\n");
+	else if (startsWith(cmd, "AT+CREG=1"))
+	{
+		sendAt(t, "\r\nOK\r\n");
+		sendUrc(t + 0.1, "+CREG: 1");
+	}
+	else if (startsWith(cmd, "AT+KTCPCFG"))
+		sendAt(t, "\r\n+KTCPCFG: 1\r\n\r\nOK\r\n");
+	else if (startsWith(cmd, "AT+KTCPSTAT"))
+	{
+		sprintf(reply, "\r\n+KTCPSTAT: 3,-1,0,%ld\r\n\r\nOK\r\n", tcpAvail);
+		sendAt(t, reply);
+	}
+	else if (sscanf(cmd, "AT+KTCPSND=%ld,%ld", &a, &b) == 2)
+	{
+		sendAt(t, "\r\nCONNECT\r\n");
+		ch->mode = MODE_TCPSND;
+		ch->sndExpected = b;
+		ch->snd.head = ch->snd.len = 0;
+	}
+	else if (startsWith(cmd, "AT+KTCPSTART="))
+	{
+		sendAt(t, "\r\nCONNECT\r\n");
+		ch->mode = MODE_STREAM;
+		ch->streamLast = t;
+		ch->streamPlus = 0;
+	}
+	else if (sscanf(cmd, "AT+IPR=%ld", &a) == 1)
+	{
+		if (!iprValid(a))
+		{
+			sendAt(t, "\r\nERROR\r\n");
+			return;
+		}
+		// The new speed applies once OK is sent
+		ev = newEvent(t);
+		bufAddStr(&ev->out, "\r\nOK\r\n");
+		ev->ipr = a;
+		schedule(ev);
+	}
+	else if (startsWith(cmd, "AT+CMUX=") && !muxOn)
+	{
+		// The multiplexer starts once OK is sent
+		ev = newEvent(t);
+		bufAddStr(&ev->out, "\r\nOK\r\n");
+		ev->muxStart = 1;
+		schedule(ev);
+	}
+	else if (sscanf(cmd, "AT+KTCPRCV=%ld,%ld", &a, &b) == 2)
+	{
+		if (b > tcpAvail)
+			b = tcpAvail;
+		ev = newEvent(t);
+		bufAddStr(&ev->out, "\r\nCONNECT\r\n");
+		if (b > 0)
+			bufAdd(&ev->out, tcpData.data + tcpData.head, b);
+		bufAddStr(&ev->out, SIM_EOF "\r\nOK\r\n");
+		schedule(ev);
+		tcpData.head += b;
+		tcpAvail -= b;
+	}
+	else if (startsWith(cmd, "AT+KFTPCFG"))
+		sendAt(t, "\r\n+KFTPCFG: 1\r\n\r\nOK\r\n");
+	else if (startsWith(cmd, "AT+KFTPRCV"))
+	{
+		ev = newEvent(t);
+		bufAddStr(&ev->out, "\r\nCONNECT\r\n");
+		for (a = 0; a < ftpSize; a++)
+		{
+			char c = simFtpByte(a);
+			bufAdd(&ev->out, &c, 1);
+		}
+		bufAddStr(&ev->out, SIM_EOF "\r\nOK\r\n");
+		schedule(ev);
+	}
+	else if (startsWith(cmd, "AT+CMGS="))
+	{
+		sendAt(t, "\r\n> ");
+		ch->mode = MODE_SMS;
+	}
+	else if (startsWith(cmd, "AT"))
+		sendAt(t, "\r\nOK\r\n");
+	else
+		sendAt(t, "\r\nERROR\r\n");
+}
+
+// Transparent mode data, echoed after rtt. Chars received within 1 ms go together.
+static void streamData(const char* data, size_t len, double t)
+{
+	double due = t + rtt / 1000.0;
+
+	if (ch->streamEv == NULL || due - ch->streamEv->due > 0.001)
+	{
+		ch->streamEv = newEvent(due);
+		schedule(ch->streamEv);
+	}
+	bufAdd(&ch->streamEv->out, data, len);
+}
+
+// Handles a char of the current channel
+static void chanInput(char c, double t)
+{
+	char reply[64];
+
+	switch (ch->mode)
+	{
+		case MODE_TCPSND:
+			bufAdd(&ch->snd, &c, 1);
+			if (bufSize(&ch->snd) >= SIM_EOF_LEN
+				&& memcmp(ch->snd.data + ch->snd.len - SIM_EOF_LEN, SIM_EOF, SIM_EOF_LEN) == 0
+				&& (long)bufSize(&ch->snd) - SIM_EOF_LEN >= ch->sndExpected)
+			{
+				long len = bufSize(&ch->snd) - SIM_EOF_LEN;
+
+				bufAdd(&tcpData, ch->snd.data + ch->snd.head, len);
+				tcpReceived(t, len);
+				sendAt(t + replyDelay("AT+KTCPSND"), "\r\nOK\r\n");
+				// Data sent, but not as many chars as announced
+				if (len != ch->sndExpected)
+					sendUrc(t + replyDelay("AT+KTCPSND"), "+KTCP_NOTIF: 1,8");
+				ch->mode = MODE_CMD;
+			}
+			break;
+
+		case MODE_STREAM:
+			// "+++" is an escape only after a guard time, and before another one (see simRun)
+			if (c == '+' && ch->streamPlus < 3 && (ch->streamPlus > 0 || t - ch->streamLast >= SIM_GUARD))
+				ch->streamPlus++;
+			else
+			{
+				if (ch->streamPlus > 0)
+					streamData("+++", ch->streamPlus, t);
+				ch->streamPlus = 0;
+				streamData(&c, 1, t);
+			}
+			ch->streamLast = t;
+			break;
+
+		case MODE_SMS:
+			if (ch->echo)
+				bufAdd(&echoBuf, &c, 1);
+			if (c == 0x1A)
+			{
+				sprintf(reply, "\r\n+CMGS: %d\r\n\r\nOK\r\n", ++cmgsRef);
+				sendAt(t + replyDelay("AT+CMGS"), reply);
+				ch->mode = MODE_CMD;
+			}
+			else if (c == 0x1B)
+			{
+				sendAt(t, "\r\nOK\r\n");
+				ch->mode = MODE_CMD;
+			}
+			break;
+
+		default:
+			if (ch->echo)
+				bufAdd(&echoBuf, &c, 1);
+			if (c == '\r')
+			{
+				ch->line[ch->lineLen] = '\0';
+				ch->lineLen = 0;
+				// The echo goes before the reply
+				echoFlush();
+				command(ch->line, t + replyDelay(ch->line));
+			}
+			else if (c != '\n' && ch->lineLen < SIM_LINE - 1)
+				ch->line[ch->lineLen++] = c;
+			break;
+	}
+}
+
+static void selectChan(int dlci)
+{
+	cur = dlci;
+	ch = &chans[dlci];
+}
+
+// Control channel: opens the DLCIs (SABM) and answers their modem status (MSC).
+// The host stops a channel with the flow control bit of its MSC.
+static void muxControl(int dlci, unsigned char ctrl, const unsigned char* info, int len)
+{
+	unsigned char msc[4];
+	int n;
+
+	if ((ctrl & ~MUX_PF) == MUX_SABM)
+	{
+		muxFrame(dlci, 1, MUX_UA | MUX_PF, NULL, 0);
+		return;
+	}
+	if (dlci != 0 || (ctrl & ~MUX_PF) != MUX_UIH || len < 4 || info[0] != (MUX_MSC | 2))
+		return;
+	n = info[2] >> 2;
+	if (n <= 0 || n >= MUX_CHANNELS)
+		return;
+	memcpy(msc, info, 4);
+	msc[0] = MUX_MSC;
+	muxFrame(0, 1, MUX_UIH, (char*)msc, 4);
+	chans[n].stopped = (info[3] & MUX_V24_FC) != 0;
+}
+
+// A frame was received whole, up to its closing flag
+static void muxInput(double t)
+{
+	int dlci, len, i;
+	unsigned char ctrl, fcs;
+
+	dlci = frame[0] >> 2;
+	ctrl = frame[1];
+	len = frame[2] >> 1;
+	if (dlci >= MUX_CHANNELS)
+		return;
+	fcs = muxFcs(muxFcs(muxFcs(0xFF, frame[0]), frame[1]), frame[2]);
+	if (muxFcs(fcs, frame[len + 3]) != 0xCF)
+		return;
+	if (dlci == 0 || (ctrl & ~MUX_PF) != MUX_UIH)
+	{
+		muxControl(dlci, ctrl, frame + 3, len);
+		return;
+	}
+	selectChan(dlci);
+	for (i = 0; i < len; i++)
+		chanInput(frame[3 + i], t);
+	echoFlush();
+}
+
+// Handles a char coming from the UART, once it is fully received
+static void input(char c, double t)
+{
+	if (!muxOn)
+	{
+		chanInput(c, t);
+		echoFlush();
+		return;
+	}
+	// Flags between frames, or lost frame: waits for the next flag
+	if (muxHunt || (frameLen == 0 && (unsigned char)c == MUX_FLAG))
+	{
+		muxHunt = (unsigned char)c != MUX_FLAG;
+		return;
+	}
+	frame[frameLen++] = c;
+	if (frameLen == 3 && (!(frame[2] & 1) || (frame[2] >> 1) > MUX_N1))
+	{
+		muxHunt = 1;
+		frameLen = 0;
+	}
+	else if (frameLen >= 3 && frameLen == (frame[2] >> 1) + 5)
+	{
+		if ((unsigned char)c == MUX_FLAG)
+			muxInput(t);
+		else
+			muxHunt = 1;
+		frameLen = 0;
+	}
+}
+
+static void fireEvents(double t)
+{
+	struct simEvent* ev;
+	char urc[64];
+	int i;
+
+	while (events != NULL && events->due <= t)
+	{
+		ev = events;
+		events = ev->next;
+		for (i = 0; i < MUX_CHANNELS; i++)
+			if (ev == chans[i].streamEv)
+				chans[i].streamEv = NULL;
+		if (ev->tcpData > 0)
+		{
+			tcpInFlight -= ev->tcpData;
+			tcpAvail += ev->tcpData;
+			sprintf(urc, "\r\n+KTCP_DATA: 1,%ld\r\n", tcpAvail);
+			chanOut(0, urc, strlen(urc));
+		}
+		else
+			chanOut(ev->dlci, ev->out.data + ev->out.head, bufSize(&ev->out));
+		if (ev->ipr > 0)
+			iprNext = ev->ipr;
+		if (ev->muxStart)
+		{
+			// Both DLCIs start with the settings of the UART
+			muxOn = 1;
+			frameLen = 0;
+			muxHunt = 0;
+			for (i = 1; i < MUX_CHANNELS; i++)
+				chans[i].echo = chans[0].echo;
+		}
+		free(ev->out.data);
+		free(ev);
+	}
+}
+
+// Ends the transparent mode of the channels that got "+++" and a guard time since.
+// Returns when the next one is due, -1 if none.
+static double streamEscape(double t)
+{
+	double next = -1;
+	int i;
+
+	for (i = 0; i < MUX_CHANNELS; i++)
+	{
+		if (chans[i].mode != MODE_STREAM || chans[i].streamPlus != 3)
+			continue;
+		if (t - chans[i].streamLast >= SIM_GUARD)
+		{
+			chanOut(i, "\r\nOK\r\n", 6);
+			chans[i].mode = MODE_CMD;
+		}
+		else if (next < 0 || chans[i].streamLast + SIM_GUARD < next)
+			next = chans[i].streamLast + SIM_GUARD;
+	}
+	return next;
+}
+
+// Reads the chars sent by the host, each one is received one byteTime after the previous one
+static void uartIn(double t)
+{
+	char buf[512];
+	size_t pending;
+	ssize_t n, i;
+
+	n = read(uart, buf, sizeof(buf));
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (n <= 0)
+		exit(EXIT_SUCCESS);
+	// inq and inDue are kept aligned from their start
+	pending = bufSize(&inq);
+	if (inq.head > 0)
+	{
+		memmove(inq.data, inq.data + inq.head, pending);
+		memmove(inDue, inDue + inq.head, pending * sizeof(double));
+		inq.len = pending;
+		inq.head = 0;
+	}
+	if (inDueSize < pending + n)
+	{
+		inDueSize = (pending + n) * 2;
+		inDue = realloc(inDue, inDueSize * sizeof(double));
+		if (inDue == NULL)
+		{
+			perror("sim");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (i = 0; i < n; i++)
+	{
+		if (inClock < t)
+			inClock = t;
+		inClock += byteTime;
+		inDue[inq.len + i] = inClock;
+	}
+	bufAdd(&inq, buf, n);
+}
+
+static void uartFlush(double t)
+{
+	size_t n = bufSize(&outq);
+	ssize_t w;
+
+	if (n == 0)
+		return;
+	if (byteTime > 0)
+	{
+		size_t due = (size_t)((t - outClock) / byteTime);
+
+		if (due < n)
+			n = due;
+		if (n == 0)
+			return;
+	}
+	w = write(uart, outq.data + outq.head, n);
+	// Held by the host: the line was idle until now
+	if (w < (ssize_t)n)
+		outClock = t;
+	if (w <= 0)
+		return;
+	outq.head += w;
+	if (w == (ssize_t)n)
+		outClock += w * byteTime;
+}
+
+void simRun(int fd)
+{
+	struct pollfd pfd;
+	struct timespec ts;
+	double t, next, wait, escape;
+	int i;
+
+	uart = fd;
+	for (i = 0; i < MUX_CHANNELS; i++)
+	{
+		chans[i].mode = MODE_CMD;
+		chans[i].echo = 1;
+	}
+	fcntl(uart, F_SETFL, fcntl(uart, F_GETFL) | O_NONBLOCK);
+	byteTime = baud > 0 ? 10.0 / baud : 0;
+	startTime = now();
+	for (i = 0; i < ruleCount; i++)
+		if (rules[i].type == RULE_URC)
+			sendUrc(startTime + rules[i].ms / 1000.0, rules[i].text);
+
+	for (;;)
+	{
+		t = now();
+		while (bufSize(&inq) > 0 && inDue[inq.head] <= t)
+		{
+			input(inq.data[inq.head], inDue[inq.head]);
+			inq.head++;
+		}
+		fireEvents(t);
+		escape = streamEscape(t);
+		muxPump();
+		uartFlush(t);
+		muxPump();
+		if (iprNext > 0 && bufSize(&outq) == 0)
+		{
+			if (byteTime > 0)
+				byteTime = 10.0 / (baud = iprNext);
+			iprNext = 0;
+		}
+
+		// Sleeps until the next char or event is due
+		next = -1;
+		if (bufSize(&inq) > 0)
+			next = inDue[inq.head];
+		pfd.fd = uart;
+		pfd.events = POLLIN;
+		if (bufSize(&outq) > 0)
+		{
+			// Chars already due wait for room in the pty
+			if (outClock + byteTime <= now())
+				pfd.events |= POLLOUT;
+			else if (next < 0 || outClock + byteTime < next)
+				next = outClock + byteTime;
+		}
+		if (events != NULL && (next < 0 || events->due < next))
+			next = events->due;
+		if (escape >= 0 && (next < 0 || escape < next))
+			next = escape;
+		if (next < 0)
+			poll(&pfd, 1, -1);
+		else
+		{
+			wait = next - now();
+			if (wait < 0)
+				wait = 0;
+			ts.tv_sec = (time_t)wait;
+			ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+			ppoll(&pfd, 1, &ts, NULL);
+		}
+		if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+			uartIn(now());
+	}
+}
+
+int simOpen(char* path, size_t len)
+{
+	struct termios tio;
+	int master, slave;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0
+		|| ptsname_r(master, path, len) != 0)
+	{
+		perror("sim: pty");
+		return -1;
+	}
+	// The pty is raw before anybody uses it. Its other side is kept open, so the
+	// modem stays up when the host closes it.
+	slave = open(path, O_RDWR | O_NOCTTY);
+	if (slave < 0 || tcgetattr(slave, &tio) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+	if (tcgetattr(master, &tio) == 0)
+	{
+		cfmakeraw(&tio);
+		tcsetattr(master, TCSANOW, &tio);
+	}
+	return master;
+}
+
+pid_t simStart(char* path, size_t len)
+{
+	int master = simOpen(path, len);
+	pid_t pid;
+
+	if (master < 0)
+		return -1;
+	pid = fork();
+	if (pid < 0)
+	{
+		perror("sim: fork");
+		return -1;
+	}
+	if (pid == 0)
+	{
+		// The modem goes with the bench
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+		if (getppid() == 1)
+			exit(EXIT_SUCCESS);
+		simRun(master);
+	}
+	close(master);
+	return pid;
+}
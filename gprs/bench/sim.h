@@ -0,0 +1,27 @@
+#ifndef SIM_H
+#define SIM_H
+
+// Scriptable HiLo modem simulator, see sim.c for the script directives
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Applies one script directive, -1 if it is not valid
+int simSet(const char* line);
+// Applies the directives of a script file, -1 if it cannot be read or has errors
+int simLoad(const char* path);
+
+// UART speed set by the directives
+long simBaud(void);
+
+// Opens a raw pty for the modem and returns its master side, the path of the other side in path
+int simOpen(char* path, size_t len);
+// Runs the modem on the pty master, never returns
+void simRun(int fd);
+// Runs the modem in a child process, returns its pid or -1
+pid_t simStart(char* path, size_t len);
+
+// Char at offset of the file served by AT+KFTPRCV
+unsigned char simFtpByte(long offset);
+
+#endif
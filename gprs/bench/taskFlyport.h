@@ -0,0 +1,15 @@
+#ifndef TASKFLYPORT_H
+#define TASKFLYPORT_H
+
+// Host stand-in for the Flyport task header: bench.c provides FlyportTask
+
+#include "HWlib.h"
+#include "Hilo.h"
+
+extern xQueueHandle xQueue;
+extern xSemaphoreHandle xSemFrontEnd;
+extern xSemaphoreHandle xSemHW;
+
+void FlyportTask();
+
+#endif
@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Trace.h"
+
+// Decoder of the AT channel trace written by GSMTraceSave (see Trace.c), read back from the
+// SPI flash or saved by gprsbench -T. Gives the latency of each AT command, from its write to
+// its final result code (OK, ERROR, CONNECT...), and the run time of each command of the GSM Task,
+// with their histograms. -v prints the trace.
+
+#define LINE_MAX	64
+#define BUCKETS		15	// below 1 ms, then powers of 2 up to 8192 ms and more
+
+struct latency
+{
+	char name[16];
+	unsigned n;
+	unsigned errors;
+	double min, max, sum;
+	unsigned hist[BUCKETS];
+};
+
+// Functions of the GSM Task, see FP_GSM in Main.c
+static const char* functions[] =
+{
+	[1] = "SMSSend", [2] = "SMSRead", [3] = "SMSDelete", [5] = "SMTPParamsClear",
+	[6] = "SMTPParamsSet", [7] = "SMTPEmailTo", [8] = "SMTPEmailSend", [10] = "CALLHangUp",
+	[11] = "CALLVoiceStart", [12] = "FTPConfig", [13] = "FTPReceive", [14] = "FTPSend",
+	[15] = "FTPDelete", [17] = "LLWrite", [18] = "LLModeEnable", [19] = "STDModeEnable",
+	[20] = "TCPClientOpen", [21] = "TCPClientClose", [22] = "TCPStatus", [23] = "TCPWrite",
+	[24] = "TCPRead", [25] = "TCPRxFlush", [26] = "APNConfig", [27] = "HTTPRequest",
+	[28] = "GSMHibernate", [29] = "GSMOn", [30] = "FSWrite", [31] = "FSRead", [32] = "FSDelete",
+	[33] = "FSSize", [34] = "FSAppend", [35] = "GSMSignal", [36] = "TCPStreamStart",
+	[37] = "TCPStreamStop", [38] = "TCPStreamDial",
+};
+#define FUNCTIONS	(int)(sizeof(functions) / sizeof(functions[0]))
+
+// Final result codes of a command
+static const char* finals[] =
+{
+	"OK", "ERROR", "+CME ERROR", "+CMS ERROR", "CONNECT", "NO CARRIER", "BUSY", "NO ANSWER",
+	"NO DIALTONE",
+};
+
+static struct latency atCmds[64];
+static int atCount;
+static struct latency gsmCmds[64];
+static int gsmCount;
+static int verbose;
+
+static unsigned long records[4];
+static unsigned long bytes[4];
+static unsigned long unanswered;
+static unsigned long gapped;
+
+static double rate;
+
+// AT command waiting for its result
+static struct
+{
+	int on;
+	char name[16];
+	double t;
+} pending;
+
+// GSM Task command running
+static struct
+{
+	int function;
+	double t;
+} running;
+
+static char line[LINE_MAX];
+static int lineLen;
+
+static void usage(const char* prog)
+{
+	printf("usage: %s [-v] trace\n"
+		"  -v          prints the records\n", prog);
+}
+
+static struct latency* find(struct latency* tab, int* count, int max, const char* name)
+{
+	int i;
+
+	for (i = 0; i < *count; i++)
+		if (strcmp(tab[i].name, name) == 0)
+			return &tab[i];
+	if (*count == max)
+		return NULL;
+	memset(&tab[*count], 0, sizeof(tab[0]));
+	snprintf(tab[*count].name, sizeof(tab[0].name), "%s", name);
+	return &tab[(*count)++];
+}
+
+static void add(struct latency* l, double ms, int error)
+{
+	int b = 0;
+	double top = 1;
+
+	if (l == NULL)
+		return;
+	if (error)
+		l->errors++;
+	if (l->n == 0 || ms < l->min)
+		l->min = ms;
+	if (ms > l->max)
+		l->max = ms;
+	l->sum += ms;
+	l->n++;
+	while (b < BUCKETS - 1 && ms >= top) {
+		b++;
+		top *= 2;
+	}
+	l->hist[b]++;
+}
+
+// Name of an AT command: what follows AT, up to its parameters
+static void atName(const unsigned char* p, int len, char* name, int size)
+{
+	int n = 0;
+
+	p += 2;
+	len -= 2;
+	if (len > 0 && *p == '+') {
+		p++;
+		len--;
+	}
+	while (len-- > 0 && n < size - 1 && *p != '=' && *p != '?' && *p != '\r' && *p != ';')
+		name[n++] = *p++;
+	name[n] = '\0';
+	if (n == 0)
+		snprintf(name, size, "AT");
+}
+
+// Command written: a write starting with AT. The ones that follow are its parameters or data.
+static void tx(const unsigned char* p, int len, double t)
+{
+	if (len < 2 || p[0] != 'A' || p[1] != 'T')
+		return;
+	if (pending.on)
+		unanswered++;
+	pending.on = 1;
+	pending.t = t;
+	atName(p, len, pending.name, sizeof(pending.name));
+}
+
+// Line from the modem, at t
+static void rxLine(double t)
+{
+	size_t i;
+	size_t n;
+
+	if (lineLen == 0 || !pending.on)
+		return;
+	for (i = 0; i < sizeof(finals) / sizeof(finals[0]); i++) {
+		n = strlen(finals[i]);
+		if ((size_t)lineLen >= n && memcmp(line, finals[i], n) == 0) {
+			add(find(atCmds, &atCount, 64, pending.name), (t - pending.t) * 1e3 / rate,
+				strcmp(finals[i], "OK") != 0 && strcmp(finals[i], "CONNECT") != 0);
+			pending.on = 0;
+			return;
+		}
+	}
+}
+
+static void rx(const unsigned char* p, int len, double t)
+{
+	while (len-- > 0) {
+		if (*p == '\n') {
+			rxLine(t);
+			lineLen = 0;
+		}
+		else if (*p != '\r' && lineLen < LINE_MAX)
+			line[lineLen++] = *p;
+		p++;
+	}
+}
+
+static void cmd(const unsigned char* p, int len, double t)
+{
+	const char* name;
+	char num[16];
+	int function = p[0];
+
+	if (len == 1) {
+		running.function = function;
+		running.t = t;
+		return;
+	}
+	if (len != 4 || running.function != function)
+		return;
+	name = (function < FUNCTIONS) ? functions[function] : NULL;
+	if (name == NULL) {
+		snprintf(num, sizeof(num), "function %d", function);
+		name = num;
+	}
+	add(find(gsmCmds, &gsmCount, 64, name), (t - running.t) * 1e3 / rate, (signed char)p[1] > 0);
+	running.function = 0;
+}
+
+static void print(int type, const unsigned char* p, int len, double t)
+{
+	static const char* types[] = { "rx", "tx", "cmd", "time" };
+	int i;
+
+	printf("%12.3f %-4s ", t * 1e3 / rate, types[type]);
+	if (type == TRACE_CMD)
+		printf("%d%s", p[0], len == 4 ? " end" : "");
+	if (type == TRACE_CMD && len == 4)
+		printf(", status %d, error %d", (signed char)p[1], p[2] | p[3] << 8);
+	if (type == TRACE_RX || type == TRACE_TX)
+		for (i = 0; i < len; i++) {
+			if (p[i] >= ' ' && p[i] < 127 && p[i] != '\\')
+				putchar(p[i]);
+			else if (p[i] == '\r')
+				printf("\\r");
+			else if (p[i] == '\n')
+				printf("\\n");
+			else
+				printf("\\x%02x", p[i]);
+		}
+	putchar('\n');
+}
+
+static void report(const char* title, struct latency* tab, int count)
+{
+	struct latency* l;
+	double top;
+	int i, b, first, last;
+
+	if (count == 0)
+		return;
+	printf("\n%-16s %6s %6s %10s %10s %10s\n", title, "count", "errors", "min ms", "mean ms", "max ms");
+	for (i = 0; i < count; i++) {
+		l = &tab[i];
+		printf("%-16s %6u %6u %10.2f %10.2f %10.2f\n", l->name, l->n, l->errors, l->min,
+			l->sum / l->n, l->max);
+	}
+	for (i = 0; i < count; i++) {
+		l = &tab[i];
+		for (first = 0; l->hist[first] == 0; first++)
+			;
+		for (last = BUCKETS - 1; l->hist[last] == 0; last--)
+			;
+		printf("\n%s\n", l->name);
+		top = 1;
+		for (b = 0; b < BUCKETS; b++, top *= 2) {
+			if (b < first || b > last)
+				continue;
+			if (b == 0)
+				printf("   %5s ms .. %-5g", "0", top);
+			else if (b == BUCKETS - 1)
+				printf("   %5g ms ..      ", top / 2);
+			else
+				printf("   %5g ms .. %-5g", top / 2, top);
+			printf(" %6u |%.*s\n", l->hist[b], (int)(50 * l->hist[b] / l->n),
+				"##################################################");
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static unsigned char buf[65536 + TRACE_HEAD_LEN];
+	unsigned char* p;
+	unsigned char* end;
+	double t = 0;
+	FILE* f;
+	size_t n;
+	int opt, type, len, first;
+
+	while ((opt = getopt(argc, argv, "vh")) != -1) {
+		switch (opt) {
+		case 'v': verbose++; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	f = fopen(argv[optind], "rb");
+	if (f == NULL) {
+		perror(argv[optind]);
+		return 1;
+	}
+	n = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+	if (n < TRACE_HEAD_LEN || memcmp(buf, TRACE_MAGIC, 4) != 0) {
+		fprintf(stderr, "%s: not a trace\n", argv[optind]);
+		return 1;
+	}
+	rate = buf[4] | buf[5] << 8 | buf[6] << 16 | (unsigned long)buf[7] << 24;
+	len = buf[8] | buf[9] << 8;
+	if (rate == 0 || n < (size_t)TRACE_HEAD_LEN + len) {
+		fprintf(stderr, "%s: truncated trace\n", argv[optind]);
+		return 1;
+	}
+
+	p = buf + TRACE_HEAD_LEN;
+	end = p + len;
+	while (p + 3 <= end) {
+		type = p[0] >> 6;
+		len = p[0] & TRACE_MAX_LEN;
+		if (p + 3 + len > end) {
+			fprintf(stderr, "truncated record\n");
+			break;
+		}
+		// The first record is after one dropped from the ring, or the start
+		first = (p == buf + TRACE_HEAD_LEN);
+		if (!first)
+			t += p[1] | p[2] << 8;
+		p += 3;
+		// Times are from the first TRACE_TIME: the older ones are relative to the first record
+		if (type == TRACE_TIME && len == 4) {
+			static int based;
+			static double base;
+			double abs = p[0] | p[1] << 8 | p[2] << 16 | (unsigned long)p[3] << 24;
+
+			if (!based) {
+				// After a wrap of the ring, it ends a gap of unknown length: the command and
+				// the AT command started before it are left out
+				if (!first) {
+					gapped += pending.on + (running.function != 0);
+					pending.on = 0;
+					running.function = 0;
+				}
+				base = abs - t;
+				based = 1;
+			}
+			t = abs - base;
+			if (t < 0)
+				t += 4294967296.0;
+		}
+		records[type]++;
+		bytes[type] += len;
+		if (verbose)
+			print(type, p, len, t);
+		switch (type) {
+		case TRACE_RX: rx(p, len, t); break;
+		case TRACE_TX: tx(p, len, t); break;
+		case TRACE_CMD: cmd(p, len, t); break;
+		}
+		p += len;
+	}
+
+	printf("%.3f s, %lu chars in %lu records from the modem, %lu chars in %lu records to it, "
+		"%lu commands\n", t / rate, bytes[TRACE_RX], records[TRACE_RX], bytes[TRACE_TX],
+		records[TRACE_TX], records[TRACE_CMD] / 2);
+	if (unanswered)
+		printf("%lu AT commands without result code\n", unanswered);
+	if (gapped)
+		printf("%lu commands across the wrap of the ring left out\n", gapped);
+	report("AT command", atCmds, atCount);
+	report("GSM Task", gsmCmds, gsmCount);
+	return 0;
+}
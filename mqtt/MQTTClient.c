@@ -3,6 +3,34 @@
 static uint16_t MQTTClient_readPacket(MQTTClient_t *this);
 static BOOL MQTTClient_write(MQTTClient_t *this, uint8_t header, uint8_t* buf, uint16_t length);
 static uint16_t MQTTClient_writeStr(char* string, uint8_t* buf, uint16_t pos);
+static uint8_t MQTTClient_writeHeader(uint8_t header, uint8_t* buf, uint16_t length);
+static BOOL MQTTClient_resendInflight(MQTTClient_t *this, BOOL all);
+static BOOL MQTTClient_sendPublish(MQTTClient_t *this, uint8_t header, TCP_IOVEC *topic, uint8_t ntopic, uint16_t msgId, TCP_IOVEC *payload, uint8_t npayload);
+static BOOL MQTTClient_resendSlot(MQTTClient_t *this, MQTTInflight_t *slot);
+static void MQTTClient_reconnect(MQTTClient_t *this);
+static BOOL MQTTClient_puback(MQTTClient_t *this, uint16_t msgId);
+
+// Finds the in-flight slot holding msgId, a msgId of 0 returns a free slot
+static MQTTInflight_t *MQTTClient_findInflight(MQTTClient_t *this, uint16_t msgId)
+{
+   uint8_t i;
+   for (i = 0;i<MQTT_MAX_INFLIGHT;i++) {
+      if (this->inflight[i].msgId == msgId)
+         return &this->inflight[i];
+   }
+   return NULL;
+}
+
+static uint16_t MQTTClient_nextMsgId(MQTTClient_t *this)
+{
+   do {
+      this->nextMsgId++;
+      if (this->nextMsgId == 0) {
+         this->nextMsgId = 1;
+      }
+   } while (MQTTClient_findInflight(this, this->nextMsgId));
+   return this->nextMsgId;
+}
 
 /**
 * Creates an MQTT client ready for connection to the specified server
@@ -18,12 +46,160 @@ void MQTTClient_init(MQTTClient_t *this, char* server, uint16_t port, void (*cal
 {
    this->_client = client;
    this->callback = callback;
+   this->stream = NULL;
+   this->state = MQTT_STATE_IDLE;
+   this->subCount = 0;
+   this->cleanSession = TRUE;
+   this->keepAlive = this->keepAliveGood = MQTT_KEEPALIVE;
+   this->keepAliveLimit = MQTT_KEEPALIVE_MAX;
+   this->pingCount = 0;
+   this->sessionPresent = FALSE;
+   this->rxState = MQTT_RX_HEADER;
    this->server = server;
    this->port = port;
+   this->nextMsgId = 1;
+   this->inflightCount = 0;
+   this->protocol = MQTTPROTOCOLVERSION;
+   this->connackRc = 0xFF;
+   this->aliasMax = 0;
+   uint8_t i;
+   for (i = 0;i<MQTT_MAX_INFLIGHT;i++) {
+      this->inflight[i].msgId = 0;
+   }
+}
+
+/*
+* Keepalive tuning. The ping interval starts at MQTT_KEEPALIVE, the longest interval known to
+* keep the link up. After MQTT_KEEPALIVE_PROBES answered pings it is raised by MQTT_KEEPALIVE_STEP,
+* up to MQTT_KEEPALIVE_MAX. A ping lost while probing a longer interval means the carrier NAT
+* dropped the idle connection: the interval goes back to the known good one and is not probed
+* again. A ping lost at the known good interval lowers it by a step.
+*/
+static void MQTTClient_pingOk(MQTTClient_t *this)
+{
+   if (this->keepAlive > this->keepAliveGood)
+      this->keepAliveGood = this->keepAlive;
+   if (++this->pingCount >= MQTT_KEEPALIVE_PROBES && this->keepAlive + MQTT_KEEPALIVE_STEP <= this->keepAliveLimit
+         && this->keepAlive + MQTT_KEEPALIVE_STEP <= this->keepAliveMax) {
+      this->keepAlive += MQTT_KEEPALIVE_STEP;
+      this->pingCount = 0;
+   }
+}
+
+static void MQTTClient_pingLost(MQTTClient_t *this)
+{
+   if (this->keepAlive > this->keepAliveGood) {
+      this->keepAliveLimit = this->keepAliveGood;
+   } else if (this->keepAliveGood >= MQTT_KEEPALIVE + MQTT_KEEPALIVE_STEP) {
+      this->keepAliveGood -= MQTT_KEEPALIVE_STEP;
+      this->keepAliveLimit = this->keepAliveGood;
+   }
+   this->keepAlive = this->keepAliveGood;
+   this->pingCount = 0;
+}
+
+// Returns the size of the fixed header (type byte and remaining length) of the packet in buf
+static uint16_t MQTTClient_headerLen(uint8_t *buf)
+{
+   uint16_t pos = 1;
+   while ((buf[pos++] & 128) != 0);
+   return pos;
+}
+
+/**
+* Selects whether the server discards the session when the client connects.
+* With clean sessions off the server keeps the subscriptions and the QoS 1 messages
+* for the client ID while it is away, MQTT_SESSION_EXPIRY seconds at most in MQTT 5.0 mode.
+* When CONNACK reports the session present the subscriptions are not sent again.
+*/
+void MQTTClient_setCleanSession(MQTTClient_t *this, BOOL clean)
+{
+   this->cleanSession = clean;
+}
+
+/**
+* Selects the protocol level used by the next MQTTClient_connect.
+*
+* Parameters
+* @protocol : MQTT_PROTOCOL_V31 (default), MQTT_PROTOCOL_V311 or MQTT_PROTOCOL_V5.
+*  In MQTT 5.0 mode repeated publishes to a topic carry a topic alias instead of the
+*  topic string, within the Topic Alias Maximum granted by the server in CONNACK.
+*/
+void MQTTClient_setProtocol(MQTTClient_t *this, uint8_t protocol)
+{
+   this->protocol = protocol;
+}
+
+// Decodes a variable byte integer, returns its size or 0 if it is incomplete or malformed
+static uint8_t MQTTClient_readVarint(uint8_t *buf, uint16_t avail, unsigned long *value)
+{
+   uint8_t n = 0;
+   *value = 0;
+   while (n < avail && n < 4) {
+      *value += (unsigned long)(buf[n] & 127) << (7 * n);
+      if ((buf[n++] & 128) == 0)
+         return n;
+   }
+   return 0;
+}
+
+// Returns the position following the MQTT 5.0 property starting at pos
+static uint16_t MQTTClient_skipProperty(uint8_t *buf, uint16_t pos)
+{
+   unsigned long v;
+   switch (buf[pos++]) {
+   case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+      return pos + 1;
+   case MQTTPROP_SERVER_KEEPALIVE: case 0x21: case MQTTPROP_TOPIC_ALIAS_MAX: case MQTTPROP_TOPIC_ALIAS:
+      return pos + 2;
+   case 0x02: case 0x11: case 0x18: case 0x27:
+      return pos + 4;
+   case 0x0B:
+      return pos + MQTTClient_readVarint(buf + pos, 4, &v);
+   case 0x26:
+      // User property, a pair of strings
+      pos += 2 + (buf[pos]<<8) + buf[pos+1];
+      return pos + 2 + (buf[pos]<<8) + buf[pos+1];
+   default:
+      // String or binary data
+      return pos + 2 + (buf[pos]<<8) + buf[pos+1];
+   }
+}
+
+// Picks up the CONNACK properties the client uses from the len bytes packet in buffer
+static void MQTTClient_readConnack(MQTTClient_t *this, uint16_t len)
+{
+   uint8_t *buffer = this->buffer;
+   uint16_t pos = MQTTClient_headerLen(buffer) + 2;
+   unsigned long propLen;
+   uint8_t vl = MQTTClient_readVarint(buffer + pos, len - pos, &propLen);
+   if (vl == 0)
+      return;
+   pos += vl;
+   uint16_t end = pos + propLen;
+   if (end > len)
+      end = len;
+   while (pos < end) {
+      if (buffer[pos] == MQTTPROP_TOPIC_ALIAS_MAX && pos + 3 <= end)
+         this->aliasMax = (buffer[pos+1]<<8) + buffer[pos+2];
+      if (buffer[pos] == MQTTPROP_SERVER_KEEPALIVE && pos + 3 <= end) {
+         // The server imposes its own keepalive, do not ping less often
+         this->keepAliveMax = (buffer[pos+1]<<8) + buffer[pos+2];
+         if (this->keepAlive > this->keepAliveMax)
+            this->keepAlive = this->keepAliveMax;
+         if (this->keepAliveGood > this->keepAliveMax)
+            this->keepAliveGood = this->keepAliveMax;
+      }
+      pos = MQTTClient_skipProperty(buffer, pos);
+   }
 }
 
 /**
-* Connects the client with a Will message, username and password specified.
+* Starts connecting the client with a Will message, username and password specified.
+* The connection is then driven by MQTTClient_loop: the socket is opened, CONNECT is sent,
+* the subscriptions set with MQTTClient_setSubscriptions are made and the client becomes
+* ready, see MQTTClient_connected. A lost connection is re-established the same way.
+* The strings are used for every reconnect, they must remain valid.
 *
 * Parameters
 * @id : the client ID to use when connecting to the server. As per MQTT, this must be between 1 and 23 characters long.
@@ -35,206 +211,484 @@ void MQTTClient_init(MQTTClient_t *this, char* server, uint16_t port, void (*cal
 * @willMessage : the payload of the will message 
 
 * Returns
-*  false - connection failed.
-*  true -connection succeeded.
+*  false - the client is already connected or connecting.
+*  true - the connection was started.
 */
 BOOL MQTTClient_connect(MQTTClient_t *this, char *id, char *user, char *pass, char* willTopic, uint8_t willQos, uint8_t willRetain, char* willMessage)
 {
-   if (!MQTTClient_connected(this)) {
-      TCPClient_t *client = this->_client;
-      uint8_t *buffer = this->buffer;
-      int result = TCPClient_connect(client, this->server, this->port);
-		
-      if (result) {
-         this->nextMsgId = 1;
-         uint8_t d[9] = {0x00,0x06,'M','Q','I','s','d','p',MQTTPROTOCOLVERSION};
-         // Leave room in the buffer for header and variable length field
-         uint16_t length = 5;
-         unsigned int j;
-         for (j = 0;j<9;j++) {
-            buffer[length++] = d[j];
-         }
+   if (this->state != MQTT_STATE_IDLE)
+      return FALSE;
+   this->id = id;
+   this->user = user;
+   this->pass = pass;
+   this->willTopic = willTopic;
+   this->willQos = willQos;
+   this->willRetain = willRetain;
+   this->willMessage = willMessage;
+   MQTTClient_reconnect(this);
+   // First attempt without waiting
+   this->lastOutActivity -= MQTT_RECONNECT_INTERVAL;
+   return TRUE;
+}
 
-         uint8_t v;
-         if (willTopic) {
-            v = 0x06|(willQos<<3)|(willRetain<<5);
-         } else {
-            v = 0x02;
-         }
+// Closes the connection and schedules a new attempt, in-flight publishes are kept
+static void MQTTClient_reconnect(MQTTClient_t *this)
+{
+   TCPClient_stop(this->_client);
+   TCPClient_init(this->_client);
+   this->state = MQTT_STATE_CONNECTING;
+   this->lastOutActivity = tickGetSeconds();
+}
 
-         if(user != NULL) {
-            v = v|0x80;
+static BOOL MQTTClient_sendConnect(MQTTClient_t *this)
+{
+   uint8_t *buffer = this->buffer;
+   // Leave room in the buffer for header and variable length field
+   uint16_t length = 5;
+   if (this->protocol == MQTT_PROTOCOL_V31) {
+      length = MQTTClient_writeStr("MQIsdp",buffer,length);
+   } else {
+      length = MQTTClient_writeStr("MQTT",buffer,length);
+   }
+   buffer[length++] = this->protocol;
 
-            if(pass != NULL) {
-               v = v|(0x80>>1);
-            }
-         }
+   uint8_t v = 0;
+   if (this->cleanSession) {
+      v = 0x02;
+   }
+   if (this->willTopic) {
+      v = v|0x04|(this->willQos<<3)|(this->willRetain<<5);
+   }
 
-         buffer[length++] = v;
+   if(this->user != NULL) {
+      v = v|0x80;
 
-         buffer[length++] = ((MQTT_KEEPALIVE) >> 8);
-         buffer[length++] = ((MQTT_KEEPALIVE) & 0xFF);
-         length = MQTTClient_writeStr(id,buffer,length);
-         if (willTopic) {
-            length = MQTTClient_writeStr(willTopic,buffer,length);
-            length = MQTTClient_writeStr(willMessage,buffer,length);
-         }
+      if(this->pass != NULL) {
+         v = v|(0x80>>1);
+      }
+   }
 
-         if(user != NULL) {
-            length = MQTTClient_writeStr(user,buffer,length);
-            if(pass != NULL) {
-               length = MQTTClient_writeStr(pass,buffer,length);
-            }
-         }
-         
-         MQTTClient_write(this,MQTTCONNECT,buffer,length-5);
-         
-         this->lastInActivity = this->lastOutActivity = tickGetSeconds();
-         
-         while (!TCPClient_available(client)) {
-            unsigned long t = tickGetSeconds();
-            if (t - this->lastInActivity > MQTT_KEEPALIVE) {
-               TCPClient_stop(client);
-               return FALSE;
-            }
-         }
-         uint16_t len = MQTTClient_readPacket(this);
-         if (len == 4 && buffer[3] == 0) {
-            this->lastInActivity = tickGetSeconds();
-            this->pingOutstanding = FALSE;
-            return TRUE;
-         }
-		 else {
-		 	TCPClient_stop(client);
-		 }
+   buffer[length++] = v;
+
+   // The server allows for the longest interval, pings follow the current one
+   this->keepAliveMax = MQTT_KEEPALIVE_MAX;
+   buffer[length++] = ((MQTT_KEEPALIVE_MAX) >> 8);
+   buffer[length++] = ((MQTT_KEEPALIVE_MAX) & 0xFF);
+   if (this->protocol == MQTT_PROTOCOL_V5) {
+      // Ask for the Topic Alias Maximum in CONNACK, no aliases accepted from the server.
+      // A session only outlives the connection with a Session Expiry Interval
+      if (this->cleanSession) {
+         buffer[length++] = 0;
+      } else {
+         buffer[length++] = 5;
+         buffer[length++] = 0x11;
+         buffer[length++] = (MQTT_SESSION_EXPIRY >> 24);
+         buffer[length++] = (MQTT_SESSION_EXPIRY >> 16) & 0xFF;
+         buffer[length++] = (MQTT_SESSION_EXPIRY >> 8) & 0xFF;
+         buffer[length++] = (MQTT_SESSION_EXPIRY & 0xFF);
       }
    }
-   return FALSE;
+   length = MQTTClient_writeStr(this->id,buffer,length);
+   if (this->willTopic) {
+      if (this->protocol == MQTT_PROTOCOL_V5) {
+         buffer[length++] = 0; // no will properties
+      }
+      length = MQTTClient_writeStr(this->willTopic,buffer,length);
+      length = MQTTClient_writeStr(this->willMessage,buffer,length);
+   }
+
+   if(this->user != NULL) {
+      length = MQTTClient_writeStr(this->user,buffer,length);
+      if(this->pass != NULL) {
+         length = MQTTClient_writeStr(this->pass,buffer,length);
+      }
+   }
+   
+   // Nothing else goes out before CONNACK, do not wait for more writes to combine
+   return MQTTClient_write(this,MQTTCONNECT,buffer,length-5) && TCPClient_push(this->_client);
 }
 
-static uint8_t MQTTClient_readByte(MQTTClient_t *this, int *err)
+// Handles the CONNACK of len bytes in buffer: flags, return code, then MQTT 5.0 properties
+static BOOL MQTTClient_handleConnack(MQTTClient_t *this, uint16_t len)
 {
-   int data = TCPClient_readByte(this->_client);
-   if (data == -1) {
-	   unsigned long t = tickGetSeconds();
-	   while(!TCPClient_available(this->_client)) {
-	      if (tickGetSeconds() - t > 1) {
-	   		*err = 1;
-			return 0;
-	      }
-	   }
-	   data = TCPClient_readByte(this->_client);
+   uint8_t *buffer = this->buffer;
+   uint8_t i;
+   if (len >= 4) {
+      this->sessionPresent = (buffer[MQTTClient_headerLen(buffer)] & 0x01) != 0;
+      this->connackRc = buffer[MQTTClient_headerLen(buffer)+1];
    }
-   
-   return (uint8_t)data;
+   if (this->connackRc != 0) {
+      // Unacceptable protocol version, retry with MQTT 3.1.1
+      if (this->protocol == MQTT_PROTOCOL_V5 && (this->connackRc == 0x01 || this->connackRc == 0x84))
+         this->protocol = MQTT_PROTOCOL_V311;
+      return FALSE;
+   }
+   // Aliases only live as long as the network connection
+   this->aliasMax = 0;
+   for (i = 0;i<MQTT_MAX_ALIASES;i++) {
+      this->alias[i][0] = 0;
+   }
+   if (this->protocol == MQTT_PROTOCOL_V5) {
+      MQTTClient_readConnack(this, len);
+   }
+   this->pingOutstanding = FALSE;
+   // Publishes not acknowledged before the link dropped go out again as duplicates
+   if (!MQTTClient_resendInflight(this, TRUE))
+      return FALSE;
+
+   this->subFailed = 0;
+   // The server kept the subscriptions of the previous connection
+   if (this->subCount == 0 || (!this->cleanSession && this->sessionPresent)) {
+      this->state = MQTT_STATE_READY;
+      return TRUE;
+   }
+   this->state = MQTT_STATE_SUBSCRIBING;
+   if (!MQTTClient_subscribev(this, this->subTopics, this->subQos, this->subCount))
+      return FALSE;
+   this->subAckId = this->nextMsgId;
+   return TRUE;
 }
 
+// Records the topics the server refused in the SUBACK of len bytes in buffer
+static void MQTTClient_readSuback(MQTTClient_t *this, uint16_t len)
+{
+   uint8_t *buffer = this->buffer;
+   uint16_t pos = MQTTClient_headerLen(buffer) + 2;
+   uint8_t i;
+   if (this->protocol == MQTT_PROTOCOL_V5) {
+      unsigned long propLen;
+      uint8_t vl = MQTTClient_readVarint(buffer + pos, len - pos, &propLen);
+      if (vl == 0)
+         return;
+      pos += vl + propLen;
+   }
+   this->subFailed = 0;
+   for (i = 0;i<this->subCount && i<8;i++) {
+      // A missing return code counts as a failure
+      if (pos + i >= len || buffer[pos + i] >= 0x80)
+         this->subFailed |= (1 << i);
+   }
+}
+
+/**
+* Sets the topics subscribed to, in one SUBSCRIBE, each time the client connects.
+* The client is ready once the server acknowledged them. The topics the server
+* refused are then flagged in subFailed, bit 0 for the first topic.
+* The lists are not copied, they must remain valid.
+*
+* Parameters
+* @topics : the topics
+* @qos : the maximum QoS of each topic (0 or 1), NULL for QoS 0 on all of them
+* @ntopics : the number of topics, at most 8 are checked in SUBACK
+*/
+void MQTTClient_setSubscriptions(MQTTClient_t *this, char **topics, uint8_t *qos, uint8_t ntopics)
+{
+   this->subTopics = topics;
+   this->subQos = qos;
+   this->subCount = ntopics;
+}
+
+/*
+* Feeds the packet decoder with the bytes the transport already holds, without waiting for more.
+* Packets that fit in buffer are returned whole. A larger PUBLISH is passed to the stream
+* callback in chunks once its topic is known; any other oversized packet is discarded.
+*
+* Returns the length of a complete packet left in buffer, 0 while no complete packet is available.
+*/
 static uint16_t MQTTClient_readPacket(MQTTClient_t *this)
 {
+   TCPClient_t *client = this->_client;
    uint8_t *buffer = this->buffer;
-   uint16_t len = 0;
-   uint8_t multiplier = 1;
-   uint16_t length = 0;
-   uint8_t digit = 0;
-   uint16_t i;
-   int err = 0;
+   int budget = TCPClient_available(client);
+   uint16_t n, pos, need;
+   uint8_t *span;
 
-   buffer[len++] = MQTTClient_readByte(this, &err);
-   
-   do {
-      digit = MQTTClient_readByte(this, &err);
-      if (err)
-         return 0;
-      buffer[len++] = digit;
-      length += (digit & 127) * multiplier;
-      multiplier *= 128;
-   } while ((digit & 128) != 0);
-   
-   for (i = 0;i<length;i++)
-   {
-      if (len < MQTT_MAX_PACKET_SIZE) {
-         buffer[len++] = MQTTClient_readByte(this, &err);
-      } else {
-         MQTTClient_readByte(this, &err);
-         len = 0; // This will cause the packet to be ignored.
-      }
+   while (budget > 0) {
+      switch (this->rxState) {
+      case MQTT_RX_HEADER:
+         TCPClient_read(client, buffer, 1);
+         budget--;
+         this->rxLen = 1;
+         this->rxRemaining = 0;
+         this->rxState = MQTT_RX_LENGTH;
+         break;
+
+      case MQTT_RX_LENGTH:
+         TCPClient_read(client, buffer + this->rxLen, 1);
+         budget--;
+         this->rxRemaining += (unsigned long)(buffer[this->rxLen] & 127) << (7 * (this->rxLen - 1));
+         if ((buffer[this->rxLen++] & 128) != 0) {
+            if (this->rxLen == 5) {
+               // Remaining length is at most 4 bytes long, the stream is out of sync
+               this->rxState = MQTT_RX_HEADER;
+               TCPClient_stop(client);
+               return 0;
+            }
+            break;
+         }
+         if (this->rxRemaining == 0) {
+            this->rxState = MQTT_RX_HEADER;
+            return this->rxLen;
+         }
+         if (this->rxLen + this->rxRemaining <= MQTT_MAX_PACKET_SIZE)
+            this->rxState = MQTT_RX_BODY;
+         else if ((buffer[0] & 0xF0) == MQTTPUBLISH && this->stream)
+            this->rxState = MQTT_RX_TOPIC;
+         else
+            this->rxState = MQTT_RX_SKIP;
+         break;
+
+      case MQTT_RX_BODY:
+         n = (this->rxRemaining < budget) ? this->rxRemaining : budget;
+         n = TCPClient_read(client, buffer + this->rxLen, n);
+         budget -= n;
+         this->rxLen += n;
+         this->rxRemaining -= n;
+         if (this->rxRemaining == 0) {
+            this->rxState = MQTT_RX_HEADER;
+            return this->rxLen;
+         }
+         break;
+
+      case MQTT_RX_TOPIC:
+         // Collect topic length, topic and message ID of a PUBLISH to be streamed
+         pos = MQTTClient_headerLen(buffer);
+         need = pos + 2;
+         if (this->rxLen >= need) {
+            uint16_t tl = (buffer[pos]<<8)+buffer[pos+1];
+            if (tl > MQTT_MAX_TOPIC_LEN) {
+               this->rxState = MQTT_RX_SKIP;
+               break;
+            }
+            need += tl + (((buffer[0] & 0x06) != 0) ? 2 : 0);
+            if (this->protocol == MQTT_PROTOCOL_V5) {
+               // Properties follow, preceded by their length
+               unsigned long propLen;
+               uint8_t vl = MQTTClient_readVarint(buffer + need, (this->rxLen > need) ? this->rxLen - need : 0, &propLen);
+               if (vl == 0)
+                  need = ((this->rxLen > need) ? this->rxLen : need) + 1;
+               else
+                  need += vl + propLen;
+               if (need > MQTT_MAX_PACKET_SIZE) {
+                  this->rxState = MQTT_RX_SKIP;
+                  break;
+               }
+            }
+            if (this->rxLen >= need) {
+               this->rxMsgId = 0;
+               if ((buffer[0] & 0x06) != 0) {
+                  this->rxMsgId = (buffer[pos+2+tl]<<8)+buffer[pos+3+tl];
+               }
+               // Keep the header byte, move the topic after it and terminate it
+               memmove(buffer + 1, buffer + pos + 2, tl);
+               buffer[1 + tl] = 0;
+               this->rxOffset = 0;
+               this->rxState = MQTT_RX_STREAM;
+               break;
+            }
+         }
+         if (this->rxRemaining == 0) {
+            // Packet ended inside its variable header
+            this->rxState = MQTT_RX_HEADER;
+            break;
+         }
+         n = need - this->rxLen;
+         if (n > budget)
+            n = budget;
+         if (n > this->rxRemaining)
+            n = this->rxRemaining;
+         n = TCPClient_read(client, buffer + this->rxLen, n);
+         budget -= n;
+         this->rxLen += n;
+         this->rxRemaining -= n;
+         break;
+
+      case MQTT_RX_STREAM:
+         // The payload is passed straight from the receive buffer of the transport
+         n = TCPClient_peek(client, &span);
+         if (n > budget)
+            n = budget;
+         if (n > this->rxRemaining)
+            n = this->rxRemaining;
+         budget -= n;
+         this->rxRemaining -= n;
+         this->stream((char*)buffer + 1, this->rxOffset, span, n, this->rxRemaining == 0);
+         TCPClient_skip(client, n);
+         this->rxOffset += n;
+         if (this->rxRemaining == 0) {
+            this->rxState = MQTT_RX_HEADER;
+            if (this->rxMsgId != 0)
+               MQTTClient_puback(this, this->rxMsgId);
+         }
+         break;
 
-	  if (err)
-         return 0;
+      case MQTT_RX_SKIP:
+         n = (this->rxRemaining < budget) ? this->rxRemaining : budget;
+         TCPClient_skip(client, n);
+         budget -= n;
+         this->rxRemaining -= n;
+         if (this->rxRemaining == 0)
+            this->rxState = MQTT_RX_HEADER;
+         break;
+      }
    }
 
-   return len;
+   return 0;
 }
 
 /**
 * This should be called regularly to allow the client to process incoming messages and maintain its connection to the server.
+* It also drives connecting and reconnecting, without waiting for the server.
 *
 * Returns
-*  false - the client is no longer connected
-*  true - the client is still connected
+*  false - the client is not ready, see MQTTClient_connected
+*  true - the client is connected and ready
 */
 BOOL MQTTClient_loop(MQTTClient_t *this)
 {
    uint8_t *buffer = this->buffer;
-   if (MQTTClient_connected(this)) {
-      unsigned long t = tickGetSeconds();
-      if ((t - this->lastInActivity > MQTT_KEEPALIVE) || (t - this->lastOutActivity > MQTT_KEEPALIVE)) {
-         if (this->pingOutstanding) {
-            TCPClient_stop(this->_client);
-            return FALSE;
-         } else {
-            buffer[0] = MQTTPINGREQ;
-            buffer[1] = 0;
-            if (0 == TCPClient_write(this->_client, buffer, 2))
-			   return FALSE;
-            this->lastOutActivity = t;
-            this->lastInActivity = t;
-            this->pingOutstanding = TRUE;
-         }
+   unsigned long t = tickGetSeconds();
+   uint8_t ctrl[2];
+
+   if (this->state == MQTT_STATE_IDLE) {
+      return FALSE;
+   }
+   if (this->state == MQTT_STATE_CONNECTING) {
+      if (t - this->lastOutActivity < MQTT_RECONNECT_INTERVAL)
+         return FALSE;
+      this->lastOutActivity = t;
+      if (!TCPClient_open(this->_client, this->server, this->port))
+         return FALSE;
+      this->rxState = MQTT_RX_HEADER;
+      this->connackRc = 0xFF;
+      this->sessionPresent = FALSE;
+      if (!MQTTClient_sendConnect(this)) {
+         MQTTClient_reconnect(this);
+         return FALSE;
+      }
+      this->lastInActivity = this->lastOutActivity;
+      this->state = MQTT_STATE_WAIT_CONNACK;
+      return FALSE;
+   }
+   if (!TCPClient_connected(this->_client)) {
+      MQTTClient_reconnect(this);
+      return FALSE;
+   }
+
+   if (this->state != MQTT_STATE_READY) {
+      // CONNACK and SUBACK are expected within a keepalive interval
+      if (t - this->lastInActivity > MQTT_KEEPALIVE) {
+         MQTTClient_reconnect(this);
+         return FALSE;
       }
-      if (TCPClient_available(this->_client)) {
-         uint16_t len = MQTTClient_readPacket(this);
-         if (len > 0) {
-            this->lastInActivity = t;
-            uint8_t type = buffer[0]&0xF0;
-            if (type == MQTTPUBLISH) {
-               if (this->callback) {
-                  uint16_t tl, offset;
-                  if (len < 128) {
-                     tl = (buffer[2]<<8)+buffer[3];
-                     offset = 4;
-                  }
-				  else {
-                     tl = (buffer[3]<<8)+buffer[4];
-                     offset = 5;
-				  }
-                  char topic[MQTT_MAX_TOPIC_LEN + 1];
-				  uint16_t i;
-				  if (tl > MQTT_MAX_TOPIC_LEN)
-				     return TRUE;
-                  for (i=0;i<tl;i++) {
-                     topic[i] = buffer[offset+i];
-                  }
-                  topic[tl] = 0;
-                  // ignore msgID - only support QoS 0 subs
-                  uint8_t *payload = buffer+offset+tl;
-                  this->callback(topic,payload,len-offset-tl);
+   } else if (this->pingOutstanding) {
+      if (t - this->pingSent > MQTT_PING_TIMEOUT) {
+         MQTTClient_pingLost(this);
+         MQTTClient_reconnect(this);
+         return FALSE;
+      }
+   } else if ((t - this->lastInActivity > this->keepAlive) || (t - this->lastOutActivity > this->keepAliveMax)) {
+      // Ping only when nothing was heard from the server for the current interval,
+      // or the server is about to miss our traffic
+      ctrl[0] = MQTTPINGREQ;
+      ctrl[1] = 0;
+      if (0 == TCPClient_write(this->_client, ctrl, 2)) {
+         MQTTClient_reconnect(this);
+         return FALSE;
+      }
+      this->lastOutActivity = t;
+      this->pingSent = t;
+      this->pingOutstanding = TRUE;
+   }
+   if (this->state != MQTT_STATE_WAIT_CONNACK && !MQTTClient_resendInflight(this, FALSE)) {
+      MQTTClient_reconnect(this);
+      return FALSE;
+   }
+   if (TCPClient_available(this->_client)) {
+      this->lastInActivity = t;
+      uint16_t len = MQTTClient_readPacket(this);
+      if (len > 0) {
+         uint8_t type = buffer[0]&0xF0;
+         if (this->state == MQTT_STATE_WAIT_CONNACK) {
+            if (type != MQTTCONNACK || !MQTTClient_handleConnack(this, len)) {
+               MQTTClient_reconnect(this);
+               return FALSE;
+            }
+         } else if (type == MQTTPUBLISH) {
+            uint16_t offset = MQTTClient_headerLen(buffer);
+            uint16_t tl = (buffer[offset]<<8)+buffer[offset+1];
+            uint16_t topicPos = offset + 2;
+            uint16_t msgId = 0;
+            // Delivered only with a callback and a topic that fits
+            BOOL deliver = (this->callback != NULL && tl <= MQTT_MAX_TOPIC_LEN && topicPos + tl <= len);
+            offset += 2 + tl;
+            // QoS 1 is acknowledged once the message was handled, or dropped, so that the
+            // server does not send it again. QoS 2 is not supported.
+            if ((buffer[0] & 0x06) != 0 && offset + 2 <= len) {
+               msgId = (buffer[offset]<<8)+buffer[offset+1];
+               offset += 2;
+            }
+            if (deliver && this->protocol == MQTT_PROTOCOL_V5) {
+               unsigned long propLen;
+               uint8_t vl = MQTTClient_readVarint(buffer+offset, len-offset, &propLen);
+               if (vl == 0 || offset + vl + propLen > len)
+                  deliver = FALSE;
+               else
+                  offset += vl + propLen;
+            }
+            if (deliver) {
+               char topic[MQTT_MAX_TOPIC_LEN + 1];
+               uint16_t i;
+               for (i=0;i<tl;i++) {
+                  topic[i] = buffer[topicPos+i];
                }
-            } else if (type == MQTTPINGREQ) {
-               buffer[0] = MQTTPINGRESP;
-               buffer[1] = 0;
-               if (0 == TCPClient_write(this->_client,buffer,2))
-			      return FALSE;
-            } else if (type == MQTTPINGRESP) {
-               this->pingOutstanding = FALSE;
-            } else {
-               TCPClient_flush(this->_client);
+               topic[tl] = 0;
+               uint8_t *payload = buffer+offset;
+               this->callback(topic,payload,len-offset);
+            }
+            if (msgId != 0 && !MQTTClient_puback(this, msgId)) {
+               MQTTClient_reconnect(this);
+               return FALSE;
+            }
+         } else if (type == MQTTPINGREQ) {
+            ctrl[0] = MQTTPINGRESP;
+            ctrl[1] = 0;
+            if (0 == TCPClient_write(this->_client,ctrl,2)) {
+               MQTTClient_reconnect(this);
+               return FALSE;
+            }
+         } else if (type == MQTTPINGRESP) {
+            if (this->pingOutstanding)
+               MQTTClient_pingOk(this);
+            this->pingOutstanding = FALSE;
+         } else if (type == MQTTPUBACK) {
+            // MQTT 5.0 may append a reason code and properties
+            if (len >= 4) {
+               MQTTInflight_t *slot = MQTTClient_findInflight(this, (buffer[2]<<8)+buffer[3]);
+               if (slot) {
+                  slot->msgId = 0;
+                  this->inflightCount--;
+               }
+            }
+         } else if (type == MQTTSUBACK) {
+            if (this->state == MQTT_STATE_SUBSCRIBING && len >= 4 && (buffer[2]<<8)+buffer[3] == this->subAckId) {
+               MQTTClient_readSuback(this, len);
+               this->state = MQTT_STATE_READY;
             }
          }
       }
-      return TRUE;
    }
-   return FALSE;
+   return (this->state == MQTT_STATE_READY);
+}
+
+/**
+* Sets the function called with the payload of a PUBLISH too large for the client buffer.
+* The payload is delivered in order, in chunks: (topic, offset, data, length, final).
+* Without a stream callback such messages are discarded.
+*/
+void MQTTClient_setStream(MQTTClient_t *this, void (*stream)(char*,unsigned long,uint8_t*,unsigned int,BOOL))
+{
+   this->stream = stream;
 }
 
 /**
@@ -254,32 +708,131 @@ BOOL MQTTClient_loop(MQTTClient_t *this)
 */
 BOOL MQTTClient_publish(MQTTClient_t *this, char* topic, uint8_t* payload, unsigned int plength, BOOL retained)
 {
-   if (MQTTClient_connected(this)) {
-      uint8_t *buffer = this->buffer;
-      // Leave room in the buffer for header and variable length field
-      uint16_t length = 5;
-      length = MQTTClient_writeStr(topic,buffer,length);
-      uint16_t i;
-      for (i=0;i<plength;i++) {
-         buffer[length++] = payload[i];
-      }
-      uint8_t header = MQTTPUBLISH;
-      if (retained) {
-         header |= 1;
+   return MQTTClient_publishQos(this, topic, payload, plength, 0, retained);
+}
+
+/**
+* Publishes a message to the specified topic at the given QoS.
+* See MQTTClient_publishv.
+*/
+BOOL MQTTClient_publishQos(MQTTClient_t *this, char* topic, uint8_t* payload, unsigned int plength, uint8_t qos, BOOL retained)
+{
+   TCP_IOVEC t, p;
+   t.buf = topic;
+   t.len = strlen(topic);
+   p.buf = (char*)payload;
+   p.len = plength;
+   return MQTTClient_publishv(this, &t, 1, &p, 1, qos, retained, NULL);
+}
+
+/**
+* Publishes a message whose topic and payload are given as lists of segments.
+* At QoS 0 only the fixed header and the topic length are built in a scratch area,
+* the segments are handed to the transport as they are, in one send operation,
+* so the payload is not limited by MQTT_MAX_PACKET_SIZE.
+* In MQTT 5.0 mode the topic is replaced by its alias once the server knows it.
+* A QoS 1 message (topic and payload) is gathered into a free in-flight slot and kept there until
+* MQTTClient_loop receives the matching PUBACK. It is resent with the DUP flag
+* when no PUBACK arrives within MQTT_RETRY_INTERVAL, and after every reconnect.
+* QoS 1 messages are also accepted while the client is connecting.
+
+* Parameters
+* @topic : the topic segments, concatenated to form the topic
+* @ntopic : the number of topic segments
+* @payload : the payload segments
+* @npayload : the number of payload segments
+* @qos : 0 or 1 (QoS 2 is not supported)
+* @retained : whether the message should be retained
+* @msgId : if not NULL, set to the message ID of an accepted QoS 1 message (see MQTTClient_delivered), 0 otherwise
+* Returns
+*  false - publish failed, the client is not connected (QoS 0) or no in-flight slot is free (see MQTTClient_inflightFree).
+*  true - QoS 0: the message was sent. QoS 1: the message was accepted for delivery.
+*/
+BOOL MQTTClient_publishv(MQTTClient_t *this, TCP_IOVEC *topic, uint8_t ntopic, TCP_IOVEC *payload, uint8_t npayload, uint8_t qos, BOOL retained, uint16_t *msgId)
+{
+   uint8_t header = MQTTPUBLISH;
+   uint16_t tl = 0;
+   uint16_t pl = 0;
+   uint8_t i;
+   if (msgId) {
+      *msgId = 0;
+   }
+   if (retained) {
+      header |= 1;
+   }
+   if (qos == 0) {
+      if (!MQTTClient_connected(this)) {
+         return FALSE;
       }
-      return MQTTClient_write(this,header,buffer,length-5);
+      return MQTTClient_sendPublish(this, header, topic, ntopic, 0, payload, npayload);
    }
-   return FALSE;
+   if (qos != 1 || this->state == MQTT_STATE_IDLE) {
+      return FALSE;
+   }
+   for (i = 0;i<ntopic;i++) {
+      tl += topic[i].len;
+   }
+   for (i = 0;i<npayload;i++) {
+      pl += payload[i].len;
+   }
+
+   MQTTInflight_t *slot = MQTTClient_findInflight(this, 0);
+   if (slot == NULL || tl + pl > MQTT_INFLIGHT_MSG_SIZE) {
+      return FALSE;
+   }
+   uint8_t *buf = slot->buf;
+   uint16_t length = 0;
+   for (i = 0;i<ntopic;i++) {
+      memcpy(buf+length, topic[i].buf, topic[i].len);
+      length += topic[i].len;
+   }
+   for (i = 0;i<npayload;i++) {
+      memcpy(buf+length, payload[i].buf, payload[i].len);
+      length += payload[i].len;
+   }
+   slot->msgId = MQTTClient_nextMsgId(this);
+   slot->header = header|MQTTQOS1;
+   slot->topicLen = tl;
+   slot->length = length;
+   this->inflightCount++;
+   if (msgId) {
+      *msgId = slot->msgId;
+   }
+
+   // While connecting the message waits in its slot, it goes out after CONNACK.
+   // A failed write leaves the message queued, it is resent after reconnect
+   if (this->state >= MQTT_STATE_SUBSCRIBING) {
+      MQTTClient_resendSlot(this, slot);
+   }
+   slot->lastSent = tickGetSeconds();
+   return TRUE;
 }
 
-static BOOL MQTTClient_write(MQTTClient_t *this, uint8_t header, uint8_t* buf, uint16_t length)
+/**
+* Returns the number of QoS 1 publishes that can still be issued before the
+* in-flight window is full.
+*/
+uint8_t MQTTClient_inflightFree(MQTTClient_t *this)
+{
+   return MQTT_MAX_INFLIGHT - this->inflightCount;
+}
+
+/**
+* Tells whether the QoS 1 publish with message ID msgId, given by MQTTClient_publishv,
+* was acknowledged by the server.
+*/
+BOOL MQTTClient_delivered(MQTTClient_t *this, uint16_t msgId)
+{
+   return (MQTTClient_findInflight(this, msgId) == NULL);
+}
+
+static uint8_t MQTTClient_writeHeader(uint8_t header, uint8_t* buf, uint16_t length)
 {
    uint8_t lenBuf[4];
    uint8_t llen = 0;
    uint8_t digit;
    uint8_t pos = 0;
-   uint8_t rc;
-   uint8_t len = length;
+   uint16_t len = length;
    int i;
    
    do {
@@ -296,14 +849,154 @@ static BOOL MQTTClient_write(MQTTClient_t *this, uint8_t header, uint8_t* buf, u
    for (i=0;i<llen;i++) {
       buf[5-llen+i] = lenBuf[i];
    }
-   rc = TCPClient_write(this->_client,buf+(4-llen),length+1+llen);
+   return llen;
+}
+
+static BOOL MQTTClient_write(MQTTClient_t *this, uint8_t header, uint8_t* buf, uint16_t length)
+{
+   uint8_t llen = MQTTClient_writeHeader(header, buf, length);
+   int rc = TCPClient_write(this->_client,buf+(4-llen),length+1+llen);
    
    this->lastOutActivity = tickGetSeconds();
    return (rc == 1+llen+length);
 }
 
+// Resends the in-flight QoS 1 publishes whose PUBACK is overdue, or all of them
+static BOOL MQTTClient_resendInflight(MQTTClient_t *this, BOOL all)
+{
+   unsigned long t = tickGetSeconds();
+   uint8_t i;
+   for (i = 0;i<MQTT_MAX_INFLIGHT;i++) {
+      MQTTInflight_t *slot = &this->inflight[i];
+      if (slot->msgId == 0)
+         continue;
+      if (!all && (t - slot->lastSent <= MQTT_RETRY_INTERVAL))
+         continue;
+      if (!MQTTClient_resendSlot(this, slot))
+         return FALSE;
+      slot->lastSent = t;
+   }
+   return TRUE;
+}
+
+// Sends the QoS 1 publish held by an in-flight slot, any later send is flagged DUP
+static BOOL MQTTClient_resendSlot(MQTTClient_t *this, MQTTInflight_t *slot)
+{
+   TCP_IOVEC t, p;
+   t.buf = (char*)slot->buf;
+   t.len = slot->topicLen;
+   p.buf = (char*)slot->buf + slot->topicLen;
+   p.len = slot->length - slot->topicLen;
+   BOOL rc = MQTTClient_sendPublish(this, slot->header, &t, 1, slot->msgId, &p, 1);
+   slot->header |= MQTTDUP;
+   return rc;
+}
+
+/*
+* Returns the alias to send with a topic in MQTT 5.0 mode, 0 if the topic goes out without one.
+* known is set when the server already holds the alias, so the topic can be left empty.
+* A topic is bound to the first free alias and keeps it until the connection is closed.
+*/
+static uint16_t MQTTClient_topicAlias(MQTTClient_t *this, TCP_IOVEC *topic, uint8_t ntopic, uint16_t tl, BOOL *known)
+{
+   uint16_t i, pos;
+   uint8_t j;
+   *known = FALSE;
+   if (this->protocol != MQTT_PROTOCOL_V5 || tl > MQTT_MAX_TOPIC_LEN)
+      return 0;
+   for (i = 0;i<MQTT_MAX_ALIASES && i<this->aliasMax;i++) {
+      char *a = this->alias[i];
+      if (a[0] == 0) {
+         // Free alias, bind it to the topic
+         pos = 0;
+         for (j = 0;j<ntopic;j++) {
+            memcpy(a+pos, topic[j].buf, topic[j].len);
+            pos += topic[j].len;
+         }
+         a[pos] = 0;
+         return i+1;
+      }
+      pos = 0;
+      for (j = 0;j<ntopic;j++) {
+         if (strncmp(a+pos, topic[j].buf, topic[j].len) != 0)
+            break;
+         pos += topic[j].len;
+      }
+      if (j == ntopic && a[pos] == 0) {
+         *known = TRUE;
+         return i+1;
+      }
+   }
+   return 0;
+}
+
+// Builds a PUBLISH around the topic and payload segments and sends it in one operation
+static BOOL MQTTClient_sendPublish(MQTTClient_t *this, uint8_t header, TCP_IOVEC *topic, uint8_t ntopic, uint16_t msgId, TCP_IOVEC *payload, uint8_t npayload)
+{
+   TCP_IOVEC iov[MQTT_MAX_IOV];
+   uint8_t pre[7];
+   uint8_t post[6];
+   uint8_t plen = 0;
+   uint8_t n = 0;
+   uint16_t tl = 0;
+   uint16_t length = 0;
+   uint8_t i;
+   BOOL known;
+
+   if (2 + ntopic + npayload > MQTT_MAX_IOV) {
+      return FALSE;
+   }
+   for (i = 0;i<ntopic;i++) {
+      tl += topic[i].len;
+   }
+   for (i = 0;i<npayload;i++) {
+      length += payload[i].len;
+   }
+   uint16_t alias = MQTTClient_topicAlias(this, topic, ntopic, tl, &known);
+   if (known) {
+      ntopic = 0;
+      tl = 0;
+   }
+   // Message ID and properties go between the topic and the payload
+   if (msgId != 0) {
+      post[plen++] = (msgId >> 8);
+      post[plen++] = (msgId & 0xFF);
+   }
+   if (this->protocol == MQTT_PROTOCOL_V5) {
+      if (alias != 0) {
+         post[plen++] = 3;
+         post[plen++] = MQTTPROP_TOPIC_ALIAS;
+         post[plen++] = (alias >> 8);
+         post[plen++] = (alias & 0xFF);
+      } else {
+         post[plen++] = 0;
+      }
+   }
+   length += 2 + tl + plen;
+
+   // Fixed header ends at pre[4], followed by the topic length
+   uint8_t llen = MQTTClient_writeHeader(header, pre, length);
+   pre[5] = (tl >> 8);
+   pre[6] = (tl & 0xFF);
+   iov[n].buf = (char*)pre+(4-llen);
+   iov[n++].len = 1+llen+2;
+   for (i = 0;i<ntopic;i++) {
+      iov[n++] = topic[i];
+   }
+   if (plen > 0) {
+      iov[n].buf = (char*)post;
+      iov[n++].len = plen;
+   }
+   for (i = 0;i<npayload;i++) {
+      iov[n++] = payload[i];
+   }
+   int rc = TCPClient_writev(this->_client,iov,n);
+   this->lastOutActivity = tickGetSeconds();
+   return (rc == 1+llen+length);
+}
+
 /**
-* Subscribes to messages published to the specified topic.
+* Subscribes to messages published to the specified topic, at QoS 0.
 
 * Parameters
 * @topic  : the topic to publish to
@@ -313,33 +1006,76 @@ static BOOL MQTTClient_write(MQTTClient_t *this, uint8_t header, uint8_t* buf, u
 */
 BOOL MQTTClient_subscribe(MQTTClient_t *this, char* topic)
 {
-   if (MQTTClient_connected(this)) {
+   return MQTTClient_subscribev(this, &topic, NULL, 1);
+}
+
+/**
+* Subscribes to a list of topics with a single SUBSCRIBE.
+* Messages received at QoS 1 are acknowledged after the callback returned.
+
+* Parameters
+* @topics : the topics
+* @qos : the maximum QoS of each topic (0 or 1), NULL for QoS 0 on all of them
+* @ntopics : the number of topics
+* Returns
+*  false - sending the subscribe failed, the topics do not fit in the buffer, or the buffer
+*          holds part of a received packet (try again after MQTTClient_loop).
+*  true - sending the subscribe succeeded. The request completes asynchronously.
+*/
+BOOL MQTTClient_subscribev(MQTTClient_t *this, char **topics, uint8_t *qos, uint8_t ntopics)
+{
+   // The packet is built in the buffer, that keeps a packet being received between loops
+   if (this->state >= MQTT_STATE_SUBSCRIBING && this->rxState == MQTT_RX_HEADER) {
       uint8_t *buffer = this->buffer;
       // Leave room in the buffer for header and variable length field
       uint16_t length = 7;
-      this->nextMsgId++;
-      if (this->nextMsgId == 0) {
-         this->nextMsgId = 1;
+      uint8_t i;
+      uint16_t msgId = MQTTClient_nextMsgId(this);
+      buffer[5] = (msgId >> 8);
+      buffer[6] = (msgId & 0xFF);
+      if (this->protocol == MQTT_PROTOCOL_V5) {
+         buffer[length++] = 0; // no subscribe properties
       }
-      buffer[0] = (this->nextMsgId >> 8);
-      buffer[1] = (this->nextMsgId & 0xFF);
-      length = MQTTClient_writeStr(topic, buffer,length);
-      buffer[length++] = 0; // Only do QoS 0 subs
-      return MQTTClient_write(this,MQTTSUBSCRIBE|MQTTQOS1,buffer,length-5);
+      for (i = 0;i<ntopics;i++) {
+         if (length + 2 + strlen(topics[i]) + 1 > MQTT_MAX_PACKET_SIZE) {
+            return FALSE;
+         }
+         length = MQTTClient_writeStr(topics[i], buffer,length);
+         uint8_t opts = (qos != NULL && qos[i] != 0) ? 1 : 0;
+         if (this->protocol == MQTT_PROTOCOL_V5) {
+            opts |= 0x04; // No Local: our own publishes are not sent back
+         }
+         buffer[length++] = opts;
+      }
+      return MQTTClient_write(this,MQTTSUBSCRIBE|MQTTQOS1,buffer,length-5) && TCPClient_push(this->_client);
    }
    return FALSE;
 }
 
+static BOOL MQTTClient_puback(MQTTClient_t *this, uint16_t msgId)
+{
+   uint8_t ctrl[4];
+   ctrl[0] = MQTTPUBACK;
+   ctrl[1] = 2;
+   ctrl[2] = (msgId >> 8);
+   ctrl[3] = (msgId & 0xFF);
+   this->lastOutActivity = tickGetSeconds();
+   return (TCPClient_write(this->_client,ctrl,4) == 4);
+}
+
 /**
-* Disconnects the client.
+* Disconnects the client, it does not reconnect until MQTTClient_connect is called again.
 */
 void MQTTClient_disconnect(MQTTClient_t *this)
 {
-   if (!TCPClient_connected(this->_client))
+   uint8_t ctrl[2];
+   uint8_t state = this->state;
+   this->state = MQTT_STATE_IDLE;
+   if (state < MQTT_STATE_WAIT_CONNACK || !TCPClient_connected(this->_client))
       return;
-   this->buffer[0] = MQTTDISCONNECT;
-   this->buffer[1] = 0;
-   TCPClient_write(this->_client,this->buffer,2);
+   ctrl[0] = MQTTDISCONNECT;
+   ctrl[1] = 0;
+   TCPClient_write(this->_client,ctrl,2);
    TCPClient_stop(this->_client);
    this->lastInActivity = this->lastOutActivity = tickGetSeconds();
 }
@@ -359,14 +1095,14 @@ static uint16_t MQTTClient_writeStr(char* string, uint8_t* buf, uint16_t pos)
 }
 
 /**
-* Checks whether the client is connected to the server.
+* Checks whether the client is connected to the server and done subscribing.
 
 * Returns
-*  false - the client is no longer connected
-*  true - the client is still connected
+*  false - the client is not connected, or still connecting
+*  true - the client is ready
 */
 BOOL MQTTClient_connected(MQTTClient_t *this)
 {
-   return TCPClient_connected(this->_client);
+   return (this->state == MQTT_STATE_READY);
 }
 
@@ -9,17 +9,77 @@
 #define MQTT_MAX_PACKET_SIZE 512
 #endif
 
+// MQTT_RECONNECT_INTERVAL : Delay between connection attempts in Seconds
+#ifndef MQTT_RECONNECT_INTERVAL
+#define MQTT_RECONNECT_INTERVAL 2UL
+#endif
+
+// MQTT_SESSION_EXPIRY : Lifetime of a persistent session after disconnection in Seconds (MQTT 5.0)
+#ifndef MQTT_SESSION_EXPIRY
+#define MQTT_SESSION_EXPIRY 86400UL
+#endif
+
 // MQTT_MAX_TOPIC_LEN : Maximum topic length
 #ifndef MQTT_MAX_TOPIC_LEN
 #define MQTT_MAX_TOPIC_LEN 32
 #endif
 
-// MQTT_KEEPALIVE : keepAlive interval in Seconds
+// MQTT_KEEPALIVE : keepAlive interval in Seconds, the shortest one when it is tuned
 #ifndef MQTT_KEEPALIVE
 #define MQTT_KEEPALIVE 30UL
 #endif
 
-#define MQTTPROTOCOLVERSION 3
+// MQTT_KEEPALIVE_MAX : Longest keepAlive interval tried, in Seconds. Sent to the server in CONNECT
+#ifndef MQTT_KEEPALIVE_MAX
+#define MQTT_KEEPALIVE_MAX MQTT_KEEPALIVE
+#endif
+
+// MQTT_KEEPALIVE_STEP : keepAlive interval increment in Seconds
+#ifndef MQTT_KEEPALIVE_STEP
+#define MQTT_KEEPALIVE_STEP 30UL
+#endif
+
+// MQTT_KEEPALIVE_PROBES : Number of answered pings before a longer interval is tried
+#ifndef MQTT_KEEPALIVE_PROBES
+#define MQTT_KEEPALIVE_PROBES 3
+#endif
+
+// MQTT_PING_TIMEOUT : PINGRESP timeout in Seconds
+#ifndef MQTT_PING_TIMEOUT
+#define MQTT_PING_TIMEOUT 20UL
+#endif
+
+// MQTT_MAX_INFLIGHT : Maximum number of QoS 1 publishes waiting for PUBACK
+#ifndef MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT 2
+#endif
+
+// MQTT_INFLIGHT_MSG_SIZE : Maximum size of a QoS 1 publish kept for retransmission
+#ifndef MQTT_INFLIGHT_MSG_SIZE
+#define MQTT_INFLIGHT_MSG_SIZE 128
+#endif
+
+// MQTT_MAX_IOV : Maximum number of segments sent by a MQTTClient_publishv
+#ifndef MQTT_MAX_IOV
+#define MQTT_MAX_IOV 6
+#endif
+
+// MQTT_RETRY_INTERVAL : PUBACK timeout before a QoS 1 publish is resent, in Seconds
+#ifndef MQTT_RETRY_INTERVAL
+#define MQTT_RETRY_INTERVAL 20UL
+#endif
+
+// MQTT_MAX_ALIASES : Maximum number of topic aliases used in MQTT 5.0 mode
+#ifndef MQTT_MAX_ALIASES
+#define MQTT_MAX_ALIASES 4
+#endif
+
+// Protocol levels, see MQTTClient_setProtocol
+#define MQTT_PROTOCOL_V31   3 // MQTT 3.1 ("MQIsdp")
+#define MQTT_PROTOCOL_V311  4 // MQTT 3.1.1
+#define MQTT_PROTOCOL_V5    5 // MQTT 5.0
+#define MQTTPROTOCOLVERSION MQTT_PROTOCOL_V31
+
 #define MQTTCONNECT     1 << 4  // Client request to connect to Server
 #define MQTTCONNACK     2 << 4  // Connect Acknowledgment
 #define MQTTPUBLISH     3 << 4  // Publish message
@@ -39,6 +99,37 @@
 #define MQTTQOS0        (0 << 1)
 #define MQTTQOS1        (1 << 1)
 #define MQTTQOS2        (2 << 1)
+#define MQTTDUP         (1 << 3)
+
+// MQTT 5.0 property identifiers
+#define MQTTPROP_SERVER_KEEPALIVE 0x13
+#define MQTTPROP_TOPIC_ALIAS_MAX  0x22
+#define MQTTPROP_TOPIC_ALIAS      0x23
+
+// Packet decoder states
+#define MQTT_RX_HEADER  0 // waiting for the fixed header byte
+#define MQTT_RX_LENGTH  1 // decoding the remaining length
+#define MQTT_RX_BODY    2 // storing a packet that fits in buffer
+#define MQTT_RX_TOPIC   3 // storing the topic of a PUBLISH to be streamed
+#define MQTT_RX_STREAM  4 // passing the payload to the stream callback
+#define MQTT_RX_SKIP    5 // discarding an oversized packet
+
+// Connection states, driven by MQTTClient_loop
+#define MQTT_STATE_IDLE          0 // not connected, no connection requested
+#define MQTT_STATE_CONNECTING    1 // opening the socket
+#define MQTT_STATE_WAIT_CONNACK  2 // CONNECT sent
+#define MQTT_STATE_SUBSCRIBING   3 // waiting for SUBACK
+#define MQTT_STATE_READY         4
+
+typedef struct MQTTInflight
+{
+   uint16_t msgId;   // 0 when the slot is free
+   uint8_t header;   // fixed header byte
+   uint16_t topicLen; // buf holds the topic followed by the payload
+   uint16_t length;
+   unsigned long lastSent;
+   uint8_t buf[MQTT_INFLIGHT_MSG_SIZE];
+} MQTTInflight_t;
 
 typedef struct MQTTClient 
 {
@@ -48,17 +139,59 @@ typedef struct MQTTClient
    unsigned long lastOutActivity;
    unsigned long lastInActivity;
    BOOL pingOutstanding;
+   unsigned long pingSent;
+   uint16_t keepAlive;      // current ping interval
+   uint16_t keepAliveGood;  // longest interval the link is known to survive
+   uint16_t keepAliveLimit; // probing stops below this interval
+   uint16_t keepAliveMax;   // interval announced to the server
+   uint8_t pingCount;       // answered pings at the current interval
+   MQTTInflight_t inflight[MQTT_MAX_INFLIGHT];
+   uint8_t inflightCount;
+   uint8_t protocol;
+   uint8_t connackRc; // return code of the last CONNACK, 0xFF if none arrived
+   BOOL cleanSession;
+   BOOL sessionPresent; // session present flag of the last CONNACK
+   uint16_t aliasMax; // Topic Alias Maximum granted by the server, 0 without aliases
+   char alias[MQTT_MAX_ALIASES][MQTT_MAX_TOPIC_LEN + 1];
    void (*callback)(char*,uint8_t*,unsigned int);
+   void (*stream)(char*,unsigned long,uint8_t*,unsigned int,BOOL);
+   uint8_t rxState;
+   uint16_t rxLen;
+   unsigned long rxRemaining;
+   unsigned long rxOffset;
+   uint16_t rxMsgId;
+   uint8_t state;
+   char *id;
+   char *user;
+   char *pass;
+   char *willTopic;
+   uint8_t willQos;
+   uint8_t willRetain;
+   char *willMessage;
+   char **subTopics;
+   uint8_t *subQos;
+   uint8_t subCount;
+   uint16_t subAckId; // message ID of the SUBSCRIBE sent on connect
+   uint8_t subFailed; // topics refused in its SUBACK, one bit per topic
    char* server;
    uint16_t port;
 } MQTTClient_t;
 
 void MQTTClient_init(MQTTClient_t *, char*, uint16_t, void(*)(char*,uint8_t*,unsigned int),TCPClient_t *);
+void MQTTClient_setProtocol(MQTTClient_t *, uint8_t);
+void MQTTClient_setCleanSession(MQTTClient_t *, BOOL);
 BOOL MQTTClient_connect(MQTTClient_t *, char *, char *, char *, char *, uint8_t, uint8_t, char*);
 void MQTTClient_disconnect(MQTTClient_t *);
 BOOL MQTTClient_publish(MQTTClient_t *, char *, uint8_t *, unsigned int, BOOL);
+BOOL MQTTClient_publishQos(MQTTClient_t *, char *, uint8_t *, unsigned int, uint8_t, BOOL);
+BOOL MQTTClient_publishv(MQTTClient_t *, TCP_IOVEC *, uint8_t, TCP_IOVEC *, uint8_t, uint8_t, BOOL, uint16_t *);
+uint8_t MQTTClient_inflightFree(MQTTClient_t *);
+BOOL MQTTClient_delivered(MQTTClient_t *, uint16_t);
 BOOL MQTTClient_subscribe(MQTTClient_t *, char *);
+BOOL MQTTClient_subscribev(MQTTClient_t *, char **, uint8_t *, uint8_t);
+void MQTTClient_setSubscriptions(MQTTClient_t *, char **, uint8_t *, uint8_t);
 BOOL MQTTClient_loop(MQTTClient_t *);
+void MQTTClient_setStream(MQTTClient_t *, void(*)(char*,unsigned long,uint8_t*,unsigned int,BOOL));
 BOOL MQTTClient_connected(MQTTClient_t *);
 
 #endif
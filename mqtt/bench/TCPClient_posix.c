@@ -0,0 +1,239 @@
+#include "TCPClient.h"
+#include "net.h"
+
+// TCPClient over POSIX sockets. A send costs net_modem_ms, like an AT+KTCPSND on the module,
+// scaled like the clock
+
+void TCPClient_init(TCPClient_t *this)
+{
+	this->sock.number = INVALID_SOCKET;
+	this->size = 0;
+	this->idx = 0;
+	this->tick = tickGetSeconds();
+#if TCP_TX_BUF_SIZE > 0
+	this->txLen = 0;
+#endif
+}
+
+BOOL TCPClient_open(TCPClient_t *this, char *server, uint16_t port)
+{
+	this->size = 0;
+	this->idx = 0;
+#if TCP_TX_BUF_SIZE > 0
+	this->txLen = 0;
+#endif
+	this->sock.number = net_connect(server, port);
+	return (this->sock.number != INVALID_SOCKET);
+}
+
+BOOL TCPClient_connect(TCPClient_t *this, char *server, uint16_t port)
+{
+	TCPClient_init(this);
+	while (!TCPClient_open(this, server, port))
+		net_sleep_ms(200);
+	return TRUE;
+}
+
+void TCPClient_stop(TCPClient_t *this)
+{
+	if (this->sock.number == INVALID_SOCKET)
+		return;
+	TCPClient_push(this);
+	if (this->sock.number == INVALID_SOCKET)
+		return;
+	net_close(this->sock.number);
+	this->sock.number = INVALID_SOCKET;
+}
+
+// Fills the free span after the buffered bytes, like the module read in TCPClient.c
+static int TCPCheckStatus(TCPClient_t *this)
+{
+	int len, room;
+	uint16_t end;
+
+#if TCP_TX_BUF_SIZE > 0
+	if (this->txLen > 0 && (uint32_t)net_now_ms() - this->txTick >= TCP_TX_DELAY_MS / net_timescale)
+		TCPClient_push(this);
+#endif
+
+	if (this->sock.number == INVALID_SOCKET)
+		return (this->size > 0) ? this->size : -1;
+
+	end = this->idx + this->size;
+	if (end >= TCP_MAX_BUF_SIZE)
+		end -= TCP_MAX_BUF_SIZE;
+	if (end < this->idx || this->size == TCP_MAX_BUF_SIZE)
+		room = this->idx - end;
+	else
+		room = TCP_MAX_BUF_SIZE - end;
+	if (room > TCP_MAX_READ)
+		room = TCP_MAX_READ;
+	if (room == 0)
+		return this->size;
+
+	len = net_recv(this->sock.number, this->buff + end, room);
+	if (len < 0) {
+		TCPClient_stop(this);
+		return (this->size > 0) ? this->size : -1;
+	}
+	net_stats.rxBytes += len;
+	this->size += len;
+	return this->size;
+}
+
+int TCPClient_available(TCPClient_t *this)
+{
+	int rxlen = TCPCheckStatus(this);
+	if (rxlen > 0)
+		return rxlen;
+	return 0;
+}
+
+int TCPClient_write(TCPClient_t *this, uint8_t *buf, int len)
+{
+	TCP_IOVEC iov;
+	iov.buf = (char*)buf;
+	iov.len = len;
+	return TCPClient_writev(this, &iov, 1);
+}
+
+static int TCPSendV(TCPClient_t *this, TCP_IOVEC *iov, int iovcnt)
+{
+	char seg[2048];
+	int i, len = 0;
+
+	// One send operation, as the module sends it
+	for (i = 0; i < iovcnt; i++) {
+		if (len + iov[i].len > (int)sizeof(seg))
+			return 0;
+		memcpy(seg + len, iov[i].buf, iov[i].len);
+		len += iov[i].len;
+	}
+	net_sleep_ms((double)net_modem_ms / net_timescale);
+	if (net_send(this->sock.number, seg, len) != len) {
+		TCPClient_stop(this);
+		return 0;
+	}
+	net_stats.txBytes += len;
+	net_stats.txSegments++;
+	return len;
+}
+
+// Write combining as in TCPClient.c, txTick holds net_now_ms in milliseconds
+int TCPClient_writev(TCPClient_t *this, TCP_IOVEC *iov, int iovcnt)
+{
+#if TCP_TX_BUF_SIZE > 0
+	TCP_IOVEC seg[TCP_TX_MAX_IOV + 1];
+	int i, len = 0;
+#endif
+
+	if (this->sock.number == INVALID_SOCKET)
+		return 0;
+
+#if TCP_TX_BUF_SIZE > 0
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].len;
+
+	if (this->txLen + len <= TCP_TX_BUF_SIZE) {
+		if (this->txLen == 0)
+			this->txTick = (uint32_t)net_now_ms();
+		for (i = 0; i < iovcnt; i++) {
+			memcpy(this->txBuff + this->txLen, iov[i].buf, iov[i].len);
+			this->txLen += iov[i].len;
+		}
+		if (this->txLen == TCP_TX_BUF_SIZE && !TCPClient_push(this))
+			return 0;
+		return len;
+	}
+
+	if (this->txLen > 0 && iovcnt <= TCP_TX_MAX_IOV) {
+		seg[0].buf = this->txBuff;
+		seg[0].len = this->txLen;
+		memcpy(seg + 1, iov, iovcnt * sizeof(TCP_IOVEC));
+		this->txLen = 0;
+		return (TCPSendV(this, seg, iovcnt + 1) > 0) ? len : 0;
+	}
+	if (!TCPClient_push(this))
+		return 0;
+#endif
+	return TCPSendV(this, iov, iovcnt);
+}
+
+BOOL TCPClient_push(TCPClient_t *this)
+{
+#if TCP_TX_BUF_SIZE > 0
+	TCP_IOVEC iov;
+
+	if (this->txLen == 0)
+		return TRUE;
+	iov.buf = this->txBuff;
+	iov.len = this->txLen;
+	this->txLen = 0;
+	if (this->sock.number == INVALID_SOCKET)
+		return FALSE;
+	return (TCPSendV(this, &iov, 1) > 0);
+#else
+	return TRUE;
+#endif
+}
+
+int TCPClient_read(TCPClient_t *this, uint8_t *buf, int len)
+{
+	uint8_t *span;
+	int n, nbytes = 0;
+
+	while (nbytes < len && (n = TCPClient_peek(this, &span)) > 0) {
+		if (n > len - nbytes)
+			n = len - nbytes;
+		memcpy(buf + nbytes, span, n);
+		TCPClient_skip(this, n);
+		nbytes += n;
+	}
+	return nbytes;
+}
+
+int TCPClient_readByte(TCPClient_t *this)
+{
+	if (this->size > 0) {
+		uint8_t b = this->buff[this->idx];
+		TCPClient_skip(this, 1);
+		return b;
+	}
+	return -1;
+}
+
+int TCPClient_peek(TCPClient_t *this, uint8_t **buf)
+{
+	int n = TCP_MAX_BUF_SIZE - this->idx;
+	if (n > this->size)
+		n = this->size;
+	*buf = (uint8_t*)this->buff + this->idx;
+	return n;
+}
+
+void TCPClient_skip(TCPClient_t *this, int len)
+{
+	if (len > this->size)
+		len = this->size;
+	this->size -= len;
+	this->idx += len;
+	if (this->idx >= TCP_MAX_BUF_SIZE)
+		this->idx -= TCP_MAX_BUF_SIZE;
+	if (this->size == 0)
+		this->idx = 0;
+}
+
+BOOL TCPClient_connected(TCPClient_t *this)
+{
+	if (this->sock.number == INVALID_SOCKET)
+		return FALSE;
+	if (TCPCheckStatus(this) == -1)
+		return FALSE;
+	return TRUE;
+}
+
+void TCPClient_flush(TCPClient_t *this)
+{
+	this->size = 0;
+	this->idx = 0;
+}
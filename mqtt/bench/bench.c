@@ -0,0 +1,171 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "MQTTClient.h"
+#include "broker.h"
+#include "net.h"
+
+// Host benchmark of MQTTClient: connect latency, publish rate, bytes on wire per feed
+// and keepalive overhead, against the broker stand-in over an emulated GPRS link.
+
+#define BENCH_IMEI   "867584030012345"
+#define TCPIP_HEADER 40		// IPv4 and TCP headers of a segment
+#define BENCH_DRAIN  10000	// ms to wait for the last feeds to reach the broker
+
+static MQTTClient_t mqtt;
+static TCPClient_t client;
+
+static void callback(char *topic, uint8_t *payload, unsigned int length)
+{
+}
+
+static void usage(char *prog)
+{
+	printf("usage: %s [options]\n"
+		"  -n count    feeds to publish (200)\n"
+		"  -s size     feed payload size (16)\n"
+		"  -q qos      feed QoS, 0 or 1 (1)\n"
+		"  -v level    protocol level, 3, 4 or 5 (5)\n"
+		"  -r ms       round trip time (600)\n"
+		"  -l percent  segment loss (0)\n"
+		"  -m ms       modem time per send (100)\n"
+		"  -i seconds  idle time measured for keepalive, simulated (3600)\n"
+		"  -t seconds  carrier NAT idle timeout, simulated, 0 for none (0)\n"
+		"  -x factor   simulated seconds per second while idle (100)\n"
+		"  -p port     broker port (18830)\n", prog);
+}
+
+// Runs the client loop, pausing like FlyportTask does between modem polls
+static void run_loop(void)
+{
+	MQTTClient_loop(&mqtt);
+	net_sleep_ms(1);
+}
+
+int main(int argc, char **argv)
+{
+	broker_cfg_t bc;
+	broker_stats_t b0, b1;
+	net_stats_t n0;
+	unsigned count = 200, size = 16, qos = 1, protocol = MQTT_PROTOCOL_V5;
+	unsigned long idle = 3600;
+	unsigned scale = 100;
+	double t0, t1;
+	unsigned i;
+	int opt;
+
+	memset(&bc, 0, sizeof(bc));
+	bc.port = 18830;
+	bc.rttMs = 600;
+	bc.aliasMax = 4;
+	net_modem_ms = 100;
+
+	while ((opt = getopt(argc, argv, "n:s:q:v:r:l:m:i:t:x:p:h")) != -1) {
+		switch (opt) {
+		case 'n': count = atoi(optarg); break;
+		case 's': size = atoi(optarg); break;
+		case 'q': qos = atoi(optarg); break;
+		case 'v': protocol = atoi(optarg); break;
+		case 'r': bc.rttMs = atoi(optarg); break;
+		case 'l': bc.lossPct = atoi(optarg); break;
+		case 'm': net_modem_ms = atoi(optarg); break;
+		case 'i': idle = atol(optarg); break;
+		case 't': bc.natTimeout = atol(optarg); break;
+		case 'x': scale = atoi(optarg); break;
+		case 'p': bc.port = atoi(optarg); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (size > MQTT_INFLIGHT_MSG_SIZE - sizeof(BENCH_IMEI "/feeds")) {
+		printf("feed size too large for an in-flight slot\n");
+		return 1;
+	}
+	bc.rtoMs = (bc.rttMs * 3 > 1000) ? bc.rttMs * 3 : 1000;
+	if (broker_start(&bc) < 0) {
+		printf("cannot listen on port %u\n", bc.port);
+		return 1;
+	}
+
+	static char sub[] = BENCH_IMEI "/cmd/req";
+	static char *subs[1] = { sub };
+	static uint8_t subQos[1] = { 1 };
+	TCPClient_init(&client);
+	MQTTClient_init(&mqtt, "127.0.0.1", bc.port, callback, &client);
+	MQTTClient_setProtocol(&mqtt, protocol);
+	MQTTClient_setSubscriptions(&mqtt, subs, subQos, 1);
+
+	printf("rtt %u ms, loss %u%%, modem %u ms/send, MQTT level %u, QoS %u, %u byte feeds\n",
+		bc.rttMs, bc.lossPct, net_modem_ms, protocol, qos, size);
+
+	// Connect: CONNECT/CONNACK and SUBSCRIBE/SUBACK
+	t0 = net_now_ms();
+	MQTTClient_connect(&mqtt, BENCH_IMEI, "admin", "password", NULL, 0, 0, NULL);
+	while (!MQTTClient_connected(&mqtt))
+		run_loop();
+	t1 = net_now_ms();
+	printf("connect latency      %8.0f ms\n", t1 - t0);
+
+	// Feeds, published the way FlyportTask does
+	char payload[MQTT_INFLIGHT_MSG_SIZE];
+	TCP_IOVEC topic[2], data;
+	for (i = 0; i < size; i++)
+		payload[i] = (char)i;
+	topic[0].buf = BENCH_IMEI;
+	topic[0].len = strlen(BENCH_IMEI);
+	topic[1].buf = "/feeds";
+	topic[1].len = 6;
+	data.buf = payload;
+	data.len = size;
+
+	broker_stats(&b0);
+	n0 = net_stats;
+	t0 = net_now_ms();
+	for (i = 0; i < count; i++) {
+		while (qos && !MQTTClient_inflightFree(&mqtt))
+			run_loop();
+		if (!MQTTClient_publishv(&mqtt, topic, 2, &data, 1, qos, FALSE, NULL)) {
+			printf("publish failed\n");
+			return 1;
+		}
+		run_loop();
+	}
+	while (MQTTClient_inflightFree(&mqtt) < MQTT_MAX_INFLIGHT)
+		run_loop();
+	// QoS 0 feeds may still be in the write buffer or on the link
+	TCPClient_push(&client);
+	t1 = net_now_ms();
+	do {
+		broker_stats(&b1);
+		if (b1.publishes - b0.publishes >= count)
+			break;
+		run_loop();
+	} while (net_now_ms() - t1 < BENCH_DRAIN);
+	t1 = net_now_ms();
+
+	unsigned long bytes = net_stats.txBytes - n0.txBytes;
+	unsigned long segs = net_stats.txSegments - n0.txSegments;
+	printf("publish rate         %8.2f feeds/s\n", count * 1000.0 / (t1 - t0));
+	printf("MQTT bytes per feed  %8.1f (payload %u)\n", (double)bytes / count, size);
+	printf("wire bytes per feed  %8.1f (%lu segments, %u byte TCP/IP headers)\n",
+		(double)(bytes + segs * TCPIP_HEADER) / count, segs, TCPIP_HEADER);
+	printf("downlink per feed    %8.1f bytes\n", (double)(b1.txBytes - b0.txBytes) / count);
+	printf("feeds at broker      %8lu\n", b1.publishes - b0.publishes);
+
+	// Keepalive: idle link, simulated time runs faster
+	net_timescale = scale;
+	mqtt.lastInActivity = mqtt.lastOutActivity = tickGetSeconds();
+	broker_stats(&b0);
+	n0 = net_stats;
+	unsigned long start = tickGetSeconds();
+	while (tickGetSeconds() - start < idle)
+		run_loop();
+	broker_stats(&b1);
+
+	bytes = (net_stats.txBytes - n0.txBytes) + (net_stats.rxBytes - n0.rxBytes);
+	segs = net_stats.txSegments - n0.txSegments;
+	printf("idle %lu s: %lu pings, %lu reconnects, %lu NAT drops, ping interval now %u s\n",
+		idle, b1.pings - b0.pings, b1.connects - b0.connects, b1.natDrops - b0.natDrops, mqtt.keepAlive);
+	printf("keepalive overhead   %8.1f bytes/hour (%.1f sends/hour)\n",
+		(bytes + 2 * segs * TCPIP_HEADER) * 3600.0 / idle, segs * 3600.0 / idle);
+	return 0;
+}
@@ -0,0 +1,215 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "broker.h"
+#include "net.h"
+
+unsigned long TickGetDiv64K(void);
+
+#define BROKER_BUF_SIZE  4096
+#define BROKER_MAX_REPLY 64
+
+typedef struct reply
+{
+	double due;
+	int len;
+	unsigned char data[16];
+} reply_t;
+
+static broker_cfg_t cfg;
+static broker_stats_t stats;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static reply_t replies[BROKER_MAX_REPLY];
+static int head, count;
+static double lastDue;
+
+void broker_stats(broker_stats_t *s)
+{
+	pthread_mutex_lock(&lock);
+	*s = stats;
+	pthread_mutex_unlock(&lock);
+}
+
+static void count_stat(unsigned long *stat, unsigned long n)
+{
+	pthread_mutex_lock(&lock);
+	*stat += n;
+	pthread_mutex_unlock(&lock);
+}
+
+// Queues a reply, a lost segment also holds back the ones behind it
+static void queue_reply(unsigned char *data, int len)
+{
+	reply_t *r;
+	double delay = cfg.rttMs;
+
+	if (count == BROKER_MAX_REPLY)
+		return;
+	if (cfg.lossPct && (unsigned)(rand() % 100) < cfg.lossPct)
+		delay += cfg.rtoMs;
+	// Link delays follow the simulated clock
+	double due = net_now_ms() + delay / net_timescale;
+	if (due < lastDue)
+		due = lastDue;
+	lastDue = due;
+	r = &replies[(head + count++) % BROKER_MAX_REPLY];
+	r->due = due;
+	r->len = len;
+	memcpy(r->data, data, len);
+}
+
+// Returns the length of the complete packet at buf, 0 if more bytes are needed
+static int packet_len(unsigned char *buf, int avail, int *hdr)
+{
+	int rem = 0, pos = 1;
+	do {
+		if (pos >= avail || pos > 4)
+			return 0;
+		rem += (buf[pos] & 127) << (7 * (pos - 1));
+	} while ((buf[pos++] & 128) != 0);
+	*hdr = pos;
+	return (pos + rem <= avail) ? pos + rem : 0;
+}
+
+// Handles one packet, returns 0 when the client disconnects
+static int handle_packet(unsigned char *p, int len, int hdr, int *protocol)
+{
+	unsigned char r[16];
+	int o, n;
+
+	switch (p[0] & 0xF0) {
+	case 0x10:	// CONNECT
+		o = hdr + 2 + ((p[hdr] << 8) | p[hdr + 1]);
+		*protocol = p[o];
+		count_stat(&stats.connects, 1);
+		r[0] = 0x20;
+		r[2] = 0;
+		r[3] = 0;
+		if (*protocol == 5) {
+			r[1] = 6;
+			r[4] = 3;
+			r[5] = 0x22;
+			r[6] = cfg.aliasMax >> 8;
+			r[7] = cfg.aliasMax & 0xFF;
+			queue_reply(r, 8);
+		} else {
+			r[1] = 2;
+			queue_reply(r, 4);
+		}
+		break;
+	case 0x30:	// PUBLISH
+		count_stat(&stats.publishes, 1);
+		if ((p[0] & 0x06) != 0) {
+			o = hdr + 2 + ((p[hdr] << 8) | p[hdr + 1]);
+			r[0] = 0x40;
+			r[1] = 2;
+			r[2] = p[o];
+			r[3] = p[o + 1];
+			queue_reply(r, 4);
+		}
+		break;
+	case 0x80:	// SUBSCRIBE
+		r[0] = 0x90;
+		r[2] = p[hdr];
+		r[3] = p[hdr + 1];
+		n = 4;
+		o = hdr + 2;
+		if (*protocol == 5) {
+			o += 1 + p[o];
+			r[n++] = 0;
+		}
+		while (o + 2 < len && n < (int)sizeof(r)) {
+			o += 2 + ((p[o] << 8) | p[o + 1]);
+			r[n++] = p[o++] & 0x03;
+		}
+		r[1] = n - 2;
+		queue_reply(r, n);
+		break;
+	case 0xC0:	// PINGREQ
+		count_stat(&stats.pings, 1);
+		r[0] = 0xD0;
+		r[1] = 0;
+		queue_reply(r, 2);
+		break;
+	case 0xE0:	// DISCONNECT
+		return 0;
+	}
+	return 1;
+}
+
+static void serve(int fd)
+{
+	static unsigned char buf[BROKER_BUF_SIZE];
+	int len = 0, plen, hdr, protocol = 4, dead = 0;
+	unsigned long lastActivity = TickGetDiv64K();
+
+	head = count = 0;
+	lastDue = 0;
+	while (1) {
+		double now = net_now_ms();
+		while (count > 0 && replies[head].due <= now) {
+			if (!dead) {
+				net_send(fd, replies[head].data, replies[head].len);
+				count_stat(&stats.txBytes, replies[head].len);
+				lastActivity = TickGetDiv64K();
+			}
+			head = (head + 1) % BROKER_MAX_REPLY;
+			count--;
+		}
+		if (cfg.natTimeout && !dead && TickGetDiv64K() - lastActivity > cfg.natTimeout) {
+			// The mapping is gone, whatever the client sends from now on is lost
+			dead = 1;
+			count_stat(&stats.natDrops, 1);
+		}
+
+		double wait = (count > 0) ? replies[head].due - now : 10;
+		if (!net_wait(fd, (wait < 10) ? wait : 10))
+			continue;
+		int n = net_recv(fd, buf + len, sizeof(buf) - len);
+		if (n < 0)
+			return;
+		if (dead)
+			continue;
+		count_stat(&stats.rxBytes, n);
+		lastActivity = TickGetDiv64K();
+		len += n;
+		while ((plen = packet_len(buf, len, &hdr)) > 0) {
+			if (!handle_packet(buf, plen, hdr, &protocol))
+				return;
+			memmove(buf, buf + plen, len - plen);
+			len -= plen;
+		}
+		if (len == sizeof(buf))
+			return;
+	}
+}
+
+static void *broker_task(void *arg)
+{
+	int lfd = (int)(long)arg;
+	while (1) {
+		int fd = net_accept(lfd);
+		if (fd < 0)
+			continue;
+		serve(fd);
+		net_close(fd);
+	}
+	return NULL;
+}
+
+int broker_start(broker_cfg_t *c)
+{
+	pthread_t th;
+	int lfd;
+
+	cfg = *c;
+	lfd = net_listen(cfg.port);
+	if (lfd < 0)
+		return -1;
+	if (pthread_create(&th, NULL, broker_task, (void *)(long)lfd) != 0)
+		return -1;
+	pthread_detach(th);
+	return 0;
+}
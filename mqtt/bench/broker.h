@@ -0,0 +1,30 @@
+#ifndef BROKER_H
+#define BROKER_H
+
+// Minimal MQTT broker stand-in for the host benchmark: one client at a time, no routing.
+// Replies are held back by the configured round trip time, as over a GPRS link.
+
+typedef struct broker_cfg
+{
+	unsigned short port;
+	unsigned rttMs;			// round trip time added to every reply
+	unsigned lossPct;		// share of segments lost and retransmitted
+	unsigned rtoMs;			// delay of a retransmission
+	unsigned long natTimeout;	// idle seconds after which the NAT drops the connection, 0 never
+	unsigned aliasMax;		// Topic Alias Maximum granted to MQTT 5.0 clients
+} broker_cfg_t;
+
+typedef struct broker_stats
+{
+	unsigned long connects;
+	unsigned long publishes;
+	unsigned long pings;
+	unsigned long natDrops;
+	unsigned long rxBytes;
+	unsigned long txBytes;
+} broker_stats_t;
+
+int broker_start(broker_cfg_t *cfg);
+void broker_stats(broker_stats_t *stats);
+
+#endif
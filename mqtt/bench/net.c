@@ -0,0 +1,132 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "net.h"
+
+net_stats_t net_stats;
+unsigned net_timescale = 1;
+unsigned net_modem_ms = 0;
+
+double net_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void net_sleep_ms(double ms)
+{
+	struct timespec ts;
+	if (ms <= 0)
+		return;
+	ts.tv_sec = (time_t)(ms / 1000);
+	ts.tv_nsec = (long)((ms - ts.tv_sec * 1000.0) * 1000000.0);
+	nanosleep(&ts, NULL);
+}
+
+unsigned long TickGetDiv64K(void)
+{
+	return (unsigned long)(net_now_ms() * net_timescale / 1000.0);
+}
+
+static void net_nodelay(int fd)
+{
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+int net_connect(const char *host, unsigned short port)
+{
+	struct sockaddr_in sa;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	if (inet_pton(AF_INET, host, &sa.sin_addr) != 1 || connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+		close(fd);
+		return -1;
+	}
+	net_nodelay(fd);
+	return fd;
+}
+
+int net_listen(unsigned short port)
+{
+	struct sockaddr_in sa;
+	int one = 1;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, 1) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int net_accept(int fd)
+{
+	int c = accept(fd, NULL, NULL);
+	if (c >= 0)
+		net_nodelay(c);
+	return c;
+}
+
+// Sends all of buf, returns len or -1
+int net_send(int fd, const void *buf, int len)
+{
+	const char *p = buf;
+	int left = len;
+	while (left > 0) {
+		int n = send(fd, p, left, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		left -= n;
+	}
+	return len;
+}
+
+// Reads what is available without waiting: 0 if nothing, -1 once the peer closed
+int net_recv(int fd, void *buf, int len)
+{
+	int n = recv(fd, buf, len, MSG_DONTWAIT);
+	if (n > 0)
+		return n;
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return 0;
+	return -1;
+}
+
+// Waits up to ms for fd to become readable, returns 1 if it is
+int net_wait(int fd, double ms)
+{
+	fd_set rd;
+	struct timeval tv;
+	if (ms < 0)
+		ms = 0;
+	FD_ZERO(&rd);
+	FD_SET(fd, &rd);
+	tv.tv_sec = (long)(ms / 1000);
+	tv.tv_usec = (long)((ms - tv.tv_sec * 1000.0) * 1000.0);
+	return select(fd + 1, &rd, NULL, NULL, &tv) > 0;
+}
+
+void net_close(int fd)
+{
+	close(fd);
+}
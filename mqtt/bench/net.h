@@ -0,0 +1,27 @@
+#ifndef NET_H
+#define NET_H
+
+// Sockets and clock for the host build, kept apart from TCPClient.h and its integer types
+
+typedef struct net_stats
+{
+	unsigned long txBytes;		// bytes written by the client
+	unsigned long txSegments;	// send operations, one TCP segment each
+	unsigned long rxBytes;
+} net_stats_t;
+
+extern net_stats_t net_stats;
+extern unsigned net_timescale;	// simulated seconds per second
+extern unsigned net_modem_ms;	// time the modem takes for a send command
+
+int net_connect(const char *host, unsigned short port);
+int net_listen(unsigned short port);
+int net_accept(int fd);
+int net_send(int fd, const void *buf, int len);
+int net_recv(int fd, void *buf, int len);
+int net_wait(int fd, double ms);
+void net_close(int fd);
+double net_now_ms(void);
+void net_sleep_ms(double ms);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _OPT_H
+#define _OPT_H
+
+// Same MQTT settings as project/gmgw, overridable from the make command line
+
+#ifndef MQTT_MAX_PACKET_SIZE
+#define MQTT_MAX_PACKET_SIZE   1000
+#endif
+
+#ifndef MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT      3
+#endif
+
+#ifndef MQTT_INFLIGHT_MSG_SIZE
+#define MQTT_INFLIGHT_MSG_SIZE 300
+#endif
+
+#ifndef MQTT_KEEPALIVE_MAX
+#define MQTT_KEEPALIVE_MAX     300UL
+#endif
+
+#ifndef TCP_TX_BUF_SIZE
+#define TCP_TX_BUF_SIZE        512
+#endif
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef TASKFLYPORT_H
+#define TASKFLYPORT_H
+
+// Host stand-in for the Flyport framework, just what TCPClient.h and MQTTClient.c use
+
+#include <string.h>
+#include <stdio.h>
+
+typedef int BOOL;
+#define TRUE  1
+#define FALSE 0
+
+typedef struct
+{
+	int number;		// socket descriptor
+} TCP_SOCKET;
+
+#define INVALID_SOCKET -1
+
+typedef struct
+{
+	char *buf;
+	int len;
+} TCP_IOVEC;
+
+// Seconds, scaled by net_timescale
+unsigned long TickGetDiv64K(void);
+
+#endif
@@ -0,0 +1,862 @@
+#include <string.h>
+#include "PPP.h"
+#include "TCPIP.h"
+
+#define HDLC_FLAG		0x7E
+#define HDLC_ESC		0x7D
+#define HDLC_GOOD_FCS	0xF0B8
+
+#define PROTO_IP		0x0021
+#define PROTO_IPCP		0x8021
+#define PROTO_LCP		0xC021
+#define PROTO_PAP		0xC023
+
+// Codes of the LCP and IPCP packets
+#define CONF_REQ		1
+#define CONF_ACK		2
+#define CONF_NAK		3
+#define CONF_REJ		4
+#define TERM_REQ		5
+#define TERM_ACK		6
+#define CODE_REJ		7
+#define PROTO_REJ		8
+#define ECHO_REQ		9
+#define ECHO_REP		10
+#define DISCARD_REQ		11
+
+#define LCP_MRU			1
+#define LCP_ACCM		2
+#define LCP_AUTH		3
+#define LCP_MAGIC		5
+#define LCP_PFC			7
+#define LCP_ACFC		8
+
+#define IPCP_ADDR		3
+#define IPCP_DNS1		129
+#define IPCP_DNS2		131
+
+// Options of our Configure-Requests, dropped when the peer rejects them
+#define OPT_MRU			0x01
+#define OPT_ACCM		0x02
+#define OPT_MAGIC		0x04
+#define OPT_ADDR		0x01
+#define OPT_DNS1		0x02
+#define OPT_DNS2		0x04
+
+#define PPP_MAX_CONFIGURE	10
+#define PPP_MAX_TERMINATE	2
+#define PPP_MAX_ECHO		3
+
+// States of LCP and IPCP, the automaton of RFC 1661 without the administrative ones
+#define CP_CLOSED		0
+#define CP_REQ_SENT		1
+#define CP_ACK_RCVD		2
+#define CP_ACK_SENT		3
+#define CP_OPENED		4
+#define CP_CLOSING		5
+
+typedef struct
+{
+	WORD proto;
+	BYTE state;
+	BYTE id;		// of the last request sent
+	BYTE retries;
+	BYTE options;	// OPT_ bits still requested
+	DWORD timer;	// when the last request was sent
+} PPPCp;
+
+static PPPCp lcp = { PROTO_LCP };
+static PPPCp ipcp = { PROTO_IPCP };
+static BYTE phase = PPP_DEAD;
+static BYTE nextId;
+
+// FCS-16 of RFC 1662, 4 bits at a time
+static const WORD fcsTable[16] =
+{
+	0x0000, 0x1081, 0x2102, 0x3183, 0x4204, 0x5285, 0x6306, 0x7387,
+	0x8408, 0x9489, 0xA50A, 0xB58B, 0xC60C, 0xD68D, 0xE70E, 0xF78F
+};
+
+// Frame being received: address, control, protocol, information and FCS
+static BYTE rxBuf[PPP_MTU + 8];
+static int rxLen;
+static WORD rxFcs;
+static BOOL rxEsc;
+static BOOL rxDrop;		// too long, skipped up to the next flag
+
+// Frame being sent, escaped into txBuf by chunks
+static BYTE txBuf[64];
+static int txLen;
+static WORD txFcs;
+static DWORD txMap;		// control chars escaped in this frame
+static DWORD txAccm;	// control chars escaped, as the peer asked
+
+// Negotiated
+static DWORD magic;
+static WORD mru;
+static WORD peerMru;
+static DWORD peerAccm;
+static BOOL papNeeded;
+static DWORD localAddr;
+static DWORD peerAddr;
+static DWORD dnsAddr[2];
+
+static BYTE papId;
+static BYTE papRetries;
+static DWORD papTimer;
+
+static DWORD rxTime;	// when the last frame came
+static DWORD echoTime;
+static BYTE echoCount;
+
+static WORD Get16(const BYTE* p)
+{
+	return ((WORD)p[0] << 8) | p[1];
+}
+
+static DWORD Get32(const BYTE* p)
+{
+	return ((DWORD)p[0] << 24) | ((DWORD)p[1] << 16) | ((DWORD)p[2] << 8) | p[3];
+}
+
+static void Put32(BYTE* p, DWORD v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static WORD FcsUpdate(WORD fcs, BYTE c)
+{
+	fcs = (fcs >> 4) ^ fcsTable[(fcs ^ c) & 0x0F];
+	return (fcs >> 4) ^ fcsTable[(fcs ^ (c >> 4)) & 0x0F];
+}
+
+/*
+* Transmitter: the frame is escaped on the fly, and written to the port by chunks of txBuf.
+*/
+static void TxFlush(void)
+{
+	if (txLen > 0)
+		PPPPortWrite(txBuf, txLen);
+	txLen = 0;
+}
+
+static void TxRaw(BYTE c)
+{
+	if (txLen == sizeof(txBuf))
+		TxFlush();
+	txBuf[txLen++] = c;
+}
+
+static void TxByte(BYTE c)
+{
+	txFcs = FcsUpdate(txFcs, c);
+	if (c == HDLC_FLAG || c == HDLC_ESC || (c < 0x20 && (txMap & (1UL << c)))) {
+		TxRaw(HDLC_ESC);
+		c ^= 0x20;
+	}
+	TxRaw(c);
+}
+
+static void TxData(const BYTE* p, int len)
+{
+	while (len-- > 0)
+		TxByte(*p++);
+}
+
+// LCP frames always have the control chars escaped (RFC 1662, 7.1)
+static void TxBegin(WORD proto)
+{
+	txMap = (proto == PROTO_LCP) ? 0xFFFFFFFFUL : txAccm;
+	TxRaw(HDLC_FLAG);
+	txFcs = 0xFFFF;
+	TxByte(0xFF);
+	TxByte(0x03);
+	TxByte(proto >> 8);
+	TxByte(proto & 0xFF);
+}
+
+static void TxEnd(void)
+{
+	WORD fcs = txFcs ^ 0xFFFF;
+
+	TxByte(fcs & 0xFF);
+	TxByte(fcs >> 8);
+	TxRaw(HDLC_FLAG);
+	TxFlush();
+}
+
+static void CpSend(WORD proto, BYTE code, BYTE id, const BYTE* data, int len)
+{
+	BYTE head[4];
+
+	head[0] = code;
+	head[1] = id;
+	head[2] = (len + 4) >> 8;
+	head[3] = (len + 4) & 0xFF;
+	TxBegin(proto);
+	TxData(head, 4);
+	TxData(data, len);
+	TxEnd();
+}
+
+static void CpSendReq(PPPCp *cp)
+{
+	BYTE opt[18];
+	int len = 0;
+
+	if (cp == &lcp) {
+		if (cp->options & OPT_MRU) {
+			opt[len++] = LCP_MRU;
+			opt[len++] = 4;
+			opt[len++] = mru >> 8;
+			opt[len++] = mru & 0xFF;
+		}
+		// Nothing to escape towards us
+		if (cp->options & OPT_ACCM) {
+			opt[len++] = LCP_ACCM;
+			opt[len++] = 6;
+			Put32(opt + len, 0);
+			len += 4;
+		}
+		if (cp->options & OPT_MAGIC) {
+			opt[len++] = LCP_MAGIC;
+			opt[len++] = 6;
+			Put32(opt + len, magic);
+			len += 4;
+		}
+	}
+	else {
+		if (cp->options & OPT_ADDR) {
+			opt[len++] = IPCP_ADDR;
+			opt[len++] = 6;
+			Put32(opt + len, localAddr);
+			len += 4;
+		}
+		if (cp->options & OPT_DNS1) {
+			opt[len++] = IPCP_DNS1;
+			opt[len++] = 6;
+			Put32(opt + len, dnsAddr[0]);
+			len += 4;
+		}
+		if (cp->options & OPT_DNS2) {
+			opt[len++] = IPCP_DNS2;
+			opt[len++] = 6;
+			Put32(opt + len, dnsAddr[1]);
+			len += 4;
+		}
+	}
+	cp->id = ++nextId;
+	cp->timer = PPPPortMillis();
+	CpSend(cp->proto, CONF_REQ, cp->id, opt, len);
+}
+
+static void CpSendTerm(PPPCp *cp)
+{
+	cp->id = ++nextId;
+	cp->timer = PPPPortMillis();
+	CpSend(cp->proto, TERM_REQ, cp->id, NULL, 0);
+}
+
+static void CpOpen(PPPCp *cp)
+{
+	cp->state = CP_REQ_SENT;
+	cp->retries = 0;
+	cp->options = (cp == &lcp) ? (OPT_MRU | OPT_ACCM | OPT_MAGIC) : (OPT_ADDR | OPT_DNS1 | OPT_DNS2);
+	CpSendReq(cp);
+}
+
+static void LinkDown(void)
+{
+	if (phase == PPP_DEAD)
+		return;
+	phase = PPP_DEAD;
+	lcp.state = CP_CLOSED;
+	ipcp.state = CP_CLOSED;
+	TCPIPLinkDown();
+}
+
+static void PapSend(void)
+{
+	BYTE head[4];
+	BYTE len;
+	int userLen = strlen(PPP_USER);
+	int passLen = strlen(PPP_PASSWORD);
+
+	papId = ++nextId;
+	papTimer = PPPPortMillis();
+	head[0] = 1;	// Authenticate-Request
+	head[1] = papId;
+	head[2] = 0;
+	head[3] = 6 + userLen + passLen;
+	TxBegin(PROTO_PAP);
+	TxData(head, 4);
+	len = userLen;
+	TxData(&len, 1);
+	TxData((const BYTE*)PPP_USER, userLen);
+	len = passLen;
+	TxData(&len, 1);
+	TxData((const BYTE*)PPP_PASSWORD, passLen);
+	TxEnd();
+}
+
+static void NetworkUp(void)
+{
+	phase = PPP_NETWORK;
+	CpOpen(&ipcp);
+}
+
+static void CpUp(PPPCp *cp)
+{
+	cp->state = CP_OPENED;
+	if (cp == &ipcp) {
+		phase = PPP_RUNNING;
+		return;
+	}
+	txAccm = peerAccm;
+	echoTime = PPPPortMillis();
+	echoCount = 0;
+	if (papNeeded) {
+		phase = PPP_AUTHENTICATE;
+		papRetries = 0;
+		PapSend();
+	}
+	else
+		NetworkUp();
+}
+
+/*
+* The peer negotiates again an opened protocol: the layers above it are down until it is opened again.
+*/
+static void CpDown(PPPCp *cp)
+{
+	if (cp == &lcp) {
+		if (phase >= PPP_NETWORK)
+			TCPIPLinkDown();
+		ipcp.state = CP_CLOSED;
+		txAccm = 0xFFFFFFFFUL;
+		papNeeded = FALSE;
+		phase = PPP_ESTABLISH;
+	}
+	else
+		phase = PPP_NETWORK;
+	cp->retries = 0;
+	CpSendReq(cp);
+	cp->state = CP_REQ_SENT;
+}
+
+/*
+* Checks an option of a Configure-Request of the peer. Returns CONF_ACK, CONF_REJ, or CONF_NAK
+* with the value we want written to nak, at most as long as the option.
+*/
+static BYTE CpCheck(PPPCp *cp, const BYTE* opt, BYTE* nak)
+{
+	int len = opt[1];
+
+	if (cp == &ipcp)
+		return (opt[0] == IPCP_ADDR && len == 6) ? CONF_ACK : CONF_REJ;
+
+	switch (opt[0]) {
+	case LCP_MRU:
+		return (len == 4) ? CONF_ACK : CONF_REJ;
+	case LCP_ACCM:
+	case LCP_MAGIC:
+		return (len == 6) ? CONF_ACK : CONF_REJ;
+	case LCP_PFC:
+	case LCP_ACFC:
+		return (len == 2) ? CONF_ACK : CONF_REJ;
+	case LCP_AUTH:
+		if (len < 4)
+			return CONF_REJ;
+		if (Get16(opt + 2) == PROTO_PAP)
+			return CONF_ACK;
+		// Only PAP is supported
+		nak[0] = LCP_AUTH;
+		nak[1] = 4;
+		nak[2] = PROTO_PAP >> 8;
+		nak[3] = PROTO_PAP & 0xFF;
+		return CONF_NAK;
+	}
+	return CONF_REJ;
+}
+
+static void CpApply(PPPCp *cp, const BYTE* opt)
+{
+	if (cp == &ipcp) {
+		peerAddr = Get32(opt + 2);
+		return;
+	}
+	switch (opt[0]) {
+	case LCP_MRU:
+		peerMru = Get16(opt + 2);
+		break;
+	case LCP_ACCM:
+		peerAccm = Get32(opt + 2);
+		break;
+	case LCP_AUTH:
+		papNeeded = TRUE;
+		break;
+	}
+}
+
+/*
+* Answers a Configure-Request of the peer. The reply is built in place, since it is never longer:
+* the options of the worst kind found are kept, or replaced by the value we want.
+* Returns the code of the reply, 0 if the request was malformed.
+*/
+static BYTE CpConfigure(PPPCp *cp, BYTE id, BYTE* data, int len)
+{
+	BYTE nak[4];
+	BYTE *p, *out, *end = data + len;
+	BYTE code = CONF_ACK, res;
+	int optLen;
+
+	for (p = data; p < end; p += p[1]) {
+		if (end - p < 2 || p[1] < 2 || p[1] > end - p)
+			return 0;
+		res = CpCheck(cp, p, nak);
+		if (res > code)
+			code = res;
+	}
+
+	out = data;
+	for (p = data; p < end; p += optLen) {
+		optLen = p[1];
+		res = CpCheck(cp, p, nak);
+		if (code == CONF_ACK)
+			CpApply(cp, p);
+		else if (res == code && res == CONF_NAK) {
+			memcpy(out, nak, nak[1]);
+			out += nak[1];
+			continue;
+		}
+		else if (res != code)
+			continue;
+		memmove(out, p, optLen);
+		out += optLen;
+	}
+	CpSend(cp->proto, code, id, data, out - data);
+	return code;
+}
+
+/*
+* Configure-Nak or Configure-Reject of our request: the next one takes it into account.
+*/
+static void CpRefused(PPPCp *cp, BYTE code, const BYTE* data, int len)
+{
+	const BYTE *p, *end = data + len;
+	BYTE bit;
+	WORD val16;
+	DWORD val32;
+
+	for (p = data; end - p >= 2 && p[1] >= 2 && p[1] <= end - p; p += p[1]) {
+		val16 = (p[1] >= 4) ? Get16(p + 2) : 0;
+		val32 = (p[1] >= 6) ? Get32(p + 2) : 0;
+		if (cp == &lcp) {
+			bit = (p[0] == LCP_MRU) ? OPT_MRU : (p[0] == LCP_ACCM) ? OPT_ACCM : (p[0] == LCP_MAGIC) ? OPT_MAGIC : 0;
+			if (code == CONF_NAK && bit == OPT_MRU && val16 >= 128 && val16 <= PPP_MTU) {
+				mru = val16;
+				continue;
+			}
+			if (code == CONF_NAK && bit == OPT_MAGIC) {
+				magic = magic * 69069UL + PPPPortMillis();
+				continue;
+			}
+		}
+		else {
+			bit = (p[0] == IPCP_ADDR) ? OPT_ADDR : (p[0] == IPCP_DNS1) ? OPT_DNS1 : (p[0] == IPCP_DNS2) ? OPT_DNS2 : 0;
+			if (code == CONF_NAK) {
+				if (bit == OPT_ADDR)
+					localAddr = val32;
+				else if (bit == OPT_DNS1)
+					dnsAddr[0] = val32;
+				else if (bit == OPT_DNS2)
+					dnsAddr[1] = val32;
+				continue;
+			}
+		}
+		cp->options &= ~bit;
+	}
+}
+
+static void CpInput(PPPCp *cp, BYTE* p, int len)
+{
+	BYTE code, id, res;
+	int plen;
+
+	if (len < 4)
+		return;
+	code = p[0];
+	id = p[1];
+	plen = Get16(p + 2);
+	if (plen < 4 || plen > len)
+		return;
+	p += 4;
+	plen -= 4;
+
+	switch (code) {
+	case CONF_REQ:
+		if (cp->state == CP_CLOSED || cp->state == CP_CLOSING)
+			break;
+		if (cp->state == CP_OPENED)
+			CpDown(cp);
+		res = CpConfigure(cp, id, p, plen);
+		if (res == CONF_ACK) {
+			if (cp->state == CP_ACK_RCVD)
+				CpUp(cp);
+			else
+				cp->state = CP_ACK_SENT;
+		}
+		else if (res != 0 && cp->state == CP_ACK_SENT)
+			cp->state = CP_REQ_SENT;
+		break;
+
+	case CONF_ACK:
+		if (id != cp->id)
+			break;
+		if (cp->state == CP_REQ_SENT) {
+			cp->state = CP_ACK_RCVD;
+			cp->retries = 0;
+		}
+		else if (cp->state == CP_ACK_SENT)
+			CpUp(cp);
+		else if (cp->state == CP_OPENED || cp->state == CP_ACK_RCVD)
+			CpDown(cp);
+		break;
+
+	case CONF_NAK:
+	case CONF_REJ:
+		if (id != cp->id || cp->state == CP_CLOSED || cp->state == CP_CLOSING)
+			break;
+		CpRefused(cp, code, p, plen);
+		if (cp->state == CP_OPENED)
+			CpDown(cp);
+		else {
+			if (cp->state == CP_ACK_RCVD)
+				cp->state = CP_REQ_SENT;
+			CpSendReq(cp);
+		}
+		break;
+
+	case TERM_REQ:
+		CpSend(cp->proto, TERM_ACK, id, NULL, 0);
+		if (cp == &lcp)
+			LinkDown();
+		else if (cp->state != CP_CLOSED) {
+			cp->state = CP_CLOSED;
+			phase = PPP_NETWORK;
+		}
+		break;
+
+	case TERM_ACK:
+		if (cp->state == CP_CLOSING)
+			LinkDown();
+		break;
+
+	case PROTO_REJ:
+		// No IP without IPCP
+		if (cp == &lcp && plen >= 2 && Get16(p) == PROTO_IPCP)
+			PPPClose();
+		break;
+
+	case ECHO_REQ:
+		if (cp == &lcp && cp->state == CP_OPENED && plen >= 4) {
+			// Sent back with our magic number
+			Put32(p, magic);
+			CpSend(PROTO_LCP, ECHO_REP, id, p, plen);
+		}
+		break;
+
+	case ECHO_REP:
+	case CODE_REJ:
+	case DISCARD_REQ:
+		break;
+
+	default:
+		if (plen > 32)
+			plen = 32;
+		CpSend(cp->proto, CODE_REJ, ++nextId, p - 4, plen + 4);
+		break;
+	}
+}
+
+static void PapInput(const BYTE* p, int len)
+{
+	if (len < 4 || p[1] != papId)
+		return;
+	if (p[0] == 2)	// Authenticate-Ack
+		NetworkUp();
+	else if (p[0] == 3)
+		PPPClose();
+}
+
+// The packet is rejected with as much of it as an LCP packet can hold
+static void ProtoReject(WORD proto, BYTE* p, int len)
+{
+	BYTE head[6];
+	int max = PPPMtu() - 6;
+
+	if (len > max)
+		len = max;
+	head[0] = PROTO_REJ;
+	head[1] = ++nextId;
+	head[2] = (len + 6) >> 8;
+	head[3] = (len + 6) & 0xFF;
+	head[4] = proto >> 8;
+	head[5] = proto & 0xFF;
+	TxBegin(PROTO_LCP);
+	TxData(head, 6);
+	TxData(p, len);
+	TxEnd();
+}
+
+static void RxFrame(BYTE* p, int len)
+{
+	WORD proto;
+
+	rxTime = PPPPortMillis();
+	echoCount = 0;
+	// Address and control fields may be compressed, and the protocol field too
+	if (len >= 2 && p[0] == 0xFF && p[1] == 0x03) {
+		p += 2;
+		len -= 2;
+	}
+	if (len < 1)
+		return;
+	if (p[0] & 1) {
+		proto = p[0];
+		p++;
+		len--;
+	}
+	else {
+		if (len < 2)
+			return;
+		proto = Get16(p);
+		p += 2;
+		len -= 2;
+	}
+
+	switch (proto) {
+	case PROTO_LCP:
+		CpInput(&lcp, p, len);
+		break;
+	case PROTO_IPCP:
+		if (phase == PPP_NETWORK || phase == PPP_RUNNING)
+			CpInput(&ipcp, p, len);
+		break;
+	case PROTO_PAP:
+		if (phase == PPP_AUTHENTICATE)
+			PapInput(p, len);
+		break;
+	case PROTO_IP:
+		if (phase == PPP_RUNNING)
+			TCPIPInput(p, len);
+		break;
+	default:
+		if (lcp.state == CP_OPENED)
+			ProtoReject(proto, p, len);
+		break;
+	}
+}
+
+static void RxByte(BYTE c)
+{
+	if (c == HDLC_FLAG) {
+		if (!rxDrop && !rxEsc && rxLen >= 4 && rxFcs == HDLC_GOOD_FCS)
+			RxFrame(rxBuf, rxLen - 2);
+		rxLen = 0;
+		rxFcs = 0xFFFF;
+		rxEsc = FALSE;
+		rxDrop = FALSE;
+		return;
+	}
+	if (c == HDLC_ESC) {
+		rxEsc = TRUE;
+		return;
+	}
+	if (rxEsc) {
+		c ^= 0x20;
+		rxEsc = FALSE;
+	}
+	rxFcs = FcsUpdate(rxFcs, c);
+	if (rxLen < sizeof(rxBuf))
+		rxBuf[rxLen++] = c;
+	else
+		rxDrop = TRUE;
+}
+
+static void CpTimer(PPPCp *cp, DWORD now)
+{
+	if (cp->state == CP_CLOSED || cp->state == CP_OPENED)
+		return;
+	if ((DWORD)(now - cp->timer) < PPP_RESTART_MS)
+		return;
+	if (++cp->retries >= ((cp->state == CP_CLOSING) ? PPP_MAX_TERMINATE : PPP_MAX_CONFIGURE)) {
+		if (cp == &ipcp)
+			PPPClose();
+		else
+			LinkDown();
+		return;
+	}
+	if (cp->state == CP_CLOSING)
+		CpSendTerm(cp);
+	else {
+		if (cp->state == CP_ACK_RCVD)
+			cp->state = CP_REQ_SENT;
+		CpSendReq(cp);
+	}
+}
+
+/**
+* Starts the negotiation of the link, once the module is connected (TCPStreamDial).
+* PPPPoll then runs it, PPPPhase is PPP_RUNNING once IP packets go through.
+*/
+void PPPOpen(void)
+{
+	if (phase != PPP_DEAD)
+		return;
+	magic = magic * 69069UL + PPPPortMillis() + 1;
+	mru = PPP_MTU;
+	peerMru = 1500;
+	peerAccm = 0xFFFFFFFFUL;
+	txAccm = 0xFFFFFFFFUL;
+	papNeeded = FALSE;
+	localAddr = 0;
+	peerAddr = 0;
+	dnsAddr[0] = 0;
+	dnsAddr[1] = 0;
+	rxLen = 0;
+	rxFcs = 0xFFFF;
+	rxEsc = FALSE;
+	rxDrop = TRUE;
+	rxTime = PPPPortMillis();
+	ipcp.state = CP_CLOSED;
+	phase = PPP_ESTABLISH;
+	CpOpen(&lcp);
+}
+
+/**
+* Terminates the link: the connections are closed at once, the module hangs up once
+* the peer acknowledged, or after PPP_MAX_TERMINATE requests.
+*/
+void PPPClose(void)
+{
+	if (phase == PPP_DEAD || phase == PPP_TERMINATE)
+		return;
+	if (phase >= PPP_NETWORK)
+		TCPIPLinkDown();
+	phase = PPP_TERMINATE;
+	ipcp.state = CP_CLOSED;
+	lcp.state = CP_CLOSING;
+	lcp.retries = 0;
+	CpSendTerm(&lcp);
+}
+
+/**
+* Drops the link without telling the peer, when the module lost the call.
+*/
+void PPPAbort(void)
+{
+	LinkDown();
+}
+
+/**
+* Handles the frames received and the timers of the link and of TCPIP.h.
+* To be called often, from the task that uses the connections.
+*/
+void PPPPoll(void)
+{
+	BYTE buf[32];
+	DWORD now;
+	int i, n;
+
+	if (phase == PPP_DEAD)
+		return;
+	while (phase != PPP_DEAD && (n = PPPPortRead(buf, sizeof(buf))) > 0) {
+		for (i = 0; i < n; i++)
+			RxByte(buf[i]);
+	}
+
+	now = PPPPortMillis();
+	CpTimer(&lcp, now);
+	CpTimer(&ipcp, now);
+	if (phase == PPP_AUTHENTICATE && (DWORD)(now - papTimer) >= PPP_RESTART_MS) {
+		if (++papRetries >= PPP_MAX_CONFIGURE)
+			PPPClose();
+		else
+			PapSend();
+	}
+#if PPP_ECHO_MS > 0
+	// A link silent for too long is checked, and dropped if it does not answer
+	if (lcp.state == CP_OPENED && (DWORD)(now - rxTime) >= PPP_ECHO_MS && (DWORD)(now - echoTime) >= PPP_RESTART_MS) {
+		BYTE data[4];
+
+		if (echoCount++ >= PPP_MAX_ECHO) {
+			LinkDown();
+			return;
+		}
+		echoTime = now;
+		Put32(data, magic);
+		CpSend(PROTO_LCP, ECHO_REQ, ++nextId, data, 4);
+	}
+#endif
+	if (phase == PPP_RUNNING)
+		TCPIPTimer();
+}
+
+/**
+* Returns the phase of the link, PPP_DEAD to PPP_TERMINATE.
+*/
+int PPPPhase(void)
+{
+	return phase;
+}
+
+/**
+* Returns the IP address given by the network, 0 before IPCP.
+*/
+DWORD PPPLocalAddr(void)
+{
+	return localAddr;
+}
+
+/**
+* Returns the IP address of the peer.
+*/
+DWORD PPPPeerAddr(void)
+{
+	return peerAddr;
+}
+
+/**
+* Returns the address of the primary (n = 0) or secondary (n = 1) DNS server given by the network, 0 if none.
+*/
+DWORD PPPDnsAddr(int n)
+{
+	return (n == 0 || n == 1) ? dnsAddr[n] : 0;
+}
+
+/**
+* Returns the largest IP packet that can be sent.
+*/
+int PPPMtu(void)
+{
+	return (peerMru < PPP_MTU) ? peerMru : PPP_MTU;
+}
+
+/**
+* Sends an IP packet made of head and data, escaped on the fly.
+* Returns false if the link is not running or the packet too large.
+*/
+BOOL PPPSendIP(const BYTE* head, int headLen, const BYTE* data, int dataLen)
+{
+	if (phase != PPP_RUNNING || headLen + dataLen > PPPMtu())
+		return FALSE;
+	TxBegin(PROTO_IP);
+	TxData(head, headLen);
+	TxData(data, dataLen);
+	TxEnd();
+	return TRUE;
+}
@@ -0,0 +1,57 @@
+#ifndef PPP_H
+#define PPP_H
+
+// PPP over the data channel of the module (TCPStreamDial): HDLC-like framing (RFC 1662),
+// LCP with PAP, and IPCP (RFC 1661, 1332, 1877). The IP packets go to the stack of TCPIP.h.
+// The link is driven by PPPPoll, from one task.
+
+#include "GenericTypeDefs.h"
+
+// PPP_MTU : Largest IP packet received, and sent when the peer takes it
+#ifndef PPP_MTU
+#define PPP_MTU 576
+#endif
+
+// PPP_USER, PPP_PASSWORD : PAP credentials, when the network asks for them
+#ifndef PPP_USER
+#define PPP_USER ""
+#endif
+#ifndef PPP_PASSWORD
+#define PPP_PASSWORD ""
+#endif
+
+// PPP_RESTART_MS : Time before an unanswered request is sent again, in milliseconds
+#ifndef PPP_RESTART_MS
+#define PPP_RESTART_MS 3000
+#endif
+
+// PPP_ECHO_MS : Idle time after which the link is checked with an LCP echo, 0 for no checks
+#ifndef PPP_ECHO_MS
+#define PPP_ECHO_MS 30000
+#endif
+
+// Phases of the link
+#define PPP_DEAD			0	// closed or lost
+#define PPP_ESTABLISH		1	// LCP negotiation
+#define PPP_AUTHENTICATE	2	// PAP
+#define PPP_NETWORK			3	// IPCP negotiation
+#define PPP_RUNNING			4	// IP packets go through
+#define PPP_TERMINATE		5	// closing
+
+void  PPPOpen(void);
+void  PPPClose(void);
+void  PPPAbort(void);
+void  PPPPoll(void);
+int   PPPPhase(void);
+DWORD PPPLocalAddr(void);
+DWORD PPPPeerAddr(void);
+DWORD PPPDnsAddr(int n);
+int   PPPMtu(void);
+BOOL  PPPSendIP(const BYTE* head, int headLen, const BYTE* data, int dataLen);
+
+// Port of the link, provided by the application: the data channel and a millisecond clock
+int   PPPPortRead(BYTE* buf, int len);
+void  PPPPortWrite(const BYTE* buf, int len);
+DWORD PPPPortMillis(void);
+
+#endif
@@ -0,0 +1,971 @@
+#include <stddef.h>
+#include <string.h>
+#include "PPP.h"
+#include "TCPIP.h"
+
+#define IP_HLEN			20
+#define TCP_HLEN		20
+#define UDP_HLEN		8
+#define ICMP_HLEN		8
+
+#define IP_ICMP			1
+#define IP_TCP			6
+#define IP_UDP			17
+
+#define TCP_FIN			0x01
+#define TCP_SYN			0x02
+#define TCP_RST			0x04
+#define TCP_PSH			0x08
+#define TCP_ACK			0x10
+
+// Largest segment we take, as told to the server
+#define TCPIP_MSS		(PPP_MTU - IP_HLEN - TCP_HLEN)
+#define TCPIP_RTO_INIT	3000
+#define TCPIP_RTO_MIN	1000
+#define TCPIP_RTO_MAX	60000
+#define TCPIP_TIME_WAIT	2000
+#define TCPIP_FIN_WAIT	60000
+
+// Internal states of a connection (RFC 793), there is no listening
+#define TCP_CLOSED		0
+#define TCP_SYN_SENT	1
+#define TCP_ESTABLISHED	2
+#define TCP_FIN_WAIT_1	3
+#define TCP_FIN_WAIT_2	4
+#define TCP_CLOSE_WAIT	5
+#define TCP_CLOSING		6
+#define TCP_LAST_ACK	7
+#define TCP_TIME_WAIT	8
+
+// Connection flags
+#define F_USED			0x01	// held by the application, until TCPIPClose or TCPIPAbort
+#define F_ACK_NOW		0x02	// an ACK is due, sent by TCPIPTimer unless data carries it first
+#define F_CLOSE			0x04	// FIN to send after the data
+#define F_FIN_SENT		0x08
+#define F_RTT			0x10	// a segment is timed
+#define F_PERSIST		0x20	// data waits for the window of the server
+
+#define DNS_PORT		53
+#define DNS_RETRY_MS	2000
+#define DNS_TRIES		4
+
+typedef struct
+{
+	BYTE state;
+	BYTE flags;
+	BYTE retries;
+	BYTE dupAcks;
+	DWORD raddr;
+	WORD lport;
+	WORD rport;
+	DWORD sndUna;		// oldest sequence not acknowledged, that of tx[0]
+	DWORD sndNxt;		// next sequence to send
+	DWORD sndMax;		// highest sequence sent
+	WORD sndWnd;
+	WORD mss;
+	WORD cwnd;
+	WORD ssthresh;
+	DWORD rcvNxt;
+	DWORD rcvAdv;		// right edge of the window last advertised
+	DWORD timer;		// start of the retransmission, persist or TIME-WAIT timer
+	DWORD rto;
+	WORD srtt;
+	WORD rttvar;
+	DWORD rttSeq;
+	DWORD rttStart;
+	WORD rxLen;
+	WORD txLen;
+	BYTE rx[TCPIP_RX_SIZE];
+	BYTE tx[TCPIP_TX_SIZE];
+} TCPIPConn;
+
+static TCPIPConn conns[TCPIP_SOCKETS];
+static WORD ipId;
+static WORD nextPort;
+static DWORD issCount;
+
+// Resolver: the query is kept to be sent again
+static BYTE dnsQuery[UDP_HLEN + 12 + 64 + 4];
+static int dnsLen;
+static int dnsState;	// 1 resolved, 0 pending, -1 failed
+static BYTE dnsTries;
+static DWORD dnsTimer;
+static DWORD dnsResult;
+
+static WORD Get16(const BYTE* p)
+{
+	return ((WORD)p[0] << 8) | p[1];
+}
+
+static DWORD Get32(const BYTE* p)
+{
+	return ((DWORD)p[0] << 24) | ((DWORD)p[1] << 16) | ((DWORD)p[2] << 8) | p[3];
+}
+
+static void Put16(BYTE* p, WORD v)
+{
+	p[0] = v >> 8;
+	p[1] = v & 0xFF;
+}
+
+static void Put32(BYTE* p, DWORD v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+// Sequence numbers compared modulo 2^32
+#define SEQ_LT(a, b)	((LONG)((a) - (b)) < 0)
+#define SEQ_LE(a, b)	((LONG)((a) - (b)) <= 0)
+
+/*
+* Internet checksum: the 16 bits sum, folded and complemented by SumEnd.
+*/
+static DWORD Sum(DWORD sum, const BYTE* p, int len)
+{
+	while (len > 1) {
+		sum += ((WORD)p[0] << 8) | p[1];
+		p += 2;
+		len -= 2;
+	}
+	if (len > 0)
+		sum += (WORD)p[0] << 8;
+	return sum;
+}
+
+static WORD SumEnd(DWORD sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	return ~sum;
+}
+
+// Sum of the pseudo header of TCP and UDP
+static DWORD SumPseudo(BYTE proto, DWORD src, DWORD dst, int len)
+{
+	return (src >> 16) + (src & 0xFFFF) + (dst >> 16) + (dst & 0xFFFF) + proto + len;
+}
+
+/*
+* Sends an IP packet: hdr has room for the IP header before the transport header (of even length hlen),
+* the payload follows in data. The transport checksum is filled in at offset sumPos of the transport header.
+*/
+static void IpSend(BYTE* hdr, int hlen, BYTE proto, DWORD dst, const BYTE* data, int len, int sumPos)
+{
+	DWORD src = PPPLocalAddr();
+	DWORD sum;
+	BYTE* t = hdr + IP_HLEN;
+
+	t[sumPos] = 0;
+	t[sumPos + 1] = 0;
+	sum = (proto == IP_ICMP) ? 0 : SumPseudo(proto, src, dst, hlen + len);
+	sum = Sum(Sum(sum, t, hlen), data, len);
+	Put16(t + sumPos, SumEnd(sum));
+
+	hdr[0] = 0x45;
+	hdr[1] = 0;
+	Put16(hdr + 2, IP_HLEN + hlen + len);
+	Put16(hdr + 4, ipId++);
+	Put16(hdr + 6, 0x4000);		// don't fragment
+	hdr[8] = 64;
+	hdr[9] = proto;
+	hdr[10] = 0;
+	hdr[11] = 0;
+	Put32(hdr + 12, src);
+	Put32(hdr + 16, dst);
+	Put16(hdr + 10, SumEnd(Sum(0, hdr, IP_HLEN)));
+	PPPSendIP(hdr, IP_HLEN + hlen, data, len);
+}
+
+static void TcpRaw(DWORD raddr, WORD lport, WORD rport, DWORD seq, DWORD ack, BYTE flags, WORD wnd, const BYTE* data, int len)
+{
+	BYTE hdr[IP_HLEN + TCP_HLEN + 4];
+	BYTE* t = hdr + IP_HLEN;
+	int hlen = TCP_HLEN;
+
+	if (flags & TCP_SYN) {
+		t[20] = 2;		// MSS option
+		t[21] = 4;
+		Put16(t + 22, TCPIP_MSS);
+		hlen += 4;
+	}
+	Put16(t, lport);
+	Put16(t + 2, rport);
+	Put32(t + 4, seq);
+	Put32(t + 8, ack);
+	t[12] = (hlen / 4) << 4;
+	t[13] = flags;
+	Put16(t + 14, wnd);
+	Put16(t + 18, 0);
+	IpSend(hdr, hlen, IP_TCP, raddr, data, len, 16);
+}
+
+static WORD RxSpace(TCPIPConn* c)
+{
+	return TCPIP_RX_SIZE - c->rxLen;
+}
+
+static void TcpSegment(TCPIPConn* c, DWORD seq, BYTE flags, const BYTE* data, int len)
+{
+	WORD wnd = RxSpace(c);
+
+	if (c->state != TCP_SYN_SENT) {
+		flags |= TCP_ACK;
+		c->flags &= ~F_ACK_NOW;
+		c->rcvAdv = c->rcvNxt + wnd;
+	}
+	TcpRaw(c->raddr, c->lport, c->rport, seq, (flags & TCP_ACK) ? c->rcvNxt : 0, flags, wnd, data, len);
+}
+
+static void TcpDrop(TCPIPConn* c)
+{
+	c->state = TCP_CLOSED;
+	c->rxLen = (c->flags & F_USED) ? c->rxLen : 0;
+	c->txLen = 0;
+	c->flags &= F_USED;
+}
+
+/*
+* Sends the data the windows allow, and the FIN once all of it is sent.
+* Pure ACKs are left to TCPIPTimer, so that the segments of one poll get a single one.
+*/
+static void TcpOutput(TCPIPConn* c)
+{
+	DWORD flight, off, win;
+	int n;
+	BYTE fin;
+
+	if (c->state != TCP_ESTABLISHED && c->state != TCP_CLOSE_WAIT && c->state != TCP_FIN_WAIT_1
+			&& c->state != TCP_CLOSING && c->state != TCP_LAST_ACK)
+		return;
+
+	while (!(c->flags & F_FIN_SENT)) {
+		flight = c->sndNxt - c->sndUna;
+		off = flight;
+		n = c->txLen - off;
+		win = (c->sndWnd < c->cwnd) ? c->sndWnd : c->cwnd;
+		if (flight >= win)
+			n = (n > 0 && flight == 0) ? -1 : 0;
+		else if ((DWORD)n > win - flight)
+			n = win - flight;
+		if (n < 0) {
+			// Zero window: probed from TCPIPTimer
+			if (!(c->flags & F_PERSIST)) {
+				c->flags |= F_PERSIST;
+				c->timer = PPPPortMillis();
+			}
+			break;
+		}
+		if (n > c->mss)
+			n = c->mss;
+		fin = ((c->flags & F_CLOSE) && off + n == c->txLen) ? TCP_FIN : 0;
+		if (n == 0 && !fin)
+			break;
+
+		if (flight == 0)
+			c->timer = PPPPortMillis();
+		if (!(c->flags & F_RTT) && c->sndNxt == c->sndMax) {
+			c->flags |= F_RTT;
+			c->rttSeq = c->sndNxt + n;
+			c->rttStart = PPPPortMillis();
+		}
+		c->flags &= ~F_PERSIST;
+		TcpSegment(c, c->sndNxt, (n > 0 ? TCP_PSH : 0) | fin, c->tx + off, n);
+		c->sndNxt += n;
+		if (fin) {
+			c->sndNxt++;
+			c->flags |= F_FIN_SENT;
+			if (c->state == TCP_ESTABLISHED)
+				c->state = TCP_FIN_WAIT_1;
+			else if (c->state == TCP_CLOSE_WAIT)
+				c->state = TCP_LAST_ACK;
+		}
+		if (SEQ_LT(c->sndMax, c->sndNxt))
+			c->sndMax = c->sndNxt;
+	}
+}
+
+static void TcpRtt(TCPIPConn* c, DWORD r)
+{
+	DWORD delta, rto;
+
+	if (r > 0xFFFF)
+		r = 0xFFFF;
+	if (c->srtt == 0) {
+		c->srtt = r ? r : 1;
+		c->rttvar = r / 2;
+	}
+	else {
+		delta = (c->srtt > r) ? c->srtt - r : r - c->srtt;
+		c->rttvar = (3 * (DWORD)c->rttvar + delta) / 4;
+		c->srtt = (7 * (DWORD)c->srtt + r) / 8;
+	}
+	rto = c->srtt + 4 * (DWORD)c->rttvar;
+	if (rto < TCPIP_RTO_MIN)
+		rto = TCPIP_RTO_MIN;
+	if (rto > TCPIP_RTO_MAX)
+		rto = TCPIP_RTO_MAX;
+	c->rto = rto;
+}
+
+/*
+* Acknowledgement of our data: frees it from tx, opens the congestion window, and times the round trip.
+*/
+static void TcpAcked(TCPIPConn* c, DWORD ack)
+{
+	DWORD n = ack - c->sndUna;
+	BOOL finAcked = (c->flags & F_CLOSE) && ack == c->sndUna + c->txLen + 1;
+
+	if (finAcked)
+		n--;
+	if (n > c->txLen)
+		n = c->txLen;
+	c->txLen -= n;
+	memmove(c->tx, c->tx + n, c->txLen);
+	c->sndUna = ack;
+	if (SEQ_LT(c->sndNxt, ack))
+		c->sndNxt = ack;
+	if (finAcked)
+		c->flags |= F_FIN_SENT;
+
+	if ((c->flags & F_RTT) && SEQ_LE(c->rttSeq, ack)) {
+		c->flags &= ~F_RTT;
+		TcpRtt(c, PPPPortMillis() - c->rttStart);
+	}
+	if (c->cwnd < c->ssthresh)
+		n = c->mss;
+	else
+		n = (DWORD)c->mss * c->mss / c->cwnd + 1;
+	if (c->cwnd + n < TCPIP_TX_SIZE + c->mss)
+		c->cwnd += n;
+	c->retries = 0;
+	c->dupAcks = 0;
+	c->timer = PPPPortMillis();
+
+	if (finAcked) {
+		if (c->state == TCP_FIN_WAIT_1)
+			c->state = TCP_FIN_WAIT_2;
+		else if (c->state == TCP_CLOSING)
+			c->state = TCP_TIME_WAIT;
+		else if (c->state == TCP_LAST_ACK)
+			TcpDrop(c);
+	}
+}
+
+static void TcpInput(DWORD src, BYTE* seg, int len)
+{
+	TCPIPConn* c;
+	WORD sport, dport, wnd;
+	DWORD seq, ack, flight, diff;
+	BYTE flags;
+	int hlen, i, n;
+	BOOL fin;
+	BYTE* data;
+
+	if (len < TCP_HLEN || SumEnd(Sum(SumPseudo(IP_TCP, src, PPPLocalAddr(), len), seg, len)) != 0)
+		return;
+	sport = Get16(seg);
+	dport = Get16(seg + 2);
+	seq = Get32(seg + 4);
+	ack = Get32(seg + 8);
+	hlen = (seg[12] >> 4) * 4;
+	flags = seg[13];
+	wnd = Get16(seg + 14);
+	if (hlen < TCP_HLEN || hlen > len)
+		return;
+	data = seg + hlen;
+	len -= hlen;
+	fin = (flags & TCP_FIN) != 0;
+
+	for (i = 0, c = conns; i < TCPIP_SOCKETS; i++, c++) {
+		if (c->state != TCP_CLOSED && c->lport == dport && c->rport == sport && c->raddr == src)
+			break;
+	}
+	if (i == TCPIP_SOCKETS) {
+		if (flags & TCP_RST)
+			return;
+		if (flags & TCP_ACK)
+			TcpRaw(src, dport, sport, ack, 0, TCP_RST, 0, NULL, 0);
+		else
+			TcpRaw(src, dport, sport, 0, seq + len + ((flags & TCP_SYN) ? 1 : 0) + fin, TCP_RST | TCP_ACK, 0, NULL, 0);
+		return;
+	}
+
+	if (c->state == TCP_SYN_SENT) {
+		if ((flags & TCP_ACK) && ack != c->sndNxt) {
+			if (!(flags & TCP_RST))
+				TcpRaw(src, dport, sport, ack, 0, TCP_RST, 0, NULL, 0);
+			return;
+		}
+		if (flags & TCP_RST) {
+			if (flags & TCP_ACK)
+				TcpDrop(c);
+			return;
+		}
+		if ((flags & (TCP_SYN | TCP_ACK)) != (TCP_SYN | TCP_ACK))
+			return;
+		// The MSS of the server, or the default one
+		c->mss = 536;
+		for (i = TCP_HLEN; i + 1 < hlen && seg[i] != 0; i += (seg[i] == 1) ? 1 : seg[i + 1]) {
+			if (seg[i] != 1 && seg[i + 1] < 2)
+				break;
+			if (seg[i] == 2 && seg[i + 1] == 4 && i + 4 <= hlen)
+				c->mss = Get16(seg + i + 2);
+		}
+		n = PPPMtu() - IP_HLEN - TCP_HLEN;
+		if (c->mss > n)
+			c->mss = n;
+		c->cwnd = 2 * c->mss;
+		c->rcvNxt = seq + 1;
+		c->sndUna = ack;
+		c->sndMax = ack;
+		c->sndWnd = wnd;
+		c->state = TCP_ESTABLISHED;
+		if (c->retries == 0)
+			TcpRtt(c, PPPPortMillis() - c->rttStart);
+		c->retries = 0;
+		c->flags = (c->flags & (F_USED | F_CLOSE)) | F_ACK_NOW;
+		TcpOutput(c);
+		return;
+	}
+
+	// Segments out of the window are only acknowledged
+	if (flags & TCP_RST) {
+		if ((LONG)(seq - c->rcvNxt) >= 0 && (LONG)(seq - c->rcvNxt) <= TCPIP_RX_SIZE)
+			TcpDrop(c);
+		return;
+	}
+	if (flags & TCP_SYN) {
+		// SYN-ACK sent again, our ACK was lost
+		c->flags |= F_ACK_NOW;
+		return;
+	}
+	if (!(flags & TCP_ACK))
+		return;
+
+	// Acknowledgement
+	flight = c->sndNxt - c->sndUna;
+	if (SEQ_LT(c->sndUna, ack) && SEQ_LE(ack, c->sndMax)) {
+		TcpAcked(c, ack);
+		if (c->state == TCP_CLOSED)
+			return;
+	}
+	else if (ack == c->sndUna && len == 0 && !fin && flight > 0 && wnd == c->sndWnd) {
+		// Fast retransmit on the third duplicate
+		if (++c->dupAcks == 3) {
+			c->ssthresh = (flight / 2 > 2 * c->mss) ? flight / 2 : 2 * c->mss;
+			c->cwnd = c->ssthresh;
+			c->sndNxt = c->sndUna;
+			c->flags &= ~(F_FIN_SENT | F_RTT);
+		}
+	}
+	if (wnd > c->sndWnd)
+		c->flags &= ~F_PERSIST;
+	c->sndWnd = wnd;
+
+	// Data, in order only: what comes ahead is dropped and sent again by the server
+	if (len > 0 || fin) {
+		c->flags |= F_ACK_NOW;
+		diff = c->rcvNxt - seq;
+		if ((LONG)diff < 0) {
+			len = 0;
+			fin = FALSE;
+		}
+		else if (diff > 0) {
+			if (diff > (DWORD)len)
+				fin = FALSE;
+			n = (diff < (DWORD)len) ? diff : len;
+			data += n;
+			len -= n;
+		}
+		if (c->state != TCP_ESTABLISHED && c->state != TCP_FIN_WAIT_1 && c->state != TCP_FIN_WAIT_2) {
+			len = 0;
+			fin = FALSE;
+		}
+		n = len;
+		if (n > RxSpace(c)) {
+			n = RxSpace(c);
+			fin = FALSE;
+		}
+		// Once the application closed, the data is only acknowledged
+		if (c->flags & F_USED) {
+			memcpy(c->rx + c->rxLen, data, n);
+			c->rxLen += n;
+		}
+		c->rcvNxt += n;
+		if (fin) {
+			c->rcvNxt++;
+			if (c->state == TCP_ESTABLISHED)
+				c->state = TCP_CLOSE_WAIT;
+			else if (c->state == TCP_FIN_WAIT_1)
+				c->state = TCP_CLOSING;
+			else {
+				c->state = TCP_TIME_WAIT;
+				c->timer = PPPPortMillis();
+			}
+		}
+	}
+	if (c->state == TCP_TIME_WAIT && (flags & TCP_FIN))
+		c->timer = PPPPortMillis();
+	TcpOutput(c);
+}
+
+static void IcmpInput(DWORD src, BYTE* msg, int len)
+{
+	BYTE hdr[IP_HLEN + ICMP_HLEN];
+
+	if (len < ICMP_HLEN || msg[0] != 8 || SumEnd(Sum(0, msg, len)) != 0)
+		return;
+	// Echo reply
+	memcpy(hdr + IP_HLEN, msg, ICMP_HLEN);
+	hdr[IP_HLEN] = 0;
+	IpSend(hdr, ICMP_HLEN, IP_ICMP, src, msg + ICMP_HLEN, len - ICMP_HLEN, 2);
+}
+
+static void DnsSend(void)
+{
+	BYTE hdr[IP_HLEN + UDP_HLEN];
+	DWORD server = PPPDnsAddr(dnsTries & 1);
+
+	// Both servers in turn, when there are two
+	if (server == 0)
+		server = PPPDnsAddr(0);
+	dnsTimer = PPPPortMillis();
+	memcpy(hdr + IP_HLEN, dnsQuery, UDP_HLEN);
+	IpSend(hdr, UDP_HLEN, IP_UDP, server, dnsQuery + UDP_HLEN, dnsLen - UDP_HLEN, 6);
+}
+
+// Skips a name of a DNS message, returns the position after it or -1
+static int DnsSkipName(const BYTE* msg, int pos, int len)
+{
+	while (pos < len) {
+		if (msg[pos] == 0)
+			return pos + 1;
+		if ((msg[pos] & 0xC0) == 0xC0)
+			return pos + 2;
+		pos += msg[pos] + 1;
+	}
+	return -1;
+}
+
+static void UdpInput(DWORD src, BYTE* dgram, int len)
+{
+	BYTE* msg = dgram + UDP_HLEN;
+	int pos, count;
+
+	if (len < UDP_HLEN || Get16(dgram + 4) > len)
+		return;
+	len = Get16(dgram + 4);
+	if (Get16(dgram + 6) != 0 && SumEnd(Sum(SumPseudo(IP_UDP, src, PPPLocalAddr(), len), dgram, len)) != 0)
+		return;
+	if (dnsState != 0 || Get16(dgram) != DNS_PORT || Get16(dgram + 2) != Get16(dnsQuery))
+		return;
+	len -= UDP_HLEN;
+	if (len < 12 || Get16(msg) != Get16(dnsQuery + UDP_HLEN) || !(msg[2] & 0x80))
+		return;
+
+	// Any answer but the first A record is a failure
+	dnsState = -1;
+	if ((msg[3] & 0x0F) != 0)
+		return;
+	pos = 12;
+	for (count = Get16(msg + 4); count > 0 && pos >= 0; count--) {
+		pos = DnsSkipName(msg, pos, len);
+		if (pos >= 0)
+			pos += 4;
+	}
+	for (count = Get16(msg + 6); count > 0 && pos >= 0; count--) {
+		pos = DnsSkipName(msg, pos, len);
+		if (pos < 0 || pos + 10 > len)
+			return;
+		if (Get16(msg + pos) == 1 && Get16(msg + pos + 2) == 1 && Get16(msg + pos + 8) == 4 && pos + 14 <= len) {
+			dnsResult = Get32(msg + pos + 10);
+			dnsState = 1;
+			return;
+		}
+		pos += 10 + Get16(msg + pos + 8);
+	}
+}
+
+/**
+* Handles an IP packet received by PPP.c.
+*/
+void TCPIPInput(BYTE* pkt, int len)
+{
+	int hlen, total;
+	DWORD src;
+
+	if (len < IP_HLEN || (pkt[0] >> 4) != 4)
+		return;
+	hlen = (pkt[0] & 0x0F) * 4;
+	total = Get16(pkt + 2);
+	if (hlen < IP_HLEN || total < hlen || total > len || SumEnd(Sum(0, pkt, hlen)) != 0)
+		return;
+	// Fragments are not reassembled, the servers see our MSS
+	if ((Get16(pkt + 6) & 0x3FFF) != 0)
+		return;
+	if (Get32(pkt + 16) != PPPLocalAddr())
+		return;
+	src = Get32(pkt + 12);
+
+	switch (pkt[9]) {
+	case IP_TCP:
+		TcpInput(src, pkt + hlen, total - hlen);
+		break;
+	case IP_UDP:
+		UdpInput(src, pkt + hlen, total - hlen);
+		break;
+	case IP_ICMP:
+		IcmpInput(src, pkt + hlen, total - hlen);
+		break;
+	}
+}
+
+/**
+* Runs the timers of the connections, and sends the ACKs due. Called by PPPPoll.
+*/
+void TCPIPTimer(void)
+{
+	TCPIPConn* c;
+	DWORD now = PPPPortMillis();
+	DWORD flight;
+	int i;
+
+	for (i = 0, c = conns; i < TCPIP_SOCKETS; i++, c++) {
+		if (c->state == TCP_CLOSED)
+			continue;
+		if (c->state == TCP_TIME_WAIT) {
+			if ((DWORD)(now - c->timer) >= TCPIP_TIME_WAIT)
+				TcpDrop(c);
+			else if (c->flags & F_ACK_NOW)
+				TcpSegment(c, c->sndNxt, 0, NULL, 0);
+			continue;
+		}
+		// Closed by the application, and the server does not close its side
+		if (c->state == TCP_FIN_WAIT_2 && !(c->flags & F_USED) && (DWORD)(now - c->timer) >= TCPIP_FIN_WAIT) {
+			TcpRaw(c->raddr, c->lport, c->rport, c->sndNxt, 0, TCP_RST, 0, NULL, 0);
+			TcpDrop(c);
+			continue;
+		}
+
+		flight = c->sndNxt - c->sndUna;
+		if (flight > 0 && (DWORD)(now - c->timer) >= c->rto) {
+			// Retransmission, from the oldest segment with a window of one segment
+			if (++c->retries > TCPIP_MAX_RETRIES) {
+				if (c->state != TCP_SYN_SENT)
+					TcpRaw(c->raddr, c->lport, c->rport, c->sndNxt, 0, TCP_RST, 0, NULL, 0);
+				TcpDrop(c);
+				continue;
+			}
+			c->rto = (2 * c->rto < TCPIP_RTO_MAX) ? 2 * c->rto : TCPIP_RTO_MAX;
+			c->timer = now;
+			c->flags &= ~F_RTT;		// Karn: no sample from retransmitted segments
+			if (c->state == TCP_SYN_SENT) {
+				TcpSegment(c, c->sndUna, TCP_SYN, NULL, 0);
+				continue;
+			}
+			c->ssthresh = (flight / 2 > 2 * c->mss) ? flight / 2 : 2 * c->mss;
+			c->cwnd = c->mss;
+			c->sndNxt = c->sndUna;
+			c->flags &= ~F_FIN_SENT;
+			TcpOutput(c);
+		}
+		else if (flight == 0 && (c->flags & F_PERSIST) && (DWORD)(now - c->timer) >= c->rto) {
+			// Zero window probe: one byte beyond the window, then retransmitted as any other
+			c->flags &= ~F_PERSIST;
+			c->timer = now;
+			TcpSegment(c, c->sndNxt, 0, c->tx, 1);
+			c->sndNxt++;
+			if (SEQ_LT(c->sndMax, c->sndNxt))
+				c->sndMax = c->sndNxt;
+		}
+		if (c->flags & F_ACK_NOW)
+			TcpSegment(c, c->sndNxt, 0, NULL, 0);
+	}
+
+	if (dnsState == 0 && (DWORD)(now - dnsTimer) >= DNS_RETRY_MS) {
+		if (++dnsTries >= DNS_TRIES)
+			dnsState = -1;
+		else
+			DnsSend();
+	}
+}
+
+/**
+* Drops the connections and the pending DNS query, the link is down.
+*/
+void TCPIPLinkDown(void)
+{
+	int i;
+
+	for (i = 0; i < TCPIP_SOCKETS; i++) {
+		if (conns[i].state != TCP_CLOSED)
+			TcpDrop(&conns[i]);
+	}
+	if (dnsState == 0)
+		dnsState = -1;
+}
+
+static TCPIPConn* TCPIPConnOf(int s)
+{
+	if (s < 0 || s >= TCPIP_SOCKETS || !(conns[s].flags & F_USED))
+		return NULL;
+	return &conns[s];
+}
+
+/**
+* Starts connecting to addr:port, without waiting: TCPIPState is TCPIP_CONNECTING until the server answered.
+* Returns the connection, -1 if the link is down or all connections are in use.
+*/
+int TCPIPConnect(DWORD addr, WORD port)
+{
+	TCPIPConn* c;
+	DWORD now = PPPPortMillis();
+	int s;
+
+	if (PPPPhase() != PPP_RUNNING)
+		return -1;
+	for (s = 0; s < TCPIP_SOCKETS; s++) {
+		if (conns[s].state == TCP_CLOSED && !(conns[s].flags & F_USED))
+			break;
+	}
+	if (s == TCPIP_SOCKETS)
+		return -1;
+
+	if (nextPort < 49152)
+		nextPort = 49152 + (now & 0x3FFF);
+	c = &conns[s];
+	memset(c, 0, offsetof(TCPIPConn, rx));
+	c->flags = F_USED;
+	c->raddr = addr;
+	c->rport = port;
+	c->lport = nextPort++;
+	c->sndUna = now * 250 + (issCount += 64000);
+	c->sndNxt = c->sndUna + 1;
+	c->sndMax = c->sndNxt;
+	c->mss = 536;
+	c->ssthresh = 0xFFFF;
+	c->rto = TCPIP_RTO_INIT;
+	c->timer = now;
+	c->rttStart = now;
+	c->state = TCP_SYN_SENT;
+	TcpSegment(c, c->sndUna, TCP_SYN, NULL, 0);
+	return s;
+}
+
+/**
+* Returns the state of connection s, TCPIP_CLOSED to TCPIP_CLOSING.
+*/
+int TCPIPState(int s)
+{
+	TCPIPConn* c = TCPIPConnOf(s);
+
+	if (c == NULL)
+		return TCPIP_CLOSED;
+	switch (c->state) {
+	case TCP_SYN_SENT:
+		return TCPIP_CONNECTING;
+	case TCP_ESTABLISHED:
+		return (c->flags & F_CLOSE) ? TCPIP_CLOSING : TCPIP_CONNECTED;
+	case TCP_CLOSE_WAIT:
+		return TCPIP_PEER_CLOSED;
+	case TCP_CLOSED:
+		return TCPIP_CLOSED;
+	}
+	return TCPIP_CLOSING;
+}
+
+/**
+* Returns the number of bytes received on connection s and not read yet.
+*/
+int TCPIPRecvSize(int s)
+{
+	TCPIPConn* c = TCPIPConnOf(s);
+
+	return (c == NULL) ? 0 : c->rxLen;
+}
+
+/**
+* Reads up to len bytes received on connection s, or discards them if buf is NULL.
+* The window is reopened to the server once the space freed is worth it.
+* Returns the number of bytes read.
+*/
+int TCPIPRecv(int s, BYTE* buf, int len)
+{
+	TCPIPConn* c = TCPIPConnOf(s);
+	int threshold = (TCPIP_RX_SIZE / 2 < 2 * TCPIP_MSS) ? TCPIP_RX_SIZE / 2 : 2 * TCPIP_MSS;
+
+	if (c == NULL || len <= 0)
+		return 0;
+	if (len > c->rxLen)
+		len = c->rxLen;
+	if (buf != NULL)
+		memcpy(buf, c->rx, len);
+	c->rxLen -= len;
+	memmove(c->rx, c->rx + len, c->rxLen);
+
+	if (len > 0 && (c->state == TCP_ESTABLISHED || c->state == TCP_FIN_WAIT_1 || c->state == TCP_FIN_WAIT_2)
+			&& (LONG)(c->rcvNxt + RxSpace(c) - c->rcvAdv) >= threshold)
+		TcpSegment(c, c->sndNxt, 0, NULL, 0);
+	return len;
+}
+
+/**
+* Returns the room left in the send buffer of connection s.
+*/
+int TCPIPSendSpace(int s)
+{
+	TCPIPConn* c = TCPIPConnOf(s);
+
+	if (c == NULL || (c->flags & F_CLOSE) || (c->state != TCP_ESTABLISHED && c->state != TCP_CLOSE_WAIT))
+		return 0;
+	return TCPIP_TX_SIZE - c->txLen;
+}
+
+/**
+* Queues up to len bytes on connection s, sent by TCPIPFlush or as the server acknowledges the previous ones.
+* Returns the number of bytes queued, 0 when the send buffer is full or the connection is not open.
+*/
+int TCPIPSend(int s, const BYTE* data, int len)
+{
+	TCPIPConn* c = TCPIPConnOf(s);
+	int room = TCPIPSendSpace(s);
+
+	if (len > room)
+		len = room;
+	if (len <= 0)
+		return 0;
+	memcpy(c->tx + c->txLen, data, len);
+	c->txLen += len;
+	return len;
+}
+
+/**
+* Sends the queued data of connection s that the windows allow, at once.
+*/
+void TCPIPFlush(int s)
+{
+	TCPIPConn* c = TCPIPConnOf(s);
+
+	if (c != NULL)
+		TcpOutput(c);
+}
+
+/**
+* Closes connection s: the queued data is sent, then the FIN. The handle is no longer valid,
+* the connection finishes in the background while PPPPoll runs.
+*/
+void TCPIPClose(int s)
+{
+	TCPIPConn* c = TCPIPConnOf(s);
+
+	if (c == NULL)
+		return;
+	c->flags &= ~F_USED;
+	c->rxLen = 0;
+	if (c->state == TCP_ESTABLISHED || c->state == TCP_CLOSE_WAIT) {
+		c->flags |= F_CLOSE;
+		TcpOutput(c);
+	}
+	else if (c->state == TCP_SYN_SENT)
+		TcpDrop(c);
+}
+
+/**
+* Resets connection s, the data not sent yet is lost.
+*/
+void TCPIPAbort(int s)
+{
+	TCPIPConn* c = TCPIPConnOf(s);
+
+	if (c == NULL)
+		return;
+	if (c->state != TCP_CLOSED && c->state != TCP_SYN_SENT)
+		TcpRaw(c->raddr, c->lport, c->rport, c->sndNxt, 0, TCP_RST, 0, NULL, 0);
+	c->flags = 0;
+	TcpDrop(c);
+}
+
+/**
+* Starts resolving a host name with the DNS servers given by IPCP, or takes a dotted address as is.
+* TCPIPResolved then tells the result. Returns false if the query cannot be sent.
+*/
+BOOL TCPIPResolve(const char* name)
+{
+	BYTE* q;
+	const char* dot;
+	DWORD addr = 0;
+	int i, n, part;
+
+	// Dotted address
+	for (i = 0, part = 0, n = -1; ; i++) {
+		if (name[i] >= '0' && name[i] <= '9') {
+			n = ((n < 0) ? 0 : n * 10) + name[i] - '0';
+			if (n > 255)
+				break;
+		}
+		else if ((name[i] == '.' || name[i] == '\0') && n >= 0) {
+			addr = (addr << 8) | n;
+			n = -1;
+			if (++part == 4 || name[i] == '\0')
+				break;
+		}
+		else
+			break;
+	}
+	if (part == 4 && name[i] == '\0') {
+		dnsResult = addr;
+		dnsState = 1;
+		return TRUE;
+	}
+
+	if (PPPPhase() != PPP_RUNNING || PPPDnsAddr(0) == 0 || strlen(name) > sizeof(dnsQuery) - UDP_HLEN - 18)
+		return FALSE;
+	// UDP header, then the query: id, recursion desired, one question
+	q = dnsQuery;
+	Put16(q, 49152 + (PPPPortMillis() & 0x3FFF));
+	Put16(q + 2, DNS_PORT);
+	memset(q + 4, 0, 4);
+	q += UDP_HLEN;
+	Put16(q, PPPPortMillis() * 13 + issCount);
+	Put16(q + 2, 0x0100);
+	Put16(q + 4, 1);
+	memset(q + 6, 0, 6);
+	q += 12;
+	// Labels
+	while (*name) {
+		dot = strchr(name, '.');
+		n = (dot != NULL) ? dot - name : strlen(name);
+		if (n == 0 || n > 63)
+			return FALSE;
+		*q++ = n;
+		memcpy(q, name, n);
+		q += n;
+		name += n;
+		if (*name == '.')
+			name++;
+	}
+	*q++ = 0;
+	Put16(q, 1);		// A
+	Put16(q + 2, 1);	// IN
+	q += 4;
+	dnsLen = q - dnsQuery;
+	Put16(dnsQuery + 4, dnsLen);
+	dnsTries = 0;
+	dnsState = 0;
+	DnsSend();
+	return TRUE;
+}
+
+/**
+* Returns 1 once the name of TCPIPResolve is resolved, with its address in addr,
+* 0 while waiting, -1 if it was not found.
+*/
+int TCPIPResolved(DWORD* addr)
+{
+	if (dnsState == 1)
+		*addr = dnsResult;
+	return dnsState;
+}
@@ -0,0 +1,54 @@
+#ifndef TCPIP_H
+#define TCPIP_H
+
+// IPv4 stack on the PPP link of PPP.h: TCP client connections, DNS over UDP, ICMP echo.
+// Addresses are in host order. Like PPP.h, it runs in the task that calls PPPPoll.
+
+#include "GenericTypeDefs.h"
+
+// TCPIP_SOCKETS : Number of TCP connections
+#ifndef TCPIP_SOCKETS
+#define TCPIP_SOCKETS 2
+#endif
+
+// TCPIP_RX_SIZE : Receive buffer of a connection, that is the most the server can send ahead (window)
+#ifndef TCPIP_RX_SIZE
+#define TCPIP_RX_SIZE 1024
+#endif
+
+// TCPIP_TX_SIZE : Send buffer of a connection, that holds the data until the server acknowledged it
+#ifndef TCPIP_TX_SIZE
+#define TCPIP_TX_SIZE 1024
+#endif
+
+// TCPIP_MAX_RETRIES : Retransmissions of a segment before the connection is dropped
+#ifndef TCPIP_MAX_RETRIES
+#define TCPIP_MAX_RETRIES 8
+#endif
+
+// States of a connection, as seen by the application
+#define TCPIP_CLOSED		0	// free, refused, reset or timed out
+#define TCPIP_CONNECTING	1
+#define TCPIP_CONNECTED		2
+#define TCPIP_PEER_CLOSED	3	// the server closed, the data received can still be read
+#define TCPIP_CLOSING		4	// closed by TCPIPClose, finishing in the background
+
+int   TCPIPConnect(DWORD addr, WORD port);
+int   TCPIPState(int s);
+int   TCPIPRecvSize(int s);
+int   TCPIPRecv(int s, BYTE* buf, int len);
+int   TCPIPSendSpace(int s);
+int   TCPIPSend(int s, const BYTE* data, int len);
+void  TCPIPFlush(int s);
+void  TCPIPClose(int s);
+void  TCPIPAbort(int s);
+
+BOOL  TCPIPResolve(const char* name);
+int   TCPIPResolved(DWORD* addr);
+
+// Called by PPP.c
+void  TCPIPInput(BYTE* pkt, int len);
+void  TCPIPTimer(void);
+void  TCPIPLinkDown(void);
+
+#endif
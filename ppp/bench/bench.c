@@ -0,0 +1,424 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "PPP.h"
+#include "TCPIP.h"
+#include "peer.h"
+#include "server.h"
+
+// Host benchmark of the PPP data path: link setup, DNS, connect, echo round trips and bulk
+// throughput of ../PPP.c and ../TCPIP.c over a pty pair. The other end of the pty is pppd,
+// or with -T the built-in peer of peer.c, forwarding to a TUN device. Both need root.
+
+#define BENCH_LOCAL		0x0a400001	// 10.64.0.1, host side of the link
+#define BENCH_REMOTE	0x0a400002	// 10.64.0.2, the Flyport
+#define BENCH_PORT		7007
+#define BENCH_HOST		"echo.bench"
+
+static int ptyFd = -1;
+static double byteTime;
+static double txClock;
+static unsigned long txBytes, rxBytes;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Port of PPP.c: the master side of the pty is the data channel of the module
+
+int PPPPortRead(BYTE *buf, int len)
+{
+	int n = read(ptyFd, buf, len);
+
+	if (n <= 0)
+		return 0;
+	rxBytes += n;
+	return n;
+}
+
+// Waits like the Tx FIFO of a UART at the baud rate of -r
+void PPPPortWrite(const BYTE *buf, int len)
+{
+	struct timespec ts;
+	double t, wait;
+	int n;
+
+	if (byteTime > 0) {
+		t = now_ms() / 1000.0;
+		if (txClock < t)
+			txClock = t;
+		wait = txClock - t;
+		if (wait > 0) {
+			ts.tv_sec = (time_t)wait;
+			ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+			nanosleep(&ts, NULL);
+		}
+		txClock += len * byteTime;
+	}
+	txBytes += len;
+	while (len > 0) {
+		n = write(ptyFd, buf, len);
+		if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+			if (errno == EAGAIN)
+				usleep(100);
+			continue;
+		}
+		if (n <= 0)
+			return;
+		buf += n;
+		len -= n;
+	}
+}
+
+DWORD PPPPortMillis(void)
+{
+	return (DWORD)now_ms();
+}
+
+// One pass of the task loop: the link is polled, then the task sleeps until chars come, 1 ms at most
+static void run_loop(void)
+{
+	struct pollfd pfd = { ptyFd, POLLIN, 0 };
+
+	PPPPoll();
+	poll(&pfd, 1, 1);
+}
+
+// Runs the loop until done() or ms passed. Returns false on timeout.
+static int run_until(int (*done)(void *), void *arg, double ms)
+{
+	double end = now_ms() + ms;
+
+	while (!done(arg)) {
+		if (now_ms() > end)
+			return 0;
+		run_loop();
+	}
+	return 1;
+}
+
+static int link_running(void *arg)
+{
+	(void)arg;
+	return PPPPhase() == PPP_RUNNING;
+}
+
+static int link_dead(void *arg)
+{
+	(void)arg;
+	return PPPPhase() == PPP_DEAD;
+}
+
+static int resolved(void *arg)
+{
+	return TCPIPResolved(arg) != 0;
+}
+
+static int connected(void *arg)
+{
+	return TCPIPState(*(int *)arg) != TCPIP_CONNECTING;
+}
+
+static void usage(char *prog)
+{
+	printf("usage: %s [options]\n"
+		"  -T          built-in peer on a TUN device, instead of pppd\n"
+		"  -P path     pppd to run (pppd)\n"
+		"  -n count    echo round trips (50)\n"
+		"  -s size     echo size (64)\n"
+		"  -b bytes    bulk echo bytes (65536)\n"
+		"  -c conns    bulk echo connections, up to %d (%d)\n"
+		"  -r baud     UART rate, 0 for none (115200)\n"
+		"  -l percent  IP packets lost by the built-in peer (0)\n"
+		"  -v          verbose\n", prog, TCPIP_SOCKETS, TCPIP_SOCKETS);
+}
+
+static int open_pty(char *slave, int len)
+{
+	struct termios tio;
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 || ptsname_r(fd, slave, len) != 0) {
+		perror("posix_openpt");
+		return -1;
+	}
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	return fd;
+}
+
+static int start_pppd(const char *pppd, const char *slave, int verbose)
+{
+	char addrs[64];
+	const char *args[20];
+	int n = 0;
+	pid_t pid;
+
+	snprintf(addrs, sizeof(addrs), "%d.%d.%d.%d:%d.%d.%d.%d",
+		BENCH_LOCAL >> 24, (BENCH_LOCAL >> 16) & 0xff, (BENCH_LOCAL >> 8) & 0xff, BENCH_LOCAL & 0xff,
+		BENCH_REMOTE >> 24, (BENCH_REMOTE >> 16) & 0xff, (BENCH_REMOTE >> 8) & 0xff, BENCH_REMOTE & 0xff);
+	args[n++] = pppd;
+	args[n++] = slave;
+	args[n++] = "115200";
+	args[n++] = "noauth";
+	args[n++] = "local";
+	args[n++] = "nodetach";
+	args[n++] = "nocrtscts";
+	args[n++] = "noccp";
+	args[n++] = "novj";
+	args[n++] = addrs;
+	args[n++] = "ms-dns";
+	args[n++] = "10.64.0.1";
+	if (verbose)
+		args[n++] = "debug";
+	args[n] = NULL;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		execvp(pppd, (char **)args);
+		perror(pppd);
+		_exit(127);
+	}
+	return pid;
+}
+
+int main(int argc, char **argv)
+{
+	const char *pppd = "pppd";
+	char slave[64];
+	int tun = 0, verbose = 0, loss = 0;
+	unsigned count = 50, size = 64, bulk = 65536, conns = TCPIP_SOCKETS;
+	long baud = 115200;
+	pid_t pid = 0;
+	double t0, t1, rtt, rttMin = 1e9, rttMax = 0, rttSum = 0;
+	unsigned long tx0, rx0;
+	DWORD addr;
+	int s[TCPIP_SOCKETS];
+	unsigned sent[TCPIP_SOCKETS], got[TCPIP_SOCKETS];
+	static BYTE out[4096], in[4096];
+	unsigned i, k, n, done;
+	int opt, rc = 0;
+
+	while ((opt = getopt(argc, argv, "TP:n:s:b:c:r:l:vh")) != -1) {
+		switch (opt) {
+		case 'T': tun = 1; break;
+		case 'P': pppd = optarg; break;
+		case 'n': count = atoi(optarg); break;
+		case 's': size = atoi(optarg); break;
+		case 'b': bulk = atoi(optarg); break;
+		case 'c': conns = atoi(optarg); break;
+		case 'r': baud = atol(optarg); break;
+		case 'l': loss = atoi(optarg); break;
+		case 'v': verbose = 1; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (size == 0 || size > sizeof(out) || conns < 1 || conns > TCPIP_SOCKETS) {
+		usage(argv[0]);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	byteTime = baud > 0 ? 10.0 / baud : 0;
+	for (i = 0; i < sizeof(out); i++)
+		out[i] = i * 7 + 1;
+	for (i = 0; i < TCPIP_SOCKETS; i++)
+		s[i] = -1;
+
+	ptyFd = open_pty(slave, sizeof(slave));
+	if (ptyFd < 0)
+		return 1;
+	if (server_echo(BENCH_LOCAL, BENCH_PORT) < 0 || server_dns(BENCH_LOCAL, BENCH_LOCAL) < 0) {
+		printf("cannot start the servers\n");
+		return 1;
+	}
+	if (tun) {
+		int fd = open(slave, O_RDWR | O_NOCTTY);
+		struct termios tio;
+
+		if (fd < 0 || tcgetattr(fd, &tio) < 0) {
+			perror(slave);
+			return 1;
+		}
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+		if (peer_start(fd, BENCH_LOCAL, BENCH_REMOTE, BENCH_LOCAL, baud, loss, verbose) < 0)
+			return 1;
+	}
+	else if ((pid = start_pppd(pppd, slave, verbose)) < 0) {
+		perror("fork");
+		return 1;
+	}
+	fcntl(ptyFd, F_SETFL, fcntl(ptyFd, F_GETFL) | O_NONBLOCK);
+
+	printf("%s, UART %ld baud, MTU %d, %d connections of %d/%d byte buffers\n",
+		tun ? "built-in peer" : pppd, baud, PPP_MTU, TCPIP_SOCKETS, TCPIP_RX_SIZE, TCPIP_TX_SIZE);
+
+	// Link
+	t0 = now_ms();
+	PPPOpen();
+	if (!run_until(link_running, NULL, 20000)) {
+		printf("link not up, phase %d\n", PPPPhase());
+		rc = 1;
+		goto out;
+	}
+	t1 = now_ms();
+	addr = PPPLocalAddr();
+	printf("link up              %8.1f ms (address %lu.%lu.%lu.%lu, %lu chars)\n", t1 - t0,
+		(unsigned long)addr >> 24, (unsigned long)(addr >> 16) & 0xff, (unsigned long)(addr >> 8) & 0xff,
+		(unsigned long)addr & 0xff, txBytes + rxBytes);
+
+	// DNS
+	t0 = now_ms();
+	if (!TCPIPResolve(BENCH_HOST) || !run_until(resolved, &addr, 10000) || TCPIPResolved(&addr) != 1) {
+		printf("%s not resolved\n", BENCH_HOST);
+		rc = 1;
+		goto close;
+	}
+	printf("DNS lookup           %8.1f ms\n", now_ms() - t0);
+
+	// Echo round trips
+	t0 = now_ms();
+	s[0] = TCPIPConnect(addr, BENCH_PORT);
+	if (s[0] < 0 || !run_until(connected, &s[0], 30000) || TCPIPState(s[0]) != TCPIP_CONNECTED) {
+		printf("connect failed\n");
+		rc = 1;
+		goto close;
+	}
+	printf("connect              %8.1f ms\n", now_ms() - t0);
+
+	for (i = 0; i < count; i++) {
+		t0 = now_ms();
+		if (TCPIPSend(s[0], out, size) != (int)size) {
+			printf("send failed\n");
+			rc = 1;
+			goto close;
+		}
+		TCPIPFlush(s[0]);
+		for (n = 0; n < size; ) {
+			if (now_ms() - t0 > 10000 || TCPIPState(s[0]) != TCPIP_CONNECTED) {
+				printf("echo %u lost, %u of %u bytes\n", i, n, size);
+				rc = 1;
+				goto close;
+			}
+			k = TCPIPRecv(s[0], in + n, size - n);
+			if (k == 0)
+				run_loop();
+			n += k;
+		}
+		if (memcmp(in, out, size) != 0) {
+			printf("echo %u corrupted\n", i);
+			rc = 1;
+			goto close;
+		}
+		rtt = now_ms() - t0;
+		rttSum += rtt;
+		if (rtt < rttMin)
+			rttMin = rtt;
+		if (rtt > rttMax)
+			rttMax = rtt;
+	}
+	if (count > 0)
+		printf("echo %4u bytes       %8.1f ms (min %.1f, max %.1f)\n", size, rttSum / count, rttMin, rttMax);
+
+	// Bulk echo, both ways at once
+	for (i = 1; i < conns; i++) {
+		s[i] = TCPIPConnect(addr, BENCH_PORT);
+		if (s[i] < 0 || !run_until(connected, &s[i], 30000) || TCPIPState(s[i]) != TCPIP_CONNECTED) {
+			printf("connect %u failed\n", i);
+			rc = 1;
+			goto close;
+		}
+	}
+	memset(sent, 0, sizeof(sent));
+	memset(got, 0, sizeof(got));
+	tx0 = txBytes;
+	rx0 = rxBytes;
+	t0 = now_ms();
+	for (done = 0; done < conns; ) {
+		if (now_ms() - t0 > 600000) {
+			printf("bulk echo stalled\n");
+			rc = 1;
+			goto close;
+		}
+		done = 0;
+		for (i = 0; i < conns; i++) {
+			unsigned share = bulk / conns;
+
+			if (sent[i] < share) {
+				k = share - sent[i];
+				if (k > sizeof(out) - sent[i] % sizeof(out))
+					k = sizeof(out) - sent[i] % sizeof(out);
+				sent[i] += TCPIPSend(s[i], out + sent[i] % sizeof(out), k);
+				TCPIPFlush(s[i]);
+			}
+			while ((k = TCPIPRecv(s[i], in, sizeof(in))) > 0) {
+				for (n = 0; n < k; n++) {
+					if (in[n] != out[(got[i] + n) % sizeof(out)]) {
+						printf("bulk echo corrupted at %u\n", got[i] + n);
+						rc = 1;
+						goto close;
+					}
+				}
+				got[i] += k;
+			}
+			if (TCPIPState(s[i]) != TCPIP_CONNECTED) {
+				printf("bulk connection %u dropped\n", i);
+				rc = 1;
+				goto close;
+			}
+			if (got[i] == share)
+				done++;
+		}
+		run_loop();
+	}
+	t1 = now_ms();
+	printf("bulk echo %7u bytes %8.1f ms, %.1f kB/s each way over %u connection%s\n", bulk / conns * conns,
+		t1 - t0, bulk / conns * conns / (t1 - t0), conns, conns > 1 ? "s" : "");
+	printf("UART efficiency      %8.1f %% up, %.1f %% down (payload / chars)\n",
+		100.0 * bulk / (txBytes - tx0), 100.0 * bulk / (rxBytes - rx0));
+	if (byteTime > 0)
+		printf("UART use             %8.1f %% of %ld baud up\n", 100.0 * (txBytes - tx0) * 10 / baud / ((t1 - t0) / 1000), baud);
+
+close:
+	for (i = 0; i < conns; i++)
+		TCPIPClose(s[i]);
+	t0 = now_ms();
+	// The FINs go out before the link closes
+	for (k = 0; k < 200; k++)
+		run_loop();
+	PPPClose();
+	if (!run_until(link_dead, NULL, 10000)) {
+		printf("link not terminated\n");
+		rc = 1;
+	}
+	else
+		printf("link down            %8.1f ms\n", now_ms() - t0);
+out:
+	if (tun) {
+		peer_stats_t ps;
+
+		peer_stats(&ps);
+		printf("peer: %lu frames in, %lu out, %lu bad, %lu IP packets in, %lu out, %lu lost\n",
+			ps.rxFrames, ps.txFrames, ps.badFrames, ps.ipIn, ps.ipOut, ps.ipLost);
+	}
+	if (pid > 0)
+		kill(pid, SIGTERM);
+	return rc;
+}
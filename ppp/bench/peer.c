@@ -0,0 +1,515 @@
+// Minimal PPP peer for the bench, standing in for pppd where it cannot run: it answers the
+// negotiation of the client (LCP, IPCP) and forwards the IP packets between the pty and a
+// TUN device, that has the address of the peer. It is written apart from ../PPP.c, bit by bit
+// FCS included, so that the two check each other.
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "peer.h"
+
+#define FLAG		0x7e
+#define ESC			0x7d
+#define MAX_FRAME	2048
+
+static int ptyFd = -1;
+static int tunFd = -1;
+static char tunName[IFNAMSIZ];
+static uint32_t ourAddr, hisAddr, dnsAddr;
+static int verbose;
+static int lossPct;
+static double byteTime;
+static double txClock;
+static pthread_mutex_t txLock = PTHREAD_MUTEX_INITIALIZER;
+static peer_stats_t stats;
+
+// Negotiation
+static uint32_t hisAccm = 0xffffffff;
+static unsigned hisMru = 1500;
+static int lcpAckRcvd, lcpAckSent, lcpUp;
+static int ipcpAckRcvd, ipcpAckSent, ipcpUp;
+static uint8_t reqId;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint16_t fcs16(uint16_t fcs, const uint8_t *p, int len)
+{
+	int i;
+
+	while (len-- > 0) {
+		fcs ^= *p++;
+		for (i = 0; i < 8; i++)
+			fcs = (fcs & 1) ? (fcs >> 1) ^ 0x8408 : fcs >> 1;
+	}
+	return fcs;
+}
+
+// Writes at the pace of the UART of the module
+static void pty_write(const uint8_t *p, int len)
+{
+	struct timespec ts;
+	double t, wait;
+	int n;
+
+	if (byteTime > 0) {
+		t = now();
+		if (txClock < t)
+			txClock = t;
+		wait = txClock - t;
+		if (wait > 0) {
+			ts.tv_sec = (time_t)wait;
+			ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+			nanosleep(&ts, NULL);
+		}
+		txClock += len * byteTime;
+	}
+	while (len > 0) {
+		n = write(ptyFd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return;
+		p += n;
+		len -= n;
+	}
+}
+
+static void send_frame(uint16_t proto, const uint8_t *data, int len)
+{
+	static uint8_t raw[MAX_FRAME + 8], out[2 * MAX_FRAME + 20];
+	uint32_t accm = (proto == 0xc021 || !lcpUp) ? 0xffffffff : hisAccm;
+	uint16_t fcs;
+	int i, n = 0, o = 0;
+
+	if (len > MAX_FRAME)
+		return;
+	raw[n++] = 0xff;
+	raw[n++] = 0x03;
+	raw[n++] = proto >> 8;
+	raw[n++] = proto & 0xff;
+	memcpy(raw + n, data, len);
+	n += len;
+	fcs = fcs16(0xffff, raw, n) ^ 0xffff;
+	raw[n++] = fcs & 0xff;
+	raw[n++] = fcs >> 8;
+
+	out[o++] = FLAG;
+	for (i = 0; i < n; i++) {
+		uint8_t c = raw[i];
+		if (c == FLAG || c == ESC || (c < 0x20 && (accm & (1u << c)))) {
+			out[o++] = ESC;
+			c ^= 0x20;
+		}
+		out[o++] = c;
+	}
+	out[o++] = FLAG;
+
+	pthread_mutex_lock(&txLock);
+	pty_write(out, o);
+	stats.txFrames++;
+	pthread_mutex_unlock(&txLock);
+}
+
+static void send_cp(uint16_t proto, uint8_t code, uint8_t id, const uint8_t *data, int len)
+{
+	uint8_t pkt[MAX_FRAME];
+
+	pkt[0] = code;
+	pkt[1] = id;
+	pkt[2] = (len + 4) >> 8;
+	pkt[3] = (len + 4) & 0xff;
+	memcpy(pkt + 4, data, len);
+	send_frame(proto, pkt, len + 4);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void send_lcp_req(void)
+{
+	uint8_t opt[12] = { 2, 6, 0, 0, 0, 0, 5, 6 };
+
+	put32(opt + 8, 0x5eed0000 | (getpid() & 0xffff));
+	send_cp(0xc021, 1, ++reqId, opt, sizeof(opt));
+}
+
+static void send_ipcp_req(void)
+{
+	uint8_t opt[6] = { 3, 6 };
+
+	put32(opt + 2, ourAddr);
+	send_cp(0x8021, 1, ++reqId, opt, sizeof(opt));
+}
+
+static void set_mtu(unsigned mtu)
+{
+	struct ifreq ifr;
+	int s = socket(AF_INET, SOCK_DGRAM, 0);
+
+	memset(&ifr, 0, sizeof(ifr));
+	snprintf(ifr.ifr_name, IFNAMSIZ, "%s", tunName);
+	ifr.ifr_mtu = mtu;
+	if (ioctl(s, SIOCSIFMTU, &ifr) < 0)
+		perror("peer: SIOCSIFMTU");
+	close(s);
+}
+
+static void lcp_check_up(void)
+{
+	if (lcpUp || !lcpAckRcvd || !lcpAckSent)
+		return;
+	lcpUp = 1;
+	set_mtu(hisMru);
+	if (verbose)
+		fprintf(stderr, "peer: LCP opened, client MRU %u, ACCM %08x\n", hisMru, hisAccm);
+	send_ipcp_req();
+}
+
+static void ipcp_check_up(void)
+{
+	if (ipcpUp || !ipcpAckRcvd || !ipcpAckSent)
+		return;
+	ipcpUp = 1;
+	if (verbose)
+		fprintf(stderr, "peer: IPCP opened\n");
+}
+
+// Configure-Request of the client: all the options of the worst kind go back in the reply
+static void conf_req(uint16_t proto, uint8_t id, uint8_t *opt, int len)
+{
+	uint8_t rej[MAX_FRAME], nak[MAX_FRAME];
+	int nrej = 0, nnak = 0, i, olen;
+	uint32_t v;
+
+	for (i = 0; i + 2 <= len; i += olen) {
+		olen = opt[i + 1];
+		if (olen < 2 || i + olen > len)
+			return;
+		if (proto == 0xc021) {
+			switch (opt[i]) {
+			case 1: if (olen == 4) continue; break;
+			case 2: case 5: if (olen == 6) continue; break;
+			case 7: case 8: if (olen == 2) continue; break;
+			}
+		}
+		else {
+			v = olen == 6 ? get32(opt + i + 2) : 0;
+			if (opt[i] == 3 && olen == 6) {
+				if (v == hisAddr)
+					continue;
+				nak[nnak] = 3;
+				nak[nnak + 1] = 6;
+				put32(nak + nnak + 2, hisAddr);
+				nnak += 6;
+				continue;
+			}
+			if (opt[i] == 129 && olen == 6) {
+				if (v == dnsAddr)
+					continue;
+				nak[nnak] = 129;
+				nak[nnak + 1] = 6;
+				put32(nak + nnak + 2, dnsAddr);
+				nnak += 6;
+				continue;
+			}
+			// A secondary DNS server is not given, as some networks do
+		}
+		memcpy(rej + nrej, opt + i, olen);
+		nrej += olen;
+	}
+
+	if (nrej > 0) {
+		send_cp(proto, 4, id, rej, nrej);
+		return;
+	}
+	if (nnak > 0) {
+		send_cp(proto, 3, id, nak, nnak);
+		return;
+	}
+	send_cp(proto, 2, id, opt, len);
+	if (proto == 0xc021) {
+		for (i = 0; i < len; i += opt[i + 1]) {
+			if (opt[i] == 1)
+				hisMru = (opt[i + 2] << 8) | opt[i + 3];
+			if (opt[i] == 2)
+				hisAccm = get32(opt + i + 2);
+		}
+		lcpAckSent = 1;
+		lcp_check_up();
+	}
+	else {
+		ipcpAckSent = 1;
+		ipcp_check_up();
+	}
+}
+
+static void cp_input(uint16_t proto, uint8_t *p, int len)
+{
+	int plen;
+
+	if (len < 4)
+		return;
+	plen = (p[2] << 8) | p[3];
+	if (plen < 4 || plen > len)
+		return;
+	switch (p[0]) {
+	case 1:
+		conf_req(proto, p[1], p + 4, plen - 4);
+		break;
+	case 2:
+		if (p[1] != reqId)
+			break;
+		if (proto == 0xc021) {
+			lcpAckRcvd = 1;
+			lcp_check_up();
+		}
+		else {
+			ipcpAckRcvd = 1;
+			ipcp_check_up();
+		}
+		break;
+	case 3:
+	case 4:
+		fprintf(stderr, "peer: request of %04x refused\n", proto);
+		break;
+	case 5:
+		send_cp(proto, 6, p[1], NULL, 0);
+		if (proto == 0xc021) {
+			if (verbose)
+				fprintf(stderr, "peer: link terminated by the client\n");
+			lcpUp = lcpAckRcvd = lcpAckSent = 0;
+			ipcpUp = ipcpAckRcvd = ipcpAckSent = 0;
+			hisAccm = 0xffffffff;
+		}
+		break;
+	case 8:
+		if (plen >= 6)
+			fprintf(stderr, "peer: protocol %02x%02x rejected\n", p[4], p[5]);
+		break;
+	case 9:
+		if (proto == 0xc021 && lcpUp) {
+			p[0] = 10;
+			put32(p + 4, 0x5eed0000 | (getpid() & 0xffff));
+			send_frame(proto, p, plen);
+		}
+		break;
+	}
+}
+
+static int lost(void)
+{
+	if (lossPct <= 0 || rand() % 100 >= lossPct)
+		return 0;
+	stats.ipLost++;
+	return 1;
+}
+
+static void frame_input(uint8_t *p, int len)
+{
+	uint16_t proto;
+
+	if (len < 4 || fcs16(0xffff, p, len) != 0xf0b8) {
+		stats.badFrames++;
+		return;
+	}
+	stats.rxFrames++;
+	len -= 2;
+	if (p[0] == 0xff && p[1] == 0x03) {
+		p += 2;
+		len -= 2;
+	}
+	if (p[0] & 1) {
+		proto = p[0];
+		p++;
+		len--;
+	}
+	else {
+		proto = (p[0] << 8) | p[1];
+		p += 2;
+		len -= 2;
+	}
+
+	switch (proto) {
+	case 0xc021:
+	case 0x8021:
+		cp_input(proto, p, len);
+		break;
+	case 0x0021:
+		if (lost())
+			break;
+		if (ipcpUp && write(tunFd, p, len) == len)
+			stats.ipIn++;
+		break;
+	default:
+		fprintf(stderr, "peer: protocol %04x from the client\n", proto);
+		break;
+	}
+}
+
+static void *pty_reader(void *arg)
+{
+	static uint8_t frame[MAX_FRAME + 8];
+	uint8_t buf[512];
+	int n, i, len = 0, esc = 0;
+
+	(void)arg;
+	for (;;) {
+		n = read(ptyFd, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return NULL;
+		for (i = 0; i < n; i++) {
+			uint8_t c = buf[i];
+			if (c == FLAG) {
+				if (len > 0 && !esc)
+					frame_input(frame, len);
+				len = 0;
+				esc = 0;
+			}
+			else if (c == ESC)
+				esc = 1;
+			else {
+				if (esc)
+					c ^= 0x20;
+				esc = 0;
+				if (len < (int)sizeof(frame))
+					frame[len++] = c;
+			}
+		}
+	}
+}
+
+static void *tun_reader(void *arg)
+{
+	uint8_t pkt[MAX_FRAME];
+	int n;
+
+	(void)arg;
+	for (;;) {
+		n = read(tunFd, pkt, sizeof(pkt));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return NULL;
+		if (!ipcpUp || lost())
+			continue;
+		send_frame(0x0021, pkt, n);
+		stats.ipOut++;
+	}
+}
+
+// Resends the requests that are not acknowledged yet
+static void *retry_timer(void *arg)
+{
+	(void)arg;
+	for (;;) {
+		if (!lcpAckRcvd)
+			send_lcp_req();
+		else if (lcpUp && !ipcpAckRcvd)
+			send_ipcp_req();
+		sleep(1);
+	}
+	return NULL;
+}
+
+static int tun_open(void)
+{
+	struct ifreq ifr;
+	struct sockaddr_in *sin = (struct sockaddr_in *)&ifr.ifr_addr;
+	int s;
+
+	tunFd = open("/dev/net/tun", O_RDWR);
+	if (tunFd < 0) {
+		perror("peer: /dev/net/tun");
+		return -1;
+	}
+	memset(&ifr, 0, sizeof(ifr));
+	ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+	strcpy(ifr.ifr_name, "pppbench%d");
+	if (ioctl(tunFd, TUNSETIFF, &ifr) < 0) {
+		perror("peer: TUNSETIFF");
+		return -1;
+	}
+	strcpy(tunName, ifr.ifr_name);
+
+	s = socket(AF_INET, SOCK_DGRAM, 0);
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(ourAddr);
+	if (ioctl(s, SIOCSIFADDR, &ifr) < 0) {
+		perror("peer: SIOCSIFADDR");
+		close(s);
+		return -1;
+	}
+	sin->sin_addr.s_addr = htonl(hisAddr);
+	if (ioctl(s, SIOCSIFDSTADDR, &ifr) < 0)
+		perror("peer: SIOCSIFDSTADDR");
+	if (ioctl(s, SIOCGIFFLAGS, &ifr) == 0) {
+		ifr.ifr_flags |= IFF_UP | IFF_RUNNING | IFF_POINTOPOINT;
+		if (ioctl(s, SIOCSIFFLAGS, &ifr) < 0)
+			perror("peer: SIOCSIFFLAGS");
+	}
+	close(s);
+	return 0;
+}
+
+int peer_start(int fd, uint32_t local, uint32_t remote, uint32_t dns, long baud, int loss, int verb)
+{
+	pthread_t t;
+
+	ptyFd = fd;
+	ourAddr = local;
+	hisAddr = remote;
+	dnsAddr = dns;
+	verbose = verb;
+	lossPct = loss;
+	byteTime = baud > 0 ? 10.0 / baud : 0;
+	if (tun_open() < 0)
+		return -1;
+	set_mtu(hisMru);
+	if (verbose)
+		fprintf(stderr, "peer: %s up\n", tunName);
+	pthread_create(&t, NULL, pty_reader, NULL);
+	pthread_create(&t, NULL, tun_reader, NULL);
+	pthread_create(&t, NULL, retry_timer, NULL);
+	return 0;
+}
+
+int peer_up(void)
+{
+	return ipcpUp;
+}
+
+void peer_stats(peer_stats_t *s)
+{
+	*s = stats;
+}
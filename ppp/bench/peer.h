@@ -0,0 +1,25 @@
+#ifndef PEER_H
+#define PEER_H
+
+#include <stdint.h>
+
+// Built-in PPP peer of the bench, see peer.c
+
+typedef struct {
+	unsigned long rxFrames;		// from the client
+	unsigned long txFrames;		// to the client
+	unsigned long badFrames;	// bad FCS or too short
+	unsigned long ipIn;			// IP packets forwarded to the TUN device
+	unsigned long ipOut;		// IP packets forwarded to the client
+	unsigned long ipLost;		// IP packets dropped, both ways
+} peer_stats_t;
+
+// Runs the peer on the pty fd, with the TUN device at local and the client at remote.
+// The peer sends at baud chars per 10 s, 0 for no pacing, and drops loss percent of the IP packets.
+// Returns -1 if the TUN device fails.
+int peer_start(int fd, uint32_t local, uint32_t remote, uint32_t dns, long baud, int loss, int verbose);
+// Whether IPCP is opened
+int peer_up(void);
+void peer_stats(peer_stats_t *stats);
+
+#endif
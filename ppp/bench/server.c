@@ -0,0 +1,138 @@
+// Echo and DNS servers of the bench. They bind to the address of the peer side of the
+// link before it exists (IP_FREEBIND), since pppd only sets it up once IPCP is opened.
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "server.h"
+
+static uint32_t dnsAnswer;
+
+static int server_socket(int type, uint32_t addr, uint16_t port)
+{
+	struct sockaddr_in sin;
+	int fd = socket(AF_INET, type, 0);
+	int one = 1;
+
+	if (fd < 0)
+		return -1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	setsockopt(fd, IPPROTO_IP, IP_FREEBIND, &one, sizeof(one));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(addr);
+	sin.sin_port = htons(port);
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		perror("server: bind");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void *echo_conn(void *arg)
+{
+	int fd = (int)(intptr_t)arg;
+	char buf[4096];
+	int n, m, one = 1;
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		for (m = 0; m < n; ) {
+			int w = write(fd, buf + m, n - m);
+			if (w <= 0)
+				goto done;
+			m += w;
+		}
+	}
+done:
+	close(fd);
+	return NULL;
+}
+
+static void *echo_accept(void *arg)
+{
+	int lfd = (int)(intptr_t)arg;
+	pthread_t t;
+	int fd;
+
+	for (;;) {
+		fd = accept(lfd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			return NULL;
+		}
+		pthread_create(&t, NULL, echo_conn, (void *)(intptr_t)fd);
+		pthread_detach(t);
+	}
+}
+
+int server_echo(uint32_t addr, uint16_t port)
+{
+	pthread_t t;
+	int fd = server_socket(SOCK_STREAM, addr, port);
+
+	if (fd < 0 || listen(fd, 8) < 0)
+		return -1;
+	pthread_create(&t, NULL, echo_accept, (void *)(intptr_t)fd);
+	return 0;
+}
+
+// Answers the A queries, with the question copied and one answer pointing at it
+static void *dns_loop(void *arg)
+{
+	int fd = (int)(intptr_t)arg;
+	struct sockaddr_in from;
+	socklen_t fromLen;
+	uint8_t msg[512];
+	int n, pos;
+
+	for (;;) {
+		fromLen = sizeof(from);
+		n = recvfrom(fd, msg, sizeof(msg) - 16, 0, (struct sockaddr *)&from, &fromLen);
+		if (n < 12)
+			continue;
+		for (pos = 12; pos < n && msg[pos] != 0; pos += msg[pos] + 1)
+			;
+		pos += 5;
+		if (pos > n || msg[pos - 4] != 0 || msg[pos - 3] != 1)
+			continue;
+		msg[2] = 0x81;	// response, recursion desired
+		msg[3] = 0x80;	// recursion available, no error
+		msg[6] = 0;
+		msg[7] = 1;		// one answer
+		memset(msg + 8, 0, 4);
+		msg[pos++] = 0xc0;
+		msg[pos++] = 12;
+		memcpy(msg + pos, "\0\1\0\1\0\0\0\x3c\0\4", 10);
+		pos += 10;
+		msg[pos++] = dnsAnswer >> 24;
+		msg[pos++] = dnsAnswer >> 16;
+		msg[pos++] = dnsAnswer >> 8;
+		msg[pos++] = dnsAnswer;
+		sendto(fd, msg, pos, 0, (struct sockaddr *)&from, fromLen);
+	}
+	return NULL;
+}
+
+int server_dns(uint32_t addr, uint32_t answer)
+{
+	pthread_t t;
+	int fd = server_socket(SOCK_DGRAM, addr, 53);
+
+	if (fd < 0)
+		return -1;
+	dnsAnswer = answer;
+	pthread_create(&t, NULL, dns_loop, (void *)(intptr_t)fd);
+	return 0;
+}
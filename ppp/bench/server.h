@@ -0,0 +1,13 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+// Servers of the bench on the host side of the link, see server.c
+
+// TCP echo server on addr:port
+int server_echo(uint32_t addr, uint16_t port);
+// DNS server on addr:53, that resolves every name to answer
+int server_dns(uint32_t addr, uint32_t answer);
+
+#endif
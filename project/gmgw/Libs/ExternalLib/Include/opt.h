@@ -20,5 +20,13 @@
 
 #define MQTT_MAX_PACKET_SIZE   1000
 
+#define MQTT_MAX_INFLIGHT      3
+
+#define MQTT_INFLIGHT_MSG_SIZE 300
+
+#define MQTT_KEEPALIVE_MAX     300UL
+
+#define TCP_TX_BUF_SIZE        512
+
 #endif
 
@@ -70,8 +70,9 @@ const long int baudComp[8] = {	1200,	2400,	4800,	9600,
 								19200,	38400,	57600,	115200		
 							 };	// Warning those values are the baud config compatible with both
 								// HiloV2 and Hilo3G models... 
+const long int baudHigh[4] = { 921600, 460800, 230400, 0 };	// Above 115200, tried from the highest by HiloStdModeOn
 
-static int (*FP_GSM[36])();
+static int (*FP_GSM[39])();
 
 void CmdCheck(int mainStat)
 {
@@ -104,7 +105,8 @@ void CmdCheck(int mainStat)
 int main(void)
 {
 	//	Queue creation - will be used for communication between the stack and other tasks
-	xQueue = xQueueCreate(3, sizeof (int));
+	xQueue = xQueueCreate(GSM_MAX_CMD, sizeof (GSMCmd*));
+	GSMCmdInit();
 
 	xSemFrontEnd = xSemaphoreCreateMutex();
 	
@@ -196,6 +198,9 @@ void GSMTask()
 	FP_GSM[33] = cFSSize;
 	FP_GSM[34] = cFSAppend;
 	FP_GSM[35] = cGSMSignal;
+	FP_GSM[36] = cTCPStreamStart;
+	FP_GSM[37] = cTCPStreamStop;	// it will be executed only if LowLevel mode is enabled
+	FP_GSM[38] = cTCPStreamDial;
 	
 	// Initialization of tick only at the startup of the device
 	if (hFlyTask == NULL)
@@ -208,7 +213,7 @@ void GSMTask()
 		_dbgwrite("Setting up GPRS module...\r\n");
 				
 		// Enter Standard Mode:
-		while(HiloStdModeOn(baudComp[7])); // 115200 baud...
+		while(HiloStdModeOn(GSM_BAUD)); // 115200 baud, then up to GSM_BAUD
 	}
 	
 	if (hFlyTask == NULL)
@@ -227,7 +232,7 @@ void GSMTask()
 	    	case SM_GSM_IDLE:
 	    		GSMUnsol(NO_ERR);
 	    		// Check on the queue to verify if other task have requested some stack function
-				xStatus = xQueueReceive(xQueue,&Cmd,0);
+				GSMCmdDispatch(OP_EXECUTION);
 				CmdCheck(OP_EXECUTION);
 				break;
 			
@@ -238,7 +243,10 @@ void GSMTask()
 				break;
 			
 			case SM_GSM_LL_MODE:
+				GSMCmdDispatch(OP_LL);
 				CmdCheck(OP_LL);
+				// TCPStreamStop, until the module is back in command mode
+				CmdCheck(OP_EXECUTION);
 				break;
 				
 			case SM_GSM_HW_FAULT:
@@ -255,7 +263,7 @@ void GSMTask()
 				HiloReset();
 				
 				// Enter Standard Mode:
-				while(HiloStdModeOn(baudComp[7])); // 115200 baud...
+				while(HiloStdModeOn(GSM_BAUD)); // 115200 baud, then up to GSM_BAUD
 				
 				mainGSMStateMachine = SM_GSM_IDLE;
 				mainOpStatus.Function = 0;
@@ -267,6 +275,7 @@ void GSMTask()
 				
 			case SM_GSM_HIBERNATE:
 				// GSMUnsol(NO_ERR);
+				GSMCmdDispatch(OP_EXECUTION);
 				// Accept only function 29 (cGSMOn)
 				if(mainOpStatus.Function == 29)
 					CmdCheck(OP_EXECUTION);
@@ -278,6 +287,14 @@ void GSMTask()
 				}
 				break;
 	    }
+	    // Wake up the task waiting for the command, once it is completed
+	    GSMCmdComplete();
+#if GSM_CMUX
+	    // Answers of the multiplexer control channel
+	    CmuxPoll();
+#endif
+	    // Nothing left to do: sleep until the modem or a task needs the GSM Task
+	    GSMIdleWait();
 	}
 }
 
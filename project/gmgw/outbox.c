@@ -0,0 +1,239 @@
+#include "taskFlyport.h"
+#include "outbox.h"
+
+// Flash outbox. Records are appended at the head of a ring of sectors and sent from the
+// tail. A record is a header followed by the data, padded to an even length:
+//	magic, flags, length (2 bytes), sequence number (4 bytes)
+// Records never reach the end of their sector, the rest of a sector too small for the
+// next record stays erased. The flags bits are cleared in place as the record goes on,
+// so the state of the outbox is found again by scanning the headers after a reset.
+#define OUTBOX_MAGIC       0x4F
+#define OUTBOX_HDR_SIZE    8
+#define OUTBOX_UNCOMMITTED 0x01	// cleared once the whole record is written
+#define OUTBOX_UNSENT      0x02	// cleared once the server acknowledged the record
+
+#define OUTBOX_FLASH_END   (OUTBOX_FLASH_START + OUTBOX_FLASH_SIZE)
+
+static DWORD head;	// where the next record is written
+static DWORD tail;	// oldest record not acknowledged, head when the outbox is empty
+static DWORD next;	// next record to send
+static DWORD nextSeq;
+static xSemaphoreHandle xSemOutbox;
+
+static DWORD sector_of(DWORD addr)
+{
+	return addr & ~SPI_FLASH_SECTOR_MASK;
+}
+
+static DWORD next_sector(DWORD addr)
+{
+	addr = sector_of(addr) + SPI_FLASH_SECTOR_SIZE;
+	if (addr >= OUTBOX_FLASH_END)
+		addr = OUTBOX_FLASH_START;
+	return addr;
+}
+
+static WORD record_size(WORD len)
+{
+	return (OUTBOX_HDR_SIZE + len + 1) & ~1;
+}
+
+static DWORD get_seq(BYTE *hdr)
+{
+	return ((DWORD)hdr[4] << 24) | ((DWORD)hdr[5] << 16) | ((WORD)hdr[6] << 8) | hdr[7];
+}
+
+// Reads the header of the record at addr. Returns the size of the record,
+// 0 past the last record of the sector or on a header cut by a reset.
+static WORD read_hdr(DWORD addr, BYTE *hdr)
+{
+	WORD len;
+
+	if (SPI_FLASH_SECTOR_SIZE - (addr & SPI_FLASH_SECTOR_MASK) < OUTBOX_HDR_SIZE)
+		return 0;
+	SPIFlashReadArray(addr, hdr, OUTBOX_HDR_SIZE);
+	if (hdr[0] != OUTBOX_MAGIC)
+		return 0;
+	len = (hdr[2] << 8) | hdr[3];
+	if (len > OUTBOX_MAX_RECORD || (addr & SPI_FLASH_SECTOR_MASK) + record_size(len) >= SPI_FLASH_SECTOR_SIZE)
+		return 0;
+	return record_size(len);
+}
+
+// Moves addr past the records already acknowledged or cut by a reset
+static DWORD skip_done(DWORD addr)
+{
+	BYTE hdr[OUTBOX_HDR_SIZE];
+	WORD size;
+
+	while (addr != head) {
+		size = read_hdr(addr, hdr);
+		if (size == 0)
+			addr = next_sector(addr);
+		else if ((hdr[1] & (OUTBOX_UNCOMMITTED | OUTBOX_UNSENT)) == OUTBOX_UNSENT)
+			break;
+		else
+			addr += size;
+	}
+	return addr;
+}
+
+// Finds head, tail and the next sequence number from the records in flash
+void outbox_init()
+{
+	BYTE hdr[OUTBOX_HDR_SIZE];
+	DWORD addr;
+	DWORD newest = 0;
+	BOOL found = FALSE;
+	WORD size;
+
+	xSemOutbox = xSemaphoreCreateMutex();
+	nextSeq = 0;
+
+	// The head is in the sector starting with the newest record. The sequence number
+	// of a record cut by a reset may not have been written.
+	for (addr = OUTBOX_FLASH_START; addr < OUTBOX_FLASH_END; addr += SPI_FLASH_SECTOR_SIZE) {
+		if (read_hdr(addr, hdr) == 0 || (hdr[1] & OUTBOX_UNCOMMITTED))
+			continue;
+		if (!found || get_seq(hdr) - nextSeq < 0x80000000UL) {
+			newest = addr;
+			nextSeq = get_seq(hdr) + 1;
+			found = TRUE;
+		}
+	}
+	if (!found) {
+		head = tail = next = OUTBOX_FLASH_START;
+		return;
+	}
+
+	head = newest;
+	while ((size = read_hdr(head, hdr)) != 0) {
+		if (!(hdr[1] & OUTBOX_UNCOMMITTED))
+			nextSeq = get_seq(hdr) + 1;
+		head += size;
+	}
+	// A header cut by a reset is not erased, go on in the next sector
+	if (SPI_FLASH_SECTOR_SIZE - (head & SPI_FLASH_SECTOR_MASK) >= OUTBOX_HDR_SIZE && hdr[0] != 0xFF)
+		head = next_sector(head);
+
+	// The tail is in the first sector holding records after the head one
+	tail = next_sector(head);
+	while (tail != sector_of(head) && read_hdr(tail, hdr) == 0)
+		tail = next_sector(tail);
+	if (tail == sector_of(head) && (head & SPI_FLASH_SECTOR_MASK) == 0)
+		tail = head;
+	tail = next = skip_done(tail);
+}
+
+// Appends a record, the oldest sector is dropped when the outbox is full.
+// Returns FALSE if the record is too large.
+BOOL outbox_put(BYTE *data, WORD len)
+{
+	BYTE hdr[OUTBOX_HDR_SIZE];
+	WORD size = record_size(len);
+
+	if (len > OUTBOX_MAX_RECORD)
+		return FALSE;
+
+	xSemaphoreTake(xSemOutbox, portMAX_DELAY);
+	// Writing at the start of a sector erases it
+	if ((head & SPI_FLASH_SECTOR_MASK) + size >= SPI_FLASH_SECTOR_SIZE) {
+		if (tail == head) {
+			head = tail = next = next_sector(head);
+		}
+		else {
+			head = next_sector(head);
+			if (sector_of(tail) == head) {
+				UARTWrite(1, "Outbox full, oldest feeds dropped\r\n");
+				tail = next = skip_done(next_sector(head));
+			}
+		}
+	}
+
+	hdr[0] = OUTBOX_MAGIC;
+	hdr[1] = 0xFF;
+	hdr[2] = len >> 8;
+	hdr[3] = len & 0xFF;
+	hdr[4] = nextSeq >> 24;
+	hdr[5] = (nextSeq >> 16) & 0xFF;
+	hdr[6] = (nextSeq >> 8) & 0xFF;
+	hdr[7] = nextSeq & 0xFF;
+	SPIFlashBeginWrite(head);
+	SPIFlashWriteArray(hdr, OUTBOX_HDR_SIZE);
+	SPIFlashWriteArray(data, len);
+	SPIFlashBeginWrite(head + 1);
+	SPIFlashWrite(0xFF & ~OUTBOX_UNCOMMITTED);
+
+	head += size;
+	nextSeq++;
+	xSemaphoreGive(xSemOutbox);
+	return TRUE;
+}
+
+// Copies the next record to send into buf: its sequence number (4 bytes, big endian)
+// followed by the data. buf must hold OUTBOX_MAX_RECORD + 4 bytes.
+// Returns the length copied, 0 when every record was sent. id identifies the record
+// for outbox_sent and outbox_ack. The record stays the next one until outbox_sent.
+WORD outbox_next(DWORD *id, BYTE *buf, WORD size)
+{
+	BYTE hdr[OUTBOX_HDR_SIZE];
+	WORD len = 0;
+
+	xSemaphoreTake(xSemOutbox, portMAX_DELAY);
+	next = skip_done(next);
+	if (next != head) {
+		read_hdr(next, hdr);
+		len = 4 + ((hdr[2] << 8) | hdr[3]);
+		if (len <= size) {
+			*id = next;
+			SPIFlashReadArray(*id + 4, buf, len);
+		}
+		else {
+			next += record_size(len - 4);
+			len = 0;
+		}
+	}
+	xSemaphoreGive(xSemOutbox);
+	return len;
+}
+
+// Moves past the record given by outbox_next, once it was handed over for sending.
+// seq guards against a record dropped meanwhile to make room.
+void outbox_sent(DWORD id, DWORD seq)
+{
+	BYTE hdr[OUTBOX_HDR_SIZE];
+	WORD size;
+
+	xSemaphoreTake(xSemOutbox, portMAX_DELAY);
+	size = read_hdr(id, hdr);
+	if (next == id && size && get_seq(hdr) == seq)
+		next += size;
+	xSemaphoreGive(xSemOutbox);
+}
+
+// Marks a record sent by outbox_next as acknowledged. seq guards against
+// a record dropped meanwhile to make room.
+void outbox_ack(DWORD id, DWORD seq)
+{
+	BYTE hdr[OUTBOX_HDR_SIZE];
+
+	xSemaphoreTake(xSemOutbox, portMAX_DELAY);
+	if (read_hdr(id, hdr) && get_seq(hdr) == seq) {
+		SPIFlashBeginWrite(id + 1);
+		SPIFlashWrite(hdr[1] & ~OUTBOX_UNSENT);
+		if (id == tail)
+			tail = skip_done(tail);
+	}
+	xSemaphoreGive(xSemOutbox);
+}
+
+// Keeps the other tasks off the SPI flash, while a firmware upgrade is downloaded
+void outbox_lock()
+{
+	xSemaphoreTake(xSemOutbox, portMAX_DELAY);
+}
+
+void outbox_unlock()
+{
+	xSemaphoreGive(xSemOutbox);
+}
@@ -0,0 +1,39 @@
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+// Records waiting to be sent are kept in a ring of SPI flash sectors. The default
+// area ends where the firmware upgrade is downloaded (0x1C0000).
+#ifndef OUTBOX_FLASH_START
+#define OUTBOX_FLASH_START 0x100000UL
+#endif
+
+#ifndef OUTBOX_FLASH_SIZE
+#define OUTBOX_FLASH_SIZE  0xC0000UL
+#endif
+
+// Largest record accepted by outbox_put
+#ifndef OUTBOX_MAX_RECORD
+#define OUTBOX_MAX_RECORD  512
+#endif
+
+#if (OUTBOX_FLASH_START % SPI_FLASH_SECTOR_SIZE) || (OUTBOX_FLASH_SIZE % SPI_FLASH_SECTOR_SIZE)
+#error The outbox must be made of whole flash sectors
+#endif
+
+#if OUTBOX_FLASH_SIZE < 2 * SPI_FLASH_SECTOR_SIZE
+#error The outbox needs at least two flash sectors
+#endif
+
+#if OUTBOX_MAX_RECORD + 8 > SPI_FLASH_SECTOR_SIZE
+#error OUTBOX_MAX_RECORD does not fit in a flash sector
+#endif
+
+extern void outbox_init();
+extern BOOL outbox_put(BYTE *data, WORD len);
+extern WORD outbox_next(DWORD *id, BYTE *buf, WORD size);
+extern void outbox_sent(DWORD id, DWORD seq);
+extern void outbox_ack(DWORD id, DWORD seq);
+extern void outbox_lock();
+extern void outbox_unlock();
+
+#endif
@@ -1,6 +1,7 @@
 #include "taskFlyport.h"
 #include "taskModbus.h"
 #include "MQTTClient.h"
+#include "outbox.h"
 #include "RS485Helper.h"
 #include "ini.h"
 #include "mb.h"
@@ -20,13 +21,40 @@ xQueueHandle xQueueMqtt;
 #define MQTT_PASS   "password"
 
 #define MQTT_TOPIC_ADVT    "/advt"
-#define MQTT_TOPIC_FEED    "/feed"
+#define MQTT_TOPIC_FEEDS   "/feeds"
 #define MQTT_TOPIC_CFG_REQ "/cfg/req"
 #define MQTT_TOPIC_CFG_RSP "/cfg/rsp"
 #define MQTT_TOPIC_CMD_REQ "/cmd/req"
 #define MQTT_TOPIC_CMD_RSP "/cmd/rsp"
 #define MQTT_TOPIC_UPGRADE "/upgrade"
 
+// Feeds, requests and command replies are delivered at least once
+#define MQTT_DATA_QOS      1
+
+// Longest sleep in ms of a pass that sent nothing, a command reply wakes the task up before.
+// The link is polled at least this often, and reconnected without starving the other tasks.
+#define MQTT_IDLE_WAIT     50
+
+// MQTT 5.0 lets repeated feeds carry a topic alias instead of the IMEI based topic,
+// the client falls back to MQTT 3.1.1 with brokers refusing it
+#define MQTT_PROTOCOL      MQTT_PROTOCOL_V5
+
+// 1: subscribe to "<devid>/#" only and route the requests locally. With MQTT 3.1.x
+// brokers this also sends back every message the gateway publishes.
+#define MQTT_SUB_WILDCARD  0
+
+#if MQTT_SUB_WILDCARD
+#define NUM_SUBS           1
+#else
+#define NUM_SUBS           3
+#endif
+
+// Outbox records, their sequence number then a feed batch, are published with
+// "<devid>/feeds" as one QoS 1 message, kept in an in-flight slot until its PUBACK
+#if MQTT_INFLIGHT_MSG_SIZE < DEVICE_ID_LENGTH + 6 + 4 + FEED_BATCH_SIZE
+#error MQTT_INFLIGHT_MSG_SIZE too small for feed batches
+#endif
+
 MQTTClient_t mqtt;
 TCPClient_t client;
 
@@ -152,6 +180,7 @@ static void do_config(char *cfg, unsigned int len)
 {
 	init = 0;
 	config.nTasks = 0;
+	reset_feeds();
 #if 0
 	config.mode = MB_RTU;
 	config.port = port485;
@@ -210,9 +239,7 @@ static void do_upgrade(char *cfg, unsigned int len)
 	FTP_SOCKET ftpSocket;
 	ftpSocket.number = INVALID_SOCKET;
 	FTPConfig(&ftpSocket, "119.97.184.140", "user", "pass", 21);
-	while(LastExecStat() == OP_EXECUTION)
-		vTaskDelay(1);
-	if(LastExecStat() != OP_SUCCESS)
+	if(LastExecWait(OP_WAIT_FOREVER) != OP_SUCCESS)
 	{
 		UARTWrite(1, "Errors on FTPConfig function!\r\n");
 		return;
@@ -220,9 +247,7 @@ static void do_upgrade(char *cfg, unsigned int len)
 	
 	gsmDebugOn = 0;
 	FTPReceive(&ftpSocket, 0x1C0000, "/", fileName, fileSize);
-	while(LastExecStat() == OP_EXECUTION)
-		vTaskDelay(1);
-	if(LastExecStat() != OP_SUCCESS)
+	if(LastExecWait(OP_WAIT_FOREVER) != OP_SUCCESS)
 		UARTWrite(1, "ERROR in download firmware!\r\n");
 	else {
 		UARTWrite(1, "OK - Firmware downloaded!\r\n");
@@ -261,12 +286,18 @@ static void do_upgrade(char *cfg, unsigned int len)
 	Reset();
 }
 
-static BOOL mqtt_send_msg(char* topic, uint8_t* payload, unsigned int length)
+static BOOL mqtt_send_msg(char* topic, uint8_t* payload, unsigned int length, uint8_t qos, uint16_t* msgId)
 {
-	char tp[MQTT_MAX_TOPIC_LEN + 1];
-	char *devid = GSMGetIMEI();
-	sprintf(tp, "%s%s", devid, topic);
-	return MQTTClient_publish(&mqtt, tp, payload, length, FALSE);
+	// Topic is "<devid><topic>", sent as two segments instead of being formatted
+	TCP_IOVEC tp[2];
+	TCP_IOVEC data;
+	tp[0].buf = GSMGetIMEI();
+	tp[0].len = strlen(tp[0].buf);
+	tp[1].buf = topic;
+	tp[1].len = strlen(topic);
+	data.buf = (char*)payload;
+	data.len = length;
+	return MQTTClient_publishv(&mqtt, tp, 2, &data, 1, qos, FALSE, msgId);
 }
 
 static void mqtt_callback(char* topic, uint8_t* payload, unsigned int length)
@@ -291,23 +322,88 @@ static void mqtt_callback(char* topic, uint8_t* payload, unsigned int length)
 		vTaskSuspend(hModbusTask);
 		do_config((char*)payload, length);
 		if (init)
-			mqtt_send_msg(MQTT_TOPIC_CFG_RSP, (uint8_t*)"OK", 2);
+			mqtt_send_msg(MQTT_TOPIC_CFG_RSP, (uint8_t*)"OK", 2, 0, NULL);
 		else
-			mqtt_send_msg(MQTT_TOPIC_CFG_RSP, (uint8_t*)"ERROR", 5);
+			mqtt_send_msg(MQTT_TOPIC_CFG_RSP, (uint8_t*)"ERROR", 5, 0, NULL);
 		vTaskResume(hModbusTask);
 		return;
 	}
 
 	if (!strcmp(topic + DEVICE_ID_LENGTH, MQTT_TOPIC_UPGRADE)) {
+		// The firmware is downloaded to the SPI flash, wait for the outbox to be left alone
+		outbox_lock();
 		vTaskSuspend(hModbusTask);
 		do_upgrade((char*)payload, length);
 		vTaskResume(hModbusTask);
+		outbox_unlock();
 		return;
 	}
 
 	UARTWrite(1, "Unknown topic!\r\n");
 }
 
+// Called for messages larger than the MQTT buffer, none of our topics accepts them
+static void mqtt_stream(char* topic, unsigned long offset, uint8_t* data, unsigned int length, BOOL final)
+{
+	if (!final)
+		return;
+
+	UARTWrite(1, "Message too large, topic=");
+	UARTWrite(1, topic);
+	UARTWrite(1, "\r\n");
+
+	if (!strcmp(topic + DEVICE_ID_LENGTH, MQTT_TOPIC_CFG_REQ))
+		mqtt_send_msg(MQTT_TOPIC_CFG_RSP, (uint8_t*)"ERROR", 5, 0, NULL);
+}
+
+// Feed batches sent from the outbox, waiting for their PUBACK
+static struct {
+	uint16_t msgId;	// 0 when the entry is free
+	DWORD id;
+	DWORD seq;
+} feedSent[MQTT_MAX_INFLIGHT];
+
+// Sends the next feed batch of the outbox, it stays there until the server acknowledges it.
+// Returns TRUE if a batch was published.
+static BOOL send_feeds()
+{
+	// A whole outbox record, mqtt.buffer may hold a packet still being decoded
+	static BYTE buf[OUTBOX_MAX_RECORD + 4];
+	DWORD id;
+	WORD len;
+	int i;
+
+	for (i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+		if (feedSent[i].msgId == 0)
+			break;
+	}
+	if (i == MQTT_MAX_INFLIGHT)
+		return FALSE;
+	len = outbox_next(&id, buf, sizeof(buf));
+	if (len == 0)
+		return FALSE;
+	// Not accepted (client not ready, no free slot): the record is sent again on the next pass
+	if (mqtt_send_msg(MQTT_TOPIC_FEEDS, buf, len, MQTT_DATA_QOS, &feedSent[i].msgId)) {
+		feedSent[i].id = id;
+		feedSent[i].seq = ((DWORD)buf[0] << 24) | ((DWORD)buf[1] << 16) | ((WORD)buf[2] << 8) | buf[3];
+		outbox_sent(id, feedSent[i].seq);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+static void ack_feeds()
+{
+	int i;
+
+	for (i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+		if (feedSent[i].msgId && MQTTClient_delivered(&mqtt, feedSent[i].msgId)) {
+			outbox_ack(feedSent[i].id, feedSent[i].seq);
+			feedSent[i].msgId = 0;
+		}
+	}
+}
+
 static void led_timer_init()
 {
 	T3CON = 0;  //turn off timer
@@ -360,12 +456,17 @@ void FlyportTask()
 {
 	init = 0;
 	int connected = 0;
+	int i;
 	unsigned long rssi_lastime = 0;
 	unsigned long ad_lastime = 0;
 	char ad_info[80];
-	msg_hdr_t *msg = (msg_hdr_t *)(mqtt.buffer + 50);
+	// Not in mqtt.buffer: it keeps a packet being received between MQTTClient_loop calls
+	static unsigned short msgBuf[(MQTT_MSG_SIZE_MAX + 1) / 2];
+	msg_hdr_t *msg = (msg_hdr_t *)msgBuf;
 
 	SPIFlashInit();
+	// Feeds not acknowledged before the reset are sent again
+	outbox_init();
 	led_timer_init();
 	
 	// Initialize the RS485
@@ -377,7 +478,7 @@ void FlyportTask()
 
 	if (hModbusTask == NULL) {
 		xQueueModbus = xQueueCreate(1, EXTRA_HEAD_ROOM + MB_SER_PDU_SIZE_MAX);
-		xQueueMqtt = xQueueCreate(1, MB_SER_PDU_SIZE_MAX);
+		xQueueMqtt = xQueueCreate(1, MQTT_MSG_SIZE_MAX);
 		// Creates the task dedicated to user code
 		xTaskCreate(TaskModbus,(signed char*) "MODBUS" , (configMINIMAL_STACK_SIZE * 4), 
 			NULL, tskIDLE_PRIORITY + 1, &hModbusTask);	
@@ -403,65 +504,94 @@ void FlyportTask()
 
 	TCPClient_init(&client);
 	MQTTClient_init(&mqtt, MQTT_SERVER, MQTT_PORT, mqtt_callback, &client);
+	MQTTClient_setStream(&mqtt, mqtt_stream);
+	MQTTClient_setProtocol(&mqtt, MQTT_PROTOCOL);
+	// Requests sent while the link is down wait on the server, no resubscription on reconnect
+	MQTTClient_setCleanSession(&mqtt, FALSE);
+
+	char *devid = GSMGetIMEI();
+	static char subTopic[NUM_SUBS][MQTT_MAX_TOPIC_LEN + 1];
+#if MQTT_SUB_WILDCARD
+	static char *subs[NUM_SUBS] = { subTopic[0] };
+	static uint8_t subQos[NUM_SUBS] = { MQTT_DATA_QOS };
+	sprintf(subTopic[0], "%s/#", devid);
+#else
+	static char *subs[NUM_SUBS] = { subTopic[0], subTopic[1], subTopic[2] };
+	// An upgrade resets the gateway before it could be acknowledged, keep it at QoS 0
+	static uint8_t subQos[NUM_SUBS] = { MQTT_DATA_QOS, MQTT_DATA_QOS, 0 };
+	sprintf(subTopic[0], "%s%s", devid, MQTT_TOPIC_CFG_REQ);
+	sprintf(subTopic[1], "%s%s", devid, MQTT_TOPIC_CMD_REQ);
+	sprintf(subTopic[2], "%s%s", devid, MQTT_TOPIC_UPGRADE);
+#endif
+	MQTTClient_setSubscriptions(&mqtt, subs, subQos, NUM_SUBS);
+
+	// clientID, username, MD5 encoded password
+	MQTTClient_connect(&mqtt, devid, MQTT_USER, MQTT_PASS, NULL, 0, 0, NULL);
 
 	while (1) {
-		if (!connected) {
-			init = 0;
-			vTaskDelay(1000);
-			char *devid = GSMGetIMEI();
-	
-			// clientID, username, MD5 encoded password
-			if (!MQTTClient_connect(&mqtt, devid, MQTT_USER, MQTT_PASS, NULL, 0, 0, NULL)) {
-				UARTWrite(1,"Failed connect to mqtt server!\r\n");
-				continue;
+		BOOL sent = FALSE;
+
+		if (!MQTTClient_connected(&mqtt)) {
+			if (connected) {
+				UARTWrite(1,"Lost connection to mqtt server!\r\n");
+				connected = 0;
 			}
+		}
+		else if (!connected) {
 			connected = 1;
+			// Without our session the server has to configure the gateway again
+			if (!mqtt.sessionPresent)
+				init = 0;
 			UARTWrite(1,"Connected to mqtt server!\r\n");
-			
-			char topic[MQTT_MAX_TOPIC_LEN + 1];
-			sprintf(topic, "%s%s", devid, MQTT_TOPIC_CFG_REQ);
-			MQTTClient_subscribe(&mqtt, topic);
 			UARTWrite(1,"Subscribed mqtt topics:\r\n");
-			UARTWrite(1, topic);
-			UARTWrite(1,"\r\n");
-			sprintf(topic, "%s%s", devid, MQTT_TOPIC_CMD_REQ);
-			MQTTClient_subscribe(&mqtt, topic);
-			UARTWrite(1, topic);
-			UARTWrite(1,"\r\n");
-			sprintf(topic, "%s%s", devid, MQTT_TOPIC_UPGRADE);
-			MQTTClient_subscribe(&mqtt, topic);
-			UARTWrite(1, topic);
-			UARTWrite(1,"\r\n");
+			for (i = 0; i < NUM_SUBS; i++) {
+				UARTWrite(1, subs[i]);
+				if (mqtt.subFailed & (1 << i))
+					UARTWrite(1," refused!");
+				UARTWrite(1,"\r\n");
+			}
 		}
 		else if (!init) {
 			if (tickGetSeconds() > (ad_lastime + 30)) {
-				mqtt_send_msg(MQTT_TOPIC_ADVT, (uint8_t*)ad_info, strlen(ad_info));
+				mqtt_send_msg(MQTT_TOPIC_ADVT, (uint8_t*)ad_info, strlen(ad_info), 0, NULL);
 				ad_lastime = tickGetSeconds();
 			}
 		}
 
-		if (xQueueReceive(xQueueMqtt, (void *)msg, 0)) {
-			if (msg->msg_type == MSG_FEED)
-				mqtt_send_msg(MQTT_TOPIC_FEED, (uint8_t*)&msg->feedid, msg->data_len);
-			else
-				mqtt_send_msg(MQTT_TOPIC_CMD_RSP, (uint8_t*)&msg->seqno[0], msg->data_len);
+		ack_feeds();
+
+		// Leave messages queued while the in-flight window is full, QoS 1 messages
+		// taken while reconnecting are sent once the connection is up.
+		// The outbox is drained in order while connected, behind command replies.
+		if (MQTTClient_inflightFree(&mqtt)) {
+			// Only command replies come through the queue, feeds go through the outbox
+			if (xQueueReceive(xQueueMqtt, (void *)msg, 0))
+				sent = mqtt_send_msg(MQTT_TOPIC_CMD_RSP, (uint8_t*)&msg->seqno[0], msg->data_len, MQTT_DATA_QOS, NULL);
+			else if (connected)
+				sent = send_feeds();
 		}
 
-		if (!MQTTClient_loop(&mqtt)) {
-			MQTTClient_disconnect(&mqtt);
-			connected = 0;
-		}
+		// Keeps the connection up, reconnecting as needed
+		MQTTClient_loop(&mqtt);
 
 		if (connected && tickGetSeconds() > (rssi_lastime + 30)) {
 			GSMSignal();
-			while(LastExecStat() == OP_EXECUTION)
-				vTaskDelay(1);
+			LastExecWait(OP_WAIT_FOREVER);
 			char rssi[12];
 			gprs_rssi = GSMGetRSSI();
 			sprintf(rssi, "RSSI:%d\r\n", gprs_rssi);
 			UARTWrite(1, rssi);	
 			rssi_lastime = tickGetSeconds();
 		}
+
+		// Nothing sent and no packet half received, MQTTClient_loop returns at once while waiting
+		// to reconnect: sleep until a command reply is queued, if there is room to send it
+		if (!sent && mqtt.rxState == MQTT_RX_HEADER) {
+			if (MQTTClient_inflightFree(&mqtt))
+				xQueuePeek(xQueueMqtt, (void *)msg, MQTT_IDLE_WAIT / portTICK_RATE_MS);
+			else
+				vTaskDelay(MQTT_IDLE_WAIT / portTICK_RATE_MS);
+		}
 	}
 }
 
@@ -1,8 +1,13 @@
 #include "taskFlyport.h"
 #include "taskModbus.h"
 #include "MQTTClient.h"
+#include "outbox.h"
 #include "mb.h"
 
+#if FEED_BATCH_SIZE > OUTBOX_MAX_RECORD
+#error FEED_BATCH_SIZE does not fit in an outbox record
+#endif
+
 extern xQueueHandle xQueueModbus;
 extern xQueueHandle xQueueMqtt;
 
@@ -25,6 +30,143 @@ static void send_msg(unsigned type, UCHAR *data, unsigned len)
 	xQueueSend(xQueueMqtt, pMsg, portMAX_DELAY);
 }
 
+// Feed batch, stored in the flash outbox when complete whatever the state of the link
+static UCHAR feedBatch[FEED_BATCH_SIZE];
+static unsigned feedBatchLen;
+static unsigned feedBatchRecords;
+static unsigned long feedBatchTime;
+
+static void flush_feeds()
+{
+	if (feedBatchRecords == 0)
+		return;
+	outbox_put(feedBatch, feedBatchLen);
+	feedBatchLen = 0;
+	feedBatchRecords = 0;
+}
+
+#if FEED_DELTA
+// Registers last reported for a feed and slave
+typedef struct feed_last {
+	unsigned short feedId;
+	UCHAR slave;
+	UCHAR count;	// byte count of the registers, 0 when the slot is free
+	UCHAR sinceKey;	// delta reports since the last full one
+	UCHAR regs[FEED_DELTA_REGS * 2];
+} feed_last_t;
+
+static feed_last_t feedLast[FEED_DELTA_SLOTS];
+static UCHAR feedDelta[2 + (FEED_DELTA_REGS + 7) / 8 + FEED_DELTA_REGS * 2];
+
+static feed_last_t *find_last(unsigned short feedId, UCHAR slave)
+{
+	feed_last_t *last = NULL;
+	int i;
+
+	for (i = 0; i < FEED_DELTA_SLOTS; i++) {
+		if (feedLast[i].count == 0) {
+			if (last == NULL)
+				last = &feedLast[i];
+		}
+		else if (feedLast[i].feedId == feedId && feedLast[i].slave == slave) {
+			return &feedLast[i];
+		}
+	}
+	if (last) {
+		last->feedId = feedId;
+		last->slave = slave;
+	}
+	return last;
+}
+
+// Encodes a read registers response as the changes against the last report:
+// function code | FEED_DELTA_FLAG, byte count, bitmap of the changed registers
+// (first register in the lowest bit), then the changed registers.
+// Returns the length of the delta PDU in feedDelta, 0 when the response is reported in full.
+static USHORT delta_pdu(unsigned short feedId, UCHAR *frame, USHORT len)
+{
+	UCHAR func = frame[1];
+	UCHAR count = frame[2];
+	UCHAR *data = frame + 3;
+	UCHAR *map = feedDelta + 2;
+	feed_last_t *last;
+	USHORT dlen = 0;
+	int i;
+
+	if ((func != MB_FUNC_READ_HOLDING_REGISTER && func != MB_FUNC_READ_INPUT_REGISTER) ||
+		len != 3 + count || (count & 1) || count > FEED_DELTA_REGS * 2)
+		return 0;
+	last = find_last(feedId, frame[0]);
+	if (last == NULL)
+		return 0;
+
+	if (last->count == count && last->sinceKey < FEED_KEYFRAME_INTERVAL) {
+		feedDelta[0] = func | FEED_DELTA_FLAG;
+		feedDelta[1] = count;
+		memset(map, 0, (count / 2 + 7) / 8);
+		dlen = 2 + (count / 2 + 7) / 8;
+		for (i = 0; i < count; i += 2) {
+			if (data[i] != last->regs[i] || data[i + 1] != last->regs[i + 1]) {
+				map[i / 16] |= 1 << ((i / 2) % 8);
+				feedDelta[dlen++] = data[i];
+				feedDelta[dlen++] = data[i + 1];
+			}
+		}
+		// Not worth it when most registers changed
+		if (dlen >= len - 1)
+			dlen = 0;
+	}
+
+	memcpy(last->regs, data, count);
+	last->count = count;
+	if (dlen)
+		last->sinceKey++;
+	else
+		last->sinceKey = 0;
+	return dlen;
+}
+#endif
+
+// Called when the poll configuration changes, the next reports are full ones
+void reset_feeds()
+{
+#if FEED_DELTA
+	int i;
+
+	for (i = 0; i < FEED_DELTA_SLOTS; i++)
+		feedLast[i].count = 0;
+#endif
+}
+
+// frame holds the slave address followed by the response PDU
+static void add_feed(unsigned short feedId, UCHAR *frame, USHORT len)
+{
+	UCHAR *rec;
+	UCHAR *pdu = frame + 1;
+	USHORT pduLen = len - 1;
+
+#if FEED_DELTA
+	USHORT dlen = delta_pdu(feedId, frame, len);
+	if (dlen) {
+		pdu = feedDelta;
+		pduLen = dlen;
+	}
+#endif
+	if (feedBatchLen + 4 + pduLen > FEED_BATCH_SIZE)
+		flush_feeds();
+	if (feedBatchRecords == 0)
+		feedBatchTime = tickGetSeconds();
+	rec = feedBatch + feedBatchLen;
+	rec[0] = feedId >> 8;
+	rec[1] = feedId & 0xFF;
+	rec[2] = frame[0];
+	rec[3] = pduLen;
+	memcpy(rec + 4, pdu, pduLen);
+	feedBatchLen += 4 + pduLen;
+	if (++feedBatchRecords >= FEED_BATCH_RECORDS)
+		flush_feeds();
+}
+
 static eMBErrorCode poll_slave(UCHAR slaveid, poll_cfg_t *task)
 {
 	eMBErrorCode eStatus;
@@ -35,10 +177,8 @@ static eMBErrorCode poll_slave(UCHAR slaveid, poll_cfg_t *task)
 	eStatus = eMBMReadRegisters(slaveid, task->funCode, task->regStart, task->nRegs, &ucRcvFrame, &usLength);
 	
 	if(eStatus == MB_ENOERR || eStatus == MB_ENOREG) {
-		UCHAR *data = ucRcvFrame - 2;
-		*((unsigned short *)data) = Swap2Bytes(task->feedId);
 		UARTWrite(1, "Replied\r\n");
-		send_msg(MSG_FEED, data, 2 + usLength);
+		add_feed(task->feedId, ucRcvFrame, usLength);
 	}
 	else {
 		char errmsg[25];
@@ -108,6 +248,8 @@ void TaskModbus()
 
 		if (init) {
 			do_poll();
+			if (feedBatchRecords && tickGetSeconds() - feedBatchTime >= FEED_BATCH_DELAY)
+				flush_feeds();
 		}
 
 		vTaskDelay(1);
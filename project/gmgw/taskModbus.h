@@ -5,8 +5,51 @@
 #define MAX_NUM_SLAVES 16
 #define MAX_NUM_POLL_TASKS 10
 
+// Size of a command reply passed to FlyportTask: header, seqno and a Modbus RTU frame
+#define MQTT_MSG_SIZE_MAX (4 + 2 + 256)
+
+// Poll results are packed into one feed batch, stored in the outbox when it holds FEED_BATCH_SIZE
+// bytes, FEED_BATCH_RECORDS records or its first record is FEED_BATCH_DELAY seconds old.
+// A batch is sent with its 4 bytes sequence number in front.
+#ifndef FEED_BATCH_SIZE
+#define FEED_BATCH_SIZE (MQTT_MSG_SIZE_MAX - 4)
+#endif
+
+#ifndef FEED_BATCH_RECORDS
+#define FEED_BATCH_RECORDS 8
+#endif
+
+#ifndef FEED_BATCH_DELAY
+#define FEED_BATCH_DELAY 5
+#endif
+
+#if FEED_BATCH_SIZE > MQTT_MSG_SIZE_MAX - 4
+#error FEED_BATCH_SIZE does not fit in a message
+#endif
+
+// 1: registers read by a poll are reported as changes against the last report of the feed
+// and slave, with a full report every FEED_KEYFRAME_INTERVAL reports. The last values are
+// kept for FEED_DELTA_SLOTS feeds and slaves of up to FEED_DELTA_REGS registers.
+#ifndef FEED_DELTA
+#define FEED_DELTA 0
+#endif
+
+#ifndef FEED_DELTA_SLOTS
+#define FEED_DELTA_SLOTS 8
+#endif
+
+#ifndef FEED_DELTA_REGS
+#define FEED_DELTA_REGS 32
+#endif
+
+#ifndef FEED_KEYFRAME_INTERVAL
+#define FEED_KEYFRAME_INTERVAL 10
+#endif
+
+// Set in the function code of a delta report
+#define FEED_DELTA_FLAG 0x40
+
 enum {
-	MSG_FEED,
 	MSG_CMD_REQ,
 	MSG_CMD_RSP,
 };
@@ -14,10 +57,7 @@ enum {
 typedef struct msg_hdr {
 	unsigned short msg_type;
 	unsigned short data_len;
-	union {
-		unsigned short feedid;
-		unsigned char seqno[2];
-	};
+	unsigned char seqno[2];
 } msg_hdr_t;
 
 typedef struct poll_cfg {
@@ -43,6 +83,7 @@ typedef struct sys_config {
 } sys_config_t;
 
 extern void TaskModbus();
+extern void reset_feeds();
 
 #endif
 
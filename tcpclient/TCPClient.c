@@ -1,6 +1,10 @@
 #include "TCPClient.h"
 #include "hilo.h"
 #include "GSMData.h"
+#if TCP_PPP
+#include "PPP.h"
+#include "TCPIP.h"
+#endif
 
 extern GSMModule mainGSM;
 extern int mainGSMStateMachine;
@@ -13,6 +17,12 @@ void TCPClient_init(TCPClient_t *this)
 	this->size = 0;
 	this->idx = 0;
 	this->tick = tickGetSeconds();
+#if TCP_TX_BUF_SIZE > 0
+	this->txLen = 0;
+#endif
+#if TCP_STREAM
+	this->stream = FALSE;
+#endif
 }
 
 static inline void RequestReset()
@@ -27,8 +37,12 @@ static inline BOOL ModuleOnReset()
 
 static void TCPHandleError(TCPClient_t *this)
 {
-	if (mainGSMStateMachine == SM_GSM_HW_FAULT)
+	if (mainGSMStateMachine == SM_GSM_HW_FAULT) {
 		this->sock.number = INVALID_SOCKET;
+#if TCP_STREAM
+		this->stream = FALSE;
+#endif
+	}
 	else
 		TCPClient_stop(this);
 }
@@ -38,45 +52,405 @@ static inline BOOL TCPInvalidSocket(TCPClient_t *this)
 	return (this->sock.number == INVALID_SOCKET);
 }
 
+/*
+* Returns the size of the free span after the buffered bytes, that starts at *end.
+*/
+static int TCPFreeSpan(TCPClient_t *this, uint16_t *end)
+{
+	*end = this->idx + this->size;
+	if (*end >= TCP_MAX_BUF_SIZE)
+		*end -= TCP_MAX_BUF_SIZE;
+	if (*end < this->idx || this->size == TCP_MAX_BUF_SIZE)
+		return this->idx - *end;
+	return TCP_MAX_BUF_SIZE - *end;
+}
+
+#if TCP_STREAM
+static const char noCarrier[] = "\r\nNO CARRIER\r\n";
+
+/*
+* Returns how many of the last bytes of the module buffer are the beginning of NO CARRIER,
+* sizeof(noCarrier) - 1 if they are all of it.
+*/
+static int TCPStreamTail(int avail)
+{
+	char tail[sizeof(noCarrier) - 1];
+	int n = sizeof(tail);
+
+	if (n > avail)
+		n = avail;
+	for (; n > 0; n--) {
+		if (TCPStreamPeek(avail - n, n, tail) && memcmp(tail, noCarrier, n) == 0)
+			return n;
+	}
+	return 0;
+}
+
+/*
+* Transparent mode: moves the bytes received by the module straight from the stream buffer
+* (the UART ring, or the data channel with GSM_CMUX) into the free span. Bytes that may be the NO CARRIER sent by the module when the server
+* closes are held back, until TCP_STREAM_HOLD_MS passed without more bytes.
+* Returns the number of bytes buffered, -1 if the connection is closed and the buffer empty.
+*/
+static int TCPStreamCheck(TCPClient_t *this)
+{
+	int avail, hold, room, n;
+	uint16_t end;
+
+	avail = TCPStreamSize();
+	if (avail < 0) {
+		// The module was reset
+		this->stream = FALSE;
+		this->sock.number = INVALID_SOCKET;
+		return (this->size > 0) ? this->size : -1;
+	}
+
+	hold = TCPStreamTail(avail);
+	if (hold > 0 && hold < sizeof(noCarrier) - 1) {
+		if (avail != this->holdAvail) {
+			this->holdAvail = avail;
+			this->holdTick = xTaskGetTickCount();
+		}
+		else if ((portTickType)(xTaskGetTickCount() - (portTickType)this->holdTick) >= TCP_STREAM_HOLD_MS / portTICK_RATE_MS)
+			hold = 0;
+	}
+
+	room = TCPFreeSpan(this, &end);
+	n = avail - hold;
+	if (n > room)
+		n = room;
+	if (n > 0) {
+		this->size += TCPStreamRead(this->buff + end, n);
+		avail -= n;
+	}
+	this->holdAvail = avail;
+
+	// The module is back in command mode once the server closed
+	if (hold == sizeof(noCarrier) - 1 && avail == hold) {
+		UARTWrite(1, "Connection closed by the server\r\n");
+#if TCP_TX_BUF_SIZE > 0
+		this->txLen = 0;
+#endif
+		TCPClient_stop(this);
+		return (this->size > 0) ? this->size : -1;
+	}
+	return this->size;
+}
+#endif
+
+#if TCP_PPP
+/*
+* Port of PPP.c: the data channel of the call opened by TCPStreamDial, and the tick count.
+*/
+int PPPPortRead(BYTE *buf, int len)
+{
+	int n = TCPStreamRead((char*)buf, len);
+	return (n > 0) ? n : 0;
+}
+
+void PPPPortWrite(const BYTE *buf, int len)
+{
+	TCPStreamWrite((char*)buf, len);
+}
+
+DWORD PPPPortMillis(void)
+{
+	return xTaskGetTickCount() * portTICK_RATE_MS;
+}
+
+/*
+* Runs the link, dropped at once when the module lost the call.
+*/
+static void TCPPPPPoll(void)
+{
+	if (PPPPhase() != PPP_DEAD && TCPStreamSize() < 0)
+		PPPAbort();
+	PPPPoll();
+}
+
+static inline BOOL TCPPPPExpired(portTickType start)
+{
+	return ((portTickType)(xTaskGetTickCount() - start) >= TCP_PPP_TIMEOUT_MS / portTICK_RATE_MS);
+}
+
+static void TCPPPPHangUp(void)
+{
+	if (TCPStreamSize() < 0)
+		return;
+	TCPStreamStop(NULL);
+	if (LastExecWait(OP_WAIT_FOREVER) != OP_SUCCESS)
+		UARTWrite(1, "Errors on TCPStreamStop!\r\n");
+}
+
+/*
+* Dials the packet data call and negotiates PPP over it, unless the link is already up.
+*/
+static BOOL TCPPPPLink(void)
+{
+	portTickType start;
+
+	TCPPPPPoll();
+	if (PPPPhase() == PPP_RUNNING)
+		return TRUE;
+
+	// A call left by a link that went down is hung up first
+	if (PPPPhase() == PPP_DEAD)
+		TCPPPPHangUp();
+
+	if (TCPStreamSize() < 0) {
+		if (ModuleOnReset()) {
+			UARTWrite(1, "GPRS hardware not ready\r\n");
+			return FALSE;
+		}
+		if ((LastConnStatus() != REG_SUCCESS) && (LastConnStatus() != ROAMING)) {
+			UARTWrite(1, "Wait for GPRS Connection\r\n");
+			return FALSE;
+		}
+		UARTWrite(1, "Dialing PPP...\r\n");
+		TCPStreamDial("cmnet");
+		LastExecWait(OP_WAIT_FOREVER);
+		if (TCPStreamSize() < 0) {
+			UARTWrite(1, "Errors on TCPStreamDial function!\r\n");
+			return FALSE;
+		}
+	}
+
+	PPPOpen();
+	start = xTaskGetTickCount();
+	while (PPPPhase() != PPP_RUNNING) {
+		if (PPPPhase() == PPP_DEAD || TCPPPPExpired(start)) {
+			UARTWrite(1, "PPP negotiation failed\r\n");
+			PPPAbort();
+			TCPPPPHangUp();
+			return FALSE;
+		}
+		vTaskDelay(1);
+		TCPPPPPoll();
+	}
+	UARTWrite(1, "PPP link up\r\n");
+	return TRUE;
+}
+
+/*
+* Resolves the server and connects to it on the IP stack, once the link is up.
+*/
+static BOOL TCPPPPOpen(TCPClient_t *this, char *server, uint16_t port)
+{
+	portTickType start;
+	DWORD addr;
+	int s, res;
+
+	if (!TCPPPPLink())
+		return FALSE;
+
+	UARTWrite(1, "Connecting to TCP Server...\r\n");
+	start = xTaskGetTickCount();
+	if (!TCPIPResolve(server)) {
+		UARTWrite(1, "Errors on TCPIPResolve function!\r\n");
+		return FALSE;
+	}
+	while ((res = TCPIPResolved(&addr)) == 0 && !TCPPPPExpired(start)) {
+		vTaskDelay(1);
+		TCPPPPPoll();
+	}
+	if (res != 1) {
+		UARTWrite(1, "Server name not resolved!\r\n");
+		return FALSE;
+	}
+
+	s = TCPIPConnect(addr, port);
+	if (s < 0) {
+		UARTWrite(1, "TCPIPConnect Failed!\r\n");
+		return FALSE;
+	}
+	while (TCPIPState(s) == TCPIP_CONNECTING && !TCPPPPExpired(start)) {
+		vTaskDelay(1);
+		TCPPPPPoll();
+	}
+	if (TCPIPState(s) != TCPIP_CONNECTED) {
+		TCPIPAbort(s);
+		UARTWrite(1, "TCPIPConnect Failed!\r\n");
+		return FALSE;
+	}
+	this->sock.number = s;
+
+	UARTWrite(1, "\r\nTCPClientOpen OK \r\n");
+	UARTWrite(1, "Socket Number: ");
+	sprintf(this->tmp, "%d\r\n", this->sock.number);
+	UARTWrite(1, this->tmp);
+	return TRUE;
+}
+
+/*
+* Moves the bytes received by the IP stack into the free span (both parts, when it wraps).
+* Returns the number of bytes buffered, -1 if the connection is closed and the buffer empty.
+*/
+static int TCPPPPCheck(TCPClient_t *this)
+{
+	int s = this->sock.number;
+	int room, n, state;
+	uint16_t end;
+
+	TCPPPPPoll();
+	while ((room = TCPFreeSpan(this, &end)) > 0 && (n = TCPIPRecv(s, (BYTE*)this->buff + end, room)) > 0)
+		this->size += n;
+
+	state = TCPIPState(s);
+	if (state == TCPIP_CLOSED || (state == TCPIP_PEER_CLOSED && TCPIPRecvSize(s) == 0)) {
+		UARTWrite(1, "Connection closed by the server\r\n");
+#if TCP_TX_BUF_SIZE > 0
+		this->txLen = 0;
+#endif
+		TCPIPClose(s);
+		this->sock.number = INVALID_SOCKET;
+		return (this->size > 0) ? this->size : -1;
+	}
+	return this->size;
+}
+#endif
+
+/*
+* Fetches the data waiting in the module into the free span after the buffered bytes.
+* Data is fetched as soon as the span can take all of it (up to TCP_MAX_READ), or when
+* the buffer is empty, so that every AT+KTCPSTAT/AT+KTCPRCV exchange brings as much as it can.
+* Returns the number of bytes buffered, -1 if the socket is closed and the buffer empty.
+*/
 static int TCPCheckStatus(TCPClient_t *this)
 {
-	int len = 0;
+#if !TCP_PPP
+	int len, room;
+	uint16_t end;
+#endif
 
-	if (this->size > 0)
-		return this->size;
+#if TCP_TX_BUF_SIZE > 0
+	// Buffered writes are sent once they waited TCP_TX_DELAY_MS
+	if (this->txLen > 0 && (portTickType)(xTaskGetTickCount() - (portTickType)this->txTick) >= TCP_TX_DELAY_MS / portTICK_RATE_MS)
+		TCPClient_push(this);
+#endif
 
 	if (TCPInvalidSocket(this))
-		return -1;
-
+		return (this->size > 0) ? this->size : -1;
+#if TCP_STREAM
+	if (this->stream)
+		return TCPStreamCheck(this);
+#endif
+#if TCP_PPP
+	return TCPPPPCheck(this);
+#else
 	len = this->sock.rxLen;
+	if (len <= 0)
+		return this->size;
+	if (len > TCP_MAX_READ)
+		len = TCP_MAX_READ;
+
+	room = TCPFreeSpan(this, &end);
+	if (len > room) {
+		if (this->size > 0)
+			return this->size;
+		len = room;
+	}
+
+	sprintf(this->tmp, "RxLen:%d\r\n", len);
+	UARTWrite(1, this->tmp);
+
+	TCPRead(&this->sock, this->buff + end, len);
 	
-	if (len > 0) {
-		sprintf(this->tmp, "RxLen:%d\r\n", len);
-		UARTWrite(1, this->tmp);
+	if(LastExecWait(OP_WAIT_FOREVER) != OP_SUCCESS)
+	{
+		UARTWrite(1, "Errors on reading TCP buffer!\r\n");	
+		TCPHandleError(this);
+		return -1;
+	}
 
-		if (len > TCP_MAX_BUF_SIZE)
-			len = TCP_MAX_BUF_SIZE;
-		TCPRead(&this->sock, this->buff, len);
-		
-		while(LastExecStat() == OP_EXECUTION)
-			vTaskDelay(1);
-		if(LastExecStat() != OP_SUCCESS)
-		{
-			UARTWrite(1, "Errors on reading TCP buffer!\r\n");	
-			TCPHandleError(this);
-			return -1;
-		}
+	this->size += TCPReadCount();
+	return this->size;
+#endif
+}
 
-		this->size = len;
-		this->idx = 0;
+/**
+* Makes one attempt to connect to a specified IP address and port, without
+* waiting for the GPRS link. The module is reset when no attempt succeeded
+* for 10 minutes since TCPClient_init.
+* With TCP_STREAM, the socket is then switched to transparent mode.
+* With TCP_PPP, the call is dialed first if needed, and the connection made on the IP stack.
+* The return value indicates success or failure, the caller retries later. 
+*/
+BOOL TCPClient_open(TCPClient_t *this, char *server, uint16_t port)
+{
+	this->sock.number = INVALID_SOCKET;
+	this->size = 0;
+	this->idx = 0;
+#if TCP_TX_BUF_SIZE > 0
+	this->txLen = 0;
+#endif
+#if TCP_STREAM
+	this->stream = FALSE;
+#endif
+
+	if ((tickGetSeconds() - this->tick) > 600) {
+		this->tick = tickGetSeconds();
+		RequestReset();
+	}
+#if TCP_PPP
+	// The module is checked when dialing, the call may already be up
+	return TCPPPPOpen(this, server, port);
+#else
+	if (ModuleOnReset()) {
+		UARTWrite(1, "GPRS hardware not ready\r\n");
+		return FALSE;
+	}
+	if ((LastConnStatus() != REG_SUCCESS) && (LastConnStatus() != ROAMING)) {
+		UARTWrite(1, "Wait for GPRS Connection\r\n");
+		return FALSE;
 	}
 	
-	return len;
+	UARTWrite(1, "\r\nSetup APN params\r\n");
+	APNConfig("cmnet", "", "", DYNAMIC_IP, DYNAMIC_IP, DYNAMIC_IP);
+	
+	if(LastExecWait(OP_WAIT_FOREVER) != OP_SUCCESS) {
+		UARTWrite(1, "Errors on APNConfig function!\r\n");	
+		return FALSE;
+	}
+	
+	UARTWrite(1, "Connecting to TCP Server...\r\n");
+	sprintf(this->tmp, "%d", port);
+	TCPClientOpen(&this->sock, server, this->tmp);
+	
+	if(LastExecWait(OP_WAIT_FOREVER) != OP_SUCCESS)
+	{
+		UARTWrite(1, "Errors on TCPClientOpen function!\r\n");	
+		return FALSE;
+	}
+	else if (TCPInvalidSocket(this))
+	{
+		UARTWrite(1, "TCPClientOpen Failed!\r\n");	
+		return FALSE;
+	}
+
+	UARTWrite(1, "\r\nTCPClientOpen OK \r\n");
+	UARTWrite(1, "Socket Number: ");
+	sprintf(this->tmp, "%d\r\n", this->sock.number);
+	UARTWrite(1, this->tmp);
+
+#if TCP_STREAM
+	TCPStreamStart(&this->sock);
+	LastExecWait(OP_WAIT_FOREVER);
+	if (TCPStreamSize() < 0) {
+		UARTWrite(1, "Errors on TCPStreamStart function!\r\n");
+		TCPHandleError(this);
+		return FALSE;
+	}
+	this->stream = TRUE;
+	this->holdAvail = 0;
+#endif
+	return TRUE;
+#endif
 }
 
 /**
 * Connects to a specified IP address and port. 
 * Also supports DNS lookups when using a domain name.
+* Retries until the connection succeeds.
 * The return value indicates success or failure. 
 */
 BOOL TCPClient_connect(TCPClient_t *this, char *server, uint16_t port)
@@ -86,77 +460,60 @@ BOOL TCPClient_connect(TCPClient_t *this, char *server, uint16_t port)
 	while (1) 
 	{
 		vTaskDelay(200);
-		if ((tickGetSeconds() - this->tick) > 600) {
-			this->tick = tickGetSeconds();
-			RequestReset();
-		}
-		if (ModuleOnReset()) {
-			UARTWrite(1, "GPRS hardware not ready\r\n");
-			continue;
-		}
-	    if ((LastConnStatus() != REG_SUCCESS) && (LastConnStatus() != ROAMING)) {
-			UARTWrite(1, "Wait for GPRS Connection\r\n");
-	    	continue;
-	    }
-		
-		UARTWrite(1, "\r\nSetup APN params\r\n");
-		APNConfig("cmnet", "", "", DYNAMIC_IP, DYNAMIC_IP, DYNAMIC_IP);
-		
-		while(LastExecStat() == OP_EXECUTION)
-			vTaskDelay(1);
-		if(LastExecStat() != OP_SUCCESS) {
-			UARTWrite(1, "Errors on APNConfig function!\r\n");	
-			continue;
-		}
-		
-		UARTWrite(1, "Connecting to TCP Server...\r\n");
-		sprintf(this->tmp, "%d", port);
-		this->sock.number = INVALID_SOCKET;
-		TCPClientOpen(&this->sock, server, this->tmp);
-		
-		while(LastExecStat() == OP_EXECUTION)
-			vTaskDelay(1);
-		if(LastExecStat() != OP_SUCCESS)
-		{
-			UARTWrite(1, "Errors on TCPClientOpen function!\r\n");	
-			continue;
-		}
-		else if (!TCPInvalidSocket(this))
-		{
-			UARTWrite(1, "\r\nTCPClientOpen OK \r\n");
-			UARTWrite(1, "Socket Number: ");
-			sprintf(this->tmp, "%d\r\n", this->sock.number);
-			UARTWrite(1, this->tmp);
+		if (TCPClient_open(this, server, port))
 			break;
-		}
-		else {
-			UARTWrite(1, "TCPClientOpen Failed!\r\n");	
-			continue;			
-		}
 	}
 	
 	return TRUE;
 }
 
 /**
-* Disconnect from the server.
+* Disconnect from the server, after sending the buffered writes.
 */
 void TCPClient_stop(TCPClient_t *this)
 {
 	if (TCPInvalidSocket(this))
 		return;
 	
+	TCPClient_push(this);
+	if (TCPInvalidSocket(this))
+		return;
+
+#if TCP_PPP
+	// The FIN follows the data queued, the IP stack finishes the close while the link is polled
+	UARTWrite(1, "Closing socket...\r\n");
+	TCPIPClose(this->sock.number);
+	TCPPPPPoll();
+	UARTWrite(1, "Socket Closed\r\n");
+	this->sock.number = INVALID_SOCKET;
+#else
+#if TCP_STREAM
+	// Back to command mode, to close the socket
+	if (this->stream) {
+		this->stream = FALSE;
+		if (TCPStreamSize() < 0) {
+			this->sock.number = INVALID_SOCKET;
+			return;
+		}
+		TCPStreamStop(&this->sock);
+		if (LastExecWait(OP_WAIT_FOREVER) != OP_SUCCESS) {
+			UARTWrite(1, "Errors on TCPStreamStop!\r\n");
+			this->sock.number = INVALID_SOCKET;
+			return;
+		}
+	}
+#endif
+
 	UARTWrite(1, "Closing socket...\r\n");
 	TCPClientClose(&this->sock);
 	
-	while(LastExecStat() == OP_EXECUTION)
-		vTaskDelay(1);
-	if(LastExecStat() != OP_SUCCESS)
+	if(LastExecWait(OP_WAIT_FOREVER) != OP_SUCCESS)
 		UARTWrite(1, "Errors on TCPClientClose!\r\n");	
 	else
 		UARTWrite(1, "Socket Closed\r\n"); 
 
 	this->sock.number = INVALID_SOCKET;
+#endif
 }
 
 /**
@@ -177,15 +534,72 @@ int TCPClient_available(TCPClient_t *this)
 */
 int TCPClient_write(TCPClient_t *this, uint8_t *buf, int len)
 {
-	if (TCPInvalidSocket(this))
-		return 0;
+	TCP_IOVEC iov;
+	iov.buf = (char*)buf;
+	iov.len = len;
+	return TCPClient_writev(this, &iov, 1);
+}
+
+// Sends a list of buffers with one AT+KTCPSND
+static int TCPSendV(TCPClient_t *this, TCP_IOVEC *iov, int iovcnt)
+{
+	int i, len = 0;
+#if TCP_PPP
+	portTickType start;
+	char *buf;
+	int left, n;
+#endif
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].len;
+
+#if TCP_PPP
+	// The buffers are queued on the connection, as fast as the server acknowledges them
+	for (i = 0; i < iovcnt; i++) {
+		buf = iov[i].buf;
+		left = iov[i].len;
+		start = xTaskGetTickCount();
+		while (left > 0) {
+			n = TCPIPSend(this->sock.number, (BYTE*)buf, left);
+			buf += n;
+			left -= n;
+			if (n > 0)
+				start = xTaskGetTickCount();
+			else if (TCPIPSendSpace(this->sock.number) == 0 && ((TCPIPState(this->sock.number) != TCPIP_CONNECTED
+					&& TCPIPState(this->sock.number) != TCPIP_PEER_CLOSED) || TCPPPPExpired(start))) {
+				UARTWrite(1, "Errors sending TCP data!\r\n");
+				TCPHandleError(this);
+				return 0;
+			}
+			if (left > 0) {
+				TCPIPFlush(this->sock.number);
+				vTaskDelay(1);
+				TCPPPPPoll();
+			}
+		}
+	}
+	TCPIPFlush(this->sock.number);
+	return len;
+#endif
+
+#if TCP_STREAM
+	// Transparent mode: the buffers go straight to the UART
+	if (this->stream) {
+		for (i = 0; i < iovcnt; i++) {
+			if (TCPStreamWrite(iov[i].buf, iov[i].len) < 0) {
+				UARTWrite(1, "Errors sending TCP data!\r\n");
+				TCPHandleError(this);
+				return 0;
+			}
+		}
+		return len;
+	}
+#endif
 
 	UARTWrite(1, "Sending data...\r\n");
-	TCPWrite(&this->sock, (char*)buf, len);
+	TCPWriteV(&this->sock, iov, iovcnt);
 	
-	while(LastExecStat() == OP_EXECUTION)
-		vTaskDelay(1);
-	if(LastExecStat() != OP_SUCCESS)
+	if(LastExecWait(OP_WAIT_FOREVER) != OP_SUCCESS)
 	{
 		UARTWrite(1, "Errors sending TCP data!\r\n");	
 		TCPHandleError(this);
@@ -199,13 +613,90 @@ int TCPClient_write(TCPClient_t *this, uint8_t *buf, int len)
 	return len;
 }
 
+/**
+* Write a list of buffers to the server as one send operation, without copying them first.
+* With TCP_TX_BUF_SIZE, writes that fit are gathered in the write-combining buffer instead and
+* sent together when it is full, after TCP_TX_DELAY_MS (checked by TCPClient_available and
+* TCPClient_connected), with the next write too large for it, or by TCPClient_push.
+* Returns the total number of bytes written. 
+*/
+int TCPClient_writev(TCPClient_t *this, TCP_IOVEC *iov, int iovcnt)
+{
+#if TCP_TX_BUF_SIZE > 0
+	TCP_IOVEC seg[TCP_TX_MAX_IOV + 1];
+	int i, len = 0;
+#endif
+
+	if (TCPInvalidSocket(this))
+		return 0;
+
+#if TCP_TX_BUF_SIZE > 0
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].len;
+
+	if (this->txLen + len <= TCP_TX_BUF_SIZE) {
+		if (this->txLen == 0)
+			this->txTick = xTaskGetTickCount();
+		for (i = 0; i < iovcnt; i++) {
+			memcpy(this->txBuff + this->txLen, iov[i].buf, iov[i].len);
+			this->txLen += iov[i].len;
+		}
+		if (this->txLen == TCP_TX_BUF_SIZE && !TCPClient_push(this))
+			return 0;
+		return len;
+	}
+
+	// The buffered writes go first, in the same send operation when possible
+	if (this->txLen > 0 && iovcnt <= TCP_TX_MAX_IOV) {
+		seg[0].buf = this->txBuff;
+		seg[0].len = this->txLen;
+		memcpy(seg + 1, iov, iovcnt * sizeof(TCP_IOVEC));
+		this->txLen = 0;
+		return (TCPSendV(this, seg, iovcnt + 1) > 0) ? len : 0;
+	}
+	if (!TCPClient_push(this))
+		return 0;
+#endif
+	return TCPSendV(this, iov, iovcnt);
+}
+
+/**
+* Sends the writes waiting in the write-combining buffer now.
+* Returns false if sending failed.
+*/
+BOOL TCPClient_push(TCPClient_t *this)
+{
+#if TCP_TX_BUF_SIZE > 0
+	TCP_IOVEC iov;
+
+	if (this->txLen == 0)
+		return TRUE;
+	iov.buf = this->txBuff;
+	iov.len = this->txLen;
+	this->txLen = 0;
+	if (TCPInvalidSocket(this))
+		return FALSE;
+	return (TCPSendV(this, &iov, 1) > 0);
+#else
+	return TRUE;
+#endif
+}
+
+/**
+* Reads up to len bytes of incoming data available.
+* Returns the number of bytes read.
+*/
 int TCPClient_read(TCPClient_t *this, uint8_t *buf, int len)
 {
-	int nbytes = (this->size > len) ? len : this->size;
-	if (nbytes > 0) {
-		memcpy(buf, this->buff + this->idx, nbytes);
-		this->size -= nbytes;
-		this->idx += nbytes;
+	uint8_t *span;
+	int n, nbytes = 0;
+
+	while (nbytes < len && (n = TCPClient_peek(this, &span)) > 0) {
+		if (n > len - nbytes)
+			n = len - nbytes;
+		memcpy(buf + nbytes, span, n);
+		TCPClient_skip(this, n);
+		nbytes += n;
 	}
 	return nbytes;
 }
@@ -217,13 +708,42 @@ int TCPClient_readByte(TCPClient_t *this)
 {
 	if (this->size > 0) {
 		uint8_t b = this->buff[this->idx];
-		this->size--;
-		this->idx++;
+		TCPClient_skip(this, 1);
 		return b;
 	}
 	return -1;
 }
 
+/**
+* Points buf at the incoming data available, without copying it. The data may wrap around
+* the end of the buffer, the rest is returned once TCPClient_skip consumed this part.
+* Returns the number of bytes buf points at.
+*/
+int TCPClient_peek(TCPClient_t *this, uint8_t **buf)
+{
+	int n = TCP_MAX_BUF_SIZE - this->idx;
+	if (n > this->size)
+		n = this->size;
+	*buf = (uint8_t*)this->buff + this->idx;
+	return n;
+}
+
+/**
+* Discards len bytes of incoming data available, typically after TCPClient_peek.
+*/
+void TCPClient_skip(TCPClient_t *this, int len)
+{
+	if (len > this->size)
+		len = this->size;
+	this->size -= len;
+	this->idx += len;
+	if (this->idx >= TCP_MAX_BUF_SIZE)
+		this->idx -= TCP_MAX_BUF_SIZE;
+	// Start over at the beginning, the next read from the module gets the whole buffer
+	if (this->size == 0)
+		this->idx = 0;
+}
+
 /**
 * Whether or not the client is connected. 
 * Note that a client is considered connected if the connection has been closed but there is still unread data.
@@ -249,10 +769,19 @@ void TCPClient_flush(TCPClient_t *this)
 	if (TCPInvalidSocket(this))
 		return;
 
+#if TCP_STREAM
+	if (this->stream) {
+		TCPStreamFlush();
+		return;
+	}
+#endif
+#if TCP_PPP
+	TCPIPRecv(this->sock.number, NULL, TCPIPRecvSize(this->sock.number));
+	return;
+#endif
+
 	TCPRxFlush(&this->sock);
-	while(LastExecStat() == OP_EXECUTION)
-		vTaskDelay(1);
-	if(LastExecStat() != OP_SUCCESS)
+	if(LastExecWait(OP_WAIT_FOREVER) != OP_SUCCESS)
 	{
 		UARTWrite(1, "Errors flush socket rx buffer!\r\n");	
 		TCPHandleError(this);
@@ -10,8 +10,55 @@ typedef unsigned long uint32_t;
 
 #define tickGetSeconds TickGetDiv64K
 
+// TCP_MAX_BUF_SIZE : Size of the circular receive buffer
 #ifndef TCP_MAX_BUF_SIZE
-#define TCP_MAX_BUF_SIZE 512
+#define TCP_MAX_BUF_SIZE 1460
+#endif
+
+// TCP_MAX_READ : Largest read from the module (AT+KTCPRCV)
+#define TCP_MAX_READ 1460
+
+// TCP_TX_BUF_SIZE : Size of the write-combining buffer, 0 sends every write on its own
+#ifndef TCP_TX_BUF_SIZE
+#define TCP_TX_BUF_SIZE 0
+#endif
+
+// TCP_TX_DELAY_MS : Longest time a write waits in the write-combining buffer, in milliseconds
+#ifndef TCP_TX_DELAY_MS
+#define TCP_TX_DELAY_MS 50
+#endif
+
+// TCP_TX_MAX_IOV : Maximum number of segments of a write sent along with the buffered writes
+#ifndef TCP_TX_MAX_IOV
+#define TCP_TX_MAX_IOV 8
+#endif
+
+// TCP_STREAM : 1 keeps the connected socket in the module transparent mode (TCPStreamStart),
+// so that the data goes over the UART without the AT+KTCPSND/AT+KTCPRCV exchanges
+// (with GSM_CMUX on a channel of its own, the other GSM commands keep working meanwhile)
+#ifndef TCP_STREAM
+#define TCP_STREAM 0
+#endif
+
+// TCP_STREAM_HOLD_MS : Longest time received bytes that may start a NO CARRIER are held back, in milliseconds
+#ifndef TCP_STREAM_HOLD_MS
+#define TCP_STREAM_HOLD_MS 20
+#endif
+
+// TCP_PPP : 1 runs the sockets on the IP stack of ppp/ (TCPIP.h), over a packet data call of the module
+// (TCPStreamDial) instead of its own sockets: up to TCPIP_SOCKETS connections, with TCP windowing and
+// no AT command for their data. The call stays up once dialed. The clients are used from one task.
+#ifndef TCP_PPP
+#define TCP_PPP 0
+#endif
+
+// TCP_PPP_TIMEOUT_MS : Longest time for the PPP negotiation, for connecting, and for a write to get room, in milliseconds
+#ifndef TCP_PPP_TIMEOUT_MS
+#define TCP_PPP_TIMEOUT_MS 30000
+#endif
+
+#if TCP_PPP && TCP_STREAM
+#error "TCP_PPP and TCP_STREAM both use the data channel of the module"
 #endif
 
 typedef struct TCPClient 
@@ -19,18 +66,33 @@ typedef struct TCPClient
 	TCP_SOCKET sock;
 	char buff[TCP_MAX_BUF_SIZE + 1];
 	char tmp[16];
-	uint16_t size;
-	uint16_t idx; 
+	uint16_t size; // bytes buffered
+	uint16_t idx;  // position of the first one
 	uint32_t tick;
+#if TCP_TX_BUF_SIZE > 0
+	char txBuff[TCP_TX_BUF_SIZE];
+	uint16_t txLen;
+	uint32_t txTick; // when the first buffered write was made
+#endif
+#if TCP_STREAM
+	BOOL stream;       // socket in transparent mode
+	uint16_t holdAvail; // bytes in the module buffer when the hold began
+	uint32_t holdTick;
+#endif
 } TCPClient_t;
 
 void TCPClient_init(TCPClient_t *);
 BOOL TCPClient_connect(TCPClient_t *, char *, uint16_t);
+BOOL TCPClient_open(TCPClient_t *, char *, uint16_t);
 void TCPClient_stop(TCPClient_t *);
 int TCPClient_available(TCPClient_t *);
 int TCPClient_write(TCPClient_t *, uint8_t *, int);
+int TCPClient_writev(TCPClient_t *, TCP_IOVEC *, int);
+BOOL TCPClient_push(TCPClient_t *);
 int TCPClient_read(TCPClient_t *, uint8_t *, int);
 int TCPClient_readByte(TCPClient_t *);
+int TCPClient_peek(TCPClient_t *, uint8_t **);
+void TCPClient_skip(TCPClient_t *, int);
 BOOL TCPClient_connected(TCPClient_t *);
 void TCPClient_flush(TCPClient_t *);
 